@@ -8,6 +8,12 @@
 typedef struct Syntax Syntax;
 typedef struct HighlightedLine HighlightedLine;
 typedef struct UndoStack UndoStack;
+typedef struct Journal Journal;
+typedef struct RowBlock RowBlock;
+typedef struct BufferSaveJob BufferSaveJob;
+typedef struct BufferSnapshot BufferSnapshot;
+typedef struct GitFile GitFile;
+typedef struct MatchIndex MatchIndex;
 
 /* Row in the buffer */
 typedef struct {
@@ -16,12 +22,43 @@ typedef struct {
     size_t capacity;
 } BufferRow;
 
+/* An edit seen as rows: rows [row, row + old_rows) before it are
+ * rows [row, row + new_rows) after it */
+typedef struct {
+    size_t row;
+    size_t old_rows;
+    size_t new_rows;
+} BufferDelta;
+
+/* Deltas a buffer queues between flushes; past this the newest absorbs the next */
+#define BUFFER_DELTA_QUEUE 64
+
+/* Rows are stored in blocks of up to this many rows. Blocks are reference
+ * counted so a snapshot can share them; the buffer copies a block before
+ * modifying it while a snapshot still holds it. */
+#define BUFFER_BLOCK_ROWS 512
+
 /* Buffer structure - represents text content */
 typedef struct Buffer {
+    unsigned long id;       /* Unique for the session, never reused */
     char *filename;
-    BufferRow *rows;
+    RowBlock **blocks;      /* Row storage - access rows through buffer_row() */
+    size_t num_blocks;
+    size_t blocks_capacity;
     size_t num_rows;
-    size_t capacity;
+    size_t lookup_block;    /* Block of the last row lookup, for sequential access */
+    size_t lookup_start;    /* First row index of lookup_block */
+    unsigned long version;  /* Bumped whenever the rows may have changed */
+
+    /* Rows touched since the last buffer_take_changes(): the first changed_top
+     * and the last changed_bottom rows are untouched (SIZE_MAX: nothing changed) */
+    size_t changed_top;
+    size_t changed_bottom;
+
+    /* Ring of deltas not yet taken, recorded only while a change listener is set */
+    BufferDelta *deltas;
+    size_t delta_head;
+    size_t delta_count;
     bool modified;
     int cursor_x;
     int cursor_y;
@@ -34,6 +71,9 @@ typedef struct Buffer {
     /* Undo/redo */
     UndoStack *undo_stack;
 
+    /* Crash recovery journal (swap file) */
+    Journal *journal;
+
     /* Visual selection */
     bool has_selection;
     int select_start_x;
@@ -41,8 +81,45 @@ typedef struct Buffer {
 
     /* Search */
     char *search_term;  /* Current search term for highlighting */
+    MatchIndex *search_index;  /* Every match of search_term, or NULL */
+
+    /* Background save in flight, or NULL */
+    BufferSaveJob *save_job;
+
+    /* Git gutter: diff against HEAD, attached on first display */
+    GitFile *git;
+    bool git_checked;       /* Repository lookup done (git may still be NULL) */
+
+    /* The file as last loaded or saved, watched for changes made on disk */
+    int file_watch;         /* file_watch id, 0 if not watched */
+    long long disk_size;    /* -1 if the file is gone */
+    long long disk_mtime;   /* Nanoseconds */
 } Buffer;
 
+/* Background save progress, reported on the main thread */
+typedef struct {
+    const char *filename;
+    size_t bytes_written;
+    size_t bytes_total;
+    bool done;
+    int error;              /* errno on failure, 0 on success */
+} BufferSaveProgress;
+
+/* buf is NULL when the buffer was closed while its save was still running */
+typedef void (*BufferSaveCallback)(Buffer *buf, const BufferSaveProgress *progress, void *data);
+
+/* What became of a buffer whose file changed on disk */
+typedef enum {
+    BUFFER_RELOADED,        /* Rows patched to match the file */
+    BUFFER_RELOAD_KEPT,     /* Left alone: it has unsaved edits */
+    BUFFER_RELOAD_GONE,     /* The file was deleted */
+} BufferReloadStatus;
+
+/* deltas (count of them, for BUFFER_RELOADED) are the rows replaced, top to
+ * bottom, each in rows as they are after the ones before it */
+typedef void (*BufferReloadCallback)(Buffer *buf, BufferReloadStatus status,
+                                     const BufferDelta *deltas, size_t count, void *data);
+
 /* Position for bracket matching */
 typedef struct {
     int row;
@@ -61,9 +138,106 @@ void buffer_delete_char(Buffer *buf);
 void buffer_append_row(Buffer *buf, const char *s, size_t len);
 void buffer_free_row(BufferRow *row);
 
+/* Row access. buffer_row() is for reading; use buffer_row_mut() before changing
+ * a row's text. Both return NULL when y is out of range, and the pointer stays
+ * valid until rows are inserted or deleted. */
+BufferRow *buffer_row(Buffer *buf, size_t y);
+BufferRow *buffer_row_mut(Buffer *buf, size_t y);
+
+/* Insert a row holding s before row at (at == num_rows appends); returns it */
+BufferRow *buffer_insert_row(Buffer *buf, size_t at, const char *s, size_t len);
+
+/* Remove count rows starting at row at */
+void buffer_delete_rows(Buffer *buf, size_t at, size_t count);
+
+/* Report and reset the untouched row counts at either end (see changed_top) */
+void buffer_take_changes(Buffer *buf, size_t *top, size_t *bottom);
+
+/* Change events: while a listener is set, edits to every buffer are queued as
+ * deltas and cb runs on the main loop once per batch (NULL stops recording).
+ * The listener drains each buffer with buffer_take_deltas(), oldest first. */
+typedef void (*BufferChangeCallback)(void *data);
+void buffer_set_change_listener(BufferChangeCallback cb, void *data);
+size_t buffer_take_deltas(Buffer *buf, BufferDelta *out, size_t max);
+
+/* Snapshots: a consistent, read-only view of the rows that any thread may
+ * read while the editor keeps modifying the buffer. Acquire on the main
+ * thread; retain/release and reading are safe from any thread. Acquiring
+ * shares the row blocks rather than copying text. */
+BufferSnapshot *buffer_snapshot_acquire(Buffer *buf);
+BufferSnapshot *buffer_snapshot_retain(BufferSnapshot *snap);
+void buffer_snapshot_release(BufferSnapshot *snap);
+
+size_t buffer_snapshot_num_rows(const BufferSnapshot *snap);
+const BufferRow *buffer_snapshot_row(const BufferSnapshot *snap, size_t y);
+
+/* Rows identical at the start and at the end of two snapshots of one buffer,
+ * old taken before cur. Found by comparing shared blocks, so an edit counts
+ * as touching the whole block it falls in. */
+void buffer_snapshot_compare(const BufferSnapshot *old, const BufferSnapshot *cur,
+                             size_t *top, size_t *bottom);
+
+/* Sequential reader - cheaper than buffer_snapshot_row() for scans */
+typedef struct {
+    const BufferSnapshot *snap;
+    size_t block;
+    size_t offset;
+} BufferSnapshotIter;
+
+void buffer_snapshot_iter_init(BufferSnapshotIter *it, const BufferSnapshot *snap, size_t from_row);
+const BufferRow *buffer_snapshot_iter_next(BufferSnapshotIter *it);
+
+/* Read the umask new files are saved with - once at startup, before any
+ * other thread runs */
+void buffer_save_init(void);
+
+/* Save on a worker thread from a snapshot; editing may continue meanwhile.
+ * Returns -1 if the buffer has no filename or a save is already running. */
+int buffer_save_async(Buffer *buf, BufferSaveCallback cb, void *data);
+
+/* Block until every background save has finished */
+void buffer_save_wait_all(void);
+
+/* Rebuild the highlighting cache after the row count changed */
+void buffer_resize_highlighting_cache(Buffer *buf, size_t old_rows, size_t new_rows);
+
 /* Bracket matching */
 BracketMatch buffer_find_matching_bracket(Buffer *buf);
 
+/* Insert text (may hold newlines) at (x, y) in one pass, as one undo step.
+ * y == num_rows appends a row. The cursor moves along if it was at or after
+ * (x, y). Returns -1 on a bad position or allocation failure. */
+int buffer_insert_text(Buffer *buf, int x, int y, const char *text, size_t len);
+
+/* Delete the text between two positions (either order) as one undo step */
+int buffer_delete_text(Buffer *buf, int x1, int y1, int x2, int y2);
+
+/* Text from (start_x, start_y) up to but not including (end_x, end_y), rows
+ * joined with '\n'. Out-of-range positions are clamped. Caller frees. */
+char *buffer_get_text_range(Buffer *buf, int start_x, int start_y, int end_x, int end_y, size_t *len);
+
+/* Bring the rows up to date with the file, patching only the ones that differ
+ * as one undo step; the cursor, and highlighting outside the changes, stay
+ * with the text they were on. Returns the number of regions changed, or -1 if
+ * the file cannot be read. The file is watched while a buffer is open on it,
+ * and an unmodified buffer is reloaded by itself when it changes. */
+int buffer_reload(Buffer *buf);
+
+/* Where row lands after the deltas of a reload; rows that were replaced go
+ * to the same offset in their replacement, as far as it reaches */
+size_t buffer_map_row(const BufferDelta *deltas, size_t count, size_t row);
+
+/* Told of every file change seen by a buffer (main thread) */
+void buffer_set_reload_listener(BufferReloadCallback cb, void *data);
+
+/* Replace rows [start, end) with count new rows as a single edit; start == end
+ * inserts and count == 0 deletes. Returns -1 on a bad range or allocation failure. */
+int buffer_set_lines(Buffer *buf, size_t start, size_t end,
+                     const char *const *lines, const size_t *lens, size_t count);
+
+/* Same, with the new rows as one text split at newlines */
+int buffer_set_text(Buffer *buf, size_t start, size_t end, const char *text, size_t len);
+
 /* Visual selection operations */
 char *buffer_get_selected_text(Buffer *buf, size_t *len);
 void buffer_delete_selection(Buffer *buf);
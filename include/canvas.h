@@ -0,0 +1,62 @@
+#ifndef CANVAS_H
+#define CANVAS_H
+
+#include "colors.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Cell buffer for custom windows. A plugin draws into the cells; the editor
+ * writes them out once per frame, one escape per style run, and skips cells
+ * the terminal already shows - as long as nothing else (a full screen clear)
+ * touched the screen since the last flush. */
+
+typedef struct Terminal Terminal;
+
+/* One column: a UTF-8 character (len 0 is a blank) and a style id */
+typedef struct {
+    char text[4];
+    uint8_t len;
+    uint8_t style;
+} CanvasCell;
+
+typedef struct Canvas {
+    int width;
+    int height;
+    CanvasCell *cells;          /* What the plugin drew */
+    CanvasCell *shown;          /* What the last flush left on the terminal */
+    int shown_x;
+    int shown_y;
+    unsigned long shown_clears; /* Terminal clear count at the last flush */
+    bool shown_valid;
+} Canvas;
+
+/* Styles are shared by all canvases; id 0 is the terminal default */
+#define CANVAS_MAX_STYLES 256
+
+/* Style drawn with the active theme's colors for a highlight type */
+int canvas_style_highlight(HighlightType type);
+
+/* Style from an SGR escape such as "\x1b[1;36m" */
+int canvas_style_sgr(const char *sgr);
+
+/* Both return the existing id for a style already added, -1 when full */
+
+Canvas *canvas_create(int width, int height);
+void canvas_destroy(Canvas *canvas);
+
+/* Change size; contents are blanked when it differs. Returns -1 on error. */
+int canvas_resize(Canvas *canvas, int width, int height);
+
+/* Blank the rectangle (clipped to the canvas) with ch in style */
+void canvas_fill(Canvas *canvas, int x, int y, int width, int height,
+                 const char *ch, size_t ch_len, uint8_t style);
+
+/* Write UTF-8 text from (x, y), one character per column, clipped at the
+ * right edge; control characters show as '?'. Returns columns written. */
+int canvas_put(Canvas *canvas, int x, int y, const char *text, size_t len, uint8_t style);
+
+/* Write the canvas to the terminal with its top left at (x, y) */
+void canvas_flush(Canvas *canvas, Terminal *term, int x, int y);
+
+#endif /* CANVAS_H */
@@ -0,0 +1,26 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Line diff (Myers, linear space) */
+
+/* A line to compare; hash must be diff_hash_line() of the text */
+typedef struct {
+    const char *data;
+    size_t len;
+    uint64_t hash;
+} DiffLine;
+
+uint64_t diff_hash_line(const char *data, size_t len);
+
+/* Mark which lines of a and b are not part of the longest common
+ * subsequence. a_changed/b_changed must hold na/nb entries.
+ * Very different inputs get a good but not always minimal result.
+ * Returns -1 on allocation failure. */
+int diff_lines(const DiffLine *a, size_t na, const DiffLine *b, size_t nb,
+               bool *a_changed, bool *b_changed);
+
+#endif /* DIFF_H */
@@ -0,0 +1,39 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+/* Main thread event loop: waits on terminal input and work posted by
+ * background threads, so long jobs never block the editor. */
+
+/* Callback run on the main thread */
+typedef void (*EventCallback)(void *data);
+
+/* Callback for a watched file descriptor; revents as reported by poll() */
+typedef void (*EventFdCallback)(int fd, short revents, void *data);
+
+/* Set up / tear down the loop (wake pipe and posted work queue) */
+int event_loop_init(void);
+void event_loop_shutdown(void);
+
+/* Queue a callback for the main thread - safe to call from any thread */
+int event_loop_post(EventCallback cb, void *data);
+
+/* Watch a file descriptor (POLLIN / POLLOUT) from the main loop - main thread only.
+ * Watching an fd again replaces its events and callback. */
+int event_loop_watch_fd(int fd, short events, EventFdCallback cb, void *data);
+void event_loop_unwatch_fd(int fd);
+
+/* Run cb once on the main thread after at least ms milliseconds - main thread only.
+ * Returns a timer id (> 0) for event_loop_cancel_timer, or -1 on error. */
+int event_loop_add_timer(int ms, EventCallback cb, void *data);
+void event_loop_cancel_timer(int id);
+
+/* Run everything posted so far */
+void event_loop_dispatch(void);
+
+/* Sleep until stdin is readable, a watched fd is ready, posted work arrives or a
+ * timer is due (timeout_ms < 0 waits forever). Posted, fd and timer callbacks are
+ * run before returning.
+ * Returns 1 if stdin is readable, 0 otherwise. */
+int event_loop_wait(int timeout_ms);
+
+#endif /* EVENT_LOOP_H */
@@ -0,0 +1,58 @@
+#ifndef FILE_INDEX_H
+#define FILE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Every file below a directory, for fuzzy finding by path. The paths live in
+ * one arena with a character mask each, so a query rejects most of them with
+ * a single AND before scoring the rest. The index is saved to a cache file and
+ * loaded from it on a background thread at the next start; a full scan then
+ * refreshes it, also in the background, and inotify keeps it current after
+ * that. .gitignore'd files and .git are left out, as in project search. */
+
+/* Longest query matched; the rest is ignored */
+#define FILE_QUERY_MAX 64
+
+typedef struct {
+    const char *path;           /* Relative to the root; valid until the index changes */
+    size_t len;
+    int score;                  /* Higher is better */
+    uint32_t positions[FILE_QUERY_MAX];  /* Byte offset of each query character */
+} FileMatch;
+
+typedef struct {
+    size_t files;
+    bool scanning;              /* Loading or scanning in the background */
+    bool watching;              /* Changes are followed with inotify */
+} FileIndexStatus;
+
+/* Index - opaque */
+typedef struct FileIndex FileIndex;
+
+/* Called on the main thread whenever the set of files changed */
+typedef void (*FileIndexCallback)(FileIndex *fi, void *data);
+
+/* Index the files below root, saving the index under cache_dir (created if
+ * needed; NULL keeps it in memory only). Returns NULL if root cannot be
+ * opened. Main thread only, like the rest of this API. */
+FileIndex *file_index_open(const char *root, const char *cache_dir,
+                           FileIndexCallback on_change, void *data);
+
+/* Stop background work and save the index if it changed since the last save */
+void file_index_close(FileIndex *fi);
+
+/* Scan the whole tree again */
+void file_index_rescan(FileIndex *fi);
+
+void file_index_status(const FileIndex *fi, FileIndexStatus *status);
+
+/* The best matches of query, a case-insensitive subsequence of the path,
+ * best first: at most max of them, written to out. Characters at the start
+ * of a word or following each other score higher, gaps score lower, and
+ * ties go to the shorter path. An empty query lists the shortest paths. */
+size_t file_index_query(FileIndex *fi, const char *query, size_t len,
+                        FileMatch *out, size_t max);
+
+#endif /* FILE_INDEX_H */
@@ -0,0 +1,25 @@
+#ifndef FILE_WATCH_H
+#define FILE_WATCH_H
+
+/* Changes to files on disk, from inotify through the event loop. The
+ * directory of a file is watched rather than the file itself, so a file
+ * replaced by a rename (as editors, build tools and git checkout do) is still
+ * followed, and so is one deleted and created again. A burst of events calls
+ * back once, after the file has been quiet for FILE_WATCH_SETTLE_MS. */
+
+#define FILE_WATCH_SETTLE_MS 50
+
+/* Runs on the main thread */
+typedef void (*FileWatchCallback)(void *data);
+
+/* Call cb whenever path is written, replaced or deleted. Returns an id (> 0)
+ * for file_watch_remove, or -1 if the directory of path cannot be watched. */
+int file_watch_add(const char *path, FileWatchCallback cb, void *data);
+
+/* Stop watching; a pending callback is dropped */
+void file_watch_remove(int id);
+
+/* Close inotify once every watch is removed */
+void file_watch_shutdown(void);
+
+#endif /* FILE_WATCH_H */
@@ -0,0 +1,47 @@
+#ifndef GIT_H
+#define GIT_H
+
+#include "buffer.h"
+#include <stddef.h>
+
+/* Native git support for the gutter: repositories are found with stat(),
+ * HEAD blobs come from one persistent `git cat-file --batch` per repository,
+ * and line status is an in-process diff of the live buffer against HEAD,
+ * updated incrementally as the buffer is edited. */
+
+typedef enum {
+    GIT_LINE_UNCHANGED = 0,
+    GIT_LINE_ADDED,
+    GIT_LINE_MODIFIED,
+    GIT_LINE_DELETED        /* Unchanged line with removed lines just above it */
+} GitLineStatus;
+
+/* Diff state for one file-backed buffer - opaque */
+typedef struct GitFile GitFile;
+
+/* Directory holding .git for path (file or directory), or NULL. Caller frees. */
+char *git_find_root(const char *path);
+
+/* Attach to filename's repository and fetch its HEAD version.
+ * Returns NULL if the file is not inside a work tree. */
+GitFile *git_file_open(const char *filename);
+void git_file_close(GitFile *gf);
+
+/* Fetch HEAD again (e.g. after a commit) - the next update re-diffs */
+int git_file_reload(GitFile *gf);
+
+/* Start re-diffing the buffer if it changed since the last update. Only the
+ * rows around the edits are diffed again, on a background thread; the result
+ * is published when done and a redraw is requested. Main thread only. */
+void git_file_update(GitFile *gf, Buffer *buf);
+
+/* Status of a row in the latest published diff (may trail the buffer briefly) */
+GitLineStatus git_file_line_status(GitFile *gf, size_t row);
+
+/* Repository root the file belongs to */
+const char *git_file_root(const GitFile *gf);
+
+/* Stop the cat-file helpers - once every GitFile is closed */
+void git_shutdown(void);
+
+#endif /* GIT_H */
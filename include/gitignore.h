@@ -0,0 +1,47 @@
+#ifndef GITIGNORE_H
+#define GITIGNORE_H
+
+#include <stdbool.h>
+#include <dirent.h>
+
+/* .gitignore rules, applied the way git does while walking a tree: each
+ * directory's .gitignore adds to the rules of the directories above it. */
+
+typedef struct IgnoreList IgnoreList;
+
+/* Rules of dir_fd's .gitignore on top of parent's (its directory's), or NULL
+ * if it has none. base is the directory relative to the root, "" for the root.
+ * Lists are immutable once loaded, so threads may share them. */
+IgnoreList *gitignore_load(int dir_fd, const char *base, const IgnoreList *parent);
+
+/* Whether path (relative to the root; name is its last component) is ignored
+ * under list and the lists above it */
+bool gitignore_match(const IgnoreList *list, const char *path, const char *name, bool is_dir);
+
+/* Lists are freed together once nothing matches against them any more:
+ * gitignore_keep() adds lists (a single one, or a set kept before) to *all */
+void gitignore_keep(IgnoreList **all, IgnoreList *lists);
+void gitignore_free_all(IgnoreList *all);
+
+/* One directory of a walk: its entries, under its own .gitignore and the
+ * rules above it */
+typedef struct {
+    DIR *dir;
+    const char *base;           /* Relative to the root, "" for the root */
+    IgnoreList *own;            /* Its .gitignore, or NULL - the caller keeps it */
+    const IgnoreList *ignore;   /* Rules its entries are matched against */
+    bool failed;                /* Out of memory: the listing stopped early */
+} GitignoreDir;
+
+/* Open base below root_fd and load its .gitignore on top of parent */
+bool gitignore_dir_open(GitignoreDir *gd, int root_fd, const char *base, const IgnoreList *parent);
+
+/* Path (relative to the root) of the next file or directory that is not
+ * ignored, or NULL at the end; the caller frees it. .git is skipped. */
+char *gitignore_dir_next(GitignoreDir *gd, bool *is_dir);
+void gitignore_dir_close(GitignoreDir *gd);
+
+/* Path of name in dir, both relative to the root; the caller frees it */
+char *gitignore_child_path(const char *dir, const char *name);
+
+#endif /* GITIGNORE_H */
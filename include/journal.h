@@ -0,0 +1,42 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "buffer.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+/* How often the background writer flushes and fsyncs pending records */
+#define JOURNAL_SYNC_INTERVAL_MS 1000
+
+/* Edit journal (swap file) - opaque, one per file-backed buffer */
+typedef struct Journal Journal;
+
+/* Start/stop the background writer thread shared by all journals */
+int journal_init(void);
+void journal_shutdown(void);
+
+/* Attach a journal to the file a buffer was loaded from.
+ * An existing swap file whose base matches the file on disk is kept for recovery. */
+Journal *journal_open(const char *filename);
+
+/* Detach and remove the swap file (kept if a recovery is still pending) */
+void journal_close(Journal *j);
+
+/* Record edits - only copies into memory, never touches the disk */
+void journal_record_insert(Journal *j, int x, int y, const char *text, size_t len);
+void journal_record_delete(Journal *j, int x1, int y1, int x2, int y2);
+
+/* Start a fresh journal against the file as just written by buffer_save */
+void journal_reset(Journal *j, const char *filename);
+
+/* Background saves: mark where the snapshot was taken, then on success restart
+ * the journal against the new file keeping only the edits made since the mark */
+void journal_checkpoint_begin(Journal *j);
+void journal_checkpoint_commit(Journal *j, const char *filename);
+void journal_checkpoint_abort(Journal *j);
+
+/* Recovery of edits left behind by a crashed session */
+bool journal_has_recovery(Journal *j);
+int journal_recover(Buffer *buf);
+
+#endif /* JOURNAL_H */
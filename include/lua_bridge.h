@@ -15,9 +15,15 @@ void lua_bridge_cleanup(Editor *ed);
 /* Load and execute a Lua plugin file */
 int lua_bridge_load_plugin(Editor *ed, const char *filename);
 
+/* Put plugin load times on the status line (details: editor.plugin_load_times()) */
+void lua_bridge_report_load_times(Editor *ed);
+
 /* Execute a Lua string */
 int lua_bridge_exec(Editor *ed, const char *code);
 
+/* Run a key binding's handler, given by name (e.g. "save_file") */
+int lua_bridge_call_binding(Editor *ed, const char *func_name);
+
 /* Call a Lua function */
 int lua_bridge_call(Editor *ed, const char *func_name);
 
@@ -36,7 +42,35 @@ bool lua_bridge_call_window_key_handler(Editor *ed, Window *win, int key);
 /* Trigger window events */
 void lua_bridge_trigger_window_event(Editor *ed, const char *event_name, int win_id, int prev_win_id);
 
+/* Run editor.on_save hooks after a buffer was written */
+void lua_bridge_trigger_save_event(Editor *ed, const char *filename, bool ok);
+
 /* Register theme API (defined in lua_theme_api.c) */
 void register_theme_api(lua_State *L);
 
+/* Register syntax API (defined in lua_syntax_api.c) */
+void register_syntax_api(lua_State *L);
+
+/* Register canvas API (defined in lua_canvas_api.c) */
+void register_canvas_api(lua_State *L);
+
+/* Push a canvas handle for win's render call; release it once the call returns */
+void lua_canvas_push(lua_State *L, Window *win);
+void lua_canvas_release(lua_State *L, int idx);
+
+/* Register task API (defined in lua_task.c) */
+void register_task_api(lua_State *L);
+
+/* Drop every task, before the Lua state is closed */
+void lua_task_shutdown(void);
+
+/* Register search API (defined in lua_search_api.c) */
+void register_search_api(lua_State *L);
+
+/* Register finder API (defined in lua_finder_api.c) */
+void register_finder_api(lua_State *L);
+
+/* Close the finder's file index, before the Lua state is closed */
+void lua_finder_shutdown(void);
+
 #endif /* LUA_BRIDGE_H */
@@ -0,0 +1,17 @@
+#ifndef LUA_CACHE_H
+#define LUA_CACHE_H
+
+#include <stdbool.h>
+
+/* Compiled bytecode cache for Lua plugins */
+
+typedef struct lua_State lua_State;
+
+/* Load path like luaL_loadfile(), using the bytecode cached in cache_dir when
+ * its recorded mtime and size still match the source (mapped with mmap), and
+ * refreshing the cache otherwise. cache_dir is created if needed; NULL
+ * disables caching. *from_cache tells which way the chunk was loaded.
+ * Returns a Lua status code with the chunk or an error message pushed. */
+int lua_cache_load(lua_State *L, const char *path, const char *cache_dir, bool *from_cache);
+
+#endif /* LUA_CACHE_H */
@@ -0,0 +1,66 @@
+#ifndef LUA_PROFILE_H
+#define LUA_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Cost accounting for calls from C into plugins. Every C->Lua boundary goes
+ * through lua_profile_pcall(); while profiling is off that is one branch and
+ * a plain lua_pcall. While on, each call is charged to the plugin file that
+ * defined the function: call count, total and max wall time, and bytes the
+ * Lua allocator handed out. Nested calls are included in their caller.
+ *
+ * The same boundary enforces a time budget: a count hook aborts a call that
+ * runs past it, the plugin is named on the status line, and optionally it is
+ * disabled - later calls into it fail at once. Plugin loads get a budget of
+ * their own. Time spent blocked inside C functions cannot be interrupted. */
+
+typedef struct lua_State lua_State;
+
+typedef enum {
+    LUA_PROFILE_KEYMAP = 0,     /* Key binding handlers */
+    LUA_PROFILE_GUTTER,         /* _gutter_renderer */
+    LUA_PROFILE_WINDOW_RENDER,  /* Custom window render() */
+    LUA_PROFILE_WINDOW_KEY,     /* Custom window on_key() */
+    LUA_PROFILE_WINDOW_EVENT,   /* window.on_* hooks */
+    LUA_PROFILE_HOOK,           /* editor hooks and process callbacks */
+    LUA_PROFILE_LOAD,           /* Running a plugin file */
+    LUA_PROFILE_TASK,           /* Resuming a task coroutine */
+    LUA_PROFILE_SITE_COUNT
+} LuaProfileSite;
+
+/* Default budgets in milliseconds; 0 turns a budget off */
+#define LUA_BUDGET_CALL_MS 200
+#define LUA_BUDGET_LOAD_MS 2000
+
+/* Instructions between deadline checks */
+#define LUA_BUDGET_HOOK_COUNT 10000
+
+extern bool lua_profile_enabled;
+
+/* lua_pcall(L, nargs, nresults, 0) within the site's budget, accounted to
+ * site when profiling */
+int lua_profile_pcall(lua_State *L, int nargs, int nresults, LuaProfileSite site);
+
+/* lua_resume(co, from, nargs, nresults) for one step of a task owned by
+ * plugin; each step gets the call budget and is accounted as LUA_PROFILE_TASK */
+int lua_profile_resume(lua_State *co, lua_State *from, int nargs, int *nresults,
+                       const char *plugin);
+
+/* Plugin that defined the function at idx: its path below plugins/ when it
+ * has one, or Lua's short source ("[C]", [string "..."]) otherwise */
+void lua_profile_function_plugin(lua_State *L, int idx, char *out, size_t size);
+
+/* Start or stop profiling; collected data is kept until reset */
+void lua_profile_enable(lua_State *L, bool enable);
+void lua_profile_reset(void);
+
+/* Stop profiling and forget all data, budgets and disabled plugins */
+void lua_profile_cleanup(lua_State *L);
+
+/* editor.profile(), editor.profile_report(), editor.profile_reset(),
+ * editor.lua_budget(), editor.enable_plugin() and the built-in "profiler"
+ * custom window. Call after the editor table exists. */
+void register_profile_api(lua_State *L);
+
+#endif /* LUA_PROFILE_H */
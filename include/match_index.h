@@ -0,0 +1,43 @@
+#ifndef MATCH_INDEX_H
+#define MATCH_INDEX_H
+
+#include "buffer.h"
+#include "search.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Every match of a search in a buffer, for highlighting and "match k of N".
+ * The first index scans the whole buffer on a background thread; after edits
+ * only the rows around them are searched again and the other matches are
+ * carried over. Matches are non-overlapping, never empty, and sorted. */
+
+typedef struct {
+    size_t row;
+    uint32_t col;
+    uint32_t len;
+} IndexedMatch;
+
+/* Index of one buffer - opaque */
+typedef struct MatchIndex MatchIndex;
+
+/* Index matches of pat or re (exactly one of them; the index takes it over) */
+MatchIndex *match_index_create(SearchPattern *pat, Regexp *re);
+
+/* Returns at once; an index still being built is stopped and freed by its
+ * own thread */
+void match_index_destroy(MatchIndex *mi);
+
+/* Start re-indexing the buffer if it changed since the last update. The
+ * result is published when done and a redraw is requested. Main thread only. */
+void match_index_update(MatchIndex *mi, Buffer *buf);
+
+/* The latest published index (may trail the buffer briefly): its matches and
+ * their count, read together. They stay valid until the next
+ * match_index_update(), so a frame loads the view once and uses only that. */
+const IndexedMatch *match_index_view(const MatchIndex *mi, size_t *count);
+
+/* Position in a view of the first match starting at or after (row, col) -
+ * count if none */
+size_t match_index_find(const IndexedMatch *matches, size_t count, size_t row, size_t col);
+
+#endif /* MATCH_INDEX_H */
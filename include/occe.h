@@ -31,6 +31,7 @@ struct Editor {
     int next_tab_id;           /* For unique tab IDs */
 
     bool running;
+    bool screen_stale;         /* Clear the whole screen on the next refresh */
     void *lua_state;
 
     /* Status message */
@@ -42,6 +43,7 @@ struct Editor {
 
     /* Display options */
     bool show_line_numbers;
+    bool git_gutter;     /* Mark lines changed against git HEAD */
 
     /* Tab settings */
     int tab_width;       /* Number of spaces per tab */
@@ -62,4 +64,10 @@ int editor_run(Editor *ed);
 void editor_quit(Editor *ed);
 void editor_set_status(Editor *ed, const char *msg);
 
+/* Save on a background thread, reporting progress on the status line */
+int editor_save_async(Editor *ed, Buffer *buf);
+
+/* Tell the user when a freshly opened buffer has crash-recovery data */
+void editor_offer_recovery(Editor *ed, Buffer *buf);
+
 #endif /* OCCE_H */
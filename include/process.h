@@ -0,0 +1,44 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Child processes run without blocking the editor: their pipes are non-blocking
+ * and watched by the main event loop, and all callbacks run on the main thread. */
+
+/* Read at most this much from one pipe per wakeup, handed over as a single chunk */
+#define PROCESS_READ_CHUNK (64 * 1024)
+
+typedef struct {
+    /* Output as it arrives, in batched chunks (not split on lines) */
+    void (*on_stdout)(pid_t pid, const char *chunk, size_t len, void *data);
+    void (*on_stderr)(pid_t pid, const char *chunk, size_t len, void *data);
+    /* Called once, after all output has been delivered.
+     * code is the exit status, 128 + signal number if the child was killed,
+     * or -1 if the editor is shutting down and the child was abandoned. */
+    void (*on_exit)(pid_t pid, int code, void *data);
+    void *data;
+} ProcessCallbacks;
+
+/* Install the SIGCHLD handler and start watching for exited children */
+int process_init(void);
+
+/* Terminate all running children, reporting each to on_exit with code -1 */
+void process_shutdown(void);
+
+/* Start argv[0] (searched in PATH) with piped stdout/stderr.
+ * input (may be NULL) is written to the child's stdin, which is then closed.
+ * Returns the child's pid, or -1 with errno set. */
+pid_t process_spawn(char *const argv[], const char *input, size_t input_len,
+                    const ProcessCallbacks *callbacks);
+
+/* Start a long-lived helper with blocking pipes for request/response use
+ * (e.g. git cat-file --batch); its stderr goes to /dev/null. The caller owns
+ * both fds and must waitpid() the child once it has closed them. */
+pid_t process_spawn_pipe(char *const argv[], int *stdin_fd, int *stdout_fd);
+
+/* Send a signal to a child started by process_spawn */
+int process_kill(pid_t pid, int sig);
+
+#endif /* PROCESS_H */
@@ -0,0 +1,63 @@
+#ifndef PROJECT_SEARCH_H
+#define PROJECT_SEARCH_H
+
+#include "search.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Search every file below a directory, like grep -r, without blocking the
+ * editor. A pool of worker threads walks the tree and searches the files,
+ * mapping the large ones into memory; each worker queues the directories and
+ * files it finds and idle workers steal from the others' queues. .gitignore files are honoured
+ * and .git is skipped; a file with a NUL byte in its first block is taken as
+ * binary and skipped. Matches reach the main thread in batches as they are
+ * found. */
+
+/* One match. The strings are only valid during the callback. */
+typedef struct {
+    const char *path;   /* Relative to the search root */
+    size_t line;        /* 0-based */
+    size_t col;         /* Byte offset in the line */
+    size_t len;
+    const char *text;   /* The line, without its newline */
+    size_t text_len;
+} ProjectMatch;
+
+typedef struct {
+    size_t files;       /* Files searched */
+    size_t binary;      /* Files skipped as binary */
+    size_t matches;
+    bool truncated;     /* Stopped at max_results */
+    bool cancelled;
+} ProjectSearchStats;
+
+/* Both run on the main thread. Matches of one file arrive in order, files in
+ * no particular order. on_done is always called once, last - also for a
+ * cancelled search, with stats->cancelled set and no more matches. */
+typedef struct {
+    void (*on_matches)(const ProjectMatch *matches, size_t count, void *data);
+    void (*on_done)(const ProjectSearchStats *stats, void *data);
+    void *data;
+} ProjectSearchCallbacks;
+
+typedef struct {
+    int flags;          /* SEARCH_IGNORE_CASE, SEARCH_WHOLE_WORD */
+    bool regex;         /* query is a regular expression (regexp.h) */
+    size_t max_results; /* Stop after this many matches; 0 for no limit */
+    int threads;        /* 0 for one per CPU */
+} ProjectSearchOptions;
+
+/* Start searching the files below root. Returns an id (> 0), or -1 if the
+ * query is invalid or root cannot be opened (err says why). Main thread only. */
+int project_search_start(const char *root, const char *query, size_t len,
+                         const ProjectSearchOptions *opts,
+                         const ProjectSearchCallbacks *callbacks,
+                         char *err, size_t err_size);
+
+/* Stop a search early; on_done follows once its workers have stopped */
+void project_search_cancel(int id);
+
+/* Cancel every search and wait for its workers, before shutting down */
+void project_search_shutdown(void);
+
+#endif /* PROJECT_SEARCH_H */
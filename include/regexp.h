@@ -0,0 +1,53 @@
+#ifndef REGEXP_H
+#define REGEXP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Regular expressions compiled to an NFA and matched in time linear in the
+ * text - no backtracking, so no pattern can make a search blow up. A lazily
+ * built DFA rejects text without a match at one table lookup per byte; the NFA
+ * only runs where there is a match, to find its extent and capture groups.
+ *
+ * Syntax: literals, ., [...] and [^...], \d \w \s \D \W \S, ^ $ \b \B, groups
+ * (...) and (?:...), alternation |, and * + ? {n} {n,} {n,m}, each with a lazy
+ * ? form. Matching is leftmost-first, as in Perl, with RE2's captures for a
+ * repeat whose body matched empty. ^ and $ are the start and end of the text
+ * (a buffer row). . and classes match whole UTF-8 characters; case folding
+ * and the word characters of \w and \b follow ASCII rules, with every
+ * non-ASCII character counted as a word character. */
+
+#define REGEXP_IGNORE_CASE 0x1  /* Letters match in either case */
+
+/* Capture groups \1 to \9; \0 is the whole match */
+#define REGEXP_MAX_GROUPS 9
+
+/* A compiled expression. Matching updates its DFA cache and scratch space,
+ * so one Regexp must not be used by two threads at once. */
+typedef struct Regexp Regexp;
+
+typedef struct {
+    ptrdiff_t start[REGEXP_MAX_GROUPS + 1];  /* -1: the group took no part */
+    ptrdiff_t end[REGEXP_MAX_GROUPS + 1];
+} RegexpMatch;
+
+/* NULL on a syntax error or allocation failure; err (if given) says which */
+Regexp *regexp_compile(const char *pattern, int flags, char *err, size_t err_size);
+void regexp_free(Regexp *re);
+
+/* Number of capture groups, not counting the whole match */
+int regexp_groups(const Regexp *re);
+
+/* Leftmost match in text[0, len) starting at or after from. m may be NULL
+ * when only the answer is needed. */
+bool regexp_search(Regexp *re, const char *text, size_t len, size_t from, RegexpMatch *m);
+
+/* Match starting exactly at pos */
+bool regexp_match_at(Regexp *re, const char *text, size_t len, size_t pos, RegexpMatch *m);
+
+/* Replacement text for a match: \0 to \9 insert groups, \n and \t a newline
+ * and a tab, and any other escaped character (such as \\) is itself. Caller
+ * frees; NULL on allocation failure. */
+char *regexp_expand(const char *tmpl, const char *text, const RegexpMatch *m, size_t *out_len);
+
+#endif /* REGEXP_H */
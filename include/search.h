@@ -2,6 +2,8 @@
 #define SEARCH_H
 
 #include "buffer.h"
+#include "regexp.h"
+#include <stddef.h>
 
 /* Search result */
 typedef struct {
@@ -10,10 +12,45 @@ typedef struct {
     size_t match_len;
 } SearchResult;
 
+/* Search modes, combined as flags. Both follow ASCII rules: other bytes
+ * (UTF-8 sequences) only match themselves and count as word characters. */
+#define SEARCH_IGNORE_CASE 0x1  /* Letters match in either case */
+#define SEARCH_WHOLE_WORD  0x2  /* No word character right before or after a match */
+
+/* A needle prepared once for any number of searches */
+typedef struct SearchPattern SearchPattern;
+
+/* NULL for an empty needle or on allocation failure */
+SearchPattern *search_pattern_create(const char *needle, size_t len, int flags);
+void search_pattern_destroy(SearchPattern *pat);
+size_t search_pattern_length(const SearchPattern *pat);
+
+/* Offset of the first match in text[0, len) that starts at or after from, or -1 */
+ptrdiff_t search_find(const SearchPattern *pat, const char *text, size_t len, size_t from);
+
+/* Offset of the last match in text[0, len) that starts before before, or -1 */
+ptrdiff_t search_rfind(const SearchPattern *pat, const char *text, size_t len, size_t before);
+
 /* Search for text in buffer */
 SearchResult *buffer_search(Buffer *buf, const char *query, int start_row, int start_col, bool forward);
 
-/* Search and replace */
+/* Same, with a prepared pattern: the next match after (start_row, start_col),
+ * or the previous one before it */
+SearchResult *buffer_search_pattern(Buffer *buf, const SearchPattern *pat,
+                                    int start_row, int start_col, bool forward);
+
+/* Same, with a regular expression. A backward search finds the match that
+ * starts closest before the cursor. */
+SearchResult *buffer_search_regexp(Buffer *buf, Regexp *re, int start_row, int start_col, bool forward);
+
+/* Replace the first match in the buffer, or all of them, in one pass. The
+ * changed rows are set as a single edit and one undo step; newlines in the
+ * replacement split rows. Each returns the number of replacements. */
 int buffer_replace(Buffer *buf, const char *search, const char *replace, bool all);
+int buffer_replace_pattern(Buffer *buf, const SearchPattern *pat,
+                           const char *replace, size_t len, bool all);
+
+/* Same, with a regular expression; tmpl is expanded by regexp_expand() */
+int buffer_replace_regexp(Buffer *buf, Regexp *re, const char *tmpl, bool all);
 
 #endif /* SEARCH_H */
@@ -12,7 +12,7 @@
 /* Syntax pattern types */
 typedef enum {
     PATTERN_KEYWORD,        /* Exact keyword match */
-    PATTERN_MATCH,          /* Lua pattern match */
+    PATTERN_MATCH,          /* Regular expression (see regexp.h) */
     PATTERN_MULTILINE_START, /* Start of multiline comment */
     PATTERN_MULTILINE_END    /* End of multiline comment */
 } PatternType;
@@ -23,6 +23,7 @@ typedef struct {
     char *pattern;          /* Pattern or keyword */
     HighlightType hl_type;  /* Color to use */
     int priority;           /* Higher priority = checked first */
+    struct Regexp *regex;   /* Compiled pattern of a PATTERN_MATCH rule */
 } SyntaxRule;
 
 /* Syntax definition for a language */
@@ -34,11 +35,20 @@ typedef struct Syntax {
     SyntaxRule *rules;      /* Array of syntax rules */
     size_t num_rules;
     size_t rules_capacity;
+    size_t num_patterns;    /* PATTERN_MATCH rules among them */
 
     char *singleline_comment; /* Single-line comment start (e.g., double slash) */
     char *multiline_start;     /* Multi-line comment start */
     char *multiline_end;       /* Multi-line comment end */
 
+    /* Declared syntaxes know only their name and extensions until a file of
+     * theirs is opened; then the plugin in source is run to add the rules */
+    char *source;
+    bool loaded;
+
+    /* Keyword table in the mapped syntax bundle, if it has this language */
+    const struct SyntaxBundleLang *bundle;
+
     struct Syntax *next;    /* Linked list of syntaxes */
 } Syntax;
 
@@ -63,9 +73,17 @@ extern Syntax *syntax_list;
 /* Initialize syntax system */
 void syntax_init(void);
 
-/* Register a new syntax */
+/* Register a syntax, or return the one already registered or declared
+ * under name (a declared one counts as loaded from then on) */
 Syntax *syntax_register(const char *name);
 
+/* Declare a syntax whose rules live in the plugin source, loaded on first use */
+Syntax *syntax_declare(const char *name, const char *source);
+
+/* Runs a declared syntax's plugin; returns false if it could not be loaded */
+typedef bool (*SyntaxLoader)(Syntax *syn, void *data);
+void syntax_set_loader(SyntaxLoader loader, void *data);
+
 /* Add file extension to syntax */
 void syntax_add_extension(Syntax *syn, const char *ext);
 
@@ -75,10 +93,16 @@ void syntax_add_rule(Syntax *syn, PatternType type, const char *pattern, Highlig
 /* Add keyword */
 void syntax_add_keyword(Syntax *syn, const char *keyword, HighlightType hl_type);
 
+/* Add a regular expression rule. Patterns are tried in the order added at
+ * each position not already inside a comment; the first non-empty match is
+ * highlighted. Returns -1 with err set if the pattern does not compile. */
+int syntax_add_pattern(Syntax *syn, const char *pattern, HighlightType hl_type,
+                       char *err, size_t err_size);
+
 /* Set comment markers */
 void syntax_set_comments(Syntax *syn, const char *single, const char *multi_start, const char *multi_end);
 
-/* Find syntax by filename */
+/* Find syntax by filename, loading its rules if it was only declared */
 Syntax *syntax_find_by_filename(const char *filename);
 
 /* Highlight a line of text */
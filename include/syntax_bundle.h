@@ -0,0 +1,64 @@
+#ifndef SYNTAX_BUNDLE_H
+#define SYNTAX_BUNDLE_H
+
+#include "syntax.h"
+#include <stdint.h>
+
+/* Precompiled syntax definitions. occe-syntaxc runs the plugins/syntax files and
+ * writes every language into one file: name, extensions, comment markers, an
+ * open-addressing keyword hash table and the regular expression rules, which
+ * are compiled once at load. The editor maps the file at startup
+ * and highlights straight from it - no Lua, no parsing, no per-keyword copies.
+ * All offsets are from the start of the file; 0 means "none". */
+
+#define SYNTAX_BUNDLE_MAGIC "OCCESB2"
+#define SYNTAX_BUNDLE_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t byte_order;        /* Written natively - rejects foreign bundles */
+    uint32_t size;              /* Whole file */
+    uint32_t num_langs;
+    uint32_t langs;             /* SyntaxBundleLang[num_langs] */
+} SyntaxBundleHeader;
+
+typedef struct SyntaxBundleLang {
+    uint32_t name;
+    uint32_t extensions;        /* uint32_t[num_extensions] string offsets */
+    uint32_t num_extensions;
+    uint32_t singleline_comment;
+    uint32_t multiline_start;
+    uint32_t multiline_end;
+    uint32_t keywords;          /* SyntaxBundleKeyword[keyword_mask + 1] */
+    uint32_t keyword_mask;
+    uint32_t patterns;          /* SyntaxBundlePattern[num_patterns], in rule order */
+    uint32_t num_patterns;
+} SyntaxBundleLang;
+
+/* Hash table slot; word == 0 marks an empty slot */
+typedef struct {
+    uint32_t hash;
+    uint32_t word;
+    uint32_t len;
+    uint32_t hl_type;
+} SyntaxBundleKeyword;
+
+typedef struct {
+    uint32_t pattern;
+    uint32_t hl_type;
+} SyntaxBundlePattern;
+
+/* Write every loaded syntax to path. Returns 0 or -1. */
+int syntax_bundle_write(const char *path);
+
+/* Map path and register its languages. A language whose plugin
+ * (syntax/<name>.lua in the first of plugin_dirs that has one) was modified
+ * after the bundle was written is left out, for the plugin to be loaded
+ * instead. Returns the number of languages registered, or -1 if the file is
+ * missing or not a valid bundle. */
+int syntax_bundle_load(const char *path, const char *const *plugin_dirs, size_t num_dirs);
+
+/* Highlight type of word in syn's bundled keyword table, or -1 */
+int syntax_bundle_lookup(const Syntax *syn, const char *word, size_t len);
+
+#endif /* SYNTAX_BUNDLE_H */
@@ -13,6 +13,7 @@ typedef struct Terminal {
     char *screen_buffer;
     size_t buffer_size;
     size_t buffer_used;
+    unsigned long clears;   /* Full screen clears so far (see terminal_clear_screen) */
 } Terminal;
 
 /* Key codes */
@@ -73,6 +74,8 @@ bool terminal_read_mouse_event(MouseEvent *event);
 
 /* Screen buffer functions */
 void terminal_clear(Terminal *term);
+void terminal_clear_screen(Terminal *term);  /* Erase the whole screen */
+void terminal_erase_chars(Terminal *term, int count);  /* Blank count cells from the cursor */
 void terminal_write(Terminal *term, const char *data, size_t len);
 void terminal_write_str(Terminal *term, const char *str);
 void terminal_flush(Terminal *term);
@@ -10,6 +10,9 @@ typedef enum {
     UNDO_DELETE_CHAR,
     UNDO_INSERT_LINE,
     UNDO_DELETE_LINE,
+    UNDO_INSERT_TEXT,
+    UNDO_DELETE_TEXT,
+    UNDO_REPLACE_LINES,
     UNDO_GROUP_BEGIN,
     UNDO_GROUP_END
 } UndoActionType;
@@ -38,6 +41,20 @@ typedef struct UndoAction {
             char *line_data;
             size_t line_len;
         } delete_line;
+
+        /* Span of text (may hold newlines) starting at cursor_x/cursor_y */
+        struct {
+            char *text;
+            size_t len;
+        } text;
+
+        /* Rows from cursor_y, joined by newlines, before and after the edit */
+        struct {
+            char *old_text;
+            size_t old_len;
+            char *new_text;
+            size_t new_len;
+        } lines;
     } data;
 
     struct UndoAction *next;
@@ -61,6 +78,10 @@ void undo_push_insert_char(UndoStack *stack, int x, int y, int c);
 void undo_push_delete_char(UndoStack *stack, int x, int y, int c);
 void undo_push_insert_line(UndoStack *stack, int x, int y, const char *line, size_t len);
 void undo_push_delete_line(UndoStack *stack, int x, int y, const char *line, size_t len);
+void undo_push_insert_text(UndoStack *stack, int x, int y, const char *text, size_t len);
+void undo_push_delete_text(UndoStack *stack, int x, int y, const char *text, size_t len);
+void undo_push_replace_lines(UndoStack *stack, int y, const char *old_text, size_t old_len,
+                             const char *new_text, size_t new_len);
 
 /* Undo/redo operations */
 int undo_apply(Buffer *buf, UndoStack *stack);
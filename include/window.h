@@ -8,6 +8,7 @@
 /* Forward declarations */
 typedef struct Terminal Terminal;
 typedef struct Editor Editor;
+typedef struct Canvas Canvas;
 
 /* Window types */
 typedef enum {
@@ -29,13 +30,22 @@ typedef struct Window {
     int width, height;  /* Size */
     int id;             /* Unique window ID */
 
-    /* For leaf windows */
+    /* For leaf windows; the field of the other content type stays NULL, so
+     * code that only checks content.buffer skips custom windows */
     ContentType content_type;
-    union {
+    struct {
         Buffer *buffer;         /* For CONTENT_BUFFER */
         void *custom_data;      /* For CONTENT_CUSTOM (opaque Lua data) */
     } content;
     char *renderer_name;        /* Lua function name for custom rendering */
+    Canvas *canvas;             /* Cells a custom renderer drew, once it uses them */
+
+    /* What the canvas was last drawn for; the renderer is only called again
+     * once this goes stale (see lua_bridge_call_window_renderer) */
+    bool render_valid;          /* Cleared by window_invalidate */
+    bool render_focused;
+    unsigned long render_buffers;  /* Buffer state, for renderers that depend on it */
+    int render_timer;           /* Pending redraw timer id, or 0 */
     int row_offset;             /* Scroll offset */
     int col_offset;
 
@@ -70,6 +80,9 @@ void window_render(Window *win, Terminal *term, Editor *ed, bool show_line_numbe
 Window *window_find_by_id(Window *root, int id);
 void window_set_focused(Window *win, bool focused);
 
+/* Have a custom window's renderer called again on the next frame */
+void window_invalidate(Window *win);
+
 /* Window navigation */
 Window *window_find_leaf(Window *win, Window *target);
 Window *window_get_next_leaf(Window *root, Window *current);
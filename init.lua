@@ -34,6 +34,8 @@ loader.load_plugins({
 -- Load feature plugins (optional functionality)
 loader.load_plugins({
     "features/search.lua",
+    "features/project_search.lua",
+    "features/fuzzy_finder.lua",
     "features/word_navigation.lua",
     "features/shift_selection.lua",
     "features/git.lua",
@@ -9,7 +9,7 @@ print("OCCE Core Plugin Loaded")
 -- ============================================================================
 
 -- File operations
-editor.bind_key(editor.KEY.CTRL_S, editor.KMOD.NONE, "editor.save")
+editor.bind_key(editor.KEY.CTRL_S, editor.KMOD.NONE, "editor.save_async")
 editor.bind_key(editor.KEY.CTRL_Q, editor.KMOD.NONE, "editor.quit")
 
 -- Undo/Redo
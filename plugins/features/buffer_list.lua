@@ -1,61 +1,46 @@
 -- Buffer List Custom Window Plugin
--- Demonstrates custom window rendering
+-- Demonstrates custom window rendering on a canvas
 -- Shows list of open buffers with navigation
 
+-- Canvas styles, created once and shared by every frame
+local STYLE_TITLE = canvas.style({fg = 6, bold = true})   -- Bold cyan
+local STYLE_HINT = canvas.style({fg = 8})                 -- Gray
+local STYLE_SELECTED = canvas.style({reverse = true})
+
 -- Register the buffer list renderer
 window.register_renderer("buffer_list", {
-    -- Render function: called every frame
-    render = function(data, x, y, width, height)
-        -- Draw title
-        terminal.move(y, x)
-        terminal.set_color("\x1b[1;36m")  -- Bold cyan
-        terminal.write("=== Buffer List ===")
-        terminal.reset_color()
-        terminal.clear_line()
-
-        -- Get buffer count
-        local buf_count = buffer.get_line_count()
-
-        -- Draw instructions
-        terminal.move(y + 1, x)
-        terminal.set_color("\x1b[90m")  -- Gray
-        terminal.write("Use j/k to navigate, Enter to select, q to close")
-        terminal.reset_color()
-        terminal.clear_line()
-
-        -- Draw separator
-        terminal.move(y + 2, x)
-        for i = 1, width do
-            terminal.write("-")
-        end
-
-        -- Draw buffer entries (placeholder data)
+    -- Render function: the whole window is drawn into the canvas with one
+    -- call, and the editor writes the cells out itself. It is only called
+    -- again once something changed - here, a handled key or a focus change.
+    render = function(data, x, y, width, height, canvas)
         local entries = data.entries or {"[Buffer 1]", "[Buffer 2]", "[Buffer 3]"}
         local selected = data.selected or 1
 
+        local lines = {
+            {{"=== Buffer List ===", STYLE_TITLE}},
+            {{"Use j/k to navigate, Enter to select, q to close", STYLE_HINT}},
+            string.rep("-", width),
+        }
+
         for i, entry in ipairs(entries) do
-            if y + 3 + i - 1 >= y + height - 1 then
+            if #lines >= height - 1 then
                 break  -- Don't overflow window
             end
 
-            terminal.move(y + 3 + i - 1, x)
-
             -- Highlight selected entry
             if i == selected then
-                terminal.set_color("\x1b[7m")  -- Reverse video
-                terminal.write("> " .. entry)
-                terminal.reset_color()
+                table.insert(lines, {{"> " .. entry, STYLE_SELECTED}})
             else
-                terminal.write("  " .. entry)
+                table.insert(lines, "  " .. entry)
             end
-            terminal.clear_line()
         end
 
         -- Clear remaining lines
-        for i = #entries + 4, height - 1 do
-            terminal.move(y + i, x)
-            terminal.clear_line()
+        while #lines < height do
+            table.insert(lines, "")
         end
+
+        canvas:blit_lines(lines)
     end,
 
     -- Key handler: called when key is pressed in this window
@@ -0,0 +1,130 @@
+-- Fuzzy Finder Plugin
+-- Opens files by typing part of their path: the files below a directory are
+-- indexed in the background (finder.open) and ranked on every key
+
+local STYLE_PROMPT = canvas.style({fg = 6, bold = true})  -- Bold cyan
+local STYLE_HINT = canvas.style({fg = 8})                 -- Gray
+local STYLE_MATCH = canvas.style({fg = 3, bold = true})   -- Bold yellow
+local STYLE_SELECTED = canvas.style({reverse = true})
+
+local HEADER_LINES = 3
+
+-- One result as styled spans, with the matched characters highlighted
+local function result_line(r, selected)
+    if selected then
+        return {{r.path, STYLE_SELECTED}}
+    end
+
+    local spans = {}
+    local matched = {}
+    for _, pos in ipairs(r.positions) do
+        matched[pos + 1] = true
+    end
+    local from = 1
+    for i = 1, #r.path + 1 do
+        -- Close a run where matched and unmatched characters meet
+        if i > #r.path or (matched[i] or false) ~= (matched[from] or false) then
+            table.insert(spans, {r.path:sub(from, i - 1), matched[from] and STYLE_MATCH or nil})
+            from = i
+        end
+    end
+    return spans
+end
+
+local function status_text(data)
+    local s = finder.status()
+    if not s then
+        return ""
+    end
+    local text = #data.results .. " of " .. s.files .. " files"
+    if s.scanning then
+        text = text .. " (indexing...)"
+    end
+    return text
+end
+
+local function update(data)
+    data.results = finder.query(data.query, data.limit)
+    data.selected = math.min(math.max(data.selected, 1), math.max(#data.results, 1))
+end
+
+window.register_renderer("fuzzy_finder", {
+    render = function(data, x, y, width, height, canvas)
+        data.limit = math.max(height - HEADER_LINES, 1)
+        local lines = {
+            {{"> " .. data.query, STYLE_PROMPT}},
+            {{status_text(data) .. "  -  arrows to move, Enter to open, Esc to close", STYLE_HINT}},
+            string.rep("-", width),
+        }
+
+        for i = 1, math.min(data.limit, #data.results) do
+            table.insert(lines, result_line(data.results[i], i == data.selected))
+        end
+
+        while #lines < height do
+            table.insert(lines, "")
+        end
+
+        canvas:blit_lines(lines)
+    end,
+
+    on_key = function(data, key)
+        if key == editor.KEY.ARROW_DOWN or key == 14 then  -- Ctrl-N
+            data.selected = math.min(data.selected + 1, math.max(#data.results, 1))
+
+        elseif key == editor.KEY.ARROW_UP or key == 16 then  -- Ctrl-P
+            data.selected = math.max(data.selected - 1, 1)
+
+        elseif key == 27 then  -- Esc
+            finder.open(data.root)  -- Drops on_update
+            editor.tabclose()
+
+        elseif key == 10 or key == 13 then  -- Enter
+            local r = data.results[data.selected]
+            finder.open(data.root)
+            editor.tabclose()
+            if r then
+                local path = r.path
+                if data.root ~= "." then
+                    path = data.root .. "/" .. path
+                end
+                editor.tabnew(path)
+            end
+
+        elseif key == 127 or key == 8 then  -- Backspace
+            data.query = data.query:sub(1, -2)
+            update(data)
+
+        elseif key >= 32 and key <= 126 then
+            data.query = data.query .. string.char(key)
+            data.selected = 1
+            update(data)
+
+        else
+            return false
+        end
+        return true
+    end,
+})
+
+-- Pick a file below root (default: the current directory) to open
+function fuzzy_finder(root)
+    root = root or "."
+    local data = {root = root, query = "", results = {}, selected = 1, limit = 20}
+
+    local ok, err = finder.open(root, {
+        on_update = function()
+            update(data)
+            window.invalidate(data)
+        end,
+    })
+    if not ok then
+        editor.message("Finder failed: " .. err)
+        return
+    end
+    update(data)
+
+    -- A tab of its own, so Esc returns to the buffers
+    editor.tabnew()
+    window.create_custom("fuzzy_finder", data)
+end
@@ -0,0 +1,135 @@
+-- Project Search Plugin
+-- Searches every file below a directory in the background (search.project)
+-- and lists the matches in a custom window as they arrive
+
+local STYLE_TITLE = canvas.style({fg = 6, bold = true})   -- Bold cyan
+local STYLE_HINT = canvas.style({fg = 8})                 -- Gray
+local STYLE_PATH = canvas.style({fg = 5})                 -- Magenta
+local STYLE_MATCH = canvas.style({fg = 3, bold = true})   -- Bold yellow
+local STYLE_SELECTED = canvas.style({reverse = true})
+
+local HEADER_LINES = 3
+
+-- One result as styled spans: path:line: text, with the match highlighted
+local function result_line(r, selected)
+    local prefix = r.path .. ":" .. (r.line + 1) .. ": "
+    local text = r.text:gsub("\t", " ")  -- Byte for byte, so col still fits
+    if selected then
+        return {{prefix .. text, STYLE_SELECTED}}
+    end
+    return {
+        {prefix, STYLE_PATH},
+        {text:sub(1, r.col), nil},
+        {text:sub(r.col + 1, r.col + r.len), STYLE_MATCH},
+        {text:sub(r.col + r.len + 1), nil},
+    }
+end
+
+local function status_text(data)
+    if not data.stats then
+        return "searching... " .. #data.results .. " matches"
+    end
+    local s = data.stats
+    local text = s.matches .. " matches in " .. s.files .. " files"
+    if s.truncated then
+        text = text .. " (stopped at the limit)"
+    end
+    return text
+end
+
+window.register_renderer("project_search", {
+    render = function(data, x, y, width, height, canvas)
+        local lines = {
+            {{"=== Search: " .. data.query .. " ===", STYLE_TITLE}},
+            {{status_text(data) .. "  -  j/k to move, Enter to open, q to close", STYLE_HINT}},
+            string.rep("-", width),
+        }
+
+        -- Keep the selection on screen
+        local rows = math.max(height - HEADER_LINES, 1)
+        if data.selected <= data.top then
+            data.top = data.selected - 1
+        elseif data.selected > data.top + rows then
+            data.top = data.selected - rows
+        end
+
+        for i = data.top + 1, math.min(data.top + rows, #data.results) do
+            table.insert(lines, result_line(data.results[i], i == data.selected))
+        end
+
+        while #lines < height do
+            table.insert(lines, "")
+        end
+
+        canvas:blit_lines(lines)
+    end,
+
+    on_key = function(data, key)
+        local char = key < 256 and string.char(key) or ""
+
+        if char == 'j' or key == editor.KEY.ARROW_DOWN then
+            data.selected = math.min(data.selected + 1, #data.results)
+            if data.selected < 1 then data.selected = 1 end
+            return true
+
+        elseif char == 'k' or key == editor.KEY.ARROW_UP then
+            data.selected = math.max(data.selected - 1, 1)
+            return true
+
+        elseif char == 'q' then
+            if not data.stats then
+                search.cancel(data.id)
+            end
+            editor.tabclose()
+            return true
+
+        elseif key == 10 or key == 13 then  -- Enter
+            local r = data.results[data.selected]
+            if r then
+                local path = r.path
+                if data.root ~= "." then
+                    path = data.root .. "/" .. path
+                end
+                editor.tabnew(path)
+                buffer.set_cursor(r.col, r.line)
+            end
+            return true
+        end
+
+        return false
+    end,
+})
+
+-- Search the files below root (default: the current directory) for query.
+-- opts as for search.project: regex, ignore_case, whole_word, max_results
+function project_search(query, root, opts)
+    root = root or "."
+    local data = {query = query, root = root, results = {}, selected = 1, top = 0}
+
+    local search_opts = {
+        on_results = function(results)
+            for _, r in ipairs(results) do
+                table.insert(data.results, r)
+            end
+            window.invalidate(data)
+        end,
+        on_done = function(stats)
+            data.stats = stats
+            window.invalidate(data)
+        end,
+    }
+    for _, k in ipairs({"regex", "ignore_case", "whole_word", "max_results"}) do
+        search_opts[k] = opts and opts[k]
+    end
+
+    local id, err = search.project(query, root, search_opts)
+    if not id then
+        editor.message("Search failed: " .. err)
+        return
+    end
+    data.id = id
+
+    -- A tab of its own, so q returns to the buffers
+    editor.tabnew()
+    window.create_custom("project_search", data)
+end
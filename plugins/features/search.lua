@@ -17,6 +17,7 @@ function search_for(text)
         return
     end
 
+    buffer.set_search(text)
     local row, col = buffer.search(text, true)
     if row then
         buffer.set_cursor(col, row)
@@ -33,6 +34,7 @@ function search_back(text)
         return
     end
 
+    buffer.set_search(text)
     local row, col = buffer.search(text, false)
     if row then
         buffer.set_cursor(col, row)
@@ -42,6 +44,11 @@ function search_back(text)
     end
 end
 
+-- Stop highlighting the last search
+function search_clear()
+    buffer.set_search(nil)
+end
+
 -- Replace text
 function replace_text(search, replace_with)
     if not search or search == "" then
@@ -80,6 +87,7 @@ print("Search Plugin: Loaded")
 print("Available functions:")
 print("  - search_for(\"text\")        - Search forward")
 print("  - search_back(\"text\")       - Search backward")
+print("  - search_clear()             - Clear match highlighting")
 print("  - replace_text(\"old\", \"new\") - Replace once")
 print("  - replace_all(\"old\", \"new\")  - Replace all")
 print("")
@@ -0,0 +1,23 @@
+-- Syntax Manifest
+--
+-- Declares every bundled language by name and file extension. A language's
+-- plugin is only loaded the first time a file with one of its extensions is
+-- opened, so startup does not pay for languages that are never used.
+--
+-- To add a language: write syntax/<lang>.lua (it calls syntax.register with
+-- the same name) and declare it here.
+
+syntax.declare("c", { ".c", ".h", ".cpp", ".hpp", ".cc", ".cxx" }, "syntax/c.lua")
+syntax.declare("lua", { ".lua" }, "syntax/lua.lua")
+syntax.declare("python", { ".py", ".pyw" }, "syntax/python.lua")
+syntax.declare("javascript", { ".js", ".mjs", ".jsx" }, "syntax/javascript.lua")
+syntax.declare("typescript", { ".ts", ".tsx" }, "syntax/typescript.lua")
+syntax.declare("rust", { ".rs" }, "syntax/rust.lua")
+syntax.declare("go", { ".go" }, "syntax/go.lua")
+syntax.declare("java", { ".java" }, "syntax/java.lua")
+syntax.declare("ruby", { ".rb" }, "syntax/ruby.lua")
+syntax.declare("shell", { ".sh", ".bash" }, "syntax/shell.lua")
+syntax.declare("html", { ".html", ".htm" }, "syntax/html.lua")
+syntax.declare("css", { ".css" }, "syntax/css.lua")
+syntax.declare("json", { ".json" }, "syntax/json.lua")
+syntax.declare("markdown", { ".md", ".markdown" }, "syntax/markdown.lua")
@@ -33,8 +33,5 @@ syntax.add_keyword(rust_syntax, "false", syntax.HL_CONSTANT)
 syntax.add_keyword(rust_syntax, "None", syntax.HL_CONSTANT)
 syntax.add_keyword(rust_syntax, "Some", syntax.HL_CONSTANT)
 
--- Macros (common ones)
-local macros = {"println!", "print!", "vec!", "format!", "panic!", "assert!"}
-for _, m in ipairs(macros) do
-    syntax.add_keyword(rust_syntax, m, syntax.HL_FUNCTION)
-end
+-- Macro invocations (println!, vec!, ...)
+syntax.add_pattern(rust_syntax, "[A-Za-z_]\\w*!", syntax.HL_FUNCTION)
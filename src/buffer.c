@@ -1,21 +1,85 @@
 #define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700  /* realpath() */
 #include "buffer.h"
 #include "syntax.h"
 #include "undo.h"
+#include "journal.h"
+#include "event_loop.h"
+#include "git.h"
+#include "match_index.h"
+#include "file_watch.h"
+#include "diff.h"
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
-
-#define INITIAL_ROW_CAPACITY 16
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define INITIAL_BLOCK_CAPACITY 16
+
+/* A run of consecutive rows. The buffer and any snapshots share blocks;
+ * a block is only modified in place while the buffer is its sole holder. */
+struct RowBlock {
+    atomic_int refcount;
+    size_t count;
+    BufferRow rows[BUFFER_BLOCK_ROWS];
+};
+
+/* Immutable view of the rows at one point in time */
+struct BufferSnapshot {
+    atomic_int refcount;
+    RowBlock **blocks;          /* One block reference held per entry */
+    size_t *block_starts;       /* First row of each block, for binary search */
+    size_t num_blocks;
+    size_t num_rows;
+};
+
+/* Background save: a worker thread writing a snapshot of the rows */
+struct BufferSaveJob {
+    Buffer *buf;                /* NULL once the buffer is closed mid-save */
+    char *filename;
+    bool was_modified;
+    mode_t umask;               /* For a new file; read on the main thread */
+
+    BufferSnapshot *snapshot;   /* Released by the worker once written */
+
+    BufferSaveCallback callback;
+    void *data;
+
+    size_t bytes_total;
+    atomic_size_t bytes_written;
+    atomic_bool progress_queued;
+    struct timespec last_progress;  /* Worker thread only */
+    int error;
+};
 
 Buffer *buffer_create(void) {
+    static unsigned long next_id = 1;
+
     Buffer *buf = malloc(sizeof(Buffer));
     if (!buf) return NULL;
 
+    buf->id = next_id++;
     buf->filename = NULL;
-    buf->rows = NULL;
+    buf->blocks = NULL;
+    buf->num_blocks = 0;
+    buf->blocks_capacity = 0;
     buf->num_rows = 0;
-    buf->capacity = 0;
+    buf->lookup_block = 0;
+    buf->lookup_start = 0;
+    buf->version = 0;
+    buf->changed_top = SIZE_MAX;
+    buf->changed_bottom = SIZE_MAX;
+    buf->deltas = NULL;
+    buf->delta_head = 0;
+    buf->delta_count = 0;
     buf->modified = false;
     buf->cursor_x = 0;
     buf->cursor_y = 0;
@@ -28,6 +92,9 @@ Buffer *buffer_create(void) {
     /* Undo/redo */
     buf->undo_stack = undo_stack_create(1000);  /* Max 1000 undo levels */
 
+    /* Crash recovery journal - attached once the buffer is backed by a file */
+    buf->journal = NULL;
+
     /* Visual selection */
     buf->has_selection = false;
     buf->select_start_x = 0;
@@ -35,6 +102,16 @@ Buffer *buffer_create(void) {
 
     /* Search */
     buf->search_term = NULL;
+    buf->search_index = NULL;
+
+    buf->save_job = NULL;
+
+    buf->git = NULL;
+    buf->git_checked = false;
+
+    buf->file_watch = 0;
+    buf->disk_size = -1;
+    buf->disk_mtime = 0;
 
     return buf;
 }
@@ -48,6 +125,460 @@ void buffer_free_row(BufferRow *row) {
     }
 }
 
+/* ===== Row storage ===== */
+
+static RowBlock *row_block_new(void) {
+    RowBlock *block = malloc(sizeof(RowBlock));
+    if (!block) return NULL;
+
+    atomic_init(&block->refcount, 1);
+    block->count = 0;
+    return block;
+}
+
+/* Drop one reference; the last holder frees the rows */
+static void row_block_release(RowBlock *block) {
+    if (atomic_fetch_sub_explicit(&block->refcount, 1, memory_order_acq_rel) != 1) return;
+
+    for (size_t i = 0; i < block->count; i++) {
+        free(block->rows[i].data);
+    }
+    free(block);
+}
+
+/* Give the buffer its own copy of a block that a snapshot still holds */
+static RowBlock *buffer_unshare_block(Buffer *buf, size_t bi) {
+    RowBlock *block = buf->blocks[bi];
+    if (atomic_load_explicit(&block->refcount, memory_order_acquire) == 1) return block;
+
+    RowBlock *copy = row_block_new();
+    if (!copy) return NULL;
+
+    for (size_t i = 0; i < block->count; i++) {
+        BufferRow *src = &block->rows[i];
+        BufferRow *dst = &copy->rows[i];
+        dst->capacity = src->size + 1;
+        dst->data = malloc(dst->capacity);
+        if (!dst->data) {
+            row_block_release(copy);
+            return NULL;
+        }
+        memcpy(dst->data, src->data, src->size + 1);
+        dst->size = src->size;
+        copy->count++;
+    }
+
+    buf->blocks[bi] = copy;
+    row_block_release(block);
+    return copy;
+}
+
+/* Insert a block into the block list at index bi */
+static bool buffer_insert_block(Buffer *buf, size_t bi, RowBlock *block) {
+    if (buf->num_blocks >= buf->blocks_capacity) {
+        size_t new_capacity = buf->blocks_capacity == 0 ? INITIAL_BLOCK_CAPACITY : buf->blocks_capacity * 2;
+        RowBlock **new_blocks = realloc(buf->blocks, sizeof(RowBlock *) * new_capacity);
+        if (!new_blocks) return false;
+        buf->blocks = new_blocks;
+        buf->blocks_capacity = new_capacity;
+    }
+
+    memmove(&buf->blocks[bi + 1], &buf->blocks[bi], sizeof(RowBlock *) * (buf->num_blocks - bi));
+    buf->blocks[bi] = block;
+    buf->num_blocks++;
+    return true;
+}
+
+/* Find the block holding row y (< num_rows); *offset gets the row's index inside it.
+ * Walks from whichever of the start, the end or the last lookup is closest. */
+static size_t buffer_locate(Buffer *buf, size_t y, size_t *offset) {
+    size_t bi = buf->lookup_block;
+    size_t start = buf->lookup_start;
+    if (bi >= buf->num_blocks) {
+        bi = 0;
+        start = 0;
+    }
+
+    size_t dist = y > start ? y - start : start - y;
+    if (y < dist) {
+        bi = 0;
+        start = 0;
+    } else if (buf->num_rows - y < dist) {
+        bi = buf->num_blocks - 1;
+        start = buf->num_rows - buf->blocks[bi]->count;
+    }
+
+    while (y < start) {
+        bi--;
+        start -= buf->blocks[bi]->count;
+    }
+    while (y >= start + buf->blocks[bi]->count) {
+        start += buf->blocks[bi]->count;
+        bi++;
+    }
+
+    buf->lookup_block = bi;
+    buf->lookup_start = start;
+    *offset = y - start;
+    return bi;
+}
+
+/* Change listener: while set, every buffer queues deltas and one flush is
+ * posted to the main loop per batch of edits */
+static BufferChangeCallback change_listener = NULL;
+static void *change_listener_data = NULL;
+static bool change_flush_posted = false;
+
+static void buffer_change_flush(void *arg) {
+    (void)arg;
+    change_flush_posted = false;
+    if (change_listener) change_listener(change_listener_data);
+}
+
+void buffer_set_change_listener(BufferChangeCallback cb, void *data) {
+    change_listener = cb;
+    change_listener_data = data;
+}
+
+/* Queue rows [first, first + old_rows) -> [first, first + new_rows), merging
+ * with the newest delta when they touch (typing on one row stays one delta) */
+static void buffer_record_delta(Buffer *buf, size_t first, size_t old_rows, size_t new_rows) {
+    if (!buf->deltas) {
+        buf->deltas = malloc(sizeof(BufferDelta) * BUFFER_DELTA_QUEUE);
+        if (!buf->deltas) return;
+    }
+
+    bool merged = false;
+    if (buf->delta_count > 0) {
+        BufferDelta *last = &buf->deltas[(buf->delta_head + buf->delta_count - 1) % BUFFER_DELTA_QUEUE];
+        size_t last_end = last->row + last->new_rows;
+        bool touches = first <= last_end && first + old_rows >= last->row;
+
+        if (touches || buf->delta_count == BUFFER_DELTA_QUEUE) {
+            /* One delta spanning both (when full, possibly some untouched rows too).
+             * Rows past last_end were shifted by last, rows before it were not. */
+            size_t start = first < last->row ? first : last->row;
+            size_t end = first + old_rows > last_end ? first + old_rows : last_end;
+            last->old_rows = end - last->new_rows + last->old_rows - start;
+            last->new_rows = end + new_rows - old_rows - start;
+            last->row = start;
+            merged = true;
+        }
+    }
+
+    if (!merged) {
+        buf->deltas[(buf->delta_head + buf->delta_count) % BUFFER_DELTA_QUEUE] =
+            (BufferDelta){ .row = first, .old_rows = old_rows, .new_rows = new_rows };
+        buf->delta_count++;
+    }
+
+    if (!change_flush_posted && event_loop_post(buffer_change_flush, NULL) == 0) {
+        change_flush_posted = true;
+    }
+}
+
+size_t buffer_take_deltas(Buffer *buf, BufferDelta *out, size_t max) {
+    size_t n = 0;
+    while (n < max && buf->delta_count > 0) {
+        out[n++] = buf->deltas[buf->delta_head];
+        buf->delta_head = (buf->delta_head + 1) % BUFFER_DELTA_QUEUE;
+        buf->delta_count--;
+    }
+    return n;
+}
+
+/* Called before the row count changes: rows [first, first + old_rows) become new_rows rows */
+static void buffer_mark_changed(Buffer *buf, size_t first, size_t old_rows, size_t new_rows) {
+    size_t rows_after = buf->num_rows - first - old_rows;
+
+    buf->version++;
+    if (first < buf->changed_top) buf->changed_top = first;
+    if (rows_after < buf->changed_bottom) buf->changed_bottom = rows_after;
+
+    if (change_listener) buffer_record_delta(buf, first, old_rows, new_rows);
+}
+
+void buffer_take_changes(Buffer *buf, size_t *top, size_t *bottom) {
+    *top = buf->changed_top;
+    *bottom = buf->changed_bottom;
+    buf->changed_top = SIZE_MAX;
+    buf->changed_bottom = SIZE_MAX;
+}
+
+BufferRow *buffer_row(Buffer *buf, size_t y) {
+    if (!buf || y >= buf->num_rows) return NULL;
+
+    size_t offset;
+    size_t bi = buffer_locate(buf, y, &offset);
+    return &buf->blocks[bi]->rows[offset];
+}
+
+BufferRow *buffer_row_mut(Buffer *buf, size_t y) {
+    if (!buf || y >= buf->num_rows) return NULL;
+
+    size_t offset;
+    size_t bi = buffer_locate(buf, y, &offset);
+    RowBlock *block = buffer_unshare_block(buf, bi);
+    if (!block) return NULL;
+    buffer_mark_changed(buf, y, 1, 1);
+    return &block->rows[offset];
+}
+
+BufferRow *buffer_insert_row(Buffer *buf, size_t at, const char *s, size_t len) {
+    if (!buf || at > buf->num_rows) return NULL;
+
+    char *data = malloc(len + 1);
+    if (!data) return NULL;
+    if (len > 0) memcpy(data, s, len);
+    data[len] = '\0';
+
+    size_t bi, offset, start;
+    if (buf->num_blocks == 0) {
+        RowBlock *block = row_block_new();
+        if (!block || !buffer_insert_block(buf, 0, block)) {
+            free(block);
+            free(data);
+            return NULL;
+        }
+        bi = 0;
+        offset = 0;
+        start = 0;
+    } else if (at == buf->num_rows) {
+        bi = buf->num_blocks - 1;
+        start = buf->num_rows - buf->blocks[bi]->count;
+        offset = buf->blocks[bi]->count;
+    } else {
+        bi = buffer_locate(buf, at, &offset);
+        start = buf->lookup_start;
+    }
+
+    RowBlock *block = buffer_unshare_block(buf, bi);
+    if (!block) {
+        free(data);
+        return NULL;
+    }
+
+    if (block->count == BUFFER_BLOCK_ROWS) {
+        RowBlock *next = row_block_new();
+        if (!next || !buffer_insert_block(buf, bi + 1, next)) {
+            free(next);
+            free(data);
+            return NULL;
+        }
+
+        if (offset == block->count) {
+            /* Appending past a full block (e.g. loading a file): start a fresh one */
+            block = next;
+            bi++;
+            start += BUFFER_BLOCK_ROWS;
+            offset = 0;
+        } else {
+            /* Split in half so both blocks have room to grow */
+            size_t half = BUFFER_BLOCK_ROWS / 2;
+            memcpy(next->rows, &block->rows[half], sizeof(BufferRow) * (block->count - half));
+            next->count = block->count - half;
+            block->count = half;
+            if (offset >= half) {
+                block = next;
+                bi++;
+                start += half;
+                offset -= half;
+            }
+        }
+    }
+
+    memmove(&block->rows[offset + 1], &block->rows[offset], sizeof(BufferRow) * (block->count - offset));
+    BufferRow *row = &block->rows[offset];
+    row->data = data;
+    row->size = len;
+    row->capacity = len + 1;
+    buffer_mark_changed(buf, at, 0, 1);
+    block->count++;
+    buf->num_rows++;
+
+    /* Blocks before bi are untouched, so this stays a valid lookup anchor */
+    buf->lookup_block = bi;
+    buf->lookup_start = start;
+    return row;
+}
+
+void buffer_delete_rows(Buffer *buf, size_t at, size_t count) {
+    if (!buf || at >= buf->num_rows || count == 0) return;
+    if (count > buf->num_rows - at) count = buf->num_rows - at;
+    buffer_mark_changed(buf, at, count, 0);
+
+    size_t offset;
+    size_t bi = buffer_locate(buf, at, &offset);
+    size_t first_bi = bi;
+    size_t first_start = buf->lookup_start;
+
+    while (count > 0 && bi < buf->num_blocks) {
+        RowBlock *block = buf->blocks[bi];
+        size_t n = block->count - offset;
+        if (n > count) n = count;
+
+        if (offset == 0 && n == block->count) {
+            /* Whole block goes - no need to copy it even if a snapshot shares it */
+            row_block_release(block);
+            memmove(&buf->blocks[bi], &buf->blocks[bi + 1], sizeof(RowBlock *) * (buf->num_blocks - bi - 1));
+            buf->num_blocks--;
+        } else {
+            block = buffer_unshare_block(buf, bi);
+            if (!block) break;
+
+            for (size_t i = offset; i < offset + n; i++) {
+                free(block->rows[i].data);
+            }
+            memmove(&block->rows[offset], &block->rows[offset + n],
+                    sizeof(BufferRow) * (block->count - offset - n));
+            block->count -= n;
+            bi++;
+            offset = 0;
+        }
+
+        buf->num_rows -= n;
+        count -= n;
+    }
+
+    if (first_bi < buf->num_blocks) {
+        buf->lookup_block = first_bi;
+        buf->lookup_start = first_start;
+    } else {
+        buf->lookup_block = 0;
+        buf->lookup_start = 0;
+    }
+}
+
+/* ===== Snapshots ===== */
+
+BufferSnapshot *buffer_snapshot_acquire(Buffer *buf) {
+    if (!buf) return NULL;
+
+    BufferSnapshot *snap = malloc(sizeof(BufferSnapshot));
+    if (!snap) return NULL;
+
+    size_t n = buf->num_blocks > 0 ? buf->num_blocks : 1;
+    snap->blocks = malloc(sizeof(RowBlock *) * n);
+    snap->block_starts = malloc(sizeof(size_t) * n);
+    if (!snap->blocks || !snap->block_starts) {
+        free(snap->blocks);
+        free(snap->block_starts);
+        free(snap);
+        return NULL;
+    }
+
+    /* Share every block; the buffer copies a block before its next edit there */
+    size_t start = 0;
+    for (size_t b = 0; b < buf->num_blocks; b++) {
+        RowBlock *block = buf->blocks[b];
+        atomic_fetch_add_explicit(&block->refcount, 1, memory_order_relaxed);
+        snap->blocks[b] = block;
+        snap->block_starts[b] = start;
+        start += block->count;
+    }
+
+    atomic_init(&snap->refcount, 1);
+    snap->num_blocks = buf->num_blocks;
+    snap->num_rows = buf->num_rows;
+    return snap;
+}
+
+BufferSnapshot *buffer_snapshot_retain(BufferSnapshot *snap) {
+    if (snap) atomic_fetch_add_explicit(&snap->refcount, 1, memory_order_relaxed);
+    return snap;
+}
+
+void buffer_snapshot_release(BufferSnapshot *snap) {
+    if (!snap) return;
+    if (atomic_fetch_sub_explicit(&snap->refcount, 1, memory_order_acq_rel) != 1) return;
+
+    for (size_t b = 0; b < snap->num_blocks; b++) {
+        row_block_release(snap->blocks[b]);
+    }
+    free(snap->blocks);
+    free(snap->block_starts);
+    free(snap);
+}
+
+size_t buffer_snapshot_num_rows(const BufferSnapshot *snap) {
+    return snap ? snap->num_rows : 0;
+}
+
+/* Index of the block holding row y (< num_rows): the last one starting at or before it */
+static size_t snapshot_find_block(const BufferSnapshot *snap, size_t y) {
+    size_t lo = 0, hi = snap->num_blocks - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if (snap->block_starts[mid] <= y) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+const BufferRow *buffer_snapshot_row(const BufferSnapshot *snap, size_t y) {
+    if (!snap || y >= snap->num_rows) return NULL;
+
+    size_t b = snapshot_find_block(snap, y);
+    return &snap->blocks[b]->rows[y - snap->block_starts[b]];
+}
+
+void buffer_snapshot_iter_init(BufferSnapshotIter *it, const BufferSnapshot *snap, size_t from_row) {
+    it->snap = snap;
+    it->block = 0;
+    it->offset = 0;
+    if (!snap || from_row >= snap->num_rows) {
+        it->block = snap ? snap->num_blocks : 0;
+        return;
+    }
+
+    it->block = snapshot_find_block(snap, from_row);
+    it->offset = from_row - snap->block_starts[it->block];
+}
+
+const BufferRow *buffer_snapshot_iter_next(BufferSnapshotIter *it) {
+    const BufferSnapshot *snap = it->snap;
+    if (!snap) return NULL;
+
+    while (it->block < snap->num_blocks) {
+        RowBlock *block = snap->blocks[it->block];
+        if (it->offset < block->count) {
+            return &block->rows[it->offset++];
+        }
+        it->block++;
+        it->offset = 0;
+    }
+    return NULL;
+}
+
+/* Rows in block b of snap */
+static size_t snapshot_block_rows(const BufferSnapshot *snap, size_t b) {
+    size_t end = b + 1 < snap->num_blocks ? snap->block_starts[b + 1] : snap->num_rows;
+    return end - snap->block_starts[b];
+}
+
+void buffer_snapshot_compare(const BufferSnapshot *old, const BufferSnapshot *cur,
+                             size_t *top, size_t *bottom) {
+    /* A block both hold was never modified: edits copy shared blocks first */
+    size_t n = old->num_blocks < cur->num_blocks ? old->num_blocks : cur->num_blocks;
+    size_t front = 0;
+    *top = 0;
+    while (front < n && old->blocks[front] == cur->blocks[front]) {
+        *top += snapshot_block_rows(old, front);
+        front++;
+    }
+
+    size_t back = 0;
+    *bottom = 0;
+    while (back < n - front &&
+           old->blocks[old->num_blocks - 1 - back] == cur->blocks[cur->num_blocks - 1 - back]) {
+        *bottom += snapshot_block_rows(old, old->num_blocks - 1 - back);
+        back++;
+    }
+}
+
 /* Helper to invalidate highlighting cache from a given row onwards */
 static void buffer_invalidate_highlighting(Buffer *buf, size_t from_row) {
     if (!buf->highlighted_lines) return;
@@ -61,8 +592,8 @@ static void buffer_invalidate_highlighting(Buffer *buf, size_t from_row) {
     }
 }
 
-/* Helper to reallocate highlighting cache when buffer size changes */
-static void buffer_resize_highlighting_cache(Buffer *buf, size_t old_rows, size_t new_rows) {
+/* Reallocate highlighting cache when buffer size changes */
+void buffer_resize_highlighting_cache(Buffer *buf, size_t old_rows, size_t new_rows) {
     if (!buf->syntax) return;
 
     /* Free all cached highlighting first */
@@ -90,8 +621,13 @@ static void buffer_resize_highlighting_cache(Buffer *buf, size_t old_rows, size_
 void buffer_destroy(Buffer *buf) {
     if (!buf) return;
 
-    for (size_t i = 0; i < buf->num_rows; i++) {
-        buffer_free_row(&buf->rows[i]);
+    /* A running save keeps its own snapshot; just stop it reporting back to us */
+    if (buf->save_job) {
+        buf->save_job->buf = NULL;
+    }
+
+    for (size_t i = 0; i < buf->num_blocks; i++) {
+        row_block_release(buf->blocks[i]);
     }
 
     /* Free highlighting cache */
@@ -105,35 +641,25 @@ void buffer_destroy(Buffer *buf) {
     }
     if (buf->multiline_states) free(buf->multiline_states);
 
-    if (buf->rows) free(buf->rows);
+    if (buf->blocks) free(buf->blocks);
     if (buf->filename) free(buf->filename);
     if (buf->undo_stack) undo_stack_destroy(buf->undo_stack);
+    if (buf->journal) journal_close(buf->journal);
+    if (buf->git) git_file_close(buf->git);
+    if (buf->file_watch) file_watch_remove(buf->file_watch);
     if (buf->search_term) free(buf->search_term);
+    match_index_destroy(buf->search_index);
+    free(buf->deltas);
     free(buf);
 }
 
 void buffer_append_row(Buffer *buf, const char *s, size_t len) {
-    if (buf->num_rows >= buf->capacity) {
-        size_t new_capacity = buf->capacity == 0 ? INITIAL_ROW_CAPACITY : buf->capacity * 2;
-        BufferRow *new_rows = realloc(buf->rows, sizeof(BufferRow) * new_capacity);
-        if (!new_rows) return;
-        buf->rows = new_rows;
-        buf->capacity = new_capacity;
-    }
-
-    BufferRow *row = &buf->rows[buf->num_rows];
-    row->capacity = len + 1;
-    row->data = malloc(row->capacity);
-    if (!row->data) return;
-
-    memcpy(row->data, s, len);
-    row->data[len] = '\0';
-    row->size = len;
-
-    buf->num_rows++;
+    if (!buffer_insert_row(buf, buf->num_rows, s, len)) return;
     buf->modified = true;
 }
 
+static void buffer_watch_file(Buffer *buf);
+
 int buffer_open(Buffer *buf, const char *filename) {
     FILE *fp = fopen(filename, "r");
     if (!fp) return -1;
@@ -165,25 +691,343 @@ int buffer_open(Buffer *buf, const char *filename) {
         buf->multiline_states = calloc(buf->num_rows, sizeof(bool));
     }
 
+    /* Start journaling edits against the file as loaded */
+    buf->journal = journal_open(filename);
+
+    buffer_watch_file(buf);
     return 0;
 }
 
+/* Rows per writev() call - two iovecs each (text + newline), under IOV_MAX */
+#define SAVE_BATCH_ROWS 512
+
+/* Write every iovec in the batch, resuming after short writes */
+static int save_writev_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        /* Skip over the fully written iovecs, trim the partial one */
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/* Report progress at most this often during a background save */
+#define SAVE_PROGRESS_INTERVAL_MS 100
+
+static pthread_mutex_t save_jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t save_jobs_cond = PTHREAD_COND_INITIALIZER;
+static int save_jobs_running = 0;
+
+/* Main thread: pass the latest byte count to the caller */
+static void save_job_report_progress(void *arg) {
+    BufferSaveJob *job = arg;
+    atomic_store(&job->progress_queued, false);
+
+    if (job->callback) {
+        BufferSaveProgress progress = {
+            job->filename, atomic_load(&job->bytes_written), job->bytes_total, false, 0
+        };
+        job->callback(job->buf, &progress, job->data);
+    }
+}
+
+/* Worker thread: count written bytes, occasionally wake the main thread */
+static void save_job_advance(BufferSaveJob *job, size_t bytes) {
+    if (!job) return;
+
+    atomic_fetch_add(&job->bytes_written, bytes);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed_ms = (now.tv_sec - job->last_progress.tv_sec) * 1000 +
+                      (now.tv_nsec - job->last_progress.tv_nsec) / 1000000;
+    if (elapsed_ms < SAVE_PROGRESS_INTERVAL_MS) return;
+    job->last_progress = now;
+
+    /* One progress event in flight at a time */
+    if (!atomic_exchange(&job->progress_queued, true)) {
+        if (event_loop_post(save_job_report_progress, job) == -1) {
+            atomic_store(&job->progress_queued, false);
+        }
+    }
+}
+
+/* Stream rows into an open file descriptor in writev batches */
+static int save_write_blocks(int fd, RowBlock **blocks, size_t num_blocks, BufferSaveJob *job) {
+    static char newline = '\n';
+    struct iovec iov[SAVE_BATCH_ROWS * 2];
+    int count = 0;
+    size_t batch_bytes = 0;
+
+    for (size_t b = 0; b < num_blocks; b++) {
+        RowBlock *block = blocks[b];
+        for (size_t i = 0; i < block->count; i++) {
+            BufferRow *row = &block->rows[i];
+            if (row->size > 0) {
+                iov[count].iov_base = row->data;
+                iov[count].iov_len = row->size;
+                count++;
+            }
+            iov[count].iov_base = &newline;
+            iov[count].iov_len = 1;
+            count++;
+            batch_bytes += row->size + 1;
+
+            if (count + 2 > SAVE_BATCH_ROWS * 2) {
+                if (save_writev_all(fd, iov, count) == -1) return -1;
+                save_job_advance(job, batch_bytes);
+                count = 0;
+                batch_bytes = 0;
+            }
+        }
+    }
+
+    if (count > 0) {
+        if (save_writev_all(fd, iov, count) == -1) return -1;
+        save_job_advance(job, batch_bytes);
+    }
+    return 0;
+}
+
+/* umask() is read by setting it, and a file another thread created in
+ * between would get the temporary mask - so it is read once, at startup */
+static mode_t save_umask = 022;
+
+void buffer_save_init(void) {
+    save_umask = umask(0);
+    umask(save_umask);
+}
+
+/* Write to a temp file beside the target, fsync, then rename it into place.
+ * A crash at any point leaves either the old or the new file, never half of one. */
+static int save_atomic(const char *filename, RowBlock **blocks, size_t num_blocks, mode_t mask,
+                       BufferSaveJob *job) {
+    /* Replace the file a symlink points at, not the link itself */
+    char *target = realpath(filename, NULL);
+    if (!target) {
+        if (errno != ENOENT) return -1;
+        target = strdup(filename);
+        if (!target) return -1;
+    }
+
+    /* Temp file must live in the same directory for rename() to be atomic */
+    const char *slash = strrchr(target, '/');
+    size_t dir_len = slash ? (size_t)(slash - target) + 1 : 0;
+    const char *base = slash ? slash + 1 : target;
+
+    size_t tmp_size = dir_len + strlen(base) + 16;
+    char *tmp_path = malloc(tmp_size);
+    if (!tmp_path) {
+        free(target);
+        return -1;
+    }
+    snprintf(tmp_path, tmp_size, "%.*s.%s.XXXXXX", (int)dir_len, target, base);
+
+    int fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        free(tmp_path);
+        free(target);
+        return -1;
+    }
+
+    /* mkstemp creates 0600 - carry over the original mode/owner, or apply umask for new files */
+    struct stat st;
+    if (stat(target, &st) == 0) {
+        fchmod(fd, st.st_mode & 07777);
+        if (fchown(fd, st.st_uid, st.st_gid) == -1) {
+            /* Not owner - keep our own uid/gid, the mode still matches */
+        }
+    } else {
+        fchmod(fd, 0666 & ~mask);
+    }
+
+    int result = save_write_blocks(fd, blocks, num_blocks, job);
+    if (result == 0) result = fsync(fd);
+    if (close(fd) == -1) result = -1;
+    if (result == 0) result = rename(tmp_path, target);
+
+    if (result == -1) {
+        int saved_errno = errno;
+        unlink(tmp_path);
+        errno = saved_errno;
+    } else {
+        /* Make the rename itself durable */
+        char *dir = dir_len ? strndup(target, dir_len) : strdup(".");
+        if (dir) {
+            int dir_fd = open(dir, O_RDONLY);
+            if (dir_fd != -1) {
+                fsync(dir_fd);
+                close(dir_fd);
+            }
+            free(dir);
+        }
+    }
+
+    free(tmp_path);
+    free(target);
+    return result;
+}
+
 int buffer_save(Buffer *buf) {
     if (!buf->filename) return -1;
 
-    FILE *fp = fopen(buf->filename, "w");
-    if (!fp) return -1;
+    /* A background save finishing later would rename older text over this file */
+    if (buf->save_job) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if (save_atomic(buf->filename, buf->blocks, buf->num_blocks, save_umask, NULL) == -1) return -1;
+
+    buf->modified = false;
+
+    /* Edits so far are on disk now - restart the journal from here */
+    if (buf->journal) {
+        journal_reset(buf->journal, buf->filename);
+    } else {
+        buf->journal = journal_open(buf->filename);
+    }
+    buffer_watch_file(buf);
+    return 0;
+}
 
-    for (size_t i = 0; i < buf->num_rows; i++) {
-        fwrite(buf->rows[i].data, 1, buf->rows[i].size, fp);
-        fputc('\n', fp);
+/* Main thread: settle buffer state once the worker is done */
+static void save_job_finish(void *arg) {
+    BufferSaveJob *job = arg;
+    Buffer *buf = job->buf;
+
+    if (buf) {
+        buf->save_job = NULL;
+        if (job->error == 0) {
+            /* Journal restarts against the new file, keeping edits made during the save */
+            if (buf->journal) {
+                journal_checkpoint_commit(buf->journal, job->filename);
+            } else {
+                buf->journal = journal_open(job->filename);
+            }
+            buffer_watch_file(buf);
+        } else {
+            if (buf->journal) journal_checkpoint_abort(buf->journal);
+            if (job->was_modified) buf->modified = true;
+        }
     }
 
-    fclose(fp);
+    if (job->callback) {
+        BufferSaveProgress progress = {
+            job->filename, atomic_load(&job->bytes_written), job->bytes_total, true, job->error
+        };
+        job->callback(buf, &progress, job->data);
+    }
+
+    free(job->filename);
+    free(job);
+}
+
+static void *save_job_main(void *arg) {
+    BufferSaveJob *job = arg;
+    clock_gettime(CLOCK_MONOTONIC, &job->last_progress);
+
+    BufferSnapshot *snap = job->snapshot;
+    size_t total = 0;
+    BufferSnapshotIter it;
+    buffer_snapshot_iter_init(&it, snap, 0);
+    const BufferRow *row;
+    while ((row = buffer_snapshot_iter_next(&it))) {
+        total += row->size + 1;
+    }
+    job->bytes_total = total;
+
+    if (save_atomic(job->filename, snap->blocks, snap->num_blocks, job->umask, job) == -1) {
+        job->error = errno ? errno : EIO;
+    }
+
+    /* Release the snapshot here so blocks only it still held are freed off the UI thread */
+    buffer_snapshot_release(snap);
+    job->snapshot = NULL;
+
+    event_loop_post(save_job_finish, job);
+
+    pthread_mutex_lock(&save_jobs_lock);
+    save_jobs_running--;
+    pthread_cond_broadcast(&save_jobs_cond);
+    pthread_mutex_unlock(&save_jobs_lock);
+    return NULL;
+}
+
+int buffer_save_async(Buffer *buf, BufferSaveCallback cb, void *data) {
+    if (!buf || !buf->filename || buf->save_job) return -1;
+
+    BufferSaveJob *job = calloc(1, sizeof(BufferSaveJob));
+    if (!job) return -1;
+
+    job->filename = strdup(buf->filename);
+    job->snapshot = buffer_snapshot_acquire(buf);
+    if (!job->filename || !job->snapshot) {
+        free(job->filename);
+        buffer_snapshot_release(job->snapshot);
+        free(job);
+        return -1;
+    }
+
+    job->buf = buf;
+    job->was_modified = buf->modified;
+    job->umask = save_umask;
+    job->callback = cb;
+    job->data = data;
+    atomic_init(&job->bytes_written, 0);
+    atomic_init(&job->progress_queued, false);
+
+    pthread_mutex_lock(&save_jobs_lock);
+    save_jobs_running++;
+    pthread_mutex_unlock(&save_jobs_lock);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int rc = pthread_create(&thread, &attr, save_job_main, job);
+    pthread_attr_destroy(&attr);
+
+    if (rc != 0) {
+        pthread_mutex_lock(&save_jobs_lock);
+        save_jobs_running--;
+        pthread_mutex_unlock(&save_jobs_lock);
+
+        buffer_snapshot_release(job->snapshot);
+        free(job->filename);
+        free(job);
+        return -1;
+    }
+
+    buf->save_job = job;
+
+    /* Edits from here on are not part of the file being written */
     buf->modified = false;
+    if (buf->journal) journal_checkpoint_begin(buf->journal);
     return 0;
 }
 
+void buffer_save_wait_all(void) {
+    pthread_mutex_lock(&save_jobs_lock);
+    while (save_jobs_running > 0) {
+        pthread_cond_wait(&save_jobs_cond, &save_jobs_lock);
+    }
+    pthread_mutex_unlock(&save_jobs_lock);
+}
+
 void buffer_insert_char(Buffer *buf, int c) {
     if (buf->cursor_y == (int)buf->num_rows) {
         /* Insert at end of file */
@@ -192,7 +1036,8 @@ void buffer_insert_char(Buffer *buf, int c) {
 
     if (buf->cursor_y >= (int)buf->num_rows) return;
 
-    BufferRow *row = &buf->rows[buf->cursor_y];
+    BufferRow *row = buffer_row_mut(buf, buf->cursor_y);
+    if (!row) return;
 
     /* Ensure we have space */
     if (row->size + 1 >= row->capacity) {
@@ -214,6 +1059,10 @@ void buffer_insert_char(Buffer *buf, int c) {
     row->size++;
     row->data[row->size] = '\0';
 
+    if (buf->journal) {
+        journal_record_insert(buf->journal, buf->cursor_x, buf->cursor_y, &row->data[buf->cursor_x], 1);
+    }
+
     buf->cursor_x++;
     buf->modified = true;
 
@@ -224,6 +1073,10 @@ void buffer_insert_char(Buffer *buf, int c) {
 void buffer_insert_newline(Buffer *buf) {
     if (buf->cursor_y >= (int)buf->num_rows) {
         size_t old_rows = buf->num_rows;
+        if (buf->journal) {
+            /* Appending a row past the end: replay recreates it from an empty insert */
+            journal_record_insert(buf->journal, 0, buf->cursor_y, "", 0);
+        }
         buffer_append_row(buf, "", 0);
         /* Resize highlighting cache to accommodate new row */
         buffer_resize_highlighting_cache(buf, old_rows, buf->num_rows);
@@ -232,41 +1085,27 @@ void buffer_insert_newline(Buffer *buf) {
         return;
     }
 
-    BufferRow *row = &buf->rows[buf->cursor_y];
+    BufferRow *row = buffer_row(buf, buf->cursor_y);
 
-    /* Split the current row at cursor */
+    /* Split the current row at cursor: the text after it moves to a new row */
     const char *rest = (buf->cursor_x < (int)row->size) ? &row->data[buf->cursor_x] : "";
     size_t rest_len = (buf->cursor_x < (int)row->size) ? row->size - buf->cursor_x : 0;
 
-    /* Truncate current row */
-    row->size = buf->cursor_x;
-    row->data[row->size] = '\0';
+    BufferRow *new_row = buffer_insert_row(buf, buf->cursor_y + 1, rest, rest_len);
+    if (!new_row) return;
 
-    /* Make space for new row */
-    if (buf->num_rows >= buf->capacity) {
-        size_t new_capacity = buf->capacity == 0 ? INITIAL_ROW_CAPACITY : buf->capacity * 2;
-        BufferRow *new_rows = realloc(buf->rows, sizeof(BufferRow) * new_capacity);
-        if (!new_rows) return;
-        buf->rows = new_rows;
-        buf->capacity = new_capacity;
+    if (buf->journal) {
+        journal_record_insert(buf->journal, buf->cursor_x, buf->cursor_y, "\n", 1);
     }
 
-    /* Shift rows down */
-    memmove(&buf->rows[buf->cursor_y + 2], &buf->rows[buf->cursor_y + 1],
-            sizeof(BufferRow) * (buf->num_rows - buf->cursor_y - 1));
-
-    /* Insert new row */
-    BufferRow *new_row = &buf->rows[buf->cursor_y + 1];
-    new_row->capacity = rest_len + 1;
-    new_row->data = malloc(new_row->capacity);
-    if (!new_row->data) return;
-
-    memcpy(new_row->data, rest, rest_len);
-    new_row->data[rest_len] = '\0';
-    new_row->size = rest_len;
+    /* Truncate current row (inserting may have moved it) */
+    row = buffer_row_mut(buf, buf->cursor_y);
+    if (row) {
+        row->size = buf->cursor_x;
+        row->data[row->size] = '\0';
+    }
 
-    size_t old_rows = buf->num_rows;
-    buf->num_rows++;
+    size_t old_rows = buf->num_rows - 1;
 
     /* Resize highlighting cache to accommodate new row */
     buffer_resize_highlighting_cache(buf, old_rows, buf->num_rows);
@@ -274,14 +1113,15 @@ void buffer_insert_newline(Buffer *buf) {
     buf->cursor_y++;
 
     /* Auto-indent: copy leading whitespace from previous line */
-    BufferRow *prev_row = &buf->rows[buf->cursor_y - 1];
+    BufferRow *prev_row = buffer_row(buf, buf->cursor_y - 1);
     int indent = 0;
     while (indent < (int)prev_row->size &&
            (prev_row->data[indent] == ' ' || prev_row->data[indent] == '\t')) {
         indent++;
     }
 
-    if (indent > 0) {
+    new_row = buffer_row_mut(buf, buf->cursor_y);
+    if (indent > 0 && new_row) {
         /* Ensure new row has enough capacity */
         while (new_row->capacity < new_row->size + indent + 1) {
             new_row->capacity *= 2;
@@ -298,6 +1138,10 @@ void buffer_insert_newline(Buffer *buf) {
         new_row->size += indent;
         new_row->data[new_row->size] = '\0';
 
+        if (buf->journal) {
+            journal_record_insert(buf->journal, 0, buf->cursor_y, new_row->data, indent);
+        }
+
         buf->cursor_x = indent;
     } else {
         buf->cursor_x = 0;
@@ -310,14 +1154,18 @@ void buffer_delete_char(Buffer *buf) {
     if (buf->cursor_y >= (int)buf->num_rows) return;
     if (buf->cursor_x == 0 && buf->cursor_y == 0) return;
 
-    BufferRow *row = &buf->rows[buf->cursor_y];
-
     if (buf->cursor_x > 0) {
+        BufferRow *row = buffer_row_mut(buf, buf->cursor_y);
+        if (!row) return;
+
         /* Record undo before deleting */
         if (buf->undo_stack) {
             char deleted_char = row->data[buf->cursor_x - 1];
             undo_push_delete_char(buf->undo_stack, buf->cursor_x - 1, buf->cursor_y, deleted_char);
         }
+        if (buf->journal) {
+            journal_record_delete(buf->journal, buf->cursor_x - 1, buf->cursor_y, buf->cursor_x, buf->cursor_y);
+        }
 
         /* Delete character before cursor */
         memmove(&row->data[buf->cursor_x - 1], &row->data[buf->cursor_x],
@@ -331,9 +1179,15 @@ void buffer_delete_char(Buffer *buf) {
         buffer_invalidate_highlighting(buf, buf->cursor_y);
     } else {
         /* Delete newline - join with previous row */
-        BufferRow *prev_row = &buf->rows[buf->cursor_y - 1];
+        BufferRow *prev_row = buffer_row_mut(buf, buf->cursor_y - 1);
+        BufferRow *row = buffer_row(buf, buf->cursor_y);
+        if (!prev_row) return;
         buf->cursor_x = prev_row->size;
 
+        if (buf->journal) {
+            journal_record_delete(buf->journal, buf->cursor_x, buf->cursor_y - 1, 0, buf->cursor_y);
+        }
+
         /* Ensure previous row has space */
         while (prev_row->capacity < prev_row->size + row->size + 1) {
             prev_row->capacity *= 2;
@@ -348,14 +1202,8 @@ void buffer_delete_char(Buffer *buf) {
         prev_row->data[prev_row->size] = '\0';
 
         /* Delete current row */
-        buffer_free_row(row);
-
-        /* Shift rows up */
-        memmove(&buf->rows[buf->cursor_y], &buf->rows[buf->cursor_y + 1],
-                sizeof(BufferRow) * (buf->num_rows - buf->cursor_y - 1));
-
         size_t old_rows = buf->num_rows;
-        buf->num_rows--;
+        buffer_delete_rows(buf, buf->cursor_y, 1);
 
         /* Resize highlighting cache after deleting row */
         buffer_resize_highlighting_cache(buf, old_rows, buf->num_rows);
@@ -365,6 +1213,197 @@ void buffer_delete_char(Buffer *buf) {
     }
 }
 
+/* Grow row to hold need bytes plus the terminator */
+static bool buffer_row_reserve(BufferRow *row, size_t need) {
+    if (row->capacity >= need + 1) return true;
+
+    size_t capacity = row->capacity ? row->capacity : 16;
+    while (capacity < need + 1) capacity *= 2;
+    char *new_data = realloc(row->data, capacity);
+    if (!new_data) return false;
+    row->data = new_data;
+    row->capacity = capacity;
+    return true;
+}
+
+int buffer_insert_text(Buffer *buf, int x, int y, const char *text, size_t len) {
+    if (!buf || !text || y < 0 || y > (int)buf->num_rows) return -1;
+    if (len == 0) return 0;
+    if (x < 0) x = 0;
+
+    if (y == (int)buf->num_rows && y > 0) {
+        /* Past the last row: a newline plus text at the end of the last row,
+         * so undo and the journal see the whole change */
+        char *joined = malloc(len + 1);
+        if (!joined) return -1;
+        joined[0] = '\n';
+        memcpy(joined + 1, text, len);
+
+        bool at_cursor = buf->cursor_y == y;
+        int result = buffer_insert_text(buf, buffer_row(buf, y - 1)->size, y - 1, joined, len + 1);
+        free(joined);
+        if (result == 0 && at_cursor) {
+            buf->cursor_y = buf->num_rows - 1;
+            buf->cursor_x = buffer_row(buf, buf->cursor_y)->size;
+        }
+        return result;
+    }
+
+    size_t old_rows = buf->num_rows;
+    if (buf->num_rows == 0) {
+        buffer_append_row(buf, "", 0);
+        if (buf->num_rows == 0) return -1;
+    }
+
+    BufferRow *row = buffer_row_mut(buf, y);
+    if (!row) return -1;
+    if (x > (int)row->size) x = row->size;
+
+    if (buf->undo_stack) {
+        undo_push_insert_text(buf->undo_stack, x, y, text, len);
+    }
+    if (buf->journal) {
+        journal_record_insert(buf->journal, x, y, text, len);
+    }
+
+    int end_x, end_y = y;
+    const char *nl = memchr(text, '\n', len);
+    if (!nl) {
+        /* Single row: one memmove of the tail */
+        if (!buffer_row_reserve(row, row->size + len)) return -1;
+        memmove(&row->data[x + len], &row->data[x], row->size - x);
+        memcpy(&row->data[x], text, len);
+        row->size += len;
+        row->data[row->size] = '\0';
+        end_x = x + len;
+    } else {
+        /* Detach the tail after x; it goes after the last inserted row */
+        size_t tail_len = row->size - x;
+        char *tail = malloc(tail_len + 1);
+        if (!tail) return -1;
+        memcpy(tail, &row->data[x], tail_len);
+
+        size_t first_len = nl - text;
+        if (!buffer_row_reserve(row, x + first_len)) {
+            free(tail);
+            return -1;
+        }
+        memcpy(&row->data[x], text, first_len);
+        row->size = x + first_len;
+        row->data[row->size] = '\0';
+
+        const char *seg = nl + 1;
+        const char *end = text + len;
+        for (;;) {
+            const char *next = memchr(seg, '\n', end - seg);
+            size_t seg_len = (next ? next : end) - seg;
+            BufferRow *new_row = buffer_insert_row(buf, ++end_y, seg, seg_len);
+            if (!new_row) {
+                free(tail);
+                return -1;
+            }
+            if (!next) {
+                end_x = seg_len;
+                if (tail_len > 0 && buffer_row_reserve(new_row, seg_len + tail_len)) {
+                    memcpy(&new_row->data[seg_len], tail, tail_len);
+                    new_row->size += tail_len;
+                    new_row->data[new_row->size] = '\0';
+                }
+                break;
+            }
+            seg = next + 1;
+        }
+        free(tail);
+    }
+
+    /* The cursor moves with the text it was on */
+    if (buf->cursor_y == y && buf->cursor_x >= x) {
+        buf->cursor_x = end_x + (buf->cursor_x - x);
+        buf->cursor_y = end_y;
+    } else if (buf->cursor_y > y) {
+        buf->cursor_y += end_y - y;
+    }
+
+    buf->modified = true;
+    if (buf->num_rows != old_rows) {
+        buffer_resize_highlighting_cache(buf, old_rows, buf->num_rows);
+    } else {
+        buffer_invalidate_highlighting(buf, y);
+    }
+    return 0;
+}
+
+int buffer_delete_text(Buffer *buf, int x1, int y1, int x2, int y2) {
+    if (!buf) return -1;
+
+    if (y1 > y2 || (y1 == y2 && x1 > x2)) {
+        int tmp = y1; y1 = y2; y2 = tmp;
+        tmp = x1; x1 = x2; x2 = tmp;
+    }
+    if (y1 < 0) { y1 = 0; x1 = 0; }
+    if (x1 < 0) x1 = 0;
+    if (y1 >= (int)buf->num_rows) return 0;
+    if (y2 >= (int)buf->num_rows) {
+        y2 = buf->num_rows - 1;
+        x2 = buffer_row(buf, y2)->size;
+    }
+
+    BufferRow *first = buffer_row(buf, y1);
+    BufferRow *last = buffer_row(buf, y2);
+    if (x1 > (int)first->size) x1 = first->size;
+    if (x2 > (int)last->size) x2 = last->size;
+    if (x2 < 0) x2 = 0;
+    if (y1 == y2 && x2 <= x1) return 0;
+
+    if (buf->undo_stack) {
+        size_t len;
+        char *text = buffer_get_text_range(buf, x1, y1, x2, y2, &len);
+        if (text) {
+            undo_push_delete_text(buf->undo_stack, x1, y1, text, len);
+            free(text);
+        }
+    }
+    if (buf->journal) {
+        journal_record_delete(buf->journal, x1, y1, x2, y2);
+    }
+
+    size_t old_rows = buf->num_rows;
+    first = buffer_row_mut(buf, y1);
+    if (!first) return -1;
+
+    if (y1 == y2) {
+        memmove(&first->data[x1], &first->data[x2], first->size - x2);
+        first->size -= x2 - x1;
+        first->data[first->size] = '\0';
+    } else {
+        /* Keep the start of the first row and the end of the last one */
+        last = buffer_row(buf, y2);
+        size_t keep = last->size - x2;
+        if (!buffer_row_reserve(first, x1 + keep)) return -1;
+        memcpy(&first->data[x1], &last->data[x2], keep);
+        first->size = x1 + keep;
+        first->data[first->size] = '\0';
+        buffer_delete_rows(buf, y1 + 1, y2 - y1);
+    }
+
+    /* Cursor inside the range lands at its start; after it, shifts back */
+    if (buf->cursor_y > y2 || (buf->cursor_y == y2 && buf->cursor_x >= x2)) {
+        if (buf->cursor_y == y2) buf->cursor_x = x1 + (buf->cursor_x - x2);
+        buf->cursor_y -= y2 - y1;
+    } else if (buf->cursor_y > y1 || (buf->cursor_y == y1 && buf->cursor_x > x1)) {
+        buf->cursor_x = x1;
+        buf->cursor_y = y1;
+    }
+
+    buf->modified = true;
+    if (buf->num_rows != old_rows) {
+        buffer_resize_highlighting_cache(buf, old_rows, buf->num_rows);
+    } else {
+        buffer_invalidate_highlighting(buf, y1);
+    }
+    return 0;
+}
+
 BracketMatch buffer_find_matching_bracket(Buffer *buf) {
     BracketMatch result = {-1, -1, false};
 
@@ -372,7 +1411,7 @@ BracketMatch buffer_find_matching_bracket(Buffer *buf) {
         return result;
     }
 
-    BufferRow *row = &buf->rows[buf->cursor_y];
+    BufferRow *row = buffer_row(buf, buf->cursor_y);
     if (buf->cursor_x >= (int)row->size) {
         return result;
     }
@@ -399,7 +1438,7 @@ BracketMatch buffer_find_matching_bracket(Buffer *buf) {
 
     /* Search for matching bracket */
     while (curr_row >= 0 && curr_row < (int)buf->num_rows) {
-        BufferRow *search_row = &buf->rows[curr_row];
+        BufferRow *search_row = buffer_row(buf, curr_row);
 
         if (direction == 1) {
             /* Search forward */
@@ -439,7 +1478,7 @@ BracketMatch buffer_find_matching_bracket(Buffer *buf) {
             }
             curr_row--;
             if (curr_row >= 0) {
-                curr_col = buf->rows[curr_row].size - 1;
+                curr_col = buffer_row(buf, curr_row)->size - 1;
             }
         }
     }
@@ -447,6 +1486,55 @@ BracketMatch buffer_find_matching_bracket(Buffer *buf) {
     return result;  /* No match found */
 }
 
+char *buffer_get_text_range(Buffer *buf, int start_x, int start_y, int end_x, int end_y, size_t *len) {
+    *len = 0;
+    if (!buf) return NULL;
+
+    /* Clamp to the buffer; an end past the last row means its end */
+    if (start_y < 0) { start_y = 0; start_x = 0; }
+    if (start_x < 0) start_x = 0;
+    if (buf->num_rows == 0 || start_y >= (int)buf->num_rows) return strdup("");
+    if (end_y >= (int)buf->num_rows) {
+        end_y = buf->num_rows - 1;
+        end_x = buffer_row(buf, end_y)->size;
+    }
+    if (end_y < start_y || (end_y == start_y && end_x <= start_x)) return strdup("");
+
+    /* Size first, then copy */
+    size_t total = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        char *text = NULL;
+        if (pass == 1) {
+            text = malloc(total + 1);
+            if (!text) return NULL;
+        }
+
+        size_t pos = 0;
+        for (int y = start_y; y <= end_y; y++) {
+            BufferRow *row = buffer_row(buf, y);
+            size_t from = y == start_y ? (size_t)start_x : 0;
+            size_t to = y == end_y ? (size_t)(end_x < 0 ? 0 : end_x) : row->size;
+            if (to > row->size) to = row->size;
+            if (from < to) {
+                if (text) memcpy(text + pos, row->data + from, to - from);
+                pos += to - from;
+            }
+            if (y != end_y) {
+                if (text) text[pos] = '\n';
+                pos++;
+            }
+        }
+
+        if (text) {
+            text[pos] = '\0';
+            *len = pos;
+            return text;
+        }
+        total = pos;
+    }
+    return NULL;
+}
+
 char *buffer_get_selected_text(Buffer *buf, size_t *len) {
     if (!buf || !buf->has_selection) {
         *len = 0;
@@ -465,276 +1553,471 @@ char *buffer_get_selected_text(Buffer *buf, size_t *len) {
         tmp = start_x; start_x = end_x; end_x = tmp;
     }
 
-    /* Calculate total size needed */
-    size_t total_size = 0;
-    for (int y = start_y; y <= end_y && y < (int)buf->num_rows; y++) {
-        BufferRow *row = &buf->rows[y];
-        if (y == start_y && y == end_y) {
-            /* Single line selection */
-            int count = end_x - start_x;
-            if (count > 0 && start_x < (int)row->size) {
-                total_size += count;
+    char *text = buffer_get_text_range(buf, start_x, start_y, end_x, end_y, len);
+    if (text && *len == 0) {
+        free(text);
+        text = NULL;
+    }
+    return text;
+}
+
+void buffer_delete_selection(Buffer *buf) {
+    if (!buf || !buf->has_selection) return;
+
+    buffer_delete_text(buf, buf->select_start_x, buf->select_start_y, buf->cursor_x, buf->cursor_y);
+    buf->has_selection = false;
+}
+
+void buffer_paste_text(Buffer *buf, const char *text, size_t len) {
+    if (!buf || !text || len == 0) return;
+
+    /* Inserted as-is, without auto-indent, so pasted formatting is preserved */
+    if (buf->cursor_y > (int)buf->num_rows) buf->cursor_y = buf->num_rows;
+    buffer_insert_text(buf, buf->cursor_x, buf->cursor_y, text, len);
+}
+
+/* Journal a line replacement as the equivalent text delete + insert */
+static void buffer_journal_set_lines(Buffer *buf, size_t start, size_t end,
+                                     const char *const *lines, const size_t *lens, size_t count) {
+    Journal *j = buf->journal;
+    size_t n = buf->num_rows;
+
+    if (end > start) {
+        journal_record_delete(j, 0, start, buffer_row(buf, end - 1)->size, end - 1);
+        if (count == 0) {
+            /* Remove the row left empty, unless it is the only one */
+            if (end < n) {
+                journal_record_delete(j, 0, start, 0, start + 1);
+            } else if (start > 0) {
+                journal_record_delete(j, buffer_row(buf, start - 1)->size, start - 1, 0, start);
             }
-        } else if (y == start_y) {
-            /* First line of multi-line */
-            total_size += row->size - start_x + 1; /* +1 for newline */
-        } else if (y == end_y) {
-            /* Last line of multi-line */
-            total_size += end_x;
-        } else {
-            /* Middle lines */
-            total_size += row->size + 1; /* +1 for newline */
+            return;
         }
     }
+    if (count == 0) return;
 
-    if (total_size == 0) {
-        *len = 0;
-        return NULL;
-    }
+    bool pure_insert = end == start;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += lens[i] + 1;
 
-    /* Allocate buffer */
-    char *text = malloc(total_size + 1);
-    if (!text) {
-        *len = 0;
-        return NULL;
-    }
+    char *text = malloc(total + 1);
+    if (!text) return;
 
-    /* Copy selected text */
     size_t pos = 0;
-    for (int y = start_y; y <= end_y && y < (int)buf->num_rows; y++) {
-        BufferRow *row = &buf->rows[y];
-        if (y == start_y && y == end_y) {
-            /* Single line selection */
-            int count = end_x - start_x;
-            if (count > 0 && start_x < (int)row->size) {
-                int copy_len = count;
-                if (start_x + copy_len > (int)row->size) {
-                    copy_len = row->size - start_x;
-                }
-                memcpy(text + pos, row->data + start_x, copy_len);
-                pos += copy_len;
-            }
-        } else if (y == start_y) {
-            /* First line */
-            int copy_len = row->size - start_x;
-            if (copy_len > 0) {
-                memcpy(text + pos, row->data + start_x, copy_len);
-                pos += copy_len;
-            }
-            text[pos++] = '\n';
-        } else if (y == end_y) {
-            /* Last line */
-            int copy_len = end_x;
-            if (copy_len > (int)row->size) copy_len = row->size;
-            if (copy_len > 0) {
-                memcpy(text + pos, row->data, copy_len);
-                pos += copy_len;
-            }
-        } else {
-            /* Middle lines */
-            memcpy(text + pos, row->data, row->size);
-            pos += row->size;
-            text[pos++] = '\n';
-        }
+    if (pure_insert && start == n && n > 0) text[pos++] = '\n';
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) text[pos++] = '\n';
+        memcpy(text + pos, lines[i], lens[i]);
+        pos += lens[i];
     }
+    if (pure_insert && start < n) text[pos++] = '\n';
 
-    text[pos] = '\0';
-    *len = pos;
-    return text;
+    if (pure_insert && start == n && n > 0) {
+        journal_record_insert(j, buffer_row(buf, n - 1)->size, n - 1, text, pos);
+    } else {
+        journal_record_insert(j, 0, start, text, pos);
+    }
+    free(text);
 }
 
-void buffer_delete_selection(Buffer *buf) {
-    if (!buf || !buf->has_selection) return;
+int buffer_set_lines(Buffer *buf, size_t start, size_t end,
+                     const char *const *lines, const size_t *lens, size_t count) {
+    if (!buf || start > end || end > buf->num_rows) return -1;
+    if (start == end && count == 0) return 0;
 
-    /* Normalize selection */
-    int start_y = buf->select_start_y;
-    int start_x = buf->select_start_x;
-    int end_y = buf->cursor_y;
-    int end_x = buf->cursor_x;
+    if (buf->journal) {
+        buffer_journal_set_lines(buf, start, end, lines, lens, count);
+    }
 
-    if (start_y > end_y || (start_y == end_y && start_x > end_x)) {
-        int tmp = start_y; start_y = end_y; end_y = tmp;
-        tmp = start_x; start_x = end_x; end_x = tmp;
+    size_t old_rows = buf->num_rows;
+    size_t replaced = end - start;
+    size_t common = replaced < count ? replaced : count;
+
+    /* Rewrite rows in place; identical ones are left alone so they don't count as changed */
+    for (size_t i = 0; i < common; i++) {
+        BufferRow *row = buffer_row(buf, start + i);
+        if (row->size == lens[i] && memcmp(row->data, lines[i], lens[i]) == 0) continue;
+
+        row = buffer_row_mut(buf, start + i);
+        if (!row || !buffer_row_reserve(row, lens[i])) return -1;
+        memcpy(row->data, lines[i], lens[i]);
+        row->size = lens[i];
+        row->data[row->size] = '\0';
     }
 
-    /* Delete selection */
-    if (start_y == end_y) {
-        /* Single line deletion */
-        if (start_y >= (int)buf->num_rows) return;
-        BufferRow *row = &buf->rows[start_y];
+    if (replaced > count) {
+        buffer_delete_rows(buf, start + count, replaced - count);
+        if (buf->num_rows == 0) buffer_insert_row(buf, 0, "", 0);
+    } else {
+        for (size_t i = common; i < count; i++) {
+            if (!buffer_insert_row(buf, start + i, lines[i], lens[i])) return -1;
+        }
+    }
 
-        /* Clamp end_x to row size to prevent out of bounds access */
-        if (end_x > (int)row->size) end_x = row->size;
+    if (buf->num_rows != old_rows) {
+        buffer_resize_highlighting_cache(buf, old_rows, buf->num_rows);
+    } else {
+        buffer_invalidate_highlighting(buf, start);
+    }
 
-        int delete_count = end_x - start_x;
-        if (delete_count > 0 && start_x < (int)row->size) {
-            memmove(&row->data[start_x], &row->data[end_x],
-                    row->size - end_x);
-            row->size -= delete_count;
-            row->data[row->size] = '\0';
-        }
+    /* Keep the cursor on the text */
+    if (buf->cursor_y >= (int)buf->num_rows) {
+        buf->cursor_y = buf->num_rows > 0 ? (int)buf->num_rows - 1 : 0;
+    }
+    BufferRow *cursor_row = buffer_row(buf, buf->cursor_y);
+    if (cursor_row && buf->cursor_x > (int)cursor_row->size) {
+        buf->cursor_x = cursor_row->size;
+    }
 
-        buf->cursor_x = start_x;
-        buf->cursor_y = start_y;
+    buf->modified = true;
+    return 0;
+}
 
-        /* Invalidate highlighting for this line and onwards */
-        buffer_invalidate_highlighting(buf, start_y);
-    } else {
-        /* Multi-line deletion */
-        if (start_y >= (int)buf->num_rows || end_y >= (int)buf->num_rows) return;
+int buffer_set_text(Buffer *buf, size_t start, size_t end, const char *text, size_t len) {
+    size_t count = 1;
+    for (const char *p = text; (p = memchr(p, '\n', text + len - p)); p++) count++;
 
-        BufferRow *start_row = &buf->rows[start_y];
-        BufferRow *end_row = &buf->rows[end_y];
+    const char **lines = malloc(sizeof(char *) * count);
+    size_t *lens = malloc(sizeof(size_t) * count);
+    if (!lines || !lens) {
+        free(lines);
+        free(lens);
+        return -1;
+    }
 
-        /* Clamp end_x to prevent underflow with unsigned arithmetic */
-        if (end_x > (int)end_row->size) end_x = end_row->size;
+    const char *line = text;
+    for (size_t i = 0; i < count; i++) {
+        const char *nl = memchr(line, '\n', text + len - line);
+        lines[i] = line;
+        lens[i] = nl ? (size_t)(nl - line) : (size_t)(text + len - line);
+        line += lens[i] + 1;
+    }
 
-        /* Keep start of first line and end of last line */
-        size_t new_size = start_x + (end_row->size - end_x);
-        while (start_row->capacity < new_size + 1) {
-            start_row->capacity *= 2;
-            char *new_data = realloc(start_row->data, start_row->capacity);
-            if (!new_data) return;
-            start_row->data = new_data;
-        }
+    int result = buffer_set_lines(buf, start, end, lines, lens, count);
+    free(lines);
+    free(lens);
+    return result;
+}
 
-        /* Copy end part */
-        memcpy(&start_row->data[start_x], &end_row->data[end_x],
-               end_row->size - end_x);
-        start_row->size = new_size;
-        start_row->data[start_row->size] = '\0';
+/* ===== Reloading from disk ===== */
 
-        /* Delete rows in between */
-        for (int y = start_y + 1; y <= end_y; y++) {
-            buffer_free_row(&buf->rows[y]);
-        }
+/* Changed rows highlighted up front by a reload; past this the rest of the
+ * buffer is left to be highlighted on display */
+#define RELOAD_HIGHLIGHT_MAX 10000
 
-        /* Shift remaining rows */
-        int rows_deleted = end_y - start_y;
-        if (end_y + 1 < (int)buf->num_rows) {
-            memmove(&buf->rows[start_y + 1], &buf->rows[end_y + 1],
-                    sizeof(BufferRow) * (buf->num_rows - end_y - 1));
-        }
+static BufferReloadCallback reload_listener = NULL;
+static void *reload_listener_data = NULL;
 
-        size_t old_rows = buf->num_rows;
-        buf->num_rows -= rows_deleted;
+void buffer_set_reload_listener(BufferReloadCallback cb, void *data) {
+    reload_listener = cb;
+    reload_listener_data = data;
+}
 
-        /* Resize highlighting cache after deleting rows */
-        buffer_resize_highlighting_cache(buf, old_rows, buf->num_rows);
+static void buffer_notify_reload(Buffer *buf, BufferReloadStatus status,
+                                 const BufferDelta *deltas, size_t count) {
+    if (reload_listener) reload_listener(buf, status, deltas, count, reload_listener_data);
+}
 
-        buf->cursor_x = start_x;
-        buf->cursor_y = start_y;
+/* Remember the file as it is on disk now, to tell later changes from it */
+static void buffer_note_disk(Buffer *buf) {
+    struct stat st;
+    if (buf->filename && stat(buf->filename, &st) == 0) {
+        buf->disk_size = (long long)st.st_size;
+        buf->disk_mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    } else {
+        buf->disk_size = -1;
+        buf->disk_mtime = 0;
     }
-
-    buf->has_selection = false;
-    buf->modified = true;
 }
 
-void buffer_paste_text(Buffer *buf, const char *text, size_t len) {
-    if (!buf || !text || len == 0) return;
+static void buffer_file_changed(void *data) {
+    Buffer *buf = data;
 
-    /* Find newlines in text */
-    size_t line_start = 0;
-    bool first_line = true;
+    /* Our own save in progress: it notes the file once written */
+    if (buf->save_job) return;
 
-    for (size_t i = 0; i <= len; i++) {
-        if (i == len || text[i] == '\n') {
-            size_t line_len = i - line_start;
+    long long size = buf->disk_size, mtime = buf->disk_mtime;
+    buffer_note_disk(buf);
+    if (buf->disk_size == size && buf->disk_mtime == mtime) return;
 
-            if (first_line) {
-                /* Insert at cursor position */
-                if (buf->cursor_y >= (int)buf->num_rows) {
-                    buffer_append_row(buf, "", 0);
-                }
+    if (buf->disk_size == -1) {
+        buffer_notify_reload(buf, BUFFER_RELOAD_GONE, NULL, 0);
+    } else if (buf->modified) {
+        buffer_notify_reload(buf, BUFFER_RELOAD_KEPT, NULL, 0);
+    } else {
+        buffer_reload(buf);
+    }
+}
 
-                BufferRow *row = &buf->rows[buf->cursor_y];
+/* Note the file as loaded or saved, and follow it from now on */
+static void buffer_watch_file(Buffer *buf) {
+    buffer_note_disk(buf);
+    if (!buf->file_watch && buf->filename) {
+        int id = file_watch_add(buf->filename, buffer_file_changed, buf);
+        buf->file_watch = id > 0 ? id : 0;
+    }
+}
 
-                /* Ensure capacity */
-                while (row->capacity < row->size + line_len + 1) {
-                    row->capacity *= 2;
-                    char *new_data = realloc(row->data, row->capacity);
-                    if (!new_data) return;
-                    row->data = new_data;
-                }
+static char *read_whole_file(const char *filename, size_t *len) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    size_t capacity = fstat(fd, &st) == 0 && st.st_size > 0 ? (size_t)st.st_size + 1 : 4096;
+    char *data = malloc(capacity);
+    size_t size = 0;
+    while (data) {
+        if (size == capacity) {
+            char *grown = realloc(data, capacity * 2);
+            if (!grown) break;
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, data + size, capacity - size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0) {
+                close(fd);
+                *len = size;
+                return data;
+            }
+            break;
+        }
+        size += (size_t)n;
+    }
+    free(data);
+    close(fd);
+    return NULL;
+}
 
-                /* Insert text */
-                memmove(&row->data[buf->cursor_x + line_len],
-                        &row->data[buf->cursor_x],
-                        row->size - buf->cursor_x);
-                memcpy(&row->data[buf->cursor_x], &text[line_start], line_len);
-                row->size += line_len;
-                row->data[row->size] = '\0';
+/* Rows [from, to) of lines joined with '\n', for the undo step */
+static char *join_lines(const DiffLine *lines, size_t from, size_t to, size_t *len) {
+    size_t total = 0;
+    for (size_t i = from; i < to; i++) total += lines[i].len + 1;
+    char *text = malloc(total + 1);
+    if (!text) return NULL;
+
+    char *p = text;
+    for (size_t i = from; i < to; i++) {
+        if (i > from) *p++ = '\n';
+        memcpy(p, lines[i].data, lines[i].len);
+        p += lines[i].len;
+    }
+    *len = (size_t)(p - text);
+    return text;
+}
 
-                buf->cursor_x += line_len;
-                first_line = false;
-            } else {
-                /* New line - insert without auto-indent to preserve pasted formatting */
-                if (buf->cursor_y >= (int)buf->num_rows) {
-                    buffer_append_row(buf, "", 0);
-                    buf->cursor_y++;
-                } else {
-                    /* Split current row at cursor without auto-indent */
-                    BufferRow *row = &buf->rows[buf->cursor_y];
-                    const char *rest = (buf->cursor_x < (int)row->size) ? &row->data[buf->cursor_x] : "";
-                    size_t rest_len = (buf->cursor_x < (int)row->size) ? row->size - buf->cursor_x : 0;
-
-                    /* Truncate current row */
-                    row->size = buf->cursor_x;
-                    row->data[row->size] = '\0';
-
-                    /* Make space for new row */
-                    if (buf->num_rows >= buf->capacity) {
-                        size_t new_capacity = buf->capacity == 0 ? 16 : buf->capacity * 2;
-                        BufferRow *new_rows = realloc(buf->rows, sizeof(BufferRow) * new_capacity);
-                        if (!new_rows) return;
-                        buf->rows = new_rows;
-                        buf->capacity = new_capacity;
+size_t buffer_map_row(const BufferDelta *deltas, size_t count, size_t row) {
+    ptrdiff_t shift = 0;
+    for (size_t k = 0; k < count; k++) {
+        const BufferDelta *d = &deltas[k];
+        size_t old_start = (size_t)((ptrdiff_t)d->row - shift);
+        if (row < old_start) break;
+        if (row < old_start + d->old_rows) {
+            size_t offset = row - old_start;
+            if (d->new_rows == 0) return d->row;
+            return d->row + (offset < d->new_rows ? offset : d->new_rows - 1);
+        }
+        shift += (ptrdiff_t)d->new_rows - (ptrdiff_t)d->old_rows;
+    }
+    return (size_t)((ptrdiff_t)row + shift);
+}
+
+/* Carry cached highlighting over to the patched rows. A row that did not
+ * change keeps its highlighting as long as the multiline state coming into
+ * it is the one it was highlighted after; changed rows are highlighted now,
+ * and so are the unchanged ones after them until the states agree again. */
+static void buffer_remap_highlighting(Buffer *buf, HighlightedLine **old_lines, bool *old_states,
+                                      size_t old_rows, const bool *a_changed, const bool *b_changed) {
+    buf->highlighted_lines = calloc(buf->num_rows, sizeof(HighlightedLine *));
+    buf->multiline_states = calloc(buf->num_rows, sizeof(bool));
+    HighlightedLine **lines = buf->highlighted_lines;
+    bool *states = buf->multiline_states;
+
+    if (lines && states) {
+        bool state = false;         /* Multiline state after the previous row */
+        bool settled = true;        /* state is what the old highlighting assumed */
+        size_t budget = RELOAD_HIGHLIGHT_MAX;
+        size_t j = 0;
+        for (size_t i = 0; i < buf->num_rows; i++) {
+            if (!b_changed[i]) {
+                while (a_changed[j]) j++;
+                bool before = j > 0 && old_states ? old_states[j - 1] : false;
+                bool cached = old_lines && old_lines[j];
+                if (settled || (cached && before == state)) {
+                    if (old_lines) {
+                        lines[i] = old_lines[j];
+                        old_lines[j] = NULL;
                     }
+                    states[i] = old_states ? old_states[j] : false;
+                    state = states[i];
+                    settled = true;
+                    j++;
+                    continue;
+                }
+                j++;
 
-                    /* Shift rows down */
-                    memmove(&buf->rows[buf->cursor_y + 2], &buf->rows[buf->cursor_y + 1],
-                            sizeof(BufferRow) * (buf->num_rows - buf->cursor_y - 1));
+                /* Not highlighted before: nothing to compare with further on */
+                if (!cached) break;
+            }
 
-                    /* Insert new row */
-                    BufferRow *new_row = &buf->rows[buf->cursor_y + 1];
-                    new_row->capacity = rest_len + 1;
-                    new_row->data = malloc(new_row->capacity);
-                    if (!new_row->data) return;
+            if (budget == 0) break;
+            budget--;
+            HighlightedLine *hl = syntax_highlight_line(buf->syntax, buffer_row(buf, i)->data, state);
+            lines[i] = hl;
+            states[i] = hl ? hl->in_multiline : false;
+            state = states[i];
+            settled = !b_changed[i] && old_states && state == old_states[j - 1];
+        }
+    }
 
-                    memcpy(new_row->data, rest, rest_len);
-                    new_row->data[rest_len] = '\0';
-                    new_row->size = rest_len;
+    /* Whatever was not carried over */
+    if (old_lines) {
+        for (size_t j = 0; j < old_rows; j++) {
+            if (old_lines[j]) syntax_free_highlighted_line(old_lines[j]);
+        }
+    }
+    free(old_lines);
+    free(old_states);
+}
 
-                    buf->num_rows++;
-                    buf->cursor_y++;
-                }
-                buf->cursor_x = 0;
+int buffer_reload(Buffer *buf) {
+    if (!buf || !buf->filename) return -1;
 
-                if (line_len > 0) {
-                    BufferRow *row = &buf->rows[buf->cursor_y];
+    size_t len;
+    char *text = read_whole_file(buf->filename, &len);
+    if (!text) return -1;
 
-                    while (row->capacity < line_len + 1) {
-                        row->capacity = row->capacity == 0 ? 128 : row->capacity * 2;
-                        char *new_data = realloc(row->data, row->capacity);
-                        if (!new_data) return;
-                        row->data = new_data;
-                    }
+    /* Split the way buffer_open does; an empty file is one empty row */
+    size_t nb = 0;
+    for (const char *p = text; p < text + len; nb++) {
+        const char *nl = memchr(p, '\n', text + len - p);
+        p = nl ? nl + 1 : text + len;
+    }
+    size_t na = buf->num_rows;
+    DiffLine *a = malloc(sizeof(DiffLine) * (na ? na : 1));
+    DiffLine *b = malloc(sizeof(DiffLine) * (nb ? nb : 1));
+    bool *a_changed = malloc(na ? na : 1);
+    bool *b_changed = malloc(nb ? nb : 1);
+    BufferDelta *deltas = malloc(sizeof(BufferDelta) * ((na < nb ? na : nb) + 1));
+    char *old_text = NULL, *new_text = NULL;
+    int result = -1;
+    if (!a || !b || !a_changed || !b_changed || !deltas) goto out;
+
+    const char *p = text;
+    for (size_t i = 0; i < nb; i++) {
+        const char *nl = memchr(p, '\n', text + len - p);
+        size_t n = nl ? (size_t)(nl - p) : (size_t)(text + len - p);
+        while (n > 0 && p[n - 1] == '\r') n--;
+        b[i] = (DiffLine){p, n, diff_hash_line(p, n)};
+        p = nl ? nl + 1 : text + len;
+    }
+    if (nb == 0) {
+        b[0] = (DiffLine){"", 0, diff_hash_line("", 0)};
+        nb = 1;
+    }
+    for (size_t i = 0; i < na; i++) {
+        const BufferRow *row = buffer_row(buf, i);
+        a[i] = (DiffLine){row->data, row->size, diff_hash_line(row->data, row->size)};
+    }
+    if (diff_lines(a, na, b, nb, a_changed, b_changed) == -1) goto out;
+
+    /* Runs of changed rows, in rows as they are once the runs above are patched */
+    size_t count = 0;
+    for (size_t i = 0, j = 0; i < na || j < nb; ) {
+        if (i < na && j < nb && !a_changed[i] && !b_changed[j]) {
+            i++;
+            j++;
+            continue;
+        }
+        BufferDelta *d = &deltas[count++];
+        d->row = j;
+        d->old_rows = d->new_rows = 0;
+        while (i < na && a_changed[i]) {
+            i++;
+            d->old_rows++;
+        }
+        while (j < nb && b_changed[j]) {
+            j++;
+            d->new_rows++;
+        }
+    }
 
-                    memcpy(row->data, &text[line_start], line_len);
-                    row->size = line_len;
-                    row->data[row->size] = '\0';
-                    buf->cursor_x = line_len;
-                }
+    if (count > 0) {
+        /* One undo step from the first change to the last */
+        BufferDelta *last = &deltas[count - 1];
+        size_t first = deltas[0].row;
+        size_t new_end = last->row + last->new_rows;
+        size_t old_end = new_end + na - nb;
+        size_t old_len, new_len;
+        old_text = join_lines(a, first, old_end, &old_len);
+        new_text = join_lines(b, first, new_end, &new_len);
+        if (!old_text || !new_text) goto out;
+
+        /* The cache is rebuilt below, from what is still valid */
+        HighlightedLine **old_lines = buf->highlighted_lines;
+        bool *old_states = buf->multiline_states;
+        buf->highlighted_lines = NULL;
+        buf->multiline_states = NULL;
+
+        for (size_t k = 0; k < count; k++) {
+            const BufferDelta *d = &deltas[k];
+            size_t common = d->old_rows < d->new_rows ? d->old_rows : d->new_rows;
+            for (size_t r = 0; r < common; r++) {
+                const DiffLine *line = &b[d->row + r];
+                BufferRow *row = buffer_row_mut(buf, d->row + r);
+                if (!row || !buffer_row_reserve(row, line->len)) continue;
+                memcpy(row->data, line->data, line->len);
+                row->size = line->len;
+                row->data[row->size] = '\0';
+            }
+            if (d->old_rows > common) {
+                buffer_delete_rows(buf, d->row + common, d->old_rows - common);
+            }
+            for (size_t r = common; r < d->new_rows; r++) {
+                const DiffLine *line = &b[d->row + r];
+                buffer_insert_row(buf, d->row + r, line->data, line->len);
             }
+        }
 
-            line_start = i + 1;
+        if (buf->syntax) {
+            buffer_remap_highlighting(buf, old_lines, old_states, na, a_changed, b_changed);
+        } else {
+            free(old_states);
+            free(old_lines);
         }
-    }
 
-    buf->modified = true;
+        /* The cursor and selection stay on their text */
+        buf->cursor_y = (int)buffer_map_row(deltas, count, (size_t)buf->cursor_y);
+        if (buf->cursor_y >= (int)buf->num_rows) buf->cursor_y = (int)buf->num_rows - 1;
+        BufferRow *cursor_row = buffer_row(buf, buf->cursor_y);
+        if (cursor_row && buf->cursor_x > (int)cursor_row->size) buf->cursor_x = (int)cursor_row->size;
+        if (buf->has_selection) {
+            buf->select_start_y = (int)buffer_map_row(deltas, count, (size_t)buf->select_start_y);
+            if (buf->select_start_y >= (int)buf->num_rows) buf->select_start_y = (int)buf->num_rows - 1;
+        }
 
-    /* Invalidate all highlighting since we may have inserted multiple lines */
-    if (buf->highlighted_lines) {
-        buffer_invalidate_highlighting(buf, 0);
+        if (buf->undo_stack) {
+            undo_push_replace_lines(buf->undo_stack, (int)first, old_text, old_len, new_text, new_len);
+        }
     }
+
+    /* The buffer is the file again */
+    buf->modified = false;
+    if (buf->journal) journal_reset(buf->journal, buf->filename);
+    buffer_note_disk(buf);
+
+    if (count > 0) buffer_notify_reload(buf, BUFFER_RELOADED, deltas, count);
+    result = (int)count;
+
+out:
+    free(old_text);
+    free(new_text);
+    free(deltas);
+    free(a_changed);
+    free(b_changed);
+    free(a);
+    free(b);
+    free(text);
+    return result;
 }
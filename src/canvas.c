@@ -0,0 +1,217 @@
+#define _POSIX_C_SOURCE 200809L
+#include "canvas.h"
+#include "terminal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* A style is either a highlight type, looked up in the active theme at each
+ * flush so theme switches apply, or a fixed SGR escape */
+typedef struct {
+    int hl;         /* HighlightType, or -1 */
+    char *sgr;
+} CanvasStyle;
+
+static CanvasStyle styles[CANVAS_MAX_STYLES] = {{-1, NULL}};
+static int num_styles = 1;  /* 0: terminal default */
+
+int canvas_style_highlight(HighlightType type) {
+    if (type < 0 || type >= HL_MAX) return -1;
+
+    for (int i = 1; i < num_styles; i++) {
+        if (styles[i].hl == (int)type) return i;
+    }
+    if (num_styles >= CANVAS_MAX_STYLES) return -1;
+
+    styles[num_styles].hl = type;
+    styles[num_styles].sgr = NULL;
+    return num_styles++;
+}
+
+int canvas_style_sgr(const char *sgr) {
+    if (!sgr) return -1;
+    if (!*sgr) return 0;
+
+    for (int i = 1; i < num_styles; i++) {
+        if (styles[i].sgr && strcmp(styles[i].sgr, sgr) == 0) return i;
+    }
+    if (num_styles >= CANVAS_MAX_STYLES) return -1;
+
+    char *copy = strdup(sgr);
+    if (!copy) return -1;
+    styles[num_styles].hl = -1;
+    styles[num_styles].sgr = copy;
+    return num_styles++;
+}
+
+static void write_style(Terminal *term, uint8_t style) {
+    /* Every style starts from the default, so attributes never leak */
+    terminal_write_str(term, "\x1b[0m");
+    if (style == 0 || style >= num_styles) return;
+
+    if (styles[style].hl >= 0) {
+        char code[64];
+        colors_to_ansi_themed((HighlightType)styles[style].hl, code, sizeof(code));
+        terminal_write_str(term, code);
+    } else {
+        terminal_write_str(term, styles[style].sgr);
+    }
+}
+
+static void blank_cells(CanvasCell *cells, size_t count, uint8_t style) {
+    for (size_t i = 0; i < count; i++) {
+        cells[i].len = 0;
+        cells[i].style = style;
+    }
+}
+
+Canvas *canvas_create(int width, int height) {
+    Canvas *canvas = calloc(1, sizeof(Canvas));
+    if (!canvas) return NULL;
+
+    if (canvas_resize(canvas, width, height) != 0) {
+        free(canvas);
+        return NULL;
+    }
+    return canvas;
+}
+
+void canvas_destroy(Canvas *canvas) {
+    if (!canvas) return;
+    free(canvas->cells);
+    free(canvas->shown);
+    free(canvas);
+}
+
+int canvas_resize(Canvas *canvas, int width, int height) {
+    if (width < 0) width = 0;
+    if (height < 0) height = 0;
+    if (canvas->cells && width == canvas->width && height == canvas->height) return 0;
+
+    size_t count = (size_t)width * height;
+    CanvasCell *cells = malloc((count ? count : 1) * sizeof(CanvasCell));
+    CanvasCell *shown = malloc((count ? count : 1) * sizeof(CanvasCell));
+    if (!cells || !shown) {
+        free(cells);
+        free(shown);
+        return -1;
+    }
+
+    free(canvas->cells);
+    free(canvas->shown);
+    canvas->cells = cells;
+    canvas->shown = shown;
+    canvas->width = width;
+    canvas->height = height;
+    canvas->shown_valid = false;
+    blank_cells(cells, count, 0);
+    return 0;
+}
+
+/* Length of the UTF-8 sequence at s, or 0 if it is not a valid one */
+static size_t utf8_char_len(const char *s, size_t avail) {
+    unsigned char c = (unsigned char)s[0];
+    size_t len = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 :
+                 (c & 0xF8) == 0xF0 ? 4 : 0;
+    if (len == 0 || len > avail) return 0;
+    for (size_t i = 1; i < len; i++) {
+        if (((unsigned char)s[i] & 0xC0) != 0x80) return 0;
+    }
+    return len;
+}
+
+/* Store one character; anything that would move the cursor becomes '?' */
+static void set_cell(CanvasCell *cell, const char *ch, size_t len, uint8_t style) {
+    if (len == 1 && ((unsigned char)ch[0] < 0x20 || ch[0] == 0x7f)) {
+        ch = "?";
+    } else if (len == 1 && ch[0] == ' ') {
+        len = 0;  /* Blanks compare equal however they were drawn */
+    }
+    memcpy(cell->text, ch, len);
+    cell->len = len;
+    cell->style = style;
+}
+
+void canvas_fill(Canvas *canvas, int x, int y, int width, int height,
+                 const char *ch, size_t ch_len, uint8_t style) {
+    if (x < 0) { width += x; x = 0; }
+    if (y < 0) { height += y; y = 0; }
+    if (width > canvas->width - x) width = canvas->width - x;
+    if (height > canvas->height - y) height = canvas->height - y;
+    if (width <= 0 || height <= 0) return;
+
+    size_t len = ch && ch_len > 0 ? utf8_char_len(ch, ch_len) : 0;
+    if (len == 0) ch = " ", len = 1;
+
+    for (int row = y; row < y + height; row++) {
+        CanvasCell *cells = &canvas->cells[(size_t)row * canvas->width];
+        for (int col = x; col < x + width; col++) set_cell(&cells[col], ch, len, style);
+    }
+}
+
+int canvas_put(Canvas *canvas, int x, int y, const char *text, size_t len, uint8_t style) {
+    if (y < 0 || y >= canvas->height) return 0;
+
+    CanvasCell *cells = &canvas->cells[(size_t)y * canvas->width];
+    int written = 0;
+    size_t i = 0;
+    for (int col = x; i < len && col < canvas->width; col++) {
+        size_t n = utf8_char_len(text + i, len - i);
+        const char *ch = text + i;
+        if (n == 0) {
+            ch = "?";  /* Stray byte */
+            i++;
+            n = 1;
+        } else {
+            i += n;
+        }
+
+        /* Characters left of the canvas still take their columns */
+        if (col >= 0) {
+            set_cell(&cells[col], ch, n, style);
+            written++;
+        }
+    }
+    return written;
+}
+
+static bool same_cell(const CanvasCell *a, const CanvasCell *b) {
+    return a->len == b->len && a->style == b->style && memcmp(a->text, b->text, a->len) == 0;
+}
+
+void canvas_flush(Canvas *canvas, Terminal *term, int x, int y) {
+    bool full = !canvas->shown_valid || canvas->shown_x != x || canvas->shown_y != y ||
+                canvas->shown_clears != term->clears;
+    int style = -1;
+
+    for (int row = 0; row < canvas->height; row++) {
+        size_t base = (size_t)row * canvas->width;
+        int cursor = -1;  /* Column the terminal cursor is at, if known */
+
+        for (int col = 0; col < canvas->width; col++) {
+            const CanvasCell *cell = &canvas->cells[base + col];
+            CanvasCell *shown = &canvas->shown[base + col];
+            if (!full && same_cell(cell, shown)) continue;
+
+            if (cursor != col) terminal_move_cursor(term, y + row, x + col);
+            if (cell->style != style) {
+                write_style(term, cell->style);
+                style = cell->style;
+            }
+            if (cell->len > 0) {
+                terminal_write(term, cell->text, cell->len);
+            } else {
+                terminal_write(term, " ", 1);
+            }
+            *shown = *cell;
+            cursor = col + 1;
+        }
+    }
+
+    if (style > 0) terminal_write_str(term, "\x1b[0m");
+
+    canvas->shown_x = x;
+    canvas->shown_y = y;
+    canvas->shown_clears = term->clears;
+    canvas->shown_valid = true;
+}
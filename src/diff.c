@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+#include "diff.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/* Below this many edit steps per split the search stays exact */
+#define DIFF_MIN_COST 1024
+
+typedef struct {
+    const DiffLine *a;
+    const DiffLine *b;
+    bool *a_changed;
+    bool *b_changed;
+    long *fdiag;        /* Furthest x reached on each diagonal, forward search */
+    long *bdiag;        /* Same for the backward search */
+    long too_expensive;
+} DiffContext;
+
+uint64_t diff_hash_line(const char *data, size_t len) {
+    /* FNV-1a */
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static inline bool lines_equal(const DiffContext *c, long x, long y) {
+    const DiffLine *la = &c->a[x];
+    const DiffLine *lb = &c->b[y];
+    return la->hash == lb->hash && la->len == lb->len &&
+           (la->len == 0 || memcmp(la->data, lb->data, la->len) == 0);
+}
+
+/* Find the midpoint of a shortest edit script for a[xoff,xlim) / b[yoff,ylim)
+ * by running the search from both ends until the paths overlap. */
+static void diff_split(DiffContext *c, long xoff, long xlim, long yoff, long ylim,
+                       long *xmid, long *ymid) {
+    long *fd = c->fdiag;
+    long *bd = c->bdiag;
+    long dmin = xoff - ylim;
+    long dmax = xlim - yoff;
+    long fmid = xoff - yoff;
+    long bmid = xlim - ylim;
+    long fmin = fmid, fmax = fmid;
+    long bmin = bmid, bmax = bmid;
+    bool odd = (fmid - bmid) & 1;
+
+    fd[fmid] = xoff;
+    bd[bmid] = xlim;
+
+    for (long cost = 1;; cost++) {
+        /* Forward: extend each diagonal by one edit, then follow the snake */
+        if (fmin > dmin) fd[--fmin - 1] = -1; else ++fmin;
+        if (fmax < dmax) fd[++fmax + 1] = -1; else --fmax;
+        for (long d = fmax; d >= fmin; d -= 2) {
+            long tlo = fd[d - 1], thi = fd[d + 1];
+            long x = tlo >= thi ? tlo + 1 : thi;
+            long y = x - d;
+            while (x < xlim && y < ylim && lines_equal(c, x, y)) {
+                x++;
+                y++;
+            }
+            fd[d] = x;
+            if (odd && bmin <= d && d <= bmax && bd[d] <= x) {
+                *xmid = x;
+                *ymid = y;
+                return;
+            }
+        }
+
+        /* Backward */
+        if (bmin > dmin) bd[--bmin - 1] = LONG_MAX; else ++bmin;
+        if (bmax < dmax) bd[++bmax + 1] = LONG_MAX; else --bmax;
+        for (long d = bmax; d >= bmin; d -= 2) {
+            long tlo = bd[d - 1], thi = bd[d + 1];
+            long x = tlo < thi ? tlo : thi - 1;
+            long y = x - d;
+            while (x > xoff && y > yoff && lines_equal(c, x - 1, y - 1)) {
+                x--;
+                y--;
+            }
+            bd[d] = x;
+            if (!odd && fmin <= d && d <= fmax && x <= fd[d]) {
+                *xmid = x;
+                *ymid = y;
+                return;
+            }
+        }
+
+        if (cost >= c->too_expensive) {
+            /* Give up on minimal: split where the forward search got furthest */
+            long best = -1;
+            for (long d = fmax; d >= fmin; d -= 2) {
+                long x = fd[d] < xlim ? fd[d] : xlim;
+                long y = x - d;
+                if (y > ylim) {
+                    x = ylim + d;
+                    y = ylim;
+                }
+                if (x + y > best) {
+                    best = x + y;
+                    *xmid = x;
+                    *ymid = y;
+                }
+            }
+            return;
+        }
+    }
+}
+
+static void diff_compare(DiffContext *c, long xoff, long xlim, long yoff, long ylim) {
+    /* Common prefix and suffix are never part of the edit */
+    while (xoff < xlim && yoff < ylim && lines_equal(c, xoff, yoff)) {
+        xoff++;
+        yoff++;
+    }
+    while (xlim > xoff && ylim > yoff && lines_equal(c, xlim - 1, ylim - 1)) {
+        xlim--;
+        ylim--;
+    }
+
+    if (xoff == xlim) {
+        for (long y = yoff; y < ylim; y++) c->b_changed[y] = true;
+        return;
+    }
+    if (yoff == ylim) {
+        for (long x = xoff; x < xlim; x++) c->a_changed[x] = true;
+        return;
+    }
+
+    long xmid = xoff, ymid = yoff;
+    diff_split(c, xoff, xlim, yoff, ylim, &xmid, &ymid);
+
+    /* A heuristic split can land on a corner; treat the rest as one change */
+    if ((xmid == xoff && ymid == yoff) || (xmid == xlim && ymid == ylim)) {
+        for (long x = xoff; x < xlim; x++) c->a_changed[x] = true;
+        for (long y = yoff; y < ylim; y++) c->b_changed[y] = true;
+        return;
+    }
+
+    diff_compare(c, xoff, xmid, yoff, ymid);
+    diff_compare(c, xmid, xlim, ymid, ylim);
+}
+
+int diff_lines(const DiffLine *a, size_t na, const DiffLine *b, size_t nb,
+               bool *a_changed, bool *b_changed) {
+    if (na > 0) memset(a_changed, 0, na * sizeof(bool));
+    if (nb > 0) memset(b_changed, 0, nb * sizeof(bool));
+
+    /* Diagonals run from -nb-1 to na+1 */
+    size_t diags = na + nb + 3;
+    long *storage = malloc(2 * diags * sizeof(long));
+    if (!storage) return -1;
+
+    DiffContext c;
+    c.a = a;
+    c.b = b;
+    c.a_changed = a_changed;
+    c.b_changed = b_changed;
+    c.fdiag = storage + nb + 1;
+    c.bdiag = c.fdiag + diags;
+
+    /* Roughly sqrt(diags), so pathological inputs stay near O(N^1.5) */
+    c.too_expensive = 1;
+    for (size_t d = diags; d != 0; d >>= 2) c.too_expensive <<= 1;
+    if (c.too_expensive < DIFF_MIN_COST) c.too_expensive = DIFF_MIN_COST;
+
+    diff_compare(&c, 0, (long)na, 0, (long)nb);
+
+    free(storage);
+    return 0;
+}
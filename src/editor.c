@@ -6,8 +6,15 @@
 #include "lua_bridge.h"
 #include "keybind.h"
 #include "syntax.h"
+#include "syntax_bundle.h"
 #include "colors.h"
 #include "undo.h"
+#include "journal.h"
+#include "event_loop.h"
+#include "process.h"
+#include "git.h"
+#include "project_search.h"
+#include "file_watch.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -33,6 +40,47 @@ static char *get_config_dir(void) {
     return config_dir;
 }
 
+/* Keep the windows on a reloaded buffer showing the same text */
+static void editor_scroll_reloaded(Window *root, Buffer *buf, const BufferDelta *deltas, size_t count) {
+    Window *leaves[256];
+    int n = 0;
+    window_collect_all_leaves(root, leaves, &n, 256);
+    for (int i = 0; i < n; i++) {
+        Window *win = leaves[i];
+        if (win->content_type != CONTENT_BUFFER || win->content.buffer != buf) continue;
+        win->row_offset = (int)buffer_map_row(deltas, count, (size_t)win->row_offset);
+        if (win->row_offset >= (int)buf->num_rows) win->row_offset = buf->num_rows > 0 ? (int)buf->num_rows - 1 : 0;
+    }
+}
+
+/* A buffer's file changed on disk */
+static void editor_buffer_reloaded(Buffer *buf, BufferReloadStatus status,
+                                   const BufferDelta *deltas, size_t count, void *data) {
+    Editor *ed = data;
+    char msg[256];
+
+    switch (status) {
+        case BUFFER_RELOADED: {
+            bool root_in_tab = false;
+            for (TabGroup *tab = ed->tab_groups; tab; tab = tab->next) {
+                editor_scroll_reloaded(tab->root_window, buf, deltas, count);
+                if (tab->root_window == ed->root_window) root_in_tab = true;
+            }
+            if (!root_in_tab) editor_scroll_reloaded(ed->root_window, buf, deltas, count);
+            snprintf(msg, sizeof(msg), "%s changed on disk - reloaded (%zu change%s)",
+                     buf->filename, count, count == 1 ? "" : "s");
+            break;
+        }
+        case BUFFER_RELOAD_KEPT:
+            snprintf(msg, sizeof(msg), "%s changed on disk - not reloaded over unsaved edits", buf->filename);
+            break;
+        case BUFFER_RELOAD_GONE:
+            snprintf(msg, sizeof(msg), "%s was deleted on disk", buf->filename);
+            break;
+    }
+    editor_set_status(ed, msg);
+}
+
 Editor *editor_create(void) {
     Editor *ed = malloc(sizeof(Editor));
     if (!ed) return NULL;
@@ -55,6 +103,7 @@ Editor *editor_create(void) {
     ed->next_tab_id = 1;
 
     ed->running = true;
+    ed->screen_stale = true;
     ed->lua_state = NULL;
 
     ed->status_len = 0;
@@ -70,6 +119,7 @@ Editor *editor_create(void) {
 
     /* Initialize display options */
     ed->show_line_numbers = true;  /* Line numbers on by default */
+    ed->git_gutter = false;        /* Enabled by the git plugin */
 
     /* Initialize tab settings */
     ed->tab_width = 4;       /* Default to 4 spaces */
@@ -86,6 +136,32 @@ Editor *editor_create(void) {
     colors_init();
     syntax_init();
 
+    /* Precompiled syntax definitions, except languages whose plugins were
+     * edited since - checked in the order plugins are loaded from */
+    if (ed->config_dir) {
+        char bundle_path[512];
+        char plugin_dir[512];
+        snprintf(bundle_path, sizeof(bundle_path), "%s/syntax.bundle", ed->config_dir);
+        snprintf(plugin_dir, sizeof(plugin_dir), "%s/plugins", ed->config_dir);
+        const char *plugin_dirs[] = { "./plugins", plugin_dir };
+        syntax_bundle_load(bundle_path, plugin_dirs, 2);
+    }
+
+    /* New files are saved with the umask; read it while no thread can race */
+    buffer_save_init();
+
+    /* Start the background swap file writer */
+    journal_init();
+
+    /* Main loop wakeups for work finished on background threads */
+    event_loop_init();
+
+    /* Reap children started with process.spawn */
+    process_init();
+
+    /* Buffers follow their files on disk; say when one does */
+    buffer_set_reload_listener(editor_buffer_reloaded, ed);
+
     /* Initialize Lua */
     if (lua_bridge_init(ed) != 0) {
         keymap_destroy(ed->keymap);
@@ -104,6 +180,7 @@ Editor *editor_create(void) {
             lua_bridge_load_plugin(ed, init_path);
         }
     }
+    lua_bridge_report_load_times(ed);
 
     return ed;
 }
@@ -111,6 +188,14 @@ Editor *editor_create(void) {
 void editor_destroy(Editor *ed) {
     if (!ed) return;
 
+    /* Let background saves finish and report back while everything is still alive */
+    buffer_save_wait_all();
+    event_loop_dispatch();
+
+    /* Running children and searches hold Lua callbacks, release them before the VM goes */
+    process_shutdown();
+    project_search_shutdown();
+
     /* Clean up Lua */
     lua_bridge_cleanup(ed);
 
@@ -136,12 +221,20 @@ void editor_destroy(Editor *ed) {
     }
     if (ed->buffers) free(ed->buffers);
 
+    /* Stop the swap file writer once no buffer journals remain */
+    journal_shutdown();
+    git_shutdown();
+    buffer_set_reload_listener(NULL, NULL);
+    file_watch_shutdown();
+
     /* Clean up clipboard */
     if (ed->clipboard) free(ed->clipboard);
 
     /* Clean up config directory path */
     if (ed->config_dir) free(ed->config_dir);
 
+    event_loop_shutdown();
+
     /* Clean up terminal */
     terminal_destroy(ed->term);
 
@@ -162,6 +255,50 @@ void editor_set_status(Editor *ed, const char *msg) {
     ed->status_len = len;
 }
 
+void editor_offer_recovery(Editor *ed, Buffer *buf) {
+    if (!ed || !buf || !journal_has_recovery(buf->journal)) return;
+
+    char msg[256];
+    snprintf(msg, sizeof(msg), "Swap file found for %s - editor.recover() restores unsaved edits",
+             buf->filename ? buf->filename : "[No Name]");
+    editor_set_status(ed, msg);
+}
+
+/* Status line updates for a background save */
+static void editor_save_progress(Buffer *buf, const BufferSaveProgress *progress, void *data) {
+    (void)buf;
+    Editor *ed = (Editor *)data;
+    char msg[256];
+
+    if (!progress->done) {
+        int percent = progress->bytes_total > 0
+            ? (int)(progress->bytes_written * 100 / progress->bytes_total) : 100;
+        snprintf(msg, sizeof(msg), "Saving %s... %d%%", progress->filename, percent);
+        editor_set_status(ed, msg);
+        return;
+    }
+
+    if (progress->error == 0) {
+        snprintf(msg, sizeof(msg), "Saved %s (%zu bytes)", progress->filename, progress->bytes_written);
+    } else {
+        snprintf(msg, sizeof(msg), "Error saving %s: %s", progress->filename, strerror(progress->error));
+    }
+    editor_set_status(ed, msg);
+
+    lua_bridge_trigger_save_event(ed, progress->filename, progress->error == 0);
+}
+
+int editor_save_async(Editor *ed, Buffer *buf) {
+    if (!ed || !buf) return -1;
+
+    if (buffer_save_async(buf, editor_save_progress, ed) == -1) return -1;
+
+    char msg[256];
+    snprintf(msg, sizeof(msg), "Saving %s...", buf->filename);
+    editor_set_status(ed, msg);
+    return 0;
+}
+
 /* Helper function to check if tab bar should be shown */
 static bool editor_should_show_tabbar(Editor *ed) {
     if (!ed->tab_groups) return false;
@@ -210,7 +347,7 @@ static void editor_process_keypress(Editor *ed, int key) {
 
                 if (file_row >= 0 && file_row < (int)buf->num_rows) {
                     buf->cursor_y = file_row;
-                    BufferRow *row = &buf->rows[file_row];
+                    BufferRow *row = buffer_row(buf, file_row);
                     buf->cursor_x = file_col < (int)row->size ? file_col : (int)row->size;
                     buf->has_selection = true;
                     buf->select_start_x = buf->cursor_x;
@@ -234,7 +371,7 @@ static void editor_process_keypress(Editor *ed, int key) {
 
                 if (file_row >= 0 && file_row < (int)buf->num_rows) {
                     buf->cursor_y = file_row;
-                    BufferRow *row = &buf->rows[file_row];
+                    BufferRow *row = buffer_row(buf, file_row);
                     buf->cursor_x = file_col < (int)row->size ? file_col : (int)row->size;
                 }
             }
@@ -253,7 +390,13 @@ static void editor_process_keypress(Editor *ed, int key) {
         return;
     }
 
-    /* Check for custom keybindings first */
+    /* Custom windows see keys first; the ones they leave go to the keybindings */
+    if (ed->active_window && ed->active_window->content_type == CONTENT_CUSTOM &&
+        lua_bridge_call_window_key_handler(ed, ed->active_window, key)) {
+        return;
+    }
+
+    /* Then the keybindings */
     if (ed->keymap && keymap_execute(ed->keymap, ed, key, KMOD_NONE) == 0) {
         return;  /* Keybinding handled it */
     }
@@ -269,14 +412,14 @@ static void editor_process_keypress(Editor *ed, int key) {
             } else if (buf->cursor_y > 0) {
                 buf->cursor_y--;
                 if (buf->cursor_y < (int)buf->num_rows) {
-                    buf->cursor_x = buf->rows[buf->cursor_y].size;
+                    buf->cursor_x = buffer_row(buf, buf->cursor_y)->size;
                 }
             }
             break;
 
         case KEY_ARROW_RIGHT:
             if (buf->cursor_y < (int)buf->num_rows) {
-                BufferRow *row = &buf->rows[buf->cursor_y];
+                BufferRow *row = buffer_row(buf, buf->cursor_y);
                 if (buf->cursor_x < (int)row->size) {
                     buf->cursor_x++;
                 } else if (buf->cursor_y < (int)buf->num_rows - 1) {
@@ -291,7 +434,7 @@ static void editor_process_keypress(Editor *ed, int key) {
                 buf->cursor_y--;
                 /* Adjust cursor_x if line is shorter */
                 if (buf->cursor_y < (int)buf->num_rows) {
-                    BufferRow *row = &buf->rows[buf->cursor_y];
+                    BufferRow *row = buffer_row(buf, buf->cursor_y);
                     if (buf->cursor_x > (int)row->size) {
                         buf->cursor_x = row->size;
                     }
@@ -304,7 +447,7 @@ static void editor_process_keypress(Editor *ed, int key) {
                 buf->cursor_y++;
                 /* Adjust cursor_x if line is shorter */
                 if (buf->cursor_y < (int)buf->num_rows) {
-                    BufferRow *row = &buf->rows[buf->cursor_y];
+                    BufferRow *row = buffer_row(buf, buf->cursor_y);
                     if (buf->cursor_x > (int)row->size) {
                         buf->cursor_x = row->size;
                     }
@@ -318,7 +461,7 @@ static void editor_process_keypress(Editor *ed, int key) {
 
         case KEY_END:
             if (buf->cursor_y < (int)buf->num_rows) {
-                buf->cursor_x = buf->rows[buf->cursor_y].size;
+                buf->cursor_x = buffer_row(buf, buf->cursor_y)->size;
             }
             break;
 
@@ -346,14 +489,16 @@ static void editor_process_keypress(Editor *ed, int key) {
         case KEY_DEL:
             /* Delete character to the right, or join with next line if at end */
             if (buf->cursor_y < (int)buf->num_rows) {
-                BufferRow *row = &buf->rows[buf->cursor_y];
+                BufferRow *row = buffer_row(buf, buf->cursor_y);
                 if (buf->cursor_x < (int)row->size) {
                     /* Delete character to the right */
                     buf->cursor_x++;
                     buffer_delete_char(buf);
                 } else if (buf->cursor_y < (int)buf->num_rows - 1) {
                     /* At end of line - join with next line */
-                    BufferRow *next_row = &buf->rows[buf->cursor_y + 1];
+                    row = buffer_row_mut(buf, buf->cursor_y);
+                    BufferRow *next_row = buffer_row(buf, buf->cursor_y + 1);
+                    if (!row) break;
 
                     /* Ensure current row has space */
                     while (row->capacity < row->size + next_row->size + 1) {
@@ -362,6 +507,11 @@ static void editor_process_keypress(Editor *ed, int key) {
                         if (!new_data) break;
                         row->data = new_data;
                     }
+                    if (row->capacity < row->size + next_row->size + 1) break;
+
+                    if (buf->journal) {
+                        journal_record_delete(buf->journal, row->size, buf->cursor_y, 0, buf->cursor_y + 1);
+                    }
 
                     /* Append next row to current row */
                     memcpy(&row->data[row->size], next_row->data, next_row->size);
@@ -369,16 +519,10 @@ static void editor_process_keypress(Editor *ed, int key) {
                     row->data[row->size] = '\0';
 
                     /* Delete next row */
-                    if (next_row->data) {
-                        free(next_row->data);
-                        next_row->data = NULL;
-                    }
-
-                    /* Shift rows up */
-                    memmove(&buf->rows[buf->cursor_y + 1], &buf->rows[buf->cursor_y + 2],
-                            sizeof(BufferRow) * (buf->num_rows - buf->cursor_y - 2));
+                    size_t old_rows = buf->num_rows;
+                    buffer_delete_rows(buf, buf->cursor_y + 1, 1);
+                    buffer_resize_highlighting_cache(buf, old_rows, buf->num_rows);
 
-                    buf->num_rows--;
                     buf->modified = true;
                 }
             }
@@ -387,10 +531,14 @@ static void editor_process_keypress(Editor *ed, int key) {
         case '\t':
             /* Tab key - insert tab or spaces based on configuration */
             if (ed->use_spaces) {
-                /* Insert spaces */
-                for (int i = 0; i < ed->tab_width; i++) {
-                    buffer_insert_char(buf, ' ');
-                }
+                /* Insert spaces - one edit, one undo step */
+                size_t count = ed->tab_width > 0 ? (size_t)ed->tab_width : 0;
+                char *spaces = malloc(count ? count : 1);
+                if (!spaces) break;
+                memset(spaces, ' ', count);
+                if (buf->cursor_y > (int)buf->num_rows) buf->cursor_y = buf->num_rows;
+                buffer_insert_text(buf, buf->cursor_x, buf->cursor_y, spaces, count);
+                free(spaces);
             } else {
                 /* Insert actual tab character */
                 buffer_insert_char(buf, '\t');
@@ -484,8 +632,13 @@ static void editor_refresh_screen(Editor *ed) {
     /* Hide cursor during refresh */
     terminal_hide_cursor(ed->term);
 
-    /* Clear screen */
-    terminal_write_str(ed->term, "\x1b[2J");
+    /* Every frame paints each window's whole area, so the screen is only
+     * cleared when its size changes or another tab is shown; canvases redraw
+     * just the cells that differ in between */
+    if (ed->screen_stale) {
+        terminal_clear_screen(ed->term);
+        ed->screen_stale = false;
+    }
     terminal_move_cursor(ed->term, 0, 0);
 
     /* Render tab bar at top if we have multiple tabs */
@@ -568,13 +721,20 @@ int editor_run(Editor *ed) {
     while (ed->running) {
         editor_refresh_screen(ed);
 
-        int key = terminal_read_key();
-        if (key != -1) {
-            editor_process_keypress(ed, key);
+        /* Sleep until a key arrives; work finished in the background or a
+         * resize (SIGWINCH) wakes us to redraw */
+        if (event_loop_wait(-1) == 1) {
+            int key = terminal_read_key();
+            if (key != -1) {
+                editor_process_keypress(ed, key);
+            }
         }
 
         /* Update window size (leave room for command line and tab bar) */
+        int old_rows = ed->term->rows;
+        int old_cols = ed->term->cols;
         terminal_get_window_size(ed->term);
+        if (ed->term->rows != old_rows || ed->term->cols != old_cols) ed->screen_stale = true;
         if (ed->root_window) {
             int win_y, win_height;
             editor_get_window_area(ed, &win_y, &win_height);
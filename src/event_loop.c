@@ -0,0 +1,311 @@
+#define _POSIX_C_SOURCE 200809L
+#include "event_loop.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/* Work posted from other threads, run in FIFO order */
+typedef struct PostedEvent {
+    EventCallback cb;
+    void *data;
+    struct PostedEvent *next;
+} PostedEvent;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static PostedEvent *queue_head = NULL;
+static PostedEvent *queue_tail = NULL;
+
+/* Self-pipe: a byte written here wakes poll() in event_loop_wait */
+static int wake_pipe[2] = {-1, -1};
+static struct sigaction old_sigwinch;
+
+/* File descriptors watched by the main thread */
+typedef struct {
+    int fd;
+    short events;
+    EventFdCallback cb;
+    void *data;
+} FdWatch;
+
+static FdWatch *watches = NULL;
+static size_t num_watches = 0;
+static size_t watches_capacity = 0;
+
+/* One-shot timers, kept sorted by deadline */
+typedef struct Timer {
+    int id;
+    long long due_ms;
+    bool due;
+    EventCallback cb;
+    void *data;
+    struct Timer *next;
+} Timer;
+
+static Timer *timers = NULL;
+static int next_timer_id = 1;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int set_nonblock_cloexec(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) return -1;
+    flags = fcntl(fd, F_GETFD);
+    if (flags == -1 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1) return -1;
+    return 0;
+}
+
+/* A resize wakes the loop so the editor redraws at the new size at once. The
+ * signal may land on any thread, so it goes through the pipe, not EINTR. */
+static void sigwinch_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    char byte = 1;
+    ssize_t n = write(wake_pipe[1], &byte, 1);
+    (void)n;
+    errno = saved_errno;
+}
+
+int event_loop_init(void) {
+    if (wake_pipe[0] != -1) return 0;
+
+    if (pipe(wake_pipe) == -1) return -1;
+    if (set_nonblock_cloexec(wake_pipe[0]) == -1 || set_nonblock_cloexec(wake_pipe[1]) == -1) {
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        wake_pipe[0] = wake_pipe[1] = -1;
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigwinch_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &sa, &old_sigwinch);
+    return 0;
+}
+
+void event_loop_shutdown(void) {
+    /* Drop anything still queued - its owners are being torn down too */
+    pthread_mutex_lock(&queue_lock);
+    PostedEvent *ev = queue_head;
+    queue_head = queue_tail = NULL;
+    pthread_mutex_unlock(&queue_lock);
+
+    while (ev) {
+        PostedEvent *next = ev->next;
+        free(ev);
+        ev = next;
+    }
+
+    while (timers) {
+        Timer *next = timers->next;
+        free(timers);
+        timers = next;
+    }
+
+    free(watches);
+    watches = NULL;
+    num_watches = watches_capacity = 0;
+
+    if (wake_pipe[0] != -1) {
+        sigaction(SIGWINCH, &old_sigwinch, NULL);
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        wake_pipe[0] = wake_pipe[1] = -1;
+    }
+}
+
+static FdWatch *find_watch(int fd) {
+    for (size_t i = 0; i < num_watches; i++) {
+        if (watches[i].fd == fd) return &watches[i];
+    }
+    return NULL;
+}
+
+int event_loop_watch_fd(int fd, short events, EventFdCallback cb, void *data) {
+    if (fd < 0 || !cb) return -1;
+
+    FdWatch *w = find_watch(fd);
+    if (!w) {
+        if (num_watches >= watches_capacity) {
+            size_t new_capacity = watches_capacity ? watches_capacity * 2 : 8;
+            FdWatch *new_watches = realloc(watches, new_capacity * sizeof(FdWatch));
+            if (!new_watches) return -1;
+            watches = new_watches;
+            watches_capacity = new_capacity;
+        }
+        w = &watches[num_watches++];
+        w->fd = fd;
+    }
+    w->events = events;
+    w->cb = cb;
+    w->data = data;
+    return 0;
+}
+
+void event_loop_unwatch_fd(int fd) {
+    FdWatch *w = find_watch(fd);
+    if (!w) return;
+    *w = watches[--num_watches];
+}
+
+int event_loop_add_timer(int ms, EventCallback cb, void *data) {
+    if (!cb) return -1;
+    if (ms < 0) ms = 0;
+
+    Timer *t = malloc(sizeof(Timer));
+    if (!t) return -1;
+    t->id = next_timer_id++;
+    if (next_timer_id <= 0) next_timer_id = 1;
+    t->due_ms = now_ms() + ms;
+    t->due = false;
+    t->cb = cb;
+    t->data = data;
+
+    /* Equal deadlines fire in the order they were added */
+    Timer **pp = &timers;
+    while (*pp && (*pp)->due_ms <= t->due_ms) pp = &(*pp)->next;
+    t->next = *pp;
+    *pp = t;
+    return t->id;
+}
+
+void event_loop_cancel_timer(int id) {
+    for (Timer **pp = &timers; *pp; pp = &(*pp)->next) {
+        if ((*pp)->id == id) {
+            Timer *t = *pp;
+            *pp = t->next;
+            free(t);
+            return;
+        }
+    }
+}
+
+/* Run every timer that is due. Timers added by callbacks wait for the next
+ * round; ones cancelled by an earlier callback in this round do not run. */
+static void run_timers(void) {
+    long long now = now_ms();
+    for (Timer *t = timers; t && t->due_ms <= now; t = t->next) t->due = true;
+
+    while (timers && timers->due) {
+        Timer *t = timers;
+        timers = t->next;
+        t->cb(t->data);
+        free(t);
+    }
+}
+
+int event_loop_post(EventCallback cb, void *data) {
+    if (!cb) return -1;
+
+    PostedEvent *ev = malloc(sizeof(PostedEvent));
+    if (!ev) return -1;
+    ev->cb = cb;
+    ev->data = data;
+    ev->next = NULL;
+
+    pthread_mutex_lock(&queue_lock);
+    if (queue_tail) {
+        queue_tail->next = ev;
+    } else {
+        queue_head = ev;
+    }
+    queue_tail = ev;
+    pthread_mutex_unlock(&queue_lock);
+
+    /* A full pipe already guarantees a wakeup, so EAGAIN is fine */
+    if (wake_pipe[1] != -1) {
+        char byte = 1;
+        ssize_t n = write(wake_pipe[1], &byte, 1);
+        (void)n;
+    }
+    return 0;
+}
+
+void event_loop_dispatch(void) {
+    /* Take the whole queue at once; callbacks may post more for the next round */
+    pthread_mutex_lock(&queue_lock);
+    PostedEvent *ev = queue_head;
+    queue_head = queue_tail = NULL;
+    pthread_mutex_unlock(&queue_lock);
+
+    while (ev) {
+        PostedEvent *next = ev->next;
+        ev->cb(ev->data);
+        free(ev);
+        ev = next;
+    }
+}
+
+int event_loop_wait(int timeout_ms) {
+    struct pollfd stack_fds[16];
+    size_t nfds = 2 + num_watches;
+    struct pollfd *fds = stack_fds;
+    if (nfds > sizeof(stack_fds) / sizeof(stack_fds[0])) {
+        fds = malloc(nfds * sizeof(struct pollfd));
+        if (!fds) {
+            /* Fall back to just the terminal and the wake pipe */
+            fds = stack_fds;
+            nfds = 2;
+        }
+    }
+
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = wake_pipe[0];  /* poll() skips negative fds */
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    for (size_t i = 2; i < nfds; i++) {
+        fds[i].fd = watches[i - 2].fd;
+        fds[i].events = watches[i - 2].events;
+        fds[i].revents = 0;
+    }
+
+    /* Wake up in time for the earliest timer */
+    if (timers) {
+        long long wait = timers->due_ms - now_ms();
+        if (wait < 0) wait = 0;
+        if (timeout_ms < 0 || wait < timeout_ms) timeout_ms = (int)wait;
+    }
+
+    int ready = poll(fds, nfds, timeout_ms);
+    if (ready == -1) {
+        /* EINTR (a signal handled on this thread) just means "look again" */
+        if (fds != stack_fds) free(fds);
+        return 0;
+    }
+
+    if (fds[1].revents & POLLIN) {
+        char drain[64];
+        while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {
+        }
+    }
+
+    event_loop_dispatch();
+
+    /* Callbacks may watch or unwatch fds, so look each one up again before calling it */
+    for (size_t i = 2; i < nfds; i++) {
+        if (!fds[i].revents) continue;
+        FdWatch *w = find_watch(fds[i].fd);
+        if (w) w->cb(w->fd, fds[i].revents, w->data);
+    }
+
+    run_timers();
+
+    int stdin_ready = (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) ? 1 : 0;
+    if (fds != stack_fds) free(fds);
+    return stdin_ready;
+}
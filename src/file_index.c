@@ -0,0 +1,1251 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE  /* realpath() */
+#include "file_index.h"
+#include "gitignore.h"
+#include "event_loop.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FILE_INDEX_MAGIC "OCCEFI1"
+
+/* What a watched directory reports. Writes are only of interest for
+ * .gitignore files, but inotify cannot filter by name. */
+#define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                      IN_CLOSE_WRITE | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+/* Cache file: header, then the root, then the paths, each ending in a NUL */
+typedef struct {
+    char magic[8];
+    uint64_t count;
+    uint64_t arena_len;
+    uint32_t root_len;
+    uint32_t reserved;
+} FileIndexHeader;
+
+/* ===== Path table ===== */
+
+/* Bit of every live path's mask, so a removed path (mask 0) never matches */
+#define MASK_LIVE (1ULL << 63)
+/* Set if the path has a capital letter, so it can score a camel case bonus */
+#define MASK_UPPER (1ULL << 62)
+
+#define SLOT_EMPTY 0
+#define SLOT_REMOVED UINT32_MAX
+
+/* The paths, back to back in one arena. Each has a mask of the characters
+ * in it (see char_bit); the hash only serves to find a path by name. */
+typedef struct {
+    char *arena;
+    size_t arena_len;
+    size_t arena_capacity;
+    uint32_t *offsets;          /* Start of each path in the arena */
+    uint64_t *masks;            /* 0 once the path was removed */
+    size_t count;
+    size_t capacity;
+    size_t removed;
+    uint32_t *slots;            /* Path index + 1, SLOT_EMPTY or SLOT_REMOVED */
+    size_t slot_count;          /* Power of two, or 0 before the first hash */
+    size_t slot_used;           /* Including removed slots */
+} PathTable;
+
+static unsigned char fold(unsigned char c) {
+    return (unsigned char)(c - 'A') < 26 ? c + ('a' - 'A') : c;
+}
+
+/* Mask bit for a character: one per letter and digit, four for common
+ * punctuation, and the rest of the bytes share what is left below MASK_UPPER */
+static uint64_t char_bit(unsigned char c) {
+    c = fold(c);
+    if (c >= 'a' && c <= 'z') return 1ULL << (c - 'a');
+    if (c >= '0' && c <= '9') return 1ULL << (26 + c - '0');
+    switch (c) {
+        case '.': return 1ULL << 36;
+        case '_': return 1ULL << 37;
+        case '-': return 1ULL << 38;
+        case '/': return 1ULL << 39;
+        default:  return 1ULL << (40 + c % 22);
+    }
+}
+
+static uint64_t path_mask(const char *s, size_t len) {
+    uint64_t mask = MASK_LIVE;
+    for (size_t i = 0; i < len; i++) {
+        mask |= char_bit((unsigned char)s[i]);
+        if (s[i] >= 'A' && s[i] <= 'Z') mask |= MASK_UPPER;
+    }
+    return mask;
+}
+
+static uint64_t path_hash(const char *s, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static const char *table_path(const PathTable *t, size_t i, size_t *len) {
+    size_t end = i + 1 < t->count ? t->offsets[i + 1] : t->arena_len;
+    *len = end - t->offsets[i] - 1;
+    return t->arena + t->offsets[i];
+}
+
+static void table_free(PathTable *t) {
+    free(t->arena);
+    free(t->offsets);
+    free(t->masks);
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+/* Add a path at the end, without the hash */
+static bool table_append(PathTable *t, const char *path, size_t len) {
+    if (t->arena_len + len + 1 > UINT32_MAX) return false;
+    if (t->arena_len + len + 1 > t->arena_capacity) {
+        size_t capacity = t->arena_capacity ? t->arena_capacity : 65536;
+        while (capacity < t->arena_len + len + 1) capacity *= 2;
+        char *arena = realloc(t->arena, capacity);
+        if (!arena) return false;
+        t->arena = arena;
+        t->arena_capacity = capacity;
+    }
+    if (t->count == t->capacity) {
+        size_t capacity = t->capacity ? t->capacity * 2 : 1024;
+        uint32_t *offsets = realloc(t->offsets, capacity * sizeof(uint32_t));
+        if (!offsets) return false;
+        t->offsets = offsets;
+        uint64_t *masks = realloc(t->masks, capacity * sizeof(uint64_t));
+        if (!masks) return false;
+        t->masks = masks;
+        t->capacity = capacity;
+    }
+
+    t->offsets[t->count] = (uint32_t)t->arena_len;
+    t->masks[t->count] = path_mask(path, len);
+    t->count++;
+    memcpy(t->arena + t->arena_len, path, len);
+    t->arena[t->arena_len + len] = '\0';
+    t->arena_len += len + 1;
+    return true;
+}
+
+/* Slot of path, or of the place it would go if absent (with *found false) */
+static size_t table_slot(const PathTable *t, const char *path, size_t len, bool *found) {
+    size_t mask = t->slot_count - 1;
+    size_t i = path_hash(path, len) & mask;
+    size_t insert = SIZE_MAX;
+    for (;;) {
+        uint32_t slot = t->slots[i];
+        if (slot == SLOT_EMPTY) {
+            *found = false;
+            return insert != SIZE_MAX ? insert : i;
+        }
+        if (slot == SLOT_REMOVED) {
+            if (insert == SIZE_MAX) insert = i;
+        } else {
+            size_t plen;
+            const char *p = table_path(t, slot - 1, &plen);
+            if (plen == len && memcmp(p, path, len) == 0) {
+                *found = true;
+                return i;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/* Hash every live path again, sized for twice as many */
+static bool table_rehash(PathTable *t) {
+    size_t live = t->count - t->removed;
+    size_t slot_count = 1024;
+    while (slot_count < live * 2) slot_count *= 2;
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (!slots) return false;
+
+    free(t->slots);
+    t->slots = slots;
+    t->slot_count = slot_count;
+    t->slot_used = live;
+    for (size_t i = 0; i < t->count; i++) {
+        if (!t->masks[i]) continue;
+        size_t len;
+        const char *path = table_path(t, i, &len);
+        bool found;
+        t->slots[table_slot(t, path, len, &found)] = (uint32_t)i + 1;
+    }
+    return true;
+}
+
+/* Index of path, or -1 */
+static ptrdiff_t table_find(const PathTable *t, const char *path, size_t len) {
+    if (!t->slot_count) return -1;
+    bool found;
+    size_t slot = table_slot(t, path, len, &found);
+    return found ? (ptrdiff_t)t->slots[slot] - 1 : -1;
+}
+
+/* Add a path unless it is there already. Returns true if it was added. */
+static bool table_add(PathTable *t, const char *path, size_t len) {
+    if ((t->slot_used + 1) * 4 >= t->slot_count * 3 && !table_rehash(t)) return false;
+
+    bool found;
+    size_t slot = table_slot(t, path, len, &found);
+    if (found || !table_append(t, path, len)) return false;
+    if (t->slots[slot] == SLOT_EMPTY) t->slot_used++;
+    t->slots[slot] = (uint32_t)t->count;
+    return true;
+}
+
+static void table_remove(PathTable *t, size_t i) {
+    size_t len;
+    const char *path = table_path(t, i, &len);
+    bool found;
+    size_t slot = table_slot(t, path, len, &found);
+    if (found) t->slots[slot] = SLOT_REMOVED;
+    t->masks[i] = 0;
+    t->removed++;
+}
+
+/* Remove dir and everything below it. Returns the number removed. */
+static size_t table_remove_dir(PathTable *t, const char *dir, size_t dir_len) {
+    size_t removed = 0;
+    for (size_t i = 0; i < t->count; i++) {
+        if (!t->masks[i]) continue;
+        size_t len;
+        const char *path = table_path(t, i, &len);
+        if (len > dir_len && path[dir_len] == '/' && memcmp(path, dir, dir_len) == 0) {
+            table_remove(t, i);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+/* Drop removed paths once they make up half the table */
+static void table_compact(PathTable *t) {
+    if (t->removed < 1024 || t->removed * 2 < t->count) return;
+
+    PathTable packed = {0};
+    for (size_t i = 0; i < t->count; i++) {
+        if (!t->masks[i]) continue;
+        size_t len;
+        const char *path = table_path(t, i, &len);
+        if (!table_append(&packed, path, len)) {
+            table_free(&packed);
+            return;
+        }
+    }
+    if (!table_rehash(&packed)) {
+        table_free(&packed);
+        return;
+    }
+    table_free(t);
+    *t = packed;
+}
+
+/* ===== Cache file ===== */
+
+/* Create dir and any missing parents */
+static int make_dirs(const char *dir) {
+    if (mkdir(dir, 0755) == 0 || errno == EEXIST) return 0;
+    if (errno != ENOENT) return -1;
+
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%s", dir);
+    char *slash = strrchr(parent, '/');
+    if (!slash || slash == parent) return -1;
+    *slash = '\0';
+
+    if (make_dirs(parent) != 0) return -1;
+    return mkdir(dir, 0755) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+/* Read the paths saved for root into t; false if there are none or they
+ * were saved for another root */
+static bool cache_load(PathTable *t, const char *cache_file, const char *root) {
+    int fd = open(cache_file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(FileIndexHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    const FileIndexHeader *hdr = (const FileIndexHeader *)map;
+    size_t root_len = strlen(root);
+    const char *arena = map + sizeof(FileIndexHeader) + root_len;
+    bool ok = memcmp(hdr->magic, FILE_INDEX_MAGIC, sizeof(hdr->magic)) == 0 &&
+              hdr->root_len == root_len &&
+              sizeof(FileIndexHeader) + root_len + hdr->arena_len == size &&
+              memcmp(map + sizeof(FileIndexHeader), root, root_len) == 0 &&
+              (hdr->arena_len == 0 || arena[hdr->arena_len - 1] == '\0');
+
+    const char *p = arena, *end = arena + (ok ? hdr->arena_len : 0);
+    while (ok && p < end) {
+        size_t len = strlen(p);
+        ok = table_append(t, p, len);
+        p += len + 1;
+    }
+    ok = ok && t->count == hdr->count && table_rehash(t);
+
+    munmap(map, size);
+    if (!ok) table_free(t);
+    return ok;
+}
+
+/* Save the live paths of t; readers only ever see a complete file */
+static bool cache_save(const PathTable *t, const char *cache_file, const char *root) {
+    FileIndexHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, FILE_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.root_len = (uint32_t)strlen(root);
+    for (size_t i = 0; i < t->count; i++) {
+        if (!t->masks[i]) continue;
+        size_t len;
+        table_path(t, i, &len);
+        hdr.count++;
+        hdr.arena_len += len + 1;
+    }
+
+    char tmp_path[PATH_MAX + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", cache_file, (long)getpid());
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) return false;
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+              fwrite(root, 1, hdr.root_len, f) == hdr.root_len;
+    for (size_t i = 0; ok && i < t->count; i++) {
+        if (!t->masks[i]) continue;
+        size_t len;
+        const char *path = table_path(t, i, &len);
+        ok = fwrite(path, 1, len + 1, f) == len + 1;
+    }
+    if (fclose(f) != 0) ok = false;
+    if (!ok || rename(tmp_path, cache_file) != 0) {
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+/* ===== Scanning ===== */
+
+/* A directory to scan, with the rules of the one above it */
+typedef struct {
+    char *path;                 /* Relative to the root; "" for the root itself */
+    const IgnoreList *ignore;
+} ScanDir;
+
+/* A watched directory; dir is NULL for unused watch descriptors */
+typedef struct {
+    char *dir;
+    const IgnoreList *ignore;   /* Rules for its entries */
+} WatchDir;
+
+typedef struct {
+    int wd;
+    WatchDir watch;
+} NewWatch;
+
+typedef enum {
+    JOB_LOAD,                   /* Read the cache file */
+    JOB_SCAN,                   /* Scan the whole tree and save it */
+    JOB_SCAN_DIRS               /* Scan new directories */
+} JobType;
+
+/* Background work on an index. Only one runs at a time, and while it does
+ * inotify events wait in the kernel's queue: they are applied once its
+ * result is in, so none is lost or applied to a table about to be replaced. */
+typedef struct {
+    pthread_t thread;
+    JobType type;
+    int index_id;
+    int root_fd;                /* These four belong to the index */
+    const char *root;
+    const char *cache_file;
+    int inotify_fd;
+
+    ScanDir *dirs;              /* JOB_SCAN_DIRS: where to start */
+    size_t dir_count;
+
+    PathTable table;
+    NewWatch *watches;
+    size_t watch_count;
+    size_t watch_capacity;
+    bool watch_failed;          /* Out of inotify watches */
+    IgnoreList *ignores;        /* Every list loaded */
+    bool ok;
+    bool saved;
+
+    atomic_bool stop;
+    atomic_bool done;
+} ScanJob;
+
+struct FileIndex {
+    int id;
+    char *root;                 /* Absolute */
+    int root_fd;
+    char *cache_file;           /* NULL without a cache */
+    int inotify_fd;             /* -1 without inotify */
+    bool watching;              /* Every directory indexed is watched */
+
+    PathTable table;
+    IgnoreList *ignores;        /* Rules the watches point into */
+    WatchDir *watches;          /* By watch descriptor */
+    size_t watch_capacity;
+
+    ScanJob *job;               /* Running job, or NULL */
+    bool rescan;                /* Scan the whole tree once the job is done */
+    ScanDir *pending;           /* New directories, scanned once the job is done */
+    size_t pending_count;
+    size_t pending_capacity;
+    bool dirty;                 /* Changed since saved */
+
+    /* The last query and every path it may have matched (those it could not
+     * rank were kept unchecked). A query it is a subsequence of (typically the
+     * same one, typed further) can only match among those. */
+    unsigned char last_query[FILE_QUERY_MAX];
+    size_t last_len;
+    uint32_t *last_matches;     /* Ascending */
+    size_t last_count;
+    bool last_valid;            /* Cleared whenever the table changes */
+
+    FileIndexCallback on_change;
+    void *data;
+    struct FileIndex *next;
+};
+
+static FileIndex *indexes = NULL;  /* Main thread only */
+static int next_index_id = 1;
+
+static bool scan_dirs_push(ScanDir **dirs, size_t *count, size_t *capacity,
+                           char *path, const IgnoreList *ignore) {
+    if (*count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        ScanDir *grown = realloc(*dirs, new_capacity * sizeof(ScanDir));
+        if (!grown) return false;
+        *dirs = grown;
+        *capacity = new_capacity;
+    }
+    (*dirs)[(*count)++] = (ScanDir){path, ignore};
+    return true;
+}
+
+static void scan_watch(ScanJob *job, const char *path, const IgnoreList *ignore) {
+    if (job->inotify_fd == -1 || job->watch_failed) return;
+
+    char abs_path[PATH_MAX];
+    if (path[0]) snprintf(abs_path, sizeof(abs_path), "%s/%s", job->root, path);
+    else snprintf(abs_path, sizeof(abs_path), "%s", job->root);
+
+    int wd = inotify_add_watch(job->inotify_fd, abs_path, WATCH_EVENTS);
+    if (wd == -1) {
+        if (errno == ENOSPC || errno == ENOMEM) job->watch_failed = true;
+        return;
+    }
+    if (job->watch_count == job->watch_capacity) {
+        size_t capacity = job->watch_capacity ? job->watch_capacity * 2 : 256;
+        NewWatch *grown = realloc(job->watches, capacity * sizeof(NewWatch));
+        if (!grown) {
+            job->watch_failed = true;
+            return;
+        }
+        job->watches = grown;
+        job->watch_capacity = capacity;
+    }
+    char *dir = strdup(path);
+    if (!dir) {
+        job->watch_failed = true;
+        return;
+    }
+    job->watches[job->watch_count++] = (NewWatch){wd, {dir, ignore}};
+}
+
+/* Add the files below dir to the job's table, depth first */
+static bool scan_tree(ScanJob *job, char *dir, const IgnoreList *dir_ignore) {
+    ScanDir *stack = NULL;
+    size_t depth = 0, capacity = 0;
+    if (!scan_dirs_push(&stack, &depth, &capacity, dir, dir_ignore)) {
+        free(dir);
+        return false;
+    }
+
+    bool ok = true;
+    while (depth > 0 && !atomic_load(&job->stop)) {
+        ScanDir item = stack[--depth];
+        GitignoreDir gd;
+        if (!gitignore_dir_open(&gd, job->root_fd, item.path, item.ignore)) {
+            free(item.path);
+            continue;
+        }
+        gitignore_keep(&job->ignores, gd.own);
+        scan_watch(job, item.path, gd.ignore);
+
+        char *path;
+        bool is_dir;
+        while (ok && (path = gitignore_dir_next(&gd, &is_dir))) {
+            if (is_dir) {
+                if (!scan_dirs_push(&stack, &depth, &capacity, path, gd.ignore)) {
+                    free(path);
+                    ok = false;
+                }
+            } else {
+                ok = table_append(&job->table, path, strlen(path));
+                free(path);
+            }
+        }
+        if (gd.failed) ok = false;
+        gitignore_dir_close(&gd);
+        free(item.path);
+        if (!ok) break;
+    }
+
+    while (depth > 0) free(stack[--depth].path);
+    free(stack);
+    return ok;
+}
+
+static void file_index_job_done(void *data);
+
+static void *scan_main(void *arg) {
+    ScanJob *job = arg;
+
+    switch (job->type) {
+        case JOB_LOAD:
+            job->ok = cache_load(&job->table, job->cache_file, job->root);
+            break;
+
+        case JOB_SCAN: {
+            char *root = strdup("");
+            job->ok = root && scan_tree(job, root, NULL);
+            job->ok = job->ok && !atomic_load(&job->stop) && table_rehash(&job->table);
+            if (job->ok && job->cache_file) {
+                job->saved = cache_save(&job->table, job->cache_file, job->root);
+            }
+            break;
+        }
+
+        case JOB_SCAN_DIRS:
+            job->ok = true;
+            for (size_t i = 0; i < job->dir_count && job->ok; i++) {
+                job->ok = scan_tree(job, job->dirs[i].path, job->dirs[i].ignore);
+                job->dirs[i].path = NULL;  /* The scan took it */
+            }
+            break;
+    }
+
+    atomic_store(&job->done, true);
+    event_loop_post(file_index_job_done, (void *)(intptr_t)job->index_id);
+    return NULL;
+}
+
+static void job_free(ScanJob *job) {
+    for (size_t i = 0; i < job->dir_count; i++) free(job->dirs[i].path);
+    free(job->dirs);
+    for (size_t i = 0; i < job->watch_count; i++) free(job->watches[i].watch.dir);
+    free(job->watches);
+    table_free(&job->table);
+    gitignore_free_all(job->ignores);
+    free(job);
+}
+
+/* ===== Index ===== */
+
+static FileIndex *find_index(int id) {
+    for (FileIndex *fi = indexes; fi; fi = fi->next) {
+        if (fi->id == id) return fi;
+    }
+    return NULL;
+}
+
+static void file_index_events(int fd, short revents, void *data);
+
+/* Read inotify events from the main loop, unless a job is running */
+static void file_index_listen(FileIndex *fi, bool listen) {
+    if (fi->inotify_fd == -1) return;
+    if (listen) {
+        event_loop_watch_fd(fi->inotify_fd, POLLIN, file_index_events, (void *)(intptr_t)fi->id);
+    } else {
+        event_loop_unwatch_fd(fi->inotify_fd);
+    }
+}
+
+static bool start_job(FileIndex *fi, JobType type) {
+    ScanJob *job = calloc(1, sizeof(ScanJob));
+    if (!job) return false;
+    job->type = type;
+    job->index_id = fi->id;
+    job->root_fd = fi->root_fd;
+    job->root = fi->root;
+    job->cache_file = fi->cache_file;
+    job->inotify_fd = fi->inotify_fd;
+    atomic_init(&job->stop, false);
+    atomic_init(&job->done, false);
+
+    if (type == JOB_SCAN_DIRS) {
+        job->dirs = fi->pending;
+        job->dir_count = fi->pending_count;
+        fi->pending = NULL;
+        fi->pending_count = fi->pending_capacity = 0;
+    }
+
+    if (pthread_create(&job->thread, NULL, scan_main, job) != 0) {
+        job_free(job);
+        return false;
+    }
+    fi->job = job;
+    file_index_listen(fi, false);
+    return true;
+}
+
+/* Start what is waiting, if nothing runs */
+static void file_index_next_job(FileIndex *fi) {
+    if (fi->job) return;
+
+    if (fi->rescan) {
+        /* The scan covers the new directories too */
+        for (size_t i = 0; i < fi->pending_count; i++) free(fi->pending[i].path);
+        fi->pending_count = 0;
+        fi->rescan = false;
+        start_job(fi, JOB_SCAN);
+    } else if (fi->pending_count > 0) {
+        start_job(fi, JOB_SCAN_DIRS);
+    }
+    if (!fi->job) file_index_listen(fi, true);
+}
+
+static WatchDir *watch_get(FileIndex *fi, int wd) {
+    return wd >= 0 && (size_t)wd < fi->watch_capacity && fi->watches[wd].dir ? &fi->watches[wd] : NULL;
+}
+
+static bool watch_set(FileIndex *fi, int wd, WatchDir watch) {
+    if ((size_t)wd >= fi->watch_capacity) {
+        size_t capacity = fi->watch_capacity ? fi->watch_capacity : 256;
+        while (capacity <= (size_t)wd) capacity *= 2;
+        WatchDir *grown = realloc(fi->watches, capacity * sizeof(WatchDir));
+        if (!grown) return false;
+        memset(grown + fi->watch_capacity, 0, (capacity - fi->watch_capacity) * sizeof(WatchDir));
+        fi->watches = grown;
+        fi->watch_capacity = capacity;
+    }
+    free(fi->watches[wd].dir);
+    fi->watches[wd] = watch;
+    return true;
+}
+
+static void watch_clear(WatchDir *watch) {
+    free(watch->dir);
+    watch->dir = NULL;
+    watch->ignore = NULL;
+}
+
+/* Take over the job's watches; false if some could not be kept */
+static bool adopt_watches(FileIndex *fi, ScanJob *job) {
+    bool ok = true;
+    for (size_t i = 0; i < job->watch_count; i++) {
+        if (watch_set(fi, job->watches[i].wd, job->watches[i].watch)) {
+            job->watches[i].watch.dir = NULL;
+        } else {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/* Replace the index with a full scan */
+static void install_scan(FileIndex *fi, ScanJob *job) {
+    table_free(&fi->table);
+    fi->table = job->table;
+    memset(&job->table, 0, sizeof(job->table));
+
+    /* Directories the scan did not watch again are gone or ignored now */
+    WatchDir *old = fi->watches;
+    size_t old_capacity = fi->watch_capacity;
+    fi->watches = NULL;
+    fi->watch_capacity = 0;
+    bool ok = adopt_watches(fi, job);
+    for (size_t wd = 0; wd < old_capacity; wd++) {
+        if (!old[wd].dir) continue;
+        if (!watch_get(fi, (int)wd)) inotify_rm_watch(fi->inotify_fd, (int)wd);
+        free(old[wd].dir);
+    }
+    free(old);
+
+    /* Nothing points into the old rules any more */
+    gitignore_free_all(fi->ignores);
+    fi->ignores = job->ignores;
+    job->ignores = NULL;
+
+    fi->watching = fi->inotify_fd != -1 && !job->watch_failed && ok;
+    fi->dirty = !job->saved;
+}
+
+/* Add the files of newly scanned directories */
+static void merge_dirs(FileIndex *fi, ScanJob *job) {
+    for (size_t i = 0; i < job->table.count; i++) {
+        size_t len;
+        const char *path = table_path(&job->table, i, &len);
+        if (table_add(&fi->table, path, len)) fi->dirty = true;
+    }
+    if (!adopt_watches(fi, job) || job->watch_failed) fi->watching = false;
+    gitignore_keep(&fi->ignores, job->ignores);
+    job->ignores = NULL;
+}
+
+/* The paths changed: matches of the last query no longer apply */
+static void file_index_changed(FileIndex *fi) {
+    fi->last_valid = false;
+    if (fi->on_change) fi->on_change(fi, fi->data);
+}
+
+static void file_index_job_done(void *data) {
+    FileIndex *fi = find_index((int)(intptr_t)data);
+    if (!fi || !fi->job || !atomic_load(&fi->job->done)) return;
+
+    ScanJob *job = fi->job;
+    fi->job = NULL;
+    pthread_join(job->thread, NULL);
+
+    bool changed = false;
+    switch (job->type) {
+        case JOB_LOAD:
+            /* Usable at once; the scan that follows brings it up to date */
+            if (job->ok && fi->table.count == 0) {
+                table_free(&fi->table);
+                fi->table = job->table;
+                memset(&job->table, 0, sizeof(job->table));
+                changed = true;
+            }
+            fi->rescan = true;
+            break;
+
+        case JOB_SCAN:
+            if (job->ok) {
+                install_scan(fi, job);
+                changed = true;
+            }
+            break;
+
+        case JOB_SCAN_DIRS:
+            merge_dirs(fi, job);
+            changed = true;
+            break;
+    }
+    job_free(job);
+
+    file_index_next_job(fi);
+    if (changed) file_index_changed(fi);
+}
+
+/* ===== Watching ===== */
+
+/* Whether a new entry is a file to list: symlinks count if they lead to one */
+static bool is_listed_file(FileIndex *fi, const char *path) {
+    struct stat st;
+    return fstatat(fi->root_fd, path, &st, 0) == 0 && S_ISREG(st.st_mode);
+}
+
+/* Stop watching dir and the directories below it */
+static void unwatch_dir(FileIndex *fi, const char *dir, size_t dir_len) {
+    for (size_t wd = 0; wd < fi->watch_capacity; wd++) {
+        const char *path = fi->watches[wd].dir;
+        if (!path || strncmp(path, dir, dir_len) != 0) continue;
+        if (path[dir_len] != '\0' && path[dir_len] != '/') continue;
+        inotify_rm_watch(fi->inotify_fd, (int)wd);
+        watch_clear(&fi->watches[wd]);
+    }
+}
+
+/* Apply one event; returns true if the files changed */
+static bool handle_event(FileIndex *fi, const struct inotify_event *ev) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        fi->rescan = true;  /* Events were dropped */
+        return false;
+    }
+    WatchDir *watch = watch_get(fi, ev->wd);
+    if (!watch) return false;
+    if (ev->mask & IN_IGNORED) {
+        watch_clear(watch);
+        return false;
+    }
+    if (ev->len == 0 || strcmp(ev->name, ".git") == 0) return false;
+
+    const char *name = ev->name;
+    bool is_dir = ev->mask & IN_ISDIR;
+    if (!is_dir && strcmp(name, ".gitignore") == 0) {
+        fi->rescan = true;  /* What is ignored may have changed */
+    }
+    if (ev->mask & IN_CLOSE_WRITE) return false;
+
+    char *path = gitignore_child_path(watch->dir, name);
+    if (!path) return false;
+    size_t len = strlen(path);
+    bool changed = false;
+
+    if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+        if (gitignore_match(watch->ignore, path, name, is_dir)) {
+            /* Not listed */
+        } else if (is_dir) {
+            if (scan_dirs_push(&fi->pending, &fi->pending_count, &fi->pending_capacity,
+                               path, watch->ignore)) {
+                path = NULL;  /* Scanned by the next job */
+            }
+        } else if (is_listed_file(fi, path)) {
+            changed = table_add(&fi->table, path, len);
+        }
+    } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        if (is_dir) {
+            changed = table_remove_dir(&fi->table, path, len) > 0;
+            unwatch_dir(fi, path, len);
+        } else {
+            ptrdiff_t i = table_find(&fi->table, path, len);
+            if (i >= 0) {
+                table_remove(&fi->table, (size_t)i);
+                changed = true;
+            }
+        }
+    }
+    free(path);
+    return changed;
+}
+
+static void file_index_events(int fd, short revents, void *data) {
+    (void)revents;
+    FileIndex *fi = find_index((int)(intptr_t)data);
+    if (!fi) return;
+
+    union {
+        struct inotify_event ev;
+        char bytes[16384];
+    } buf;
+    bool changed = false;
+    ssize_t n;
+    while ((n = read(fd, buf.bytes, sizeof(buf.bytes))) > 0) {
+        for (char *p = buf.bytes; p < buf.bytes + n;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (handle_event(fi, ev)) changed = true;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+
+    if (changed) {
+        fi->dirty = true;
+        table_compact(&fi->table);
+    }
+    file_index_next_job(fi);
+    if (changed) file_index_changed(fi);
+}
+
+/* ===== Matching ===== */
+
+#define SCORE_MATCH 16
+#define BONUS_PATH_START 10     /* After a / or at the start */
+#define BONUS_WORD_START 8      /* After _ - . or a space */
+#define BONUS_CAMEL 7           /* Capital after a lower case letter */
+#define BONUS_CONSECUTIVE 4
+#define BONUS_BASENAME 12       /* The whole match is in the file name */
+#define PENALTY_GAP_START 3
+#define PENALTY_GAP 1
+
+static int position_bonus(const char *s, size_t i) {
+    if (i == 0 || s[i - 1] == '/') return BONUS_PATH_START;
+    char prev = s[i - 1];
+    if (prev == '_' || prev == '-' || prev == '.' || prev == ' ') return BONUS_WORD_START;
+    if (prev >= 'a' && prev <= 'z' && s[i] >= 'A' && s[i] <= 'Z') return BONUS_CAMEL;
+    return 0;
+}
+
+/* First i >= from with fold(s[i]) == c (folded), or n */
+static size_t find_folded(const char *s, size_t from, size_t n, unsigned char c) {
+    size_t i = from;
+#if defined(__SSE2__)
+    unsigned char alt = c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c;
+    __m128i lower = _mm_set1_epi8((char)c), upper = _mm_set1_epi8((char)alt);
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(s + i));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, lower), _mm_cmpeq_epi8(block, upper)));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    while (i < n && fold((unsigned char)s[i]) != c) i++;
+    return i;
+}
+
+/* Score of q (folded, m > 0) as a subsequence of s, or -1 if it is not one.
+ * The match is the shortest one ending where the leftmost match ends: scan
+ * forward for the end, then back for the latest start (as fzf does). */
+static int fuzzy_score(const char *s, size_t n, const unsigned char *q, size_t m,
+                       uint32_t *positions) {
+    size_t end = 0;
+    for (size_t j = 0; j < m; j++) {
+        end = find_folded(s, end, n, q[j]);
+        if (end == n) return -1;
+        end++;
+    }
+
+    size_t start = end, j = m;
+    while (j > 0) {
+        start--;
+        if (fold((unsigned char)s[start]) == q[j - 1]) j--;
+    }
+
+    int score = 0;
+    bool in_run = false;
+    for (size_t i = start; i < end; i++) {
+        if (j < m && fold((unsigned char)s[i]) == q[j]) {
+            score += SCORE_MATCH + position_bonus(s, i) + (in_run ? BONUS_CONSECUTIVE : 0);
+            if (positions) positions[j] = (uint32_t)i;
+            j++;
+            in_run = true;
+        } else {
+            score -= in_run ? PENALTY_GAP_START : PENALTY_GAP;
+            in_run = false;
+        }
+    }
+
+    const char *slash = memchr(s + start, '/', end - start);
+    if (!slash) {
+        /* No / inside the match: is there one after it? */
+        slash = memchr(s + end, '/', n - end);
+        if (!slash) score += BONUS_BASENAME;
+    }
+    return score;
+}
+
+/* The best score q could get in any path, with or without capitals (which
+ * allow camel case bonuses). Each character after the first either follows
+ * the one before it or starts a path component after a gap. */
+static int score_bound(const unsigned char *q, size_t m, bool camel) {
+    if (m == 0) return 0;
+    int bound = SCORE_MATCH + BONUS_PATH_START + BONUS_BASENAME;
+    for (size_t j = 1; j < m; j++) {
+        int after = 0;
+        if (q[j - 1] == '/') after = BONUS_PATH_START;
+        else if (q[j - 1] == '_' || q[j - 1] == '-' || q[j - 1] == '.') after = BONUS_WORD_START;
+        else if (camel && q[j - 1] >= 'a' && q[j - 1] <= 'z' && q[j] >= 'a' && q[j] <= 'z') after = BONUS_CAMEL;
+        int follow = BONUS_CONSECUTIVE + after, jump = BONUS_PATH_START - PENALTY_GAP_START;
+        bound += SCORE_MATCH + (follow > jump ? follow : jump);
+    }
+    return bound;
+}
+
+typedef struct {
+    uint32_t index;
+    uint32_t len;
+    int score;
+} Candidate;
+
+/* a ranks below b: lower score, then longer path, then later in the table */
+static bool candidate_worse(const Candidate *a, const Candidate *b) {
+    if (a->score != b->score) return a->score < b->score;
+    if (a->len != b->len) return a->len > b->len;
+    return a->index > b->index;
+}
+
+/* Min-heap on rank: the worst kept candidate is at the top */
+static void heap_sift_down(Candidate *heap, size_t count, size_t i) {
+    for (;;) {
+        size_t worst = i, l = 2 * i + 1, r = l + 1;
+        if (l < count && candidate_worse(&heap[l], &heap[worst])) worst = l;
+        if (r < count && candidate_worse(&heap[r], &heap[worst])) worst = r;
+        if (worst == i) return;
+        Candidate tmp = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = tmp;
+        i = worst;
+    }
+}
+
+static void heap_push(Candidate *heap, size_t *count, size_t max, Candidate c) {
+    if (*count < max) {
+        size_t i = (*count)++;
+        heap[i] = c;
+        while (i > 0 && candidate_worse(&heap[i], &heap[(i - 1) / 2])) {
+            Candidate tmp = heap[i];
+            heap[i] = heap[(i - 1) / 2];
+            heap[(i - 1) / 2] = tmp;
+            i = (i - 1) / 2;
+        }
+    } else if (candidate_worse(&heap[0], &c)) {
+        heap[0] = c;
+        heap_sift_down(heap, *count, 0);
+    }
+}
+
+/* Whether a (folded) is a subsequence of b */
+static bool is_subsequence(const unsigned char *a, size_t a_len, const unsigned char *b, size_t b_len) {
+    size_t i = 0;
+    for (size_t j = 0; j < b_len && i < a_len; j++) {
+        if (b[j] == a[i]) i++;
+    }
+    return i == a_len;
+}
+
+/* Queries over this many paths are split between threads */
+#define QUERY_SPLIT 32768
+#define QUERY_THREADS_MAX 8
+
+/* One thread's share of a query: the paths from[lo, hi) (or lo to hi
+ * without from), ranked into a heap of its own */
+typedef struct {
+    const PathTable *table;
+    const uint32_t *from;
+    size_t lo, hi;
+    const unsigned char *q;
+    size_t m;
+    uint64_t qmask;
+    int bound, bound_camel;
+
+    Candidate *heap;
+    size_t count, max;
+    uint32_t *matches;          /* Room for hi - lo, or NULL */
+    size_t match_count;
+    pthread_t thread;
+} QueryPart;
+
+static void query_part(QueryPart *part) {
+    const PathTable *t = part->table;
+    const unsigned char *q = part->q;
+    size_t m = part->m;
+    uint64_t qmask = part->qmask;
+    Candidate *heap = part->heap;
+
+    for (size_t k = part->lo; k < part->hi; k++) {
+        size_t i = part->from ? part->from[k] : k;
+
+        /* Most paths lack one of the characters: one AND rules them out */
+        uint64_t mask = t->masks[i];
+        if ((mask & qmask) != qmask) continue;
+        size_t plen;
+        const char *path = table_path(t, i, &plen);
+
+        /* Once the kept candidates score as well as this path possibly can,
+         * it only ranks if it is shorter. If not it is kept unchecked for
+         * the next query, without reading the path at all. */
+        if (part->count == part->max) {
+            int bound = mask & MASK_UPPER ? part->bound_camel : part->bound;
+            if (heap[0].score > bound || (heap[0].score == bound && plen >= heap[0].len)) {
+                if (part->matches) part->matches[part->match_count++] = (uint32_t)i;
+                continue;
+            }
+        }
+
+        int score = 0;
+        if (m) {
+            score = fuzzy_score(path, plen, q, m, NULL);
+            if (score < 0) continue;
+            if (part->matches) part->matches[part->match_count++] = (uint32_t)i;
+        }
+        heap_push(heap, &part->count, part->max, (Candidate){(uint32_t)i, (uint32_t)plen, score});
+    }
+}
+
+static void *query_part_main(void *arg) {
+    query_part(arg);
+    return NULL;
+}
+
+size_t file_index_query(FileIndex *fi, const char *query, size_t len,
+                        FileMatch *out, size_t max) {
+    if (!fi || max == 0) return 0;
+
+    /* Spaces only separate words of the query */
+    unsigned char q[FILE_QUERY_MAX];
+    size_t m = 0;
+    uint64_t qmask = MASK_LIVE;
+    for (size_t i = 0; i < len && m < FILE_QUERY_MAX; i++) {
+        if (query[i] == ' ') continue;
+        q[m++] = fold((unsigned char)query[i]);
+        qmask |= char_bit((unsigned char)query[i]);
+    }
+
+    const PathTable *t = &fi->table;
+    const uint32_t *from = NULL;
+    size_t from_count = t->count;
+    if (fi->last_valid && is_subsequence(fi->last_query, fi->last_len, q, m)) {
+        from = fi->last_matches;
+        from_count = fi->last_count;
+    }
+
+    static long cpus = 0;
+    if (cpus == 0) cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t part_count = from_count / QUERY_SPLIT + 1;
+    if (part_count > (size_t)(cpus > 1 ? cpus : 1)) part_count = cpus > 1 ? (size_t)cpus : 1;
+    if (part_count > QUERY_THREADS_MAX) part_count = QUERY_THREADS_MAX;
+
+    QueryPart parts[QUERY_THREADS_MAX];
+    Candidate *heaps = malloc(part_count * max * sizeof(Candidate));
+    uint32_t *matches = m && from_count ? malloc(from_count * sizeof(uint32_t)) : NULL;
+    if (!heaps || (m && from_count && !matches)) {
+        free(heaps);
+        free(matches);
+        return 0;
+    }
+
+    for (size_t p = 0; p < part_count; p++) {
+        parts[p] = (QueryPart){
+            .table = t, .from = from,
+            .lo = from_count * p / part_count, .hi = from_count * (p + 1) / part_count,
+            .q = q, .m = m, .qmask = qmask,
+            .bound = score_bound(q, m, false), .bound_camel = score_bound(q, m, true),
+            .heap = heaps + p * max, .max = max,
+        };
+        if (matches) parts[p].matches = matches + parts[p].lo;
+    }
+
+    /* This thread takes the first part; a part whose thread cannot start
+     * is done here too */
+    size_t started = 1;
+    for (; started < part_count; started++) {
+        if (pthread_create(&parts[started].thread, NULL, query_part_main, &parts[started]) != 0) break;
+    }
+    query_part(&parts[0]);
+    for (size_t p = started; p < part_count; p++) query_part(&parts[p]);
+    for (size_t p = 1; p < started; p++) pthread_join(parts[p].thread, NULL);
+
+    /* The parts' matches back to back, and their candidates in one heap */
+    Candidate *heap = parts[0].heap;
+    size_t count = parts[0].count, match_count = parts[0].match_count;
+    for (size_t p = 1; p < part_count; p++) {
+        if (matches) {
+            memmove(matches + match_count, parts[p].matches, parts[p].match_count * sizeof(uint32_t));
+        }
+        match_count += parts[p].match_count;
+        for (size_t k = 0; k < parts[p].count; k++) heap_push(heap, &count, max, parts[p].heap[k]);
+    }
+
+    /* Keep the matches for the next query, if it only adds characters */
+    free(fi->last_matches);
+    fi->last_matches = matches;
+    fi->last_count = match_count;
+    fi->last_valid = matches != NULL;
+    memcpy(fi->last_query, q, m);
+    fi->last_len = m;
+
+    /* Pop the worst to the back: best first */
+    for (size_t n = count; n > 1; n--) {
+        Candidate tmp = heap[0];
+        heap[0] = heap[n - 1];
+        heap[n - 1] = tmp;
+        heap_sift_down(heap, n - 1, 0);
+    }
+
+    for (size_t k = 0; k < count; k++) {
+        FileMatch *match = &out[k];
+        match->path = table_path(t, heap[k].index, &match->len);
+        match->score = heap[k].score;
+        if (m) fuzzy_score(match->path, match->len, q, m, match->positions);
+    }
+    free(heaps);
+    return count;
+}
+
+/* ===== Lifetime ===== */
+
+FileIndex *file_index_open(const char *root, const char *cache_dir,
+                           FileIndexCallback on_change, void *data) {
+    char abs_root[PATH_MAX];
+    if (!root || !realpath(root, abs_root)) return NULL;
+
+    FileIndex *fi = calloc(1, sizeof(FileIndex));
+    if (!fi) return NULL;
+    fi->root_fd = open(abs_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    fi->root = strdup(abs_root);
+    if (fi->root_fd == -1 || !fi->root) {
+        if (fi->root_fd != -1) close(fi->root_fd);
+        free(fi->root);
+        free(fi);
+        return NULL;
+    }
+
+    /* Cache file: FNV-1a of the root */
+    if (cache_dir && make_dirs(cache_dir) == 0) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%016llx.idx", cache_dir,
+                 (unsigned long long)path_hash(abs_root, strlen(abs_root)));
+        fi->cache_file = strdup(path);
+    }
+
+    fi->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    fi->id = next_index_id++;
+    fi->on_change = on_change;
+    fi->data = data;
+    fi->next = indexes;
+    indexes = fi;
+
+    if (!fi->cache_file || !start_job(fi, JOB_LOAD)) {
+        fi->rescan = true;
+        file_index_next_job(fi);
+    }
+    return fi;
+}
+
+void file_index_close(FileIndex *fi) {
+    if (!fi) return;
+
+    for (FileIndex **link = &indexes; *link; link = &(*link)->next) {
+        if (*link == fi) {
+            *link = fi->next;
+            break;
+        }
+    }
+
+    /* A job's late done post finds no index and is dropped */
+    if (fi->job) {
+        atomic_store(&fi->job->stop, true);
+        pthread_join(fi->job->thread, NULL);
+        job_free(fi->job);
+    }
+    if (fi->inotify_fd != -1) {
+        event_loop_unwatch_fd(fi->inotify_fd);
+        close(fi->inotify_fd);
+    }
+    if (fi->dirty && fi->cache_file) cache_save(&fi->table, fi->cache_file, fi->root);
+
+    for (size_t wd = 0; wd < fi->watch_capacity; wd++) free(fi->watches[wd].dir);
+    free(fi->watches);
+    for (size_t i = 0; i < fi->pending_count; i++) free(fi->pending[i].path);
+    free(fi->pending);
+    free(fi->last_matches);
+    table_free(&fi->table);
+    gitignore_free_all(fi->ignores);
+    close(fi->root_fd);
+    free(fi->cache_file);
+    free(fi->root);
+    free(fi);
+}
+
+void file_index_rescan(FileIndex *fi) {
+    if (!fi) return;
+    fi->rescan = true;
+    file_index_next_job(fi);
+}
+
+void file_index_status(const FileIndex *fi, FileIndexStatus *status) {
+    memset(status, 0, sizeof(*status));
+    if (!fi) return;
+    status->files = fi->table.count - fi->table.removed;
+    status->scanning = fi->job || fi->rescan;
+    status->watching = fi->watching;
+}
@@ -0,0 +1,158 @@
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700  /* realpath() */
+#include "file_watch.h"
+#include "event_loop.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+/* A file is written in place, or replaced or deleted through its directory */
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | \
+                      IN_DELETE | IN_ONLYDIR)
+
+typedef struct FileWatch {
+    int id;
+    int wd;                     /* Of the directory; files in one share it */
+    char *name;                 /* Name in the directory */
+    FileWatchCallback cb;
+    void *data;
+    int timer;                  /* Pending callback, 0 if none */
+    struct FileWatch *next;
+} FileWatch;
+
+static int inotify_fd = -1;
+static FileWatch *watches = NULL;
+static int next_watch_id = 1;
+
+static FileWatch *find_watch(int id) {
+    for (FileWatch *w = watches; w; w = w->next) {
+        if (w->id == id) return w;
+    }
+    return NULL;
+}
+
+static void watch_settled(void *data) {
+    FileWatch *w = find_watch((int)(intptr_t)data);
+    if (!w) return;
+    w->timer = 0;
+    w->cb(w->data);
+}
+
+/* (Re)start the quiet period before w calls back */
+static void watch_touch(FileWatch *w) {
+    if (w->timer) event_loop_cancel_timer(w->timer);
+    w->timer = event_loop_add_timer(FILE_WATCH_SETTLE_MS, watch_settled, (void *)(intptr_t)w->id);
+    if (w->timer == -1) w->timer = 0;
+}
+
+static void file_watch_events(int fd, short revents, void *data) {
+    (void)revents;
+    (void)data;
+
+    union {
+        struct inotify_event ev;
+        char bytes[16384];
+    } buf;
+    ssize_t len;
+    while ((len = read(fd, buf.bytes, sizeof(buf.bytes))) > 0) {
+        for (char *p = buf.bytes; p < buf.bytes + len;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            for (FileWatch *w = watches; w; w = w->next) {
+                /* After an overflow any file may have changed; a directory
+                 * that is gone (IN_IGNORED) took its files with it */
+                if ((ev->mask & IN_Q_OVERFLOW) ||
+                    (w->wd == ev->wd && ((ev->mask & IN_IGNORED) ||
+                                         (ev->len && strcmp(ev->name, w->name) == 0)))) {
+                    watch_touch(w);
+                }
+            }
+        }
+    }
+}
+
+int file_watch_add(const char *path, FileWatchCallback cb, void *data) {
+    if (!path || !cb) return -1;
+
+    if (inotify_fd == -1) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd == -1) return -1;
+        if (event_loop_watch_fd(inotify_fd, POLLIN, file_watch_events, NULL) == -1) {
+            close(inotify_fd);
+            inotify_fd = -1;
+            return -1;
+        }
+    }
+
+    /* Follow a symlink to the file it names */
+    char resolved[PATH_MAX];
+    const char *file = realpath(path, resolved) ? resolved : path;
+
+    const char *slash = strrchr(file, '/');
+    const char *name = slash ? slash + 1 : file;
+    char dir[PATH_MAX];
+    if (!slash) {
+        strcpy(dir, ".");
+    } else if (slash == file) {
+        strcpy(dir, "/");
+    } else {
+        size_t dir_len = (size_t)(slash - file);
+        if (dir_len >= sizeof(dir)) return -1;
+        memcpy(dir, file, dir_len);
+        dir[dir_len] = '\0';
+    }
+    if (!*name) return -1;
+
+    FileWatch *w = calloc(1, sizeof(FileWatch));
+    if (!w) return -1;
+    w->name = strdup(name);
+    w->wd = w->name ? inotify_add_watch(inotify_fd, dir, WATCH_EVENTS) : -1;
+    if (w->wd == -1) {
+        free(w->name);
+        free(w);
+        return -1;
+    }
+
+    w->id = next_watch_id++;
+    w->cb = cb;
+    w->data = data;
+    w->next = watches;
+    watches = w;
+    return w->id;
+}
+
+void file_watch_remove(int id) {
+    for (FileWatch **link = &watches; *link; link = &(*link)->next) {
+        FileWatch *w = *link;
+        if (w->id != id) continue;
+
+        *link = w->next;
+        if (w->timer) event_loop_cancel_timer(w->timer);
+
+        /* The directory stays watched while another file in it is */
+        bool shared = false;
+        for (FileWatch *o = watches; o; o = o->next) {
+            if (o->wd == w->wd) shared = true;
+        }
+        if (!shared) inotify_rm_watch(inotify_fd, w->wd);
+
+        free(w->name);
+        free(w);
+        return;
+    }
+}
+
+void file_watch_shutdown(void) {
+    while (watches) file_watch_remove(watches->id);
+    if (inotify_fd != -1) {
+        event_loop_unwatch_fd(inotify_fd);
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+}
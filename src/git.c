@@ -0,0 +1,729 @@
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700  /* realpath() */
+#include "git.h"
+#include "diff.h"
+#include "process.h"
+#include "event_loop.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/* Matching rows kept on each side of an edit when re-diffing around it */
+#define GIT_DIFF_CONTEXT 8
+
+/* Give up on a cat-file reply that takes longer than this */
+#define GIT_HELPER_TIMEOUT_MS 2000
+
+/* Time a helper gets to exit after its stdin closes before it is killed */
+#define GIT_HELPER_EXIT_MS 200
+
+/* A work tree and its `git cat-file --batch` helper, shared by its files */
+typedef struct GitRepo {
+    char *root;
+    pid_t pid;              /* -1 until first use or after a failure */
+    int in_fd;
+    int out_fd;
+    char rbuf[4096];
+    size_t rpos;
+    size_t rlen;
+    int refs;
+    struct GitRepo *next;
+} GitRepo;
+
+/* Buffer rows [row, row + rows) replace HEAD lines [base, base + base_lines).
+ * rows == 0 is a pure deletion, shown on the row below it (or the last row). */
+typedef struct {
+    size_t row;
+    size_t rows;
+    size_t base;
+    size_t base_lines;
+} GitHunk;
+
+/* One diff of the buffer against HEAD, as hunks sorted by row. Immutable once
+ * published; only the main thread frees it, after a newer one replaced it. */
+typedef struct {
+    size_t num_rows;
+    size_t num_hunks;
+    GitHunk hunks[];
+} GitDiff;
+
+/* Background re-diff of the rows changed since the previous diff */
+typedef struct {
+    pthread_t thread;
+    BufferSnapshot *snapshot;
+    const DiffLine *base_lines;
+    size_t base_num_lines;
+    const GitDiff *prev;        /* Diff to patch, or NULL for a full diff */
+    size_t top;                 /* Rows untouched at either end since prev */
+    size_t bottom;
+    _Atomic(GitDiff *) *publish;
+    GitDiff *retired;           /* The diff this one replaced */
+    atomic_bool done;
+    bool failed;
+} GitDiffJob;
+
+struct GitFile {
+    GitRepo *repo;
+    char *path;                 /* Relative to repo->root */
+
+    /* HEAD version, split into lines - only replaced while no job runs */
+    char *base;
+    size_t base_len;
+    DiffLine *base_lines;
+    size_t base_num_lines;
+
+    _Atomic(GitDiff *) diff;    /* Latest result, read by the renderer */
+    GitDiffJob *job;            /* Diff in progress, or NULL */
+    unsigned long version;      /* Buffer version the last job started from */
+    bool submitted;
+    bool full_rediff;           /* Next job must not patch the current diff */
+};
+
+static GitRepo *repos = NULL;
+
+/* ===== Repository discovery ===== */
+
+/* Cut the last component off an absolute path ("/a/b" -> "/a", "/a" -> "/") */
+static void path_strip_last(char *path) {
+    char *slash = strrchr(path, '/');
+    if (!slash) return;
+    if (slash == path) {
+        path[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+}
+
+/* Absolute, resolved form of path; for a file that does not exist yet its directory is resolved */
+static char *path_resolve(const char *path) {
+    char *full = realpath(path, NULL);
+    if (full) return full;
+
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+    if (!dir) return NULL;
+    char *dir_full = realpath(dir, NULL);
+    free(dir);
+    if (!dir_full) return NULL;
+
+    const char *base = slash ? slash + 1 : path;
+    size_t len = strlen(dir_full) + 1 + strlen(base) + 1;
+    full = malloc(len);
+    if (full) snprintf(full, len, "%s/%s", strcmp(dir_full, "/") == 0 ? "" : dir_full, base);
+    free(dir_full);
+    return full;
+}
+
+char *git_find_root(const char *path) {
+    if (!path || !*path) return NULL;
+
+    char *full = path_resolve(path);
+    if (!full) return NULL;
+
+    struct stat st;
+    if (stat(full, &st) == -1 || !S_ISDIR(st.st_mode)) path_strip_last(full);
+
+    /* Room to append "/.git" in place */
+    size_t len = strlen(full);
+    char *dir = realloc(full, len + 6);
+    if (!dir) {
+        free(full);
+        return NULL;
+    }
+
+    for (;;) {
+        len = strlen(dir);
+        strcpy(dir + len, strcmp(dir, "/") == 0 ? ".git" : "/.git");
+        bool found = stat(dir, &st) == 0;  /* Directory, or a file for worktrees/submodules */
+        dir[len] = '\0';
+        if (found) return dir;
+        if (strcmp(dir, "/") == 0) break;
+        path_strip_last(dir);
+    }
+
+    free(dir);
+    return NULL;
+}
+
+/* ===== cat-file helper ===== */
+
+static void repo_stop_helper(GitRepo *repo) {
+    if (repo->pid == -1) return;
+    close(repo->in_fd);
+    close(repo->out_fd);
+
+    /* cat-file exits at EOF on stdin; make sure a wedged one does too */
+    pid_t done;
+    int waited_ms = 0;
+    while ((done = waitpid(repo->pid, NULL, WNOHANG)) == 0 && waited_ms < GIT_HELPER_EXIT_MS) {
+        struct timespec pause = {0, 1000000L};
+        nanosleep(&pause, NULL);
+        waited_ms++;
+    }
+    if (done == 0) {
+        kill(repo->pid, SIGTERM);
+        waitpid(repo->pid, NULL, 0);
+    }
+    repo->pid = -1;
+    repo->rpos = repo->rlen = 0;
+}
+
+static int repo_start_helper(GitRepo *repo) {
+    if (repo->pid != -1) return 0;
+
+    char *argv[] = {"git", "-C", repo->root, "cat-file", "--batch", NULL};
+    repo->pid = process_spawn_pipe(argv, &repo->in_fd, &repo->out_fd);
+    repo->rpos = repo->rlen = 0;
+    return repo->pid == -1 ? -1 : 0;
+}
+
+static int repo_fill(GitRepo *repo) {
+    struct pollfd pfd = {repo->out_fd, POLLIN, 0};
+    int ready;
+    do {
+        ready = poll(&pfd, 1, GIT_HELPER_TIMEOUT_MS);
+    } while (ready == -1 && errno == EINTR);
+    if (ready <= 0) return -1;
+
+    ssize_t n;
+    do {
+        n = read(repo->out_fd, repo->rbuf, sizeof(repo->rbuf));
+    } while (n == -1 && errno == EINTR);
+    if (n <= 0) return -1;
+
+    repo->rpos = 0;
+    repo->rlen = n;
+    return 0;
+}
+
+static int repo_read(GitRepo *repo, char *out, size_t len) {
+    while (len > 0) {
+        if (repo->rpos == repo->rlen && repo_fill(repo) == -1) return -1;
+        size_t n = repo->rlen - repo->rpos;
+        if (n > len) n = len;
+        memcpy(out, repo->rbuf + repo->rpos, n);
+        repo->rpos += n;
+        out += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int repo_read_line(GitRepo *repo, char *line, size_t size) {
+    size_t len = 0;
+    for (;;) {
+        char c;
+        if (repo_read(repo, &c, 1) == -1) return -1;
+        if (c == '\n') break;
+        if (len + 1 < size) line[len++] = c;
+    }
+    line[len] = '\0';
+    return 0;
+}
+
+static int repo_write_all(GitRepo *repo, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(repo->in_fd, data, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Fetch HEAD:path. Returns 1 with the blob, 0 if it is not in HEAD, -1 on error. */
+static int repo_cat_head(GitRepo *repo, const char *path, char **out, size_t *out_len) {
+    if (repo_start_helper(repo) == -1) return -1;
+
+    size_t req_len = strlen(path) + 6;
+    char *req = malloc(req_len + 1);
+    if (!req) return -1;
+    snprintf(req, req_len + 1, "HEAD:%s\n", path);
+    int rc = repo_write_all(repo, req, req_len);
+    free(req);
+
+    char header[256];
+    if (rc == -1 || repo_read_line(repo, header, sizeof(header)) == -1) {
+        repo_stop_helper(repo);
+        return -1;
+    }
+
+    /* "<oid> blob <size>" or "<name> missing" */
+    char type[32];
+    unsigned long long size;
+    if (sscanf(header, "%*s %31s %llu", type, &size) != 2) return 0;
+
+    char *blob = malloc(size + 1);
+    if (!blob) {
+        repo_stop_helper(repo);  /* The reply is still in the pipe */
+        return -1;
+    }
+    char nl;
+    if (repo_read(repo, blob, size) == -1 || repo_read(repo, &nl, 1) == -1) {
+        free(blob);
+        repo_stop_helper(repo);
+        return -1;
+    }
+    if (strcmp(type, "blob") != 0) {
+        free(blob);
+        return 0;
+    }
+
+    blob[size] = '\0';
+    *out = blob;
+    *out_len = size;
+    return 1;
+}
+
+static GitRepo *repo_get(const char *root) {
+    for (GitRepo *repo = repos; repo; repo = repo->next) {
+        if (strcmp(repo->root, root) == 0) {
+            repo->refs++;
+            return repo;
+        }
+    }
+
+    GitRepo *repo = calloc(1, sizeof(GitRepo));
+    if (!repo) return NULL;
+    repo->root = strdup(root);
+    if (!repo->root) {
+        free(repo);
+        return NULL;
+    }
+    repo->pid = -1;
+    repo->refs = 1;
+    repo->next = repos;
+    repos = repo;
+    return repo;
+}
+
+static void repo_put(GitRepo *repo) {
+    if (--repo->refs > 0) return;
+
+    for (GitRepo **pp = &repos; *pp; pp = &(*pp)->next) {
+        if (*pp == repo) {
+            *pp = repo->next;
+            break;
+        }
+    }
+    repo_stop_helper(repo);
+    free(repo->root);
+    free(repo);
+}
+
+/* ===== Diffing ===== */
+
+/* Growable hunk list; merges a hunk into the previous one when they touch */
+typedef struct {
+    GitDiff *diff;
+    size_t capacity;
+} GitDiffBuilder;
+
+static bool builder_add(GitDiffBuilder *b, size_t row, size_t rows, size_t base, size_t base_lines) {
+    GitDiff *d = b->diff;
+    if (d->num_hunks > 0) {
+        GitHunk *last = &d->hunks[d->num_hunks - 1];
+        if (last->row + last->rows == row && last->base + last->base_lines == base) {
+            last->rows += rows;
+            last->base_lines += base_lines;
+            return true;
+        }
+    }
+
+    if (d->num_hunks == b->capacity) {
+        size_t capacity = b->capacity ? b->capacity * 2 : 16;
+        GitDiff *grown = realloc(d, sizeof(GitDiff) + capacity * sizeof(GitHunk));
+        if (!grown) return false;
+        b->diff = d = grown;
+        b->capacity = capacity;
+    }
+    d->hunks[d->num_hunks++] = (GitHunk){row, rows, base, base_lines};
+    return true;
+}
+
+/* Diff rows [ws, we) of the snapshot against HEAD lines [bs, be) and append the hunks */
+static bool git_diff_window(const GitDiffJob *job, GitDiffBuilder *b, size_t ws, size_t we,
+                            size_t bs, size_t be) {
+    size_t wn = we - ws;
+    size_t wb = be - bs;
+    DiffLine *lines = malloc((wn ? wn : 1) * sizeof(DiffLine));
+    bool *row_changed = malloc(wn ? wn : 1);
+    bool *base_changed = malloc(wb ? wb : 1);
+    bool ok = false;
+    if (!lines || !row_changed || !base_changed) goto out;
+
+    BufferSnapshotIter it;
+    buffer_snapshot_iter_init(&it, job->snapshot, ws);
+    for (size_t j = 0; j < wn; j++) {
+        const BufferRow *row = buffer_snapshot_iter_next(&it);
+        lines[j].data = row->data;
+        lines[j].len = row->size;
+        lines[j].hash = diff_hash_line(row->data, row->size);
+    }
+
+    if (diff_lines(job->base_lines + bs, wb, lines, wn, base_changed, row_changed) == -1) goto out;
+
+    size_t i = 0, j = 0;
+    while (i < wb || j < wn) {
+        if (i < wb && j < wn && !base_changed[i] && !row_changed[j]) {
+            i++;
+            j++;
+            continue;
+        }
+
+        size_t hi = i, hj = j;
+        while (i < wb && base_changed[i]) i++;
+        while (j < wn && row_changed[j]) j++;
+        if (i == hi && j == hj) break;  /* Marks out of step - cannot happen */
+        if (!builder_add(b, ws + hj, j - hj, bs + hi, i - hi)) goto out;
+    }
+    ok = true;
+
+out:
+    free(lines);
+    free(row_changed);
+    free(base_changed);
+    return ok;
+}
+
+/* Build the new diff. Hunks away from the edits are carried over from the
+ * previous diff; only a window around the changed rows, widened to
+ * GIT_DIFF_CONTEXT matching rows on each side, is diffed again. */
+static GitDiff *git_diff_compute(const GitDiffJob *job) {
+    const GitDiff *prev = job->prev;
+    size_t n = buffer_snapshot_num_rows(job->snapshot);
+    size_t nb = job->base_num_lines;
+
+    GitDiffBuilder b;
+    b.capacity = prev ? prev->num_hunks + 16 : 16;
+    b.diff = malloc(sizeof(GitDiff) + b.capacity * sizeof(GitHunk));
+    if (!b.diff) return NULL;
+    b.diff->num_rows = n;
+    b.diff->num_hunks = 0;
+
+    /* Rows [ws, we) against HEAD lines [bs, be); prev rows [ws, oe) are replaced */
+    size_t ws = 0, we = n, bs = 0, be = nb;
+    size_t first_suffix = 0;    /* prev hunks from here on lie below the window */
+    size_t oe = 0;
+
+    if (prev) {
+        const GitHunk *h = prev->hunks;
+        size_t nh = prev->num_hunks;
+        size_t old_n = prev->num_rows;
+        size_t top = job->top, bottom = job->bottom;
+        if (top > old_n) top = old_n;
+        if (top > n) top = n;
+        if (bottom > old_n - top) bottom = old_n - top;
+        if (bottom > n - top) bottom = n - top;
+
+        /* Upwards from the first changed row: matching rows are the gaps between hunks */
+        size_t lo = 0, hi = nh;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (h[mid].row < top) lo = mid + 1; else hi = mid;
+        }
+        size_t k = lo;              /* Hunks [0, k) start above top */
+        size_t y = top, context = 0;
+        while (y > 0) {
+            size_t gap_start = k > 0 ? h[k - 1].row + h[k - 1].rows : 0;
+            if (gap_start > y) gap_start = y;
+            if (context + (y - gap_start) >= GIT_DIFF_CONTEXT) {
+                size_t anchor = y - (GIT_DIFF_CONTEXT - context);
+                size_t delta_base = k > 0 ? h[k - 1].base + h[k - 1].base_lines : 0;
+                size_t delta_row = k > 0 ? h[k - 1].row + h[k - 1].rows : 0;
+                ws = anchor + 1;
+                bs = anchor + 1 + delta_base - delta_row;
+                break;
+            }
+            context += y - gap_start;
+            if (k == 0) break;
+            y = h[--k].row;
+        }
+
+        /* Downwards from the last changed row, in prev's row numbers */
+        y = old_n - bottom;
+        lo = 0;
+        hi = nh;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (h[mid].row + h[mid].rows <= y && h[mid].row < y) lo = mid + 1; else hi = mid;
+        }
+        k = lo;                     /* First hunk at or below y */
+        oe = old_n;
+        context = 0;
+        while (y < old_n) {
+            size_t gap_end = k < nh ? h[k].row : old_n;
+            if (gap_end < y) gap_end = y;
+            if (context + (gap_end - y) >= GIT_DIFF_CONTEXT) {
+                size_t anchor = y + (GIT_DIFF_CONTEXT - context) - 1;
+                size_t delta_base = k > 0 ? h[k - 1].base + h[k - 1].base_lines : 0;
+                size_t delta_row = k > 0 ? h[k - 1].row + h[k - 1].rows : 0;
+                oe = anchor;
+                be = anchor + delta_base - delta_row;
+                break;
+            }
+            context += gap_end - y;
+            if (k == nh) break;
+            if (h[k].row + h[k].rows > y) y = h[k].row + h[k].rows;
+            k++;
+        }
+        we = n - (old_n - oe);
+
+        /* Hunks wholly above the top anchor stay as they are */
+        size_t p = 0;
+        while (p < nh && h[p].base + h[p].base_lines < bs) {
+            b.diff->hunks[b.diff->num_hunks++] = h[p++];
+        }
+        first_suffix = p;
+        while (first_suffix < nh && h[first_suffix].base <= be) first_suffix++;
+        if (oe == old_n) first_suffix = nh;
+    }
+
+    if (!git_diff_window(job, &b, ws, we, bs, be)) {
+        free(b.diff);
+        return NULL;
+    }
+
+    if (prev) {
+        /* Hunks below the bottom anchor just move with the rows inserted or removed */
+        for (size_t p = first_suffix; p < prev->num_hunks; p++) {
+            GitHunk moved = prev->hunks[p];
+            moved.row = moved.row - oe + we;
+            if (!builder_add(&b, moved.row, moved.rows, moved.base, moved.base_lines)) {
+                free(b.diff);
+                return NULL;
+            }
+        }
+    }
+    return b.diff;
+}
+
+/* Wakes the main loop; the redraw that follows reaps the job */
+static void git_diff_ready(void *data) {
+    (void)data;
+}
+
+static void *git_diff_main(void *arg) {
+    GitDiffJob *job = arg;
+
+    GitDiff *d = git_diff_compute(job);
+    if (d) {
+        job->retired = atomic_exchange(job->publish, d);
+    } else {
+        job->failed = true;
+    }
+    buffer_snapshot_release(job->snapshot);
+    job->snapshot = NULL;
+
+    atomic_store(&job->done, true);
+    event_loop_post(git_diff_ready, NULL);
+    return NULL;
+}
+
+/* Collect a job; with wait, block until it finishes first */
+static bool git_file_reap(GitFile *gf, bool wait) {
+    GitDiffJob *job = gf->job;
+    if (!job) return true;
+    if (!wait && !atomic_load(&job->done)) return false;
+
+    pthread_join(job->thread, NULL);
+    if (job->failed) gf->full_rediff = true;  /* Its changes were taken but never applied */
+    free(job->retired);
+    free(job);
+    gf->job = NULL;
+    return true;
+}
+
+/* ===== Files ===== */
+
+static void git_file_clear_base(GitFile *gf) {
+    free(gf->base);
+    free(gf->base_lines);
+    gf->base = NULL;
+    gf->base_len = 0;
+    gf->base_lines = NULL;
+    gf->base_num_lines = 0;
+}
+
+/* Split the blob the way buffer_open splits a file */
+static int git_file_split_base(GitFile *gf) {
+    size_t count = 0;
+    for (size_t i = 0; i < gf->base_len; i++) {
+        if (gf->base[i] == '\n') count++;
+    }
+    if (gf->base_len > 0 && gf->base[gf->base_len - 1] != '\n') count++;
+
+    gf->base_lines = malloc((count ? count : 1) * sizeof(DiffLine));
+    if (!gf->base_lines) return -1;
+
+    size_t start = 0;
+    size_t n = 0;
+    while (start < gf->base_len) {
+        const char *line = gf->base + start;
+        const char *nl = memchr(line, '\n', gf->base_len - start);
+        size_t len = nl ? (size_t)(nl - line) : gf->base_len - start;
+        start += len + 1;
+        while (len > 0 && line[len - 1] == '\r') len--;
+
+        gf->base_lines[n].data = line;
+        gf->base_lines[n].len = len;
+        gf->base_lines[n].hash = diff_hash_line(line, len);
+        n++;
+    }
+    gf->base_num_lines = n;
+    return 0;
+}
+
+int git_file_reload(GitFile *gf) {
+    if (!gf) return -1;
+
+    /* A running diff reads the old lines; the next one starts from scratch */
+    git_file_reap(gf, true);
+    git_file_clear_base(gf);
+    gf->full_rediff = true;
+    gf->submitted = false;
+
+    int rc = repo_cat_head(gf->repo, gf->path, &gf->base, &gf->base_len);
+    if (rc == -1) {
+        /* Retry once with a fresh helper in case the old one died */
+        rc = repo_cat_head(gf->repo, gf->path, &gf->base, &gf->base_len);
+    }
+    if (rc <= 0) return rc;
+
+    if (git_file_split_base(gf) == -1) {
+        git_file_clear_base(gf);
+        return -1;
+    }
+    return 0;
+}
+
+GitFile *git_file_open(const char *filename) {
+    char *root = git_find_root(filename);
+    if (!root) return NULL;
+
+    char *full = path_resolve(filename);
+    size_t root_len = strlen(root);
+    if (!full || strncmp(full, root, root_len) != 0 || full[root_len] != '/' ||
+        strchr(full, '\n')) {
+        /* Not below the root (or a name cat-file cannot take) */
+        free(full);
+        free(root);
+        return NULL;
+    }
+
+    GitFile *gf = calloc(1, sizeof(GitFile));
+    if (gf) {
+        atomic_init(&gf->diff, NULL);
+        gf->path = strdup(full + root_len + 1);
+        gf->repo = repo_get(root);
+    }
+    free(full);
+    free(root);
+    if (!gf || !gf->path || !gf->repo) {
+        if (gf) {
+            if (gf->repo) repo_put(gf->repo);
+            free(gf->path);
+            free(gf);
+        }
+        return NULL;
+    }
+
+    git_file_reload(gf);
+    return gf;
+}
+
+void git_file_close(GitFile *gf) {
+    if (!gf) return;
+    git_file_reap(gf, true);
+    free(atomic_load(&gf->diff));
+    git_file_clear_base(gf);
+    free(gf->path);
+    repo_put(gf->repo);
+    free(gf);
+}
+
+const char *git_file_root(const GitFile *gf) {
+    return gf ? gf->repo->root : NULL;
+}
+
+void git_file_update(GitFile *gf, Buffer *buf) {
+    if (!gf || !buf) return;
+
+    /* One diff at a time; the next one patches its result */
+    if (!git_file_reap(gf, false)) return;
+    if (gf->submitted && gf->version == buf->version) return;
+
+    GitDiffJob *job = calloc(1, sizeof(GitDiffJob));
+    if (!job) return;
+    job->snapshot = buffer_snapshot_acquire(buf);
+    if (!job->snapshot) {
+        free(job);
+        return;
+    }
+    job->base_lines = gf->base_lines;
+    job->base_num_lines = gf->base_num_lines;
+    job->prev = gf->full_rediff ? NULL : atomic_load(&gf->diff);
+    job->publish = &gf->diff;
+    atomic_init(&job->done, false);
+    buffer_take_changes(buf, &job->top, &job->bottom);
+
+    gf->version = buf->version;
+    if (pthread_create(&job->thread, NULL, git_diff_main, job) != 0) {
+        buffer_snapshot_release(job->snapshot);
+        free(job);
+        gf->full_rediff = true;  /* The changes just taken are gone */
+        gf->submitted = false;
+        return;
+    }
+    gf->job = job;
+    gf->submitted = true;
+    gf->full_rediff = false;
+}
+
+GitLineStatus git_file_line_status(GitFile *gf, size_t row) {
+    GitDiff *d = gf ? atomic_load(&gf->diff) : NULL;
+    if (!d || row >= d->num_rows) return GIT_LINE_UNCHANGED;
+
+    /* First hunk that covers the row, or is a deletion just above it */
+    const GitHunk *h = d->hunks;
+    size_t lo = 0, hi = d->num_hunks;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (h[mid].row + (h[mid].rows ? h[mid].rows : 1) <= row) lo = mid + 1; else hi = mid;
+    }
+
+    if (lo < d->num_hunks && h[lo].row <= row) {
+        if (h[lo].rows == 0) return GIT_LINE_DELETED;
+        return h[lo].base_lines > 0 ? GIT_LINE_MODIFIED : GIT_LINE_ADDED;
+    }
+
+    /* Lines removed at the very end show on the last row */
+    if (row == d->num_rows - 1 && d->num_hunks > 0) {
+        const GitHunk *last = &h[d->num_hunks - 1];
+        if (last->rows == 0 && last->row == d->num_rows) return GIT_LINE_DELETED;
+    }
+    return GIT_LINE_UNCHANGED;
+}
+
+void git_shutdown(void) {
+    while (repos) {
+        GitRepo *repo = repos;
+        repos = repo->next;
+        repo_stop_helper(repo);
+        free(repo->root);
+        free(repo);
+    }
+}
@@ -0,0 +1,279 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE  /* d_type */
+#include "gitignore.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct {
+    char *pattern;      /* Glob, without the ! and the trailing / */
+    bool negate;
+    bool dir_only;
+    bool anchored;      /* Matched against the path from the .gitignore's directory */
+} IgnoreRule;
+
+/* The rules of one .gitignore. Those of the directories above apply too;
+ * deeper files take precedence. */
+struct IgnoreList {
+    const struct IgnoreList *parent;
+    char *base;         /* Its directory, relative to the root ("" for the root) */
+    size_t base_len;
+    IgnoreRule *rules;
+    size_t count;
+    struct IgnoreList *next_alloc;
+};
+
+/* [...] at *p against c; advances *p past the ]. -1 if the class is unclosed. */
+static int glob_class(const char **p, char c) {
+    const char *s = *p + 1;
+    bool negate = *s == '!' || *s == '^';
+    if (negate) s++;
+
+    bool match = false;
+    const char *first = s;
+    while (*s && (*s != ']' || s == first)) {
+        char lo = *s, hi = *s;
+        if (s[1] == '-' && s[2] && s[2] != ']') {
+            hi = s[2];
+            s += 2;
+        }
+        if (c >= lo && c <= hi) match = true;
+        s++;
+    }
+    if (*s != ']') return -1;
+    *p = s + 1;
+    return match != negate;
+}
+
+/* Gitignore glob: * ? and [...] stay within a path component, ** crosses them */
+static bool glob_match(const char *p, const char *s) {
+    for (;;) {
+        switch (*p) {
+            case '\0':
+                return *s == '\0';
+
+            case '*':
+                if (p[1] == '*') {
+                    /* "**" then "/": zero or more whole directories */
+                    p += 2;
+                    if (*p == '\0') return true;
+                    if (*p == '/') p++;
+                    for (;;) {
+                        if (glob_match(p, s)) return true;
+                        const char *slash = strchr(s, '/');
+                        if (!slash) return false;
+                        s = slash + 1;
+                    }
+                }
+                p++;
+                for (;;) {
+                    if (glob_match(p, s)) return true;
+                    if (*s == '\0' || *s == '/') return false;
+                    s++;
+                }
+
+            case '?':
+                if (*s == '\0' || *s == '/') return false;
+                p++;
+                s++;
+                break;
+
+            case '[': {
+                if (*s == '\0' || *s == '/') return false;
+                int m = glob_class(&p, *s);
+                if (m < 0) {
+                    if (*s != '[') return false;  /* Unclosed: a literal [ */
+                    p++;
+                } else if (!m) {
+                    return false;
+                }
+                s++;
+                break;
+            }
+
+            case '\\':
+                if (p[1]) p++;
+                /* fall through */
+            default:
+                if (*p != *s) return false;
+                p++;
+                s++;
+                break;
+        }
+    }
+}
+
+static bool ignore_parse_line(char *line, IgnoreRule *rule) {
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' ||
+                       (line[len - 1] == ' ' && (len < 2 || line[len - 2] != '\\')))) {
+        line[--len] = '\0';
+    }
+    if (len == 0 || line[0] == '#') return false;
+
+    rule->negate = line[0] == '!';
+    if (rule->negate) line++;
+    else if (line[0] == '\\' && (line[1] == '#' || line[1] == '!')) line++;
+
+    len = strlen(line);
+    rule->dir_only = len > 0 && line[len - 1] == '/';
+    if (rule->dir_only) line[--len] = '\0';
+    if (len == 0) return false;
+
+    rule->anchored = strchr(line, '/') != NULL;
+    if (line[0] == '/') line++;
+    rule->pattern = strdup(line);
+    return rule->pattern != NULL;
+}
+
+IgnoreList *gitignore_load(int dir_fd, const char *base, const IgnoreList *parent) {
+    int fd = openat(dir_fd, ".gitignore", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+    FILE *f = fdopen(fd, "r");
+    if (!f) {
+        close(fd);
+        return NULL;
+    }
+
+    IgnoreList *list = calloc(1, sizeof(IgnoreList));
+    if (!list || !(list->base = strdup(base))) {
+        free(list);
+        fclose(f);
+        return NULL;
+    }
+    list->parent = parent;
+    list->base_len = strlen(base);
+
+    char *line = NULL;
+    size_t line_cap = 0, capacity = 0;
+    while (getline(&line, &line_cap, f) != -1) {
+        IgnoreRule rule;
+        if (!ignore_parse_line(line, &rule)) continue;
+        if (list->count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            IgnoreRule *rules = realloc(list->rules, capacity * sizeof(IgnoreRule));
+            if (!rules) {
+                free(rule.pattern);
+                break;
+            }
+            list->rules = rules;
+        }
+        list->rules[list->count++] = rule;
+    }
+    free(line);
+    fclose(f);
+    return list;
+}
+
+void gitignore_keep(IgnoreList **all, IgnoreList *lists) {
+    if (!lists) return;
+    IgnoreList *last = lists;
+    while (last->next_alloc) last = last->next_alloc;
+    last->next_alloc = *all;
+    *all = lists;
+}
+
+void gitignore_free_all(IgnoreList *all) {
+    while (all) {
+        IgnoreList *next = all->next_alloc;
+        for (size_t i = 0; i < all->count; i++) free(all->rules[i].pattern);
+        free(all->rules);
+        free(all->base);
+        free(all);
+        all = next;
+    }
+}
+
+/* The last rule that matches decides, in the deepest .gitignore with one */
+bool gitignore_match(const IgnoreList *list, const char *path, const char *name, bool is_dir) {
+    for (; list; list = list->parent) {
+        const char *rel = path;
+        if (list->base_len > 0) {
+            if (strncmp(path, list->base, list->base_len) != 0 || path[list->base_len] != '/') {
+                continue;
+            }
+            rel = path + list->base_len + 1;
+        }
+
+        for (size_t i = list->count; i-- > 0;) {
+            const IgnoreRule *rule = &list->rules[i];
+            if (rule->dir_only && !is_dir) continue;
+            if (glob_match(rule->pattern, rule->anchored ? rel : name)) return !rule->negate;
+        }
+    }
+    return false;
+}
+
+/* ===== Walking ===== */
+
+char *gitignore_child_path(const char *dir, const char *name) {
+    size_t dir_len = strlen(dir), name_len = strlen(name);
+    char *path = malloc(dir_len + name_len + 2);
+    if (!path) return NULL;
+    if (dir_len > 0) {
+        memcpy(path, dir, dir_len);
+        path[dir_len++] = '/';
+    }
+    memcpy(path + dir_len, name, name_len + 1);
+    return path;
+}
+
+bool gitignore_dir_open(GitignoreDir *gd, int root_fd, const char *base, const IgnoreList *parent) {
+    int fd = openat(root_fd, base[0] ? base : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) return false;
+    gd->dir = fdopendir(fd);
+    if (!gd->dir) {
+        close(fd);
+        return false;
+    }
+
+    gd->base = base;
+    gd->own = gitignore_load(fd, base, parent);
+    gd->ignore = gd->own ? gd->own : parent;
+    gd->failed = false;
+    return true;
+}
+
+char *gitignore_dir_next(GitignoreDir *gd, bool *is_dir) {
+    struct dirent *entry;
+    while ((entry = readdir(gd->dir))) {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0) {
+            continue;
+        }
+
+        /* Symlinked files are listed; symlinked directories are not
+         * followed, so the walk cannot loop */
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK) {
+            struct stat st;
+            int flags = type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW;
+            if (fstatat(dirfd(gd->dir), name, &st, flags) == -1) continue;
+            if (S_ISREG(st.st_mode)) type = DT_REG;
+            else if (S_ISDIR(st.st_mode) && type == DT_UNKNOWN) type = DT_DIR;
+            else continue;
+        }
+        if (type != DT_REG && type != DT_DIR) continue;
+
+        char *path = gitignore_child_path(gd->base, name);
+        if (!path) {
+            gd->failed = true;
+            return NULL;
+        }
+        if (gitignore_match(gd->ignore, path, name, type == DT_DIR)) {
+            free(path);
+            continue;
+        }
+        *is_dir = type == DT_DIR;
+        return path;
+    }
+    return NULL;
+}
+
+void gitignore_dir_close(GitignoreDir *gd) {
+    closedir(gd->dir);
+    gd->dir = NULL;
+}
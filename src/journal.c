@@ -0,0 +1,618 @@
+#define _POSIX_C_SOURCE 200809L
+#include "journal.h"
+#include "buffer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define JOURNAL_MAGIC "OCCEJNL1"
+#define JOURNAL_INITIAL_CAPACITY 4096
+
+/* Record opcodes */
+#define JOURNAL_OP_INSERT 'I'   /* u32 y, u32 x, u32 len, bytes[len] */
+#define JOURNAL_OP_DELETE 'D'   /* u32 y1, u32 x1, u32 y2, u32 x2 */
+
+/* Swap file header - identifies the on-disk file the records apply to */
+typedef struct {
+    char magic[8];
+    uint64_t base_size;
+    int64_t base_mtime;         /* Nanoseconds, so two saves in one second differ */
+} JournalHeader;
+
+struct Journal {
+    char *path;                 /* Swap file path */
+    int fd;
+
+    pthread_mutex_t lock;       /* Guards everything below */
+    char *pending;              /* Records not yet handed to the writer */
+    size_t pending_len;
+    size_t pending_cap;
+    bool reset_pending;         /* Writer must truncate and rewrite the header */
+    JournalHeader header;
+
+    char *recovery;             /* Records left by a crashed session */
+    size_t recovery_len;
+
+    bool capturing;             /* Copy new records aside while a background save runs */
+    char *capture;
+    size_t capture_len;
+    size_t capture_cap;
+
+    /* Owned by the writer thread */
+    char *spare;
+    size_t spare_cap;
+
+    unsigned flush_round;       /* Writer pass that last flushed it (writer_lock) */
+    struct Journal *next;
+};
+
+/* Background writer state */
+static pthread_t writer_thread;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t writer_idle = PTHREAD_COND_INITIALIZER;
+static Journal *journal_list = NULL;
+static Journal *writer_busy = NULL;     /* Being flushed, with writer_lock released */
+static bool writer_running = false;
+
+/* Build the swap file path: dir/.name.occe.swp */
+static char *journal_swap_path(const char *filename) {
+    const char *slash = strrchr(filename, '/');
+    size_t dir_len = slash ? (size_t)(slash - filename + 1) : 0;
+    const char *base = slash ? slash + 1 : filename;
+
+    size_t len = dir_len + strlen(base) + strlen("..occe.swp") + 1;
+    char *path = malloc(len);
+    if (!path) return NULL;
+
+    snprintf(path, len, "%.*s.%s.occe.swp", (int)dir_len, filename, base);
+    return path;
+}
+
+static void journal_stat_base(const char *filename, JournalHeader *hdr) {
+    struct stat st;
+
+    memcpy(hdr->magic, JOURNAL_MAGIC, sizeof(hdr->magic));
+    if (stat(filename, &st) == 0) {
+        hdr->base_size = (uint64_t)st.st_size;
+        hdr->base_mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    } else {
+        hdr->base_size = 0;
+        hdr->base_mtime = 0;
+    }
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Append raw bytes to a growable record area */
+static void bytes_append(char **area, size_t *area_len, size_t *area_cap, const void *data, size_t len) {
+    if (*area_len + len > *area_cap) {
+        size_t new_cap = *area_cap == 0 ? JOURNAL_INITIAL_CAPACITY : *area_cap;
+        while (new_cap < *area_len + len) new_cap *= 2;
+        char *new_area = realloc(*area, new_cap);
+        if (!new_area) return;  /* Record dropped, editing continues */
+        *area = new_area;
+        *area_cap = new_cap;
+    }
+
+    memcpy(*area + *area_len, data, len);
+    *area_len += len;
+}
+
+/* Append raw bytes to the pending area (caller holds j->lock) */
+static void journal_append(Journal *j, const void *data, size_t len) {
+    bytes_append(&j->pending, &j->pending_len, &j->pending_cap, data, len);
+    if (j->capturing) {
+        bytes_append(&j->capture, &j->capture_len, &j->capture_cap, data, len);
+    }
+}
+
+static void journal_append_u32(Journal *j, uint32_t v) {
+    journal_append(j, &v, sizeof(v));
+}
+
+/* Editing while a recovery is offered means the user declined it */
+static void journal_decline_recovery(Journal *j) {
+    if (j->recovery) {
+        free(j->recovery);
+        j->recovery = NULL;
+        j->recovery_len = 0;
+    }
+}
+
+/* Hand pending records to disk - runs on the writer thread only */
+static void journal_flush(Journal *j) {
+    pthread_mutex_lock(&j->lock);
+
+    /* Keep the old swap file untouched until the user decides about recovery */
+    if (j->recovery || (!j->reset_pending && j->pending_len == 0)) {
+        pthread_mutex_unlock(&j->lock);
+        return;
+    }
+
+    char *data = j->pending;
+    size_t len = j->pending_len;
+    size_t cap = j->pending_cap;
+    j->pending = j->spare;
+    j->pending_cap = j->spare_cap;
+    j->pending_len = 0;
+
+    bool reset = j->reset_pending;
+    JournalHeader header = j->header;
+    j->reset_pending = false;
+
+    pthread_mutex_unlock(&j->lock);
+
+    if (reset) {
+        if (ftruncate(j->fd, 0) == 0 && lseek(j->fd, 0, SEEK_SET) == 0) {
+            write_all(j->fd, (const char *)&header, sizeof(header));
+        }
+    }
+    if (len > 0) {
+        write_all(j->fd, data, len);
+    }
+    fdatasync(j->fd);
+
+    j->spare = data;
+    j->spare_cap = cap;
+}
+
+static void *journal_writer_main(void *arg) {
+    (void)arg;
+    unsigned round = 0;
+
+    pthread_mutex_lock(&writer_lock);
+    while (writer_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += JOURNAL_SYNC_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (long)(JOURNAL_SYNC_INTERVAL_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&writer_cond, &writer_lock, &deadline);
+
+        /* Each journal is flushed with writer_lock released, so opening or
+         * closing another buffer never waits out a write and fdatasync */
+        round++;
+        for (;;) {
+            Journal *j = journal_list;
+            while (j && j->flush_round == round) j = j->next;
+            if (!j) break;
+
+            j->flush_round = round;
+            writer_busy = j;
+            pthread_mutex_unlock(&writer_lock);
+            journal_flush(j);
+            pthread_mutex_lock(&writer_lock);
+            writer_busy = NULL;
+            pthread_cond_broadcast(&writer_idle);
+        }
+    }
+    pthread_mutex_unlock(&writer_lock);
+
+    return NULL;
+}
+
+int journal_init(void) {
+    pthread_mutex_lock(&writer_lock);
+    if (writer_running) {
+        pthread_mutex_unlock(&writer_lock);
+        return 0;
+    }
+    writer_running = true;
+    pthread_mutex_unlock(&writer_lock);
+
+    if (pthread_create(&writer_thread, NULL, journal_writer_main, NULL) != 0) {
+        writer_running = false;
+        return -1;
+    }
+    return 0;
+}
+
+void journal_shutdown(void) {
+    pthread_mutex_lock(&writer_lock);
+    if (!writer_running) {
+        pthread_mutex_unlock(&writer_lock);
+        return;
+    }
+    writer_running = false;
+    pthread_cond_signal(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+
+    pthread_join(writer_thread, NULL);
+}
+
+/* Read an existing swap file; keep its records if they apply to the file on disk */
+static void journal_load_recovery(Journal *j) {
+    int fd = open(j->path, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size <= sizeof(JournalHeader)) {
+        close(fd);
+        return;
+    }
+
+    size_t size = (size_t)st.st_size;
+    char *data = malloc(size);
+    if (!data) {
+        close(fd);
+        return;
+    }
+
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, data + got, size - got);
+        if (n <= 0) break;
+        got += n;
+    }
+    close(fd);
+
+    JournalHeader old;
+    if (got <= sizeof(old)) {
+        free(data);
+        return;
+    }
+    memcpy(&old, data, sizeof(old));
+
+    /* Stale swap: the file was saved or changed after these edits */
+    if (memcmp(old.magic, JOURNAL_MAGIC, sizeof(old.magic)) != 0 ||
+        old.base_size != j->header.base_size || old.base_mtime != j->header.base_mtime) {
+        free(data);
+        return;
+    }
+
+    j->recovery_len = got - sizeof(old);
+    memmove(data, data + sizeof(old), j->recovery_len);
+    j->recovery = data;
+}
+
+Journal *journal_open(const char *filename) {
+    if (!filename) return NULL;
+
+    Journal *j = calloc(1, sizeof(Journal));
+    if (!j) return NULL;
+
+    j->path = journal_swap_path(filename);
+    if (!j->path) {
+        free(j);
+        return NULL;
+    }
+
+    journal_stat_base(filename, &j->header);
+    journal_load_recovery(j);
+
+    /* Not truncated here: a pending recovery must survive until the user decides */
+    j->fd = open(j->path, O_WRONLY | O_CREAT, 0600);
+    if (j->fd < 0) {
+        free(j->recovery);
+        free(j->path);
+        free(j);
+        return NULL;
+    }
+
+    pthread_mutex_init(&j->lock, NULL);
+    j->reset_pending = true;
+
+    pthread_mutex_lock(&writer_lock);
+    j->next = journal_list;
+    journal_list = j;
+    pthread_mutex_unlock(&writer_lock);
+
+    return j;
+}
+
+void journal_close(Journal *j) {
+    if (!j) return;
+
+    /* Unlink from the writer first so it never touches a closed fd; only a
+     * flush of this journal already under way is waited for */
+    pthread_mutex_lock(&writer_lock);
+    Journal **jp = &journal_list;
+    while (*jp && *jp != j) jp = &(*jp)->next;
+    if (*jp) *jp = j->next;
+    while (writer_busy == j) pthread_cond_wait(&writer_idle, &writer_lock);
+    pthread_mutex_unlock(&writer_lock);
+
+    close(j->fd);
+    if (!j->recovery) {
+        unlink(j->path);
+    }
+
+    pthread_mutex_destroy(&j->lock);
+    free(j->pending);
+    free(j->spare);
+    free(j->recovery);
+    free(j->capture);
+    free(j->path);
+    free(j);
+}
+
+void journal_record_insert(Journal *j, int x, int y, const char *text, size_t len) {
+    if (!j) return;
+
+    pthread_mutex_lock(&j->lock);
+    journal_decline_recovery(j);
+    char op = JOURNAL_OP_INSERT;
+    journal_append(j, &op, 1);
+    journal_append_u32(j, (uint32_t)y);
+    journal_append_u32(j, (uint32_t)x);
+    journal_append_u32(j, (uint32_t)len);
+    journal_append(j, text, len);
+    pthread_mutex_unlock(&j->lock);
+}
+
+void journal_record_delete(Journal *j, int x1, int y1, int x2, int y2) {
+    if (!j) return;
+
+    pthread_mutex_lock(&j->lock);
+    journal_decline_recovery(j);
+    char op = JOURNAL_OP_DELETE;
+    journal_append(j, &op, 1);
+    journal_append_u32(j, (uint32_t)y1);
+    journal_append_u32(j, (uint32_t)x1);
+    journal_append_u32(j, (uint32_t)y2);
+    journal_append_u32(j, (uint32_t)x2);
+    pthread_mutex_unlock(&j->lock);
+}
+
+void journal_reset(Journal *j, const char *filename) {
+    if (!j || !filename) return;
+
+    JournalHeader header;
+    journal_stat_base(filename, &header);
+
+    pthread_mutex_lock(&j->lock);
+    journal_decline_recovery(j);
+    j->pending_len = 0;
+    j->capturing = false;
+    j->capture_len = 0;
+    j->header = header;
+    j->reset_pending = true;
+    pthread_mutex_unlock(&j->lock);
+}
+
+void journal_checkpoint_begin(Journal *j) {
+    if (!j) return;
+
+    pthread_mutex_lock(&j->lock);
+    j->capturing = true;
+    j->capture_len = 0;
+    pthread_mutex_unlock(&j->lock);
+}
+
+void journal_checkpoint_commit(Journal *j, const char *filename) {
+    if (!j || !filename) return;
+
+    JournalHeader header;
+    journal_stat_base(filename, &header);
+
+    pthread_mutex_lock(&j->lock);
+    if (j->capturing) {
+        /* Everything before the mark is in the new file; replay only what came after */
+        j->pending_len = 0;
+        bytes_append(&j->pending, &j->pending_len, &j->pending_cap, j->capture, j->capture_len);
+        j->capturing = false;
+        j->capture_len = 0;
+        j->header = header;
+        j->reset_pending = true;
+    }
+    pthread_mutex_unlock(&j->lock);
+}
+
+void journal_checkpoint_abort(Journal *j) {
+    if (!j) return;
+
+    pthread_mutex_lock(&j->lock);
+    j->capturing = false;
+    j->capture_len = 0;
+    pthread_mutex_unlock(&j->lock);
+}
+
+bool journal_has_recovery(Journal *j) {
+    if (!j) return false;
+
+    pthread_mutex_lock(&j->lock);
+    bool has = j->recovery != NULL;
+    pthread_mutex_unlock(&j->lock);
+    return has;
+}
+
+/* ===== Replay ===== */
+
+/* Make sure row y exists, appending empty rows as the live edit did */
+static void journal_ensure_row(Buffer *buf, uint32_t y) {
+    while (buf->num_rows <= y) {
+        size_t before = buf->num_rows;
+        buffer_append_row(buf, "", 0);
+        if (buf->num_rows == before) return;
+    }
+}
+
+static bool journal_row_reserve(BufferRow *row, size_t needed) {
+    if (row->capacity >= needed + 1) return true;
+
+    size_t new_cap = row->capacity == 0 ? 16 : row->capacity;
+    while (new_cap < needed + 1) new_cap *= 2;
+    char *new_data = realloc(row->data, new_cap);
+    if (!new_data) return false;
+    row->data = new_data;
+    row->capacity = new_cap;
+    return true;
+}
+
+static void journal_apply_insert(Buffer *buf, uint32_t y, uint32_t x, const char *text, size_t len) {
+    journal_ensure_row(buf, y);
+    if (y >= buf->num_rows) return;
+
+    BufferRow *row = buffer_row_mut(buf, y);
+    if (!row) return;
+    if (x > row->size) x = row->size;
+
+    /* Detach the tail after the insertion point; it ends up after the last line */
+    size_t tail_len = row->size - x;
+    char *tail = malloc(tail_len + 1);
+    if (!tail) return;
+    memcpy(tail, row->data + x, tail_len);
+    row->size = x;
+
+    size_t cur = y;
+    size_t start = 0;
+    for (size_t i = 0; i <= len; i++) {
+        if (i < len && text[i] != '\n') continue;
+
+        size_t seg = i - start;
+        BufferRow *r = buffer_row_mut(buf, cur);
+        if (!r || !journal_row_reserve(r, r->size + seg)) break;
+        memcpy(r->data + r->size, text + start, seg);
+        r->size += seg;
+        r->data[r->size] = '\0';
+
+        if (i < len) {
+            if (!buffer_insert_row(buf, cur + 1, "", 0)) break;
+            cur++;
+        }
+        start = i + 1;
+    }
+
+    BufferRow *last = buffer_row_mut(buf, cur);
+    if (last && journal_row_reserve(last, last->size + tail_len)) {
+        memcpy(last->data + last->size, tail, tail_len);
+        last->size += tail_len;
+        last->data[last->size] = '\0';
+    }
+    free(tail);
+}
+
+static void journal_apply_delete(Buffer *buf, uint32_t y1, uint32_t x1, uint32_t y2, uint32_t x2) {
+    if (y1 >= buf->num_rows) return;
+    if (y2 >= buf->num_rows) {
+        y2 = buf->num_rows - 1;
+        x2 = buffer_row(buf, y2)->size;
+    }
+    if (y2 < y1) return;
+
+    BufferRow *first = buffer_row_mut(buf, y1);
+    BufferRow *last = buffer_row(buf, y2);
+    if (!first) return;
+    if (x1 > first->size) x1 = first->size;
+    if (x2 > last->size) x2 = last->size;
+
+    if (y1 == y2) {
+        if (x2 <= x1) return;
+        memmove(first->data + x1, first->data + x2, first->size - x2);
+        first->size -= x2 - x1;
+        first->data[first->size] = '\0';
+        return;
+    }
+
+    size_t keep = last->size - x2;
+    if (!journal_row_reserve(first, x1 + keep)) return;
+    memcpy(first->data + x1, last->data + x2, keep);
+    first->size = x1 + keep;
+    first->data[first->size] = '\0';
+
+    buffer_delete_rows(buf, y1 + 1, y2 - y1);
+}
+
+static uint32_t read_u32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+int journal_recover(Buffer *buf) {
+    if (!buf || !buf->journal) return -1;
+
+    Journal *j = buf->journal;
+
+    /* Records apply to the file as loaded, not to a buffer already edited */
+    if (buf->modified) return -1;
+
+    pthread_mutex_lock(&j->lock);
+    char *data = j->recovery;
+    size_t len = j->recovery_len;
+    j->recovery = NULL;
+    j->recovery_len = 0;
+    pthread_mutex_unlock(&j->lock);
+
+    if (!data) return -1;
+
+    size_t old_rows = buf->num_rows;
+    size_t pos = 0;
+    int applied = 0;
+
+    while (pos < len) {
+        char op = data[pos];
+        size_t rec_len;
+
+        if (op == JOURNAL_OP_INSERT) {
+            if (pos + 13 > len) break;
+            uint32_t text_len = read_u32(data + pos + 9);
+            rec_len = 13 + (size_t)text_len;
+            if (pos + rec_len > len) break;  /* Torn final record */
+
+            uint32_t y = read_u32(data + pos + 1);
+            uint32_t x = read_u32(data + pos + 5);
+            journal_apply_insert(buf, y, x, data + pos + 13, text_len);
+            buf->cursor_y = y;
+            buf->cursor_x = x + text_len;
+        } else if (op == JOURNAL_OP_DELETE) {
+            rec_len = 17;
+            if (pos + rec_len > len) break;
+
+            uint32_t y1 = read_u32(data + pos + 1);
+            uint32_t x1 = read_u32(data + pos + 5);
+            journal_apply_delete(buf, y1, x1, read_u32(data + pos + 9), read_u32(data + pos + 13));
+            buf->cursor_y = y1;
+            buf->cursor_x = x1;
+        } else {
+            break;  /* Corrupt tail */
+        }
+
+        pos += rec_len;
+        applied++;
+    }
+
+    /* Keep the recovered edits journaled against the same base */
+    pthread_mutex_lock(&j->lock);
+    journal_append(j, data, pos);
+    pthread_mutex_unlock(&j->lock);
+    free(data);
+
+    /* Keep the cursor on real text */
+    if (buf->num_rows == 0) {
+        buf->cursor_x = 0;
+        buf->cursor_y = 0;
+    } else {
+        if (buf->cursor_y >= (int)buf->num_rows) buf->cursor_y = buf->num_rows - 1;
+        BufferRow *row = buffer_row(buf, buf->cursor_y);
+        if (buf->cursor_x > (int)row->size) {
+            buf->cursor_x = row->size;
+        }
+    }
+
+    buffer_resize_highlighting_cache(buf, old_rows, buf->num_rows);
+    buf->modified = applied > 0;
+    return applied;
+}
@@ -8,14 +8,27 @@
 #include "syntax.h"
 #include "colors.h"
 #include "undo.h"
+#include "journal.h"
+#include "process.h"
+#include "git.h"
+#include "lua_cache.h"
+#include "lua_profile.h"
+#include "event_loop.h"
+#include "canvas.h"
+#include "match_index.h"
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 #include <string.h>
 #include <sys/wait.h>
+#include <signal.h>
+#include <errno.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <time.h>
 
 /* Helper to get editor from Lua state */
 static Editor *get_editor(lua_State *L) {
@@ -47,9 +60,8 @@ static int l_buffer_insert_string(lua_State *L) {
     size_t len;
     const char *str = luaL_checklstring(L, 1, &len);
 
-    for (size_t i = 0; i < len; i++) {
-        buffer_insert_char(ed->active_window->content.buffer, str[i]);
-    }
+    Buffer *buf = ed->active_window->content.buffer;
+    buffer_insert_text(buf, buf->cursor_x, buf->cursor_y, str, len);
     return 0;
 }
 
@@ -82,7 +94,11 @@ static int l_buffer_save(lua_State *L) {
         return luaL_error(L, "No active buffer");
     }
 
-    int result = buffer_save(ed->active_window->content.buffer);
+    Buffer *buf = ed->active_window->content.buffer;
+    int result = buffer_save(buf);
+    if (result == 0) {
+        lua_bridge_trigger_save_event(ed, buf->filename, true);
+    }
     lua_pushboolean(L, result == 0);
     return 1;
 }
@@ -128,7 +144,7 @@ static int l_buffer_get_line(lua_State *L) {
         return 1;
     }
 
-    BufferRow *row = &buf->rows[y];
+    BufferRow *row = buffer_row(buf, y);
     lua_pushlstring(L, row->data, row->size);
     return 1;
 }
@@ -161,7 +177,7 @@ static int l_buffer_get_char(lua_State *L) {
         return 1;
     }
 
-    BufferRow *row = &buf->rows[y];
+    BufferRow *row = buffer_row(buf, y);
     if (x < 0 || x >= (int)row->size) {
         lua_pushnil(L);
         return 1;
@@ -187,7 +203,7 @@ static int l_buffer_get_line_length(lua_State *L) {
         return 1;
     }
 
-    BufferRow *row = &buf->rows[y];
+    BufferRow *row = buffer_row(buf, y);
     lua_pushinteger(L, row->size);
     return 1;
 }
@@ -208,7 +224,43 @@ static int l_buffer_get_filename(lua_State *L) {
     return 1;
 }
 
-/* Lua API: buffer.search(query, forward) -> row, col or nil */
+/* Search options at idx: {regex = bool, ignore_case = bool, whole_word = bool} */
+static int check_search_opts(lua_State *L, int idx, bool *regex) {
+    int flags = 0;
+    *regex = false;
+    if (lua_isnoneornil(L, idx)) return flags;
+
+    luaL_checktype(L, idx, LUA_TTABLE);
+    lua_getfield(L, idx, "ignore_case");
+    if (lua_toboolean(L, -1)) flags |= SEARCH_IGNORE_CASE;
+    lua_getfield(L, idx, "whole_word");
+    if (lua_toboolean(L, -1)) flags |= SEARCH_WHOLE_WORD;
+    lua_getfield(L, idx, "regex");
+    *regex = lua_toboolean(L, -1);
+    lua_pop(L, 3);
+    return flags;
+}
+
+/* Compile a regex search, raising a Lua error on a bad pattern */
+static Regexp *check_search_regexp(lua_State *L, const char *query, size_t len, int flags) {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    if (flags & SEARCH_WHOLE_WORD) luaL_addstring(&b, "\\b(?:");
+    luaL_addlstring(&b, query, len);
+    if (flags & SEARCH_WHOLE_WORD) luaL_addstring(&b, ")\\b");
+    luaL_pushresult(&b);
+
+    char err[256];
+    Regexp *re = regexp_compile(lua_tostring(L, -1),
+                                (flags & SEARCH_IGNORE_CASE) ? REGEXP_IGNORE_CASE : 0,
+                                err, sizeof(err));
+    lua_pop(L, 1);
+    if (!re) luaL_error(L, "%s", err[0] ? err : "out of memory");
+    return re;
+}
+
+/* Lua API: buffer.search(query, forward[, opts]) -> row, col, length or nil
+ * opts: {regex = bool, ignore_case = bool, whole_word = bool} */
 static int l_buffer_search(lua_State *L) {
     Editor *ed = get_editor(L);
     if (!ed || !ed->active_window || !ed->active_window->content.buffer) {
@@ -216,23 +268,41 @@ static int l_buffer_search(lua_State *L) {
     }
 
     Buffer *buf = ed->active_window->content.buffer;
-    const char *query = luaL_checkstring(L, 1);
+    size_t query_len;
+    const char *query = luaL_checklstring(L, 1, &query_len);
     bool forward = lua_toboolean(L, 2);
-
-    SearchResult *result = buffer_search(buf, query, buf->cursor_y, buf->cursor_x, forward);
+    bool regex;
+    int flags = check_search_opts(L, 3, &regex);
+
+    SearchResult *result;
+    if (regex) {
+        Regexp *re = check_search_regexp(L, query, query_len, flags);
+        result = buffer_search_regexp(buf, re, buf->cursor_y, buf->cursor_x, forward);
+        regexp_free(re);
+    } else {
+        SearchPattern *pat = search_pattern_create(query, query_len, flags);
+        if (!pat) {
+            lua_pushnil(L);
+            return 1;
+        }
+        result = buffer_search_pattern(buf, pat, buf->cursor_y, buf->cursor_x, forward);
+        search_pattern_destroy(pat);
+    }
 
     if (result) {
         lua_pushinteger(L, result->row);
         lua_pushinteger(L, result->col);
+        lua_pushinteger(L, (lua_Integer)result->match_len);
         free(result);
-        return 2;
+        return 3;
     }
 
     lua_pushnil(L);
     return 1;
 }
 
-/* Lua API: buffer.replace(search, replace, all) -> count */
+/* Lua API: buffer.replace(search, replace, all[, opts]) -> count
+ * opts as for buffer.search; with regex, replace may use \0-\9 for groups */
 static int l_buffer_replace(lua_State *L) {
     Editor *ed = get_editor(L);
     if (!ed || !ed->active_window || !ed->active_window->content.buffer) {
@@ -240,15 +310,97 @@ static int l_buffer_replace(lua_State *L) {
     }
 
     Buffer *buf = ed->active_window->content.buffer;
-    const char *search = luaL_checkstring(L, 1);
-    const char *replace = luaL_checkstring(L, 2);
+    size_t search_len;
+    const char *search = luaL_checklstring(L, 1, &search_len);
+    size_t replace_len;
+    const char *replace = luaL_checklstring(L, 2, &replace_len);
     bool all = lua_toboolean(L, 3);
+    bool regex;
+    int flags = check_search_opts(L, 4, &regex);
 
-    int count = buffer_replace(buf, search, replace, all);
+    int count = 0;
+    if (regex) {
+        Regexp *re = check_search_regexp(L, search, search_len, flags);
+        count = buffer_replace_regexp(buf, re, replace, all);
+        regexp_free(re);
+    } else {
+        SearchPattern *pat = search_pattern_create(search, search_len, flags);
+        if (pat) {
+            count = buffer_replace_pattern(buf, pat, replace, replace_len, all);
+            search_pattern_destroy(pat);
+        }
+    }
     lua_pushinteger(L, count);
     return 1;
 }
 
+/* Lua API: buffer.set_search(query[, opts]) - Highlight every match of query
+ * (opts as for buffer.search); nil or "" clears it */
+static int l_buffer_set_search(lua_State *L) {
+    Editor *ed = get_editor(L);
+    if (!ed || !ed->active_window || !ed->active_window->content.buffer) {
+        return luaL_error(L, "No active buffer");
+    }
+
+    Buffer *buf = ed->active_window->content.buffer;
+    size_t query_len = 0;
+    const char *query = luaL_optlstring(L, 1, NULL, &query_len);
+    bool regex;
+    int flags = check_search_opts(L, 2, &regex);
+
+    /* Compile first, so a bad pattern leaves the current search alone */
+    SearchPattern *pat = NULL;
+    Regexp *re = NULL;
+    char *term = NULL;
+    if (query && query_len > 0) {
+        if (regex) {
+            re = check_search_regexp(L, query, query_len, flags);
+        } else {
+            pat = search_pattern_create(query, query_len, flags);
+            if (!pat) return luaL_error(L, "out of memory");
+        }
+        term = strdup(query);
+    }
+
+    MatchIndex *index = NULL;
+    if (pat || re) {
+        index = match_index_create(pat, re);
+        if (!index) {
+            search_pattern_destroy(pat);
+            regexp_free(re);
+            free(term);
+            return luaL_error(L, "out of memory");
+        }
+    }
+
+    match_index_destroy(buf->search_index);
+    buf->search_index = index;
+    free(buf->search_term);
+    buf->search_term = term;
+    return 0;
+}
+
+/* Lua API: buffer.search_count() -> matches, index of the match at the cursor
+ * (0 if none). Counts what the renderer last indexed. */
+static int l_buffer_search_count(lua_State *L) {
+    Editor *ed = get_editor(L);
+    if (!ed || !ed->active_window || !ed->active_window->content.buffer) {
+        return luaL_error(L, "No active buffer");
+    }
+
+    Buffer *buf = ed->active_window->content.buffer;
+    size_t num_matches;
+    const IndexedMatch *matches = match_index_view(buf->search_index, &num_matches);
+    size_t k = match_index_find(matches, num_matches, buf->cursor_y, buf->cursor_x + 1);
+    const IndexedMatch *m = k > 0 ? &matches[k - 1] : NULL;
+    bool at_match = m && m->row == (size_t)buf->cursor_y &&
+                    (size_t)buf->cursor_x < (size_t)m->col + m->len;
+
+    lua_pushinteger(L, (lua_Integer)num_matches);
+    lua_pushinteger(L, at_match ? (lua_Integer)k : 0);
+    return 2;
+}
+
 /* Lua API: buffer.start_selection() - Start selection at current cursor position */
 static int l_buffer_start_selection(lua_State *L) {
     Editor *ed = get_editor(L);
@@ -287,6 +439,349 @@ static int l_buffer_has_selection(lua_State *L) {
     return 1;
 }
 
+/* Buffer handles: userdata naming one buffer, so plugins can work on buffers
+ * other than the active one and move many lines per call */
+#define BUFFER_HANDLE "occe.buffer"
+
+/* A closed buffer's memory may be reused by a new one, so the id tells them apart */
+typedef struct {
+    Buffer *buf;
+    unsigned long id;
+} BufferHandle;
+
+static void push_buffer_handle(lua_State *L, Buffer *buf) {
+    BufferHandle *h = lua_newuserdatauv(L, sizeof(BufferHandle), 0);
+    h->buf = buf;
+    h->id = buf->id;
+    luaL_setmetatable(L, BUFFER_HANDLE);
+}
+
+static bool buffer_is_open(Editor *ed, const BufferHandle *h) {
+    for (size_t i = 0; ed && i < ed->buffer_count; i++) {
+        if (ed->buffers[i] == h->buf) return h->buf->id == h->id;
+    }
+    return false;
+}
+
+/* Buffer behind the handle at idx; errors if the buffer is gone */
+static Buffer *check_buffer_handle(lua_State *L, int idx) {
+    BufferHandle *h = luaL_checkudata(L, idx, BUFFER_HANDLE);
+    if (!buffer_is_open(get_editor(L), h)) {
+        luaL_error(L, "buffer is closed");
+        return NULL;
+    }
+    return h->buf;
+}
+
+/* Clamp a row argument to [0, num_rows] */
+static size_t opt_row(lua_State *L, int idx, Buffer *buf, size_t def) {
+    lua_Integer y = luaL_optinteger(L, idx, (lua_Integer)def);
+    if (y < 0) return 0;
+    if ((size_t)y > buf->num_rows) return buf->num_rows;
+    return (size_t)y;
+}
+
+/* Lua API: buffer.current() -> buffer handle */
+static int l_buffer_current(lua_State *L) {
+    Editor *ed = get_editor(L);
+    if (!ed || !ed->active_window || !ed->active_window->content.buffer) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    push_buffer_handle(L, ed->active_window->content.buffer);
+    return 1;
+}
+
+/* Lua API: buffer.list() -> {buffer handle, ...} */
+static int l_buffer_list(lua_State *L) {
+    Editor *ed = get_editor(L);
+    size_t count = ed ? ed->buffer_count : 0;
+
+    lua_createtable(L, (int)count, 0);
+    for (size_t i = 0; i < count; i++) {
+        push_buffer_handle(L, ed->buffers[i]);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+    return 1;
+}
+
+/* Lua API: buf:get_lines([first[, last]]) -> {line, ...} for rows [first, last) */
+static int l_buf_get_lines(lua_State *L) {
+    Buffer *buf = check_buffer_handle(L, 1);
+    size_t first = opt_row(L, 2, buf, 0);
+    size_t last = opt_row(L, 3, buf, buf->num_rows);
+    size_t count = last > first ? last - first : 0;
+
+    lua_createtable(L, count < INT_MAX ? (int)count : 0, 0);
+    for (size_t i = 0; i < count; i++) {
+        BufferRow *row = buffer_row(buf, first + i);
+        lua_pushlstring(L, row->data, row->size);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+    return 1;
+}
+
+/* Length of the last of rows [.., to), for a text range ending there */
+static int row_end(Buffer *buf, size_t to) {
+    const BufferRow *row = to > 0 ? buffer_row(buf, to - 1) : NULL;
+    return row ? (int)row->size : 0;
+}
+
+/* Lua API: buf:set_lines(first, last, {line, ...}) - replace rows [first, last) */
+static int l_buf_set_lines(lua_State *L) {
+    Buffer *buf = check_buffer_handle(L, 1);
+    size_t first = opt_row(L, 2, buf, 0);
+    size_t last = opt_row(L, 3, buf, buf->num_rows);
+    luaL_checktype(L, 4, LUA_TTABLE);
+    if (last < first) last = first;
+
+    /* The strings stay alive in the table while we hold pointers to them */
+    size_t count = lua_rawlen(L, 4);
+    const char **lines = malloc(sizeof(const char *) * (count ? count : 1));
+    size_t *lens = malloc(sizeof(size_t) * (count ? count : 1));
+    if (!lines || !lens) {
+        free(lines);
+        free(lens);
+        return luaL_error(L, "out of memory");
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        /* Only real strings: a number converted here would be a temporary
+         * string, free to be collected once popped */
+        lines[i] = NULL;
+        if (lua_rawgeti(L, 4, (lua_Integer)i + 1) == LUA_TSTRING) {
+            lines[i] = lua_tolstring(L, -1, &lens[i]);
+        }
+        lua_pop(L, 1);
+        if (!lines[i] || memchr(lines[i], '\n', lens[i])) {
+            free(lines);
+            free(lens);
+            return luaL_error(L, "set_lines: item %d must be a string without newlines", (int)i + 1);
+        }
+    }
+
+    /* The undo entry replaces whole rows, so a pure insert or delete takes a
+     * neighbouring row along to have at least one on each side */
+    size_t from = first, to = last;
+    if (first == last || count == 0) {
+        if (from > 0) {
+            from--;
+        } else if (to < buf->num_rows) {
+            to++;
+        }
+    }
+    size_t rows_outside = buf->num_rows - (to - from);
+    char *old_text = NULL;
+    size_t old_len = 0;
+    if (buf->undo_stack) {
+        old_text = buffer_get_text_range(buf, 0, (int)from, row_end(buf, to), (int)to - 1, &old_len);
+        if (!old_text) {
+            free(lines);
+            free(lens);
+            return luaL_error(L, "out of memory");
+        }
+    }
+
+    int result = buffer_set_lines(buf, first, last, lines, lens, count);
+    free(lines);
+    free(lens);
+
+    if (result == 0 && old_text) {
+        size_t new_to = from + (buf->num_rows - rows_outside);
+        size_t new_len;
+        char *new_text = buffer_get_text_range(buf, 0, (int)from, row_end(buf, new_to), (int)new_to - 1, &new_len);
+        if (new_text) {
+            undo_push_replace_lines(buf->undo_stack, (int)from, old_text, old_len, new_text, new_len);
+            free(new_text);
+        }
+    }
+    free(old_text);
+    lua_pushboolean(L, result == 0);
+    return 1;
+}
+
+/* Lua API: buf:insert_text(x, y, text) -> bool */
+static int l_buf_insert_text(lua_State *L) {
+    Buffer *buf = check_buffer_handle(L, 1);
+    int x = luaL_checkinteger(L, 2);
+    int y = luaL_checkinteger(L, 3);
+    size_t len;
+    const char *text = luaL_checklstring(L, 4, &len);
+
+    lua_pushboolean(L, buffer_insert_text(buf, x, y, text, len) == 0);
+    return 1;
+}
+
+/* Lua API: buf:delete_text(x1, y1, x2, y2) -> bool (end exclusive) */
+static int l_buf_delete_text(lua_State *L) {
+    Buffer *buf = check_buffer_handle(L, 1);
+    int x1 = luaL_checkinteger(L, 2);
+    int y1 = luaL_checkinteger(L, 3);
+    int x2 = luaL_checkinteger(L, 4);
+    int y2 = luaL_checkinteger(L, 5);
+
+    lua_pushboolean(L, buffer_delete_text(buf, x1, y1, x2, y2) == 0);
+    return 1;
+}
+
+/* Lua API: buf:get_text_range(start_x, start_y, end_x, end_y) -> string (end exclusive) */
+static int l_buf_get_text_range(lua_State *L) {
+    Buffer *buf = check_buffer_handle(L, 1);
+    int start_x = luaL_checkinteger(L, 2);
+    int start_y = luaL_checkinteger(L, 3);
+    int end_x = luaL_checkinteger(L, 4);
+    int end_y = luaL_checkinteger(L, 5);
+
+    size_t len;
+    char *text = buffer_get_text_range(buf, start_x, start_y, end_x, end_y, &len);
+    if (!text) return luaL_error(L, "out of memory");
+    lua_pushlstring(L, text, len);
+    free(text);
+    return 1;
+}
+
+/* Lua API: buf:get_line(y) -> string or nil */
+static int l_buf_get_line(lua_State *L) {
+    Buffer *buf = check_buffer_handle(L, 1);
+    lua_Integer y = luaL_checkinteger(L, 2);
+
+    if (y < 0 || y >= (lua_Integer)buf->num_rows) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    BufferRow *row = buffer_row(buf, y);
+    lua_pushlstring(L, row->data, row->size);
+    return 1;
+}
+
+/* Lua API: buf:get_line_count() -> count */
+static int l_buf_get_line_count(lua_State *L) {
+    Buffer *buf = check_buffer_handle(L, 1);
+    lua_pushinteger(L, buf->num_rows);
+    return 1;
+}
+
+/* Lua API: buf:get_filename() -> string or nil */
+static int l_buf_get_filename(lua_State *L) {
+    Buffer *buf = check_buffer_handle(L, 1);
+    if (buf->filename) {
+        lua_pushstring(L, buf->filename);
+    } else {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
+/* Lua API: buf:is_modified() -> bool */
+static int l_buf_is_modified(lua_State *L) {
+    Buffer *buf = check_buffer_handle(L, 1);
+    lua_pushboolean(L, buf->modified);
+    return 1;
+}
+
+/* Lua API: buf:is_valid() -> bool (false once the buffer is closed) */
+static int l_buf_is_valid(lua_State *L) {
+    BufferHandle *h = luaL_checkudata(L, 1, BUFFER_HANDLE);
+    lua_pushboolean(L, buffer_is_open(get_editor(L), h));
+    return 1;
+}
+
+static int l_buf_eq(lua_State *L) {
+    BufferHandle *a = luaL_checkudata(L, 1, BUFFER_HANDLE);
+    BufferHandle *b = luaL_checkudata(L, 2, BUFFER_HANDLE);
+    lua_pushboolean(L, a->id == b->id);
+    return 1;
+}
+
+static int l_buf_tostring(lua_State *L) {
+    BufferHandle *h = luaL_checkudata(L, 1, BUFFER_HANDLE);
+    lua_pushfstring(L, "buffer: %d", (int)h->id);
+    return 1;
+}
+
+/* Snapshot handles: a frozen copy of a buffer's rows that stays readable
+ * after the buffer changes or closes - what a task holds across awaits */
+#define SNAPSHOT_HANDLE "occe.snapshot"
+
+static BufferSnapshot *check_snapshot(lua_State *L, int idx) {
+    BufferSnapshot **ud = luaL_checkudata(L, idx, SNAPSHOT_HANDLE);
+    if (!*ud) luaL_error(L, "snapshot is released");
+    return *ud;
+}
+
+/* Clamp a row argument to [0, rows] */
+static size_t opt_snapshot_row(lua_State *L, int idx, size_t rows, size_t def) {
+    lua_Integer y = luaL_optinteger(L, idx, (lua_Integer)def);
+    if (y < 0) return 0;
+    if ((size_t)y > rows) return rows;
+    return (size_t)y;
+}
+
+/* Lua API: buf:snapshot() -> snapshot handle */
+static int l_buf_snapshot(lua_State *L) {
+    Buffer *buf = check_buffer_handle(L, 1);
+    BufferSnapshot **ud = lua_newuserdatauv(L, sizeof(BufferSnapshot *), 0);
+    *ud = NULL;
+    luaL_setmetatable(L, SNAPSHOT_HANDLE);
+
+    *ud = buffer_snapshot_acquire(buf);
+    if (!*ud) return luaL_error(L, "out of memory");
+    return 1;
+}
+
+/* Lua API: snap:get_lines([first[, last]]) -> {line, ...} for rows [first, last) */
+static int l_snap_get_lines(lua_State *L) {
+    BufferSnapshot *snap = check_snapshot(L, 1);
+    size_t rows = buffer_snapshot_num_rows(snap);
+    size_t first = opt_snapshot_row(L, 2, rows, 0);
+    size_t last = opt_snapshot_row(L, 3, rows, rows);
+    size_t count = last > first ? last - first : 0;
+
+    lua_createtable(L, count < INT_MAX ? (int)count : 0, 0);
+    BufferSnapshotIter it;
+    buffer_snapshot_iter_init(&it, snap, first);
+    for (size_t i = 0; i < count; i++) {
+        const BufferRow *row = buffer_snapshot_iter_next(&it);
+        lua_pushlstring(L, row->data, row->size);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+    return 1;
+}
+
+/* Lua API: snap:get_line(y) -> string or nil */
+static int l_snap_get_line(lua_State *L) {
+    BufferSnapshot *snap = check_snapshot(L, 1);
+    lua_Integer y = luaL_checkinteger(L, 2);
+
+    if (y < 0 || y >= (lua_Integer)buffer_snapshot_num_rows(snap)) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    const BufferRow *row = buffer_snapshot_row(snap, y);
+    lua_pushlstring(L, row->data, row->size);
+    return 1;
+}
+
+/* Lua API: snap:get_line_count() -> count */
+static int l_snap_get_line_count(lua_State *L) {
+    BufferSnapshot *snap = check_snapshot(L, 1);
+    lua_pushinteger(L, buffer_snapshot_num_rows(snap));
+    return 1;
+}
+
+/* Lua API: snap:release() - drop the rows now rather than at collection */
+static int l_snap_release(lua_State *L) {
+    BufferSnapshot **ud = luaL_checkudata(L, 1, SNAPSHOT_HANDLE);
+    if (*ud) {
+        buffer_snapshot_release(*ud);
+        *ud = NULL;
+    }
+    return 0;
+}
+
 /* Lua API: editor.quit() */
 static int l_editor_quit(lua_State *L) {
     Editor *ed = get_editor(L);
@@ -344,6 +839,7 @@ static int l_editor_save(lua_State *L) {
     if (buf->filename) {
         if (buffer_save(buf) == 0) {
             editor_set_status(ed, "File saved");
+            lua_bridge_trigger_save_event(ed, buf->filename, true);
             lua_pushboolean(L, 1);
         } else {
             editor_set_status(ed, "Error saving file");
@@ -356,6 +852,175 @@ static int l_editor_save(lua_State *L) {
     return 1;
 }
 
+/* Lua API: editor.save_async() - Save current buffer on a background thread */
+static int l_editor_save_async(lua_State *L) {
+    Editor *ed = get_editor(L);
+    if (!ed || !ed->active_window || !ed->active_window->content.buffer) {
+        return luaL_error(L, "No active buffer");
+    }
+
+    Buffer *buf = ed->active_window->content.buffer;
+    if (!buf->filename) {
+        editor_set_status(ed, "No filename");
+        lua_pushboolean(L, 0);
+    } else if (editor_save_async(ed, buf) == 0) {
+        lua_pushboolean(L, 1);
+    } else {
+        editor_set_status(ed, buf->save_job ? "Save already in progress" : "Error saving file");
+        lua_pushboolean(L, 0);
+    }
+    return 1;
+}
+
+/* Lua API: editor.on_save(callback) - Called with (filename, ok) after a save */
+static int l_editor_on_save(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+
+    /* Get or create _editor_hooks.save table */
+    lua_getglobal(L, "_editor_hooks");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setglobal(L, "_editor_hooks");
+    }
+
+    lua_getfield(L, -1, "save");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, "save");
+    }
+
+    int len = lua_rawlen(L, -1);
+    lua_pushvalue(L, 1);
+    lua_rawseti(L, -2, len + 1);
+
+    lua_pop(L, 2);  /* Pop save table and _editor_hooks */
+    return 0;
+}
+
+/* Buffer change listener: hand each buffer's queued deltas to the
+ * _editor_hooks.change functions, once per batch of edits */
+static void lua_change_listener(void *data) {
+    Editor *ed = data;
+    if (!ed || !ed->lua_state) return;
+
+    lua_State *L = (lua_State *)ed->lua_state;
+    BufferDelta deltas[BUFFER_DELTA_QUEUE];
+
+    lua_getglobal(L, "_editor_hooks");
+    if (lua_istable(L, -1)) {
+        lua_getfield(L, -1, "change");
+    } else {
+        lua_pushnil(L);
+    }
+    int hooks = lua_gettop(L);
+
+    for (size_t b = 0; b < ed->buffer_count; b++) {
+        Buffer *buf = ed->buffers[b];
+        size_t n = buffer_take_deltas(buf, deltas, BUFFER_DELTA_QUEUE);
+        if (n == 0 || !lua_istable(L, hooks)) continue;
+
+        /* {{row = r, old_rows = o, new_rows = n}, ...} with 0-indexed rows */
+        lua_createtable(L, (int)n, 0);
+        for (size_t i = 0; i < n; i++) {
+            lua_createtable(L, 0, 3);
+            lua_pushinteger(L, (lua_Integer)deltas[i].row);
+            lua_setfield(L, -2, "row");
+            lua_pushinteger(L, (lua_Integer)deltas[i].old_rows);
+            lua_setfield(L, -2, "old_rows");
+            lua_pushinteger(L, (lua_Integer)deltas[i].new_rows);
+            lua_setfield(L, -2, "new_rows");
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+
+        int len = lua_rawlen(L, hooks);
+        for (int i = 1; i <= len; i++) {
+            lua_rawgeti(L, hooks, i);
+            if (!lua_isfunction(L, -1)) {
+                lua_pop(L, 1);
+                continue;
+            }
+            push_buffer_handle(L, buf);
+            lua_pushvalue(L, -3);
+            if (lua_profile_pcall(L, 2, 0, LUA_PROFILE_HOOK) != LUA_OK) {
+                const char *err = lua_tostring(L, -1);
+                char msg[256];
+                snprintf(msg, sizeof(msg), "on_change: %s", err ? err : "callback error");
+                editor_set_status(ed, msg);
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 1);  /* Deltas table */
+    }
+
+    lua_settop(L, hooks - 2);
+}
+
+/* Lua API: editor.on_change(function(buf, deltas)) - called once per batch of
+ * edits to a buffer; each delta says rows [row, row + old_rows) became
+ * [row, row + new_rows) */
+static int l_editor_on_change(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+
+    /* Get or create _editor_hooks.change table */
+    lua_getglobal(L, "_editor_hooks");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setglobal(L, "_editor_hooks");
+    }
+
+    lua_getfield(L, -1, "change");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, "change");
+    }
+
+    int len = lua_rawlen(L, -1);
+    lua_pushvalue(L, 1);
+    lua_rawseti(L, -2, len + 1);
+
+    lua_pop(L, 2);  /* Pop change table and _editor_hooks */
+
+    /* Buffers only start recording deltas once someone listens */
+    buffer_set_change_listener(lua_change_listener, get_editor(L));
+    return 0;
+}
+
+/* Lua API: editor.recover() - Replay edits from the swap file of a crashed session */
+static int l_editor_recover(lua_State *L) {
+    Editor *ed = get_editor(L);
+    if (!ed || !ed->active_window || !ed->active_window->content.buffer) {
+        return luaL_error(L, "No active buffer");
+    }
+
+    Buffer *buf = ed->active_window->content.buffer;
+    if (!journal_has_recovery(buf->journal)) {
+        editor_set_status(ed, "Nothing to recover");
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    int applied = journal_recover(buf);
+    if (applied < 0) {
+        editor_set_status(ed, "Recovery failed (buffer has unsaved changes?)");
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    char msg[256];
+    snprintf(msg, sizeof(msg), "Recovered %d edit%s", applied, applied == 1 ? "" : "s");
+    editor_set_status(ed, msg);
+    lua_pushinteger(L, applied);
+    return 1;
+}
+
 /* Lua API: editor.open(filename) - Open a file */
 static int l_editor_open(lua_State *L) {
     Editor *ed = get_editor(L);
@@ -387,6 +1052,7 @@ static int l_editor_open(lua_State *L) {
             char msg[256];
             snprintf(msg, sizeof(msg), "Opened: %s", filename);
             editor_set_status(ed, msg);
+            editor_offer_recovery(ed, new_buf);
             lua_pushboolean(L, 1);
             return 1;
         }
@@ -453,6 +1119,7 @@ static int l_editor_tabnew(lua_State *L) {
                 ed->active_window = new_tab->active_window;
 
                 editor_set_status(ed, "New tab created");
+                editor_offer_recovery(ed, new_buf);
                 lua_pushboolean(L, 1);
                 return 1;
             }
@@ -479,6 +1146,7 @@ static int l_editor_tabnext(lua_State *L) {
 
     ed->root_window = ed->active_tab->root_window;
     ed->active_window = ed->active_tab->active_window;
+    ed->screen_stale = true;  /* Canvases must not diff against the old tab */
 
     char msg[256];
     snprintf(msg, sizeof(msg), "Tab: %s", ed->active_tab->name);
@@ -513,6 +1181,7 @@ static int l_editor_tabprev(lua_State *L) {
 
     ed->root_window = ed->active_tab->root_window;
     ed->active_window = ed->active_tab->active_window;
+    ed->screen_stale = true;  /* Canvases must not diff against the old tab */
 
     char msg[256];
     snprintf(msg, sizeof(msg), "Tab: %s", ed->active_tab->name);
@@ -568,6 +1237,7 @@ static int l_editor_tabclose(lua_State *L) {
     ed->active_tab = next_active;
     ed->root_window = ed->active_tab->root_window;
     ed->active_window = ed->active_tab->active_window;
+    ed->screen_stale = true;  /* Canvases must not diff against the old tab */
 
     /* Destroy the old tab */
     tabgroup_destroy(to_destroy);
@@ -596,7 +1266,8 @@ static int l_editor_split(lua_State *L) {
             /* Copy content from current buffer */
             Buffer *src = ed->active_window->content.buffer;
             for (size_t i = 0; i < src->num_rows; i++) {
-                buffer_append_row(new_buf, src->rows[i].data, src->rows[i].size);
+                BufferRow *row = buffer_row(src, i);
+                buffer_append_row(new_buf, row->data, row->size);
             }
         } else {
             buffer_append_row(new_buf, "", 0);
@@ -635,6 +1306,7 @@ static int l_editor_split(lua_State *L) {
                     }
 
                     editor_set_status(ed, "Window split horizontally");
+                    editor_offer_recovery(ed, new_buf);
                     lua_pushboolean(L, 1);
                     return 1;
                 }
@@ -666,7 +1338,8 @@ static int l_editor_vsplit(lua_State *L) {
             /* Copy content from current buffer */
             Buffer *src = ed->active_window->content.buffer;
             for (size_t i = 0; i < src->num_rows; i++) {
-                buffer_append_row(new_buf, src->rows[i].data, src->rows[i].size);
+                BufferRow *row = buffer_row(src, i);
+                buffer_append_row(new_buf, row->data, row->size);
             }
         } else {
             buffer_append_row(new_buf, "", 0);
@@ -705,6 +1378,7 @@ static int l_editor_vsplit(lua_State *L) {
                     }
 
                     editor_set_status(ed, "Window split vertically");
+                    editor_offer_recovery(ed, new_buf);
                     lua_pushboolean(L, 1);
                     return 1;
                 }
@@ -860,17 +1534,24 @@ static int l_editor_unbind_key(lua_State *L) {
     return 0;
 }
 
-/* Lua API: editor.load_plugin(filename) - Load plugin with dev mode support */
-static int l_editor_load_plugin(lua_State *L) {
-    Editor *ed = get_editor(L);
-    if (!ed) {
-        return luaL_error(L, "No editor");
+/* Lua API: editor.plugin_load_times() -> {{path, ms, cached, ok, depth}, ...} in load order */
+static int l_editor_plugin_load_times(lua_State *L) {
+    lua_getglobal(L, "_PLUGIN_LOAD_TIMES");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
     }
+    return 1;
+}
 
-    const char *filename = luaL_checkstring(L, 1);
+/* Load filename from ./plugins (for development), then config_dir/plugins.
+ * On failure the last error is left in err. */
+static int load_plugin_from_search_path(Editor *ed, const char *filename,
+                                        char *err, size_t err_size) {
+    lua_State *L = (lua_State *)ed->lua_state;
     char plugin_path[512];
     int result = -1;
-    char last_error[512] = "Plugin file not found";
+    snprintf(err, err_size, "Plugin file not found");
 
     /* Try 1: Local plugins directory (for development) */
     snprintf(plugin_path, sizeof(plugin_path), "./plugins/%s", filename);
@@ -880,8 +1561,7 @@ static int l_editor_load_plugin(lua_State *L) {
     if (result != 0) {
         lua_getglobal(L, "_PLUGIN_LOAD_ERROR");
         if (lua_isstring(L, -1)) {
-            const char *err = lua_tostring(L, -1);
-            snprintf(last_error, sizeof(last_error), "%s", err);
+            snprintf(err, err_size, "%s", lua_tostring(L, -1));
         }
         lua_pop(L, 1);
     }
@@ -895,13 +1575,26 @@ static int l_editor_load_plugin(lua_State *L) {
         if (result != 0) {
             lua_getglobal(L, "_PLUGIN_LOAD_ERROR");
             if (lua_isstring(L, -1)) {
-                const char *err = lua_tostring(L, -1);
-                snprintf(last_error, sizeof(last_error), "%s", err);
+                snprintf(err, err_size, "%s", lua_tostring(L, -1));
             }
             lua_pop(L, 1);
         }
     }
 
+    return result;
+}
+
+/* Lua API: editor.load_plugin(filename) - Load plugin with dev mode support */
+static int l_editor_load_plugin(lua_State *L) {
+    Editor *ed = get_editor(L);
+    if (!ed) {
+        return luaL_error(L, "No editor");
+    }
+
+    const char *filename = luaL_checkstring(L, 1);
+    char last_error[512];
+    int result = load_plugin_from_search_path(ed, filename, last_error, sizeof(last_error));
+
     if (result == 0) {
         lua_pushboolean(L, 1);
         lua_pushnil(L);  /* No error */
@@ -913,6 +1606,21 @@ static int l_editor_load_plugin(lua_State *L) {
     }
 }
 
+/* Runs a declared syntax's plugin the first time a file of its type opens */
+static bool lua_syntax_loader(Syntax *syn, void *data) {
+    Editor *ed = data;
+    if (!ed || !ed->lua_state) return false;
+
+    char err[512];
+    if (load_plugin_from_search_path(ed, syn->source, err, sizeof(err)) != 0) {
+        char msg[640];
+        snprintf(msg, sizeof(msg), "syntax %s: %s", syn->name, err);
+        editor_set_status(ed, msg);
+        return false;
+    }
+    return true;
+}
+
 /* Lua API: process.execute(command) -> stdout, stderr, exitcode */
 static int l_process_execute(lua_State *L) {
     const char *cmd = luaL_checkstring(L, 1);
@@ -1015,6 +1723,12 @@ static void register_buffer_api(lua_State *L) {
     lua_pushcfunction(L, l_buffer_replace);
     lua_setfield(L, -2, "replace");
 
+    lua_pushcfunction(L, l_buffer_set_search);
+    lua_setfield(L, -2, "set_search");
+
+    lua_pushcfunction(L, l_buffer_search_count);
+    lua_setfield(L, -2, "search_count");
+
     lua_pushcfunction(L, l_buffer_start_selection);
     lua_setfield(L, -2, "start_selection");
 
@@ -1024,7 +1738,83 @@ static void register_buffer_api(lua_State *L) {
     lua_pushcfunction(L, l_buffer_has_selection);
     lua_setfield(L, -2, "has_selection");
 
+    lua_pushcfunction(L, l_buffer_current);
+    lua_setfield(L, -2, "current");
+
+    lua_pushcfunction(L, l_buffer_list);
+    lua_setfield(L, -2, "list");
+
     lua_setglobal(L, "buffer");
+
+    /* Methods of buffer handles */
+    luaL_newmetatable(L, BUFFER_HANDLE);
+    lua_newtable(L);
+
+    lua_pushcfunction(L, l_buf_get_lines);
+    lua_setfield(L, -2, "get_lines");
+
+    lua_pushcfunction(L, l_buf_set_lines);
+    lua_setfield(L, -2, "set_lines");
+
+    lua_pushcfunction(L, l_buf_get_text_range);
+    lua_setfield(L, -2, "get_text_range");
+
+    lua_pushcfunction(L, l_buf_insert_text);
+    lua_setfield(L, -2, "insert_text");
+
+    lua_pushcfunction(L, l_buf_delete_text);
+    lua_setfield(L, -2, "delete_text");
+
+    lua_pushcfunction(L, l_buf_get_line);
+    lua_setfield(L, -2, "get_line");
+
+    lua_pushcfunction(L, l_buf_get_line_count);
+    lua_setfield(L, -2, "get_line_count");
+
+    lua_pushcfunction(L, l_buf_get_filename);
+    lua_setfield(L, -2, "get_filename");
+
+    lua_pushcfunction(L, l_buf_is_modified);
+    lua_setfield(L, -2, "is_modified");
+
+    lua_pushcfunction(L, l_buf_is_valid);
+    lua_setfield(L, -2, "is_valid");
+
+    lua_pushcfunction(L, l_buf_snapshot);
+    lua_setfield(L, -2, "snapshot");
+
+    lua_setfield(L, -2, "__index");
+
+    lua_pushcfunction(L, l_buf_eq);
+    lua_setfield(L, -2, "__eq");
+
+    lua_pushcfunction(L, l_buf_tostring);
+    lua_setfield(L, -2, "__tostring");
+
+    lua_pop(L, 1);
+
+    /* Methods of snapshot handles */
+    luaL_newmetatable(L, SNAPSHOT_HANDLE);
+    lua_newtable(L);
+
+    lua_pushcfunction(L, l_snap_get_lines);
+    lua_setfield(L, -2, "get_lines");
+
+    lua_pushcfunction(L, l_snap_get_line);
+    lua_setfield(L, -2, "get_line");
+
+    lua_pushcfunction(L, l_snap_get_line_count);
+    lua_setfield(L, -2, "get_line_count");
+
+    lua_pushcfunction(L, l_snap_release);
+    lua_setfield(L, -2, "release");
+
+    lua_setfield(L, -2, "__index");
+
+    lua_pushcfunction(L, l_snap_release);
+    lua_setfield(L, -2, "__gc");
+
+    lua_pop(L, 1);
 }
 
 /* Register editor API functions */
@@ -1046,6 +1836,18 @@ static void register_editor_api(lua_State *L) {
     lua_pushcfunction(L, l_editor_save);
     lua_setfield(L, -2, "save");
 
+    lua_pushcfunction(L, l_editor_save_async);
+    lua_setfield(L, -2, "save_async");
+
+    lua_pushcfunction(L, l_editor_on_save);
+    lua_setfield(L, -2, "on_save");
+
+    lua_pushcfunction(L, l_editor_on_change);
+    lua_setfield(L, -2, "on_change");
+
+    lua_pushcfunction(L, l_editor_recover);
+    lua_setfield(L, -2, "recover");
+
     lua_pushcfunction(L, l_editor_open);
     lua_setfield(L, -2, "open");
 
@@ -1091,6 +1893,9 @@ static void register_editor_api(lua_State *L) {
     lua_pushcfunction(L, l_editor_unbind_key);
     lua_setfield(L, -2, "unbind_key");
 
+    lua_pushcfunction(L, l_editor_plugin_load_times);
+    lua_setfield(L, -2, "plugin_load_times");
+
     lua_pushcfunction(L, l_editor_load_plugin);
     lua_setfield(L, -2, "load_plugin");
 
@@ -1168,99 +1973,155 @@ static void register_editor_api(lua_State *L) {
     lua_setglobal(L, "editor");
 }
 
-/* Lua API: syntax.register(name) -> syntax object */
-static int l_syntax_register(lua_State *L) {
-    const char *name = luaL_checkstring(L, 1);
-    Syntax *syn = syntax_register(name);
+/* Callbacks a plugin passed to process.spawn, held in the registry until exit */
+typedef struct {
+    Editor *ed;
+    int on_stdout;
+    int on_stderr;
+    int on_exit;
+} LuaProcess;
 
-    if (syn) {
-        lua_pushlightuserdata(L, syn);
-        return 1;
+/* Call a callback with the arguments already pushed above it */
+static void lua_process_call(LuaProcess *lp, int nargs) {
+    lua_State *L = (lua_State *)lp->ed->lua_state;
+    if (lua_profile_pcall(L, nargs, 0, LUA_PROFILE_HOOK) != LUA_OK) {
+        const char *err = lua_tostring(L, -1);
+        char msg[256];
+        snprintf(msg, sizeof(msg), "process: %s", err ? err : "callback error");
+        editor_set_status(lp->ed, msg);
+        lua_pop(L, 1);
     }
-
-    return 0;
 }
 
-/* Lua API: syntax.add_extension(syn, ext) */
-static int l_syntax_add_extension(lua_State *L) {
-    Syntax *syn = (Syntax *)lua_touserdata(L, 1);
-    const char *ext = luaL_checkstring(L, 2);
+static void lua_process_output(LuaProcess *lp, int ref, pid_t pid, const char *chunk, size_t len) {
+    if (ref == LUA_NOREF || !lp->ed->lua_state) return;
+    lua_State *L = (lua_State *)lp->ed->lua_state;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    lua_pushlstring(L, chunk, len);
+    lua_pushinteger(L, pid);
+    lua_process_call(lp, 2);
+}
 
-    if (syn && ext) {
-        syntax_add_extension(syn, ext);
-    }
+static void lua_process_stdout(pid_t pid, const char *chunk, size_t len, void *data) {
+    LuaProcess *lp = data;
+    lua_process_output(lp, lp->on_stdout, pid, chunk, len);
+}
 
-    return 0;
+static void lua_process_stderr(pid_t pid, const char *chunk, size_t len, void *data) {
+    LuaProcess *lp = data;
+    lua_process_output(lp, lp->on_stderr, pid, chunk, len);
 }
 
-/* Lua API: syntax.add_keyword(syn, keyword, hl_type) */
-static int l_syntax_add_keyword(lua_State *L) {
-    Syntax *syn = (Syntax *)lua_touserdata(L, 1);
-    const char *keyword = luaL_checkstring(L, 2);
-    int hl_type = luaL_checkinteger(L, 3);
+static void lua_process_exit(pid_t pid, int code, void *data) {
+    LuaProcess *lp = data;
+    lua_State *L = (lua_State *)lp->ed->lua_state;
 
-    if (syn && keyword) {
-        syntax_add_keyword(syn, keyword, (HighlightType)hl_type);
+    if (L) {
+        /* code -1: the editor is shutting down, only release the callbacks */
+        if (code >= 0 && lp->on_exit != LUA_NOREF) {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, lp->on_exit);
+            lua_pushinteger(L, code);
+            lua_pushinteger(L, pid);
+            lua_process_call(lp, 2);
+        }
+        luaL_unref(L, LUA_REGISTRYINDEX, lp->on_stdout);
+        luaL_unref(L, LUA_REGISTRYINDEX, lp->on_stderr);
+        luaL_unref(L, LUA_REGISTRYINDEX, lp->on_exit);
     }
-
-    return 0;
+    free(lp);
 }
 
-/* Lua API: syntax.set_comments(syn, single, multi_start, multi_end) */
-static int l_syntax_set_comments(lua_State *L) {
-    Syntax *syn = (Syntax *)lua_touserdata(L, 1);
-    const char *single = lua_isnil(L, 2) ? NULL : lua_tostring(L, 2);
-    const char *multi_start = lua_isnil(L, 3) ? NULL : lua_tostring(L, 3);
-    const char *multi_end = lua_isnil(L, 4) ? NULL : lua_tostring(L, 4);
+/* Registry ref for opts[name] if it is a function */
+static int process_opt_ref(lua_State *L, int opts, const char *name) {
+    if (opts == 0) return LUA_NOREF;
+    lua_getfield(L, opts, name);
+    if (lua_isfunction(L, -1)) return luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_pop(L, 1);
+    return LUA_NOREF;
+}
 
-    if (syn) {
-        syntax_set_comments(syn, single, multi_start, multi_end);
+/* Lua API: process.spawn(argv, {on_stdout, on_stderr, on_exit, stdin}) -> pid or nil, error
+ * Runs without blocking; callbacks are called from the main loop as
+ * on_stdout(data, pid), on_stderr(data, pid) and on_exit(code, pid). */
+static int l_process_spawn(lua_State *L) {
+    Editor *ed = get_editor(L);
+    luaL_checktype(L, 1, LUA_TTABLE);
+    int opts = 0;
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        opts = 2;
+    }
+
+    int argc = (int)lua_rawlen(L, 1);
+    if (argc == 0) return luaL_argerror(L, 1, "empty argv");
+    luaL_checkstack(L, argc + 8, "too many arguments");
+
+    /* Strings stay alive on the stack until posix_spawn has copied them */
+    char **argv = malloc((argc + 1) * sizeof(char *));
+    if (!argv) return luaL_error(L, "Out of memory");
+    for (int i = 0; i < argc; i++) {
+        lua_rawgeti(L, 1, i + 1);
+        argv[i] = (char *)lua_tostring(L, -1);
+        if (!argv[i]) {
+            free(argv);
+            return luaL_argerror(L, 1, "argv entries must be strings");
+        }
+    }
+    argv[argc] = NULL;
+
+    const char *input = NULL;
+    size_t input_len = 0;
+    if (opts) {
+        lua_getfield(L, opts, "stdin");
+        if (lua_isstring(L, -1)) input = lua_tolstring(L, -1, &input_len);
+    }
+
+    LuaProcess *lp = malloc(sizeof(LuaProcess));
+    if (!lp) {
+        free(argv);
+        return luaL_error(L, "Out of memory");
+    }
+    lp->ed = ed;
+    lp->on_stdout = process_opt_ref(L, opts, "on_stdout");
+    lp->on_stderr = process_opt_ref(L, opts, "on_stderr");
+    lp->on_exit = process_opt_ref(L, opts, "on_exit");
+
+    ProcessCallbacks callbacks = {
+        .on_stdout = lua_process_stdout,
+        .on_stderr = lua_process_stderr,
+        .on_exit = lua_process_exit,
+        .data = lp,
+    };
+    pid_t pid = process_spawn(argv, input, input_len, &callbacks);
+    int err = errno;
+    free(argv);
+
+    if (pid == -1) {
+        luaL_unref(L, LUA_REGISTRYINDEX, lp->on_stdout);
+        luaL_unref(L, LUA_REGISTRYINDEX, lp->on_stderr);
+        luaL_unref(L, LUA_REGISTRYINDEX, lp->on_exit);
+        free(lp);
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(err));
+        return 2;
     }
 
-    return 0;
+    lua_pushinteger(L, pid);
+    return 1;
 }
 
-/* Register syntax API functions */
-static void register_syntax_api(lua_State *L) {
-    lua_newtable(L);
+/* Lua API: process.kill(pid, [signal]) -> true or nil, error */
+static int l_process_kill(lua_State *L) {
+    pid_t pid = (pid_t)luaL_checkinteger(L, 1);
+    int sig = (int)luaL_optinteger(L, 2, SIGTERM);
 
-    lua_pushcfunction(L, l_syntax_register);
-    lua_setfield(L, -2, "register");
-
-    lua_pushcfunction(L, l_syntax_add_extension);
-    lua_setfield(L, -2, "add_extension");
-
-    lua_pushcfunction(L, l_syntax_add_keyword);
-    lua_setfield(L, -2, "add_keyword");
-
-    lua_pushcfunction(L, l_syntax_set_comments);
-    lua_setfield(L, -2, "set_comments");
-
-    /* Highlight type constants */
-    lua_pushinteger(L, HL_NORMAL);
-    lua_setfield(L, -2, "HL_NORMAL");
-    lua_pushinteger(L, HL_KEYWORD);
-    lua_setfield(L, -2, "HL_KEYWORD");
-    lua_pushinteger(L, HL_TYPE);
-    lua_setfield(L, -2, "HL_TYPE");
-    lua_pushinteger(L, HL_STRING);
-    lua_setfield(L, -2, "HL_STRING");
-    lua_pushinteger(L, HL_NUMBER);
-    lua_setfield(L, -2, "HL_NUMBER");
-    lua_pushinteger(L, HL_COMMENT);
-    lua_setfield(L, -2, "HL_COMMENT");
-    lua_pushinteger(L, HL_OPERATOR);
-    lua_setfield(L, -2, "HL_OPERATOR");
-    lua_pushinteger(L, HL_FUNCTION);
-    lua_setfield(L, -2, "HL_FUNCTION");
-    lua_pushinteger(L, HL_VARIABLE);
-    lua_setfield(L, -2, "HL_VARIABLE");
-    lua_pushinteger(L, HL_CONSTANT);
-    lua_setfield(L, -2, "HL_CONSTANT");
-    lua_pushinteger(L, HL_PREPROCESSOR);
-    lua_setfield(L, -2, "HL_PREPROCESSOR");
-
-    lua_setglobal(L, "syntax");
+    if (process_kill(pid, sig) == -1) {
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(errno));
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+    return 1;
 }
 
 /* Register process API functions */
@@ -1270,9 +2131,124 @@ static void register_process_api(lua_State *L) {
     lua_pushcfunction(L, l_process_execute);
     lua_setfield(L, -2, "execute");
 
+    lua_pushcfunction(L, l_process_spawn);
+    lua_setfield(L, -2, "spawn");
+
+    lua_pushcfunction(L, l_process_kill);
+    lua_setfield(L, -2, "kill");
+
     lua_setglobal(L, "process");
 }
 
+/* ===== Git API Functions ===== */
+
+/* Lua API: git.find_root(path) -> repository root or nil */
+static int l_git_find_root(lua_State *L) {
+    const char *path = luaL_checkstring(L, 1);
+    char *root = git_find_root(path);
+    if (!root) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushstring(L, root);
+    free(root);
+    return 1;
+}
+
+/* Lua API: git.enable_gutter([enabled]) - show changes against HEAD in the gutter */
+static int l_git_enable_gutter(lua_State *L) {
+    Editor *ed = get_editor(L);
+    if (!ed) return 0;
+    ed->git_gutter = lua_isnoneornil(L, 1) ? true : lua_toboolean(L, 1);
+    return 0;
+}
+
+/* Lua API: git.root() -> repository root of the current buffer or nil */
+static int l_git_root(lua_State *L) {
+    Editor *ed = get_editor(L);
+    Buffer *buf = ed && ed->active_window ? ed->active_window->content.buffer : NULL;
+    if (buf && !buf->git_checked && buf->filename) {
+        buf->git_checked = true;
+        buf->git = git_file_open(buf->filename);
+    }
+
+    const char *root = buf ? git_file_root(buf->git) : NULL;
+    if (root) {
+        lua_pushstring(L, root);
+    } else {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
+/* Lua API: git.refresh() - fetch HEAD again for the current buffer (e.g. after a commit) */
+static int l_git_refresh(lua_State *L) {
+    Editor *ed = get_editor(L);
+    Buffer *buf = ed && ed->active_window ? ed->active_window->content.buffer : NULL;
+    if (!buf) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    if (buf->git) {
+        lua_pushboolean(L, git_file_reload(buf->git) == 0);
+    } else {
+        /* Look for a repository again, e.g. after git init */
+        buf->git_checked = false;
+        lua_pushboolean(L, 1);
+    }
+    return 1;
+}
+
+/* Lua API: git.line_status(line) -> "added", "modified", "deleted", "unchanged" or nil */
+static int l_git_line_status(lua_State *L) {
+    Editor *ed = get_editor(L);
+    Buffer *buf = ed && ed->active_window ? ed->active_window->content.buffer : NULL;
+    lua_Integer line = luaL_checkinteger(L, 1);
+    if (!buf || !buf->git || line < 0) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    git_file_update(buf->git, buf);
+    switch (git_file_line_status(buf->git, (size_t)line)) {
+        case GIT_LINE_ADDED:
+            lua_pushstring(L, "added");
+            break;
+        case GIT_LINE_MODIFIED:
+            lua_pushstring(L, "modified");
+            break;
+        case GIT_LINE_DELETED:
+            lua_pushstring(L, "deleted");
+            break;
+        default:
+            lua_pushstring(L, "unchanged");
+            break;
+    }
+    return 1;
+}
+
+static void register_git_api(lua_State *L) {
+    lua_newtable(L);
+
+    lua_pushcfunction(L, l_git_find_root);
+    lua_setfield(L, -2, "find_root");
+
+    lua_pushcfunction(L, l_git_enable_gutter);
+    lua_setfield(L, -2, "enable_gutter");
+
+    lua_pushcfunction(L, l_git_root);
+    lua_setfield(L, -2, "root");
+
+    lua_pushcfunction(L, l_git_refresh);
+    lua_setfield(L, -2, "refresh");
+
+    lua_pushcfunction(L, l_git_line_status);
+    lua_setfield(L, -2, "line_status");
+
+    lua_setglobal(L, "git");
+}
+
 /* ===== Terminal API Functions ===== */
 
 /* Lua API: terminal.move(row, col) */
@@ -1665,6 +2641,50 @@ static int l_window_create_custom(lua_State *L) {
     return 1;
 }
 
+/* Invalidate the custom windows under win: all of them (target 0), the one
+ * with id target, or those whose data is the table at data_idx */
+static void invalidate_windows(lua_State *L, Window *win, int target, int data_idx) {
+    if (!win) return;
+    if (win->type != WINDOW_LEAF) {
+        invalidate_windows(L, win->left, target, data_idx);
+        invalidate_windows(L, win->right, target, data_idx);
+        return;
+    }
+    if (win->content_type != CONTENT_CUSTOM) return;
+
+    if (data_idx) {
+        if (!win->content.custom_data) return;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, (int)(intptr_t)win->content.custom_data);
+        bool same = lua_rawequal(L, -1, data_idx);
+        lua_pop(L, 1);
+        if (!same) return;
+    } else if (target && win->id != target) {
+        return;
+    }
+    window_invalidate(win);
+}
+
+/* Lua API: window.invalidate([win_id | data]) - Redraw custom windows on the
+ * next frame: the one with win_id, those created with the data table, or all */
+static int l_window_invalidate(lua_State *L) {
+    Editor *ed = get_editor(L);
+    if (!ed) return 0;
+
+    int target = 0, data_idx = 0;
+    if (lua_istable(L, 1)) {
+        data_idx = 1;
+    } else if (!lua_isnoneornil(L, 1)) {
+        target = (int)luaL_checkinteger(L, 1);
+    }
+
+    /* The active tab's layout is ed->root_window; other tabs keep their own */
+    invalidate_windows(L, ed->root_window, target, data_idx);
+    for (TabGroup *tab = ed->tab_groups; tab; tab = tab->next) {
+        if (tab != ed->active_tab) invalidate_windows(L, tab->root_window, target, data_idx);
+    }
+    return 0;
+}
+
 /* Lua API: window.equalize() - Make all windows equal size */
 static int l_window_equalize(lua_State *L) {
     Editor *ed = get_editor(L);
@@ -1818,7 +2838,7 @@ static int l_window_apply_layout(lua_State *L) {
     lua_pushinteger(L, ed->term->rows - 1);
 
     /* Call layout_function(windows, total_w, total_h) -> layout_table */
-    if (lua_pcall(L, 3, 1, 0) != LUA_OK) {
+    if (lua_profile_pcall(L, 3, 1, LUA_PROFILE_WINDOW_EVENT) != LUA_OK) {
         const char *err = lua_tostring(L, -1);
         (void)err;  /* TODO: Display error */
         lua_pop(L, 2);
@@ -2124,6 +3144,9 @@ static void register_window_api(lua_State *L) {
     lua_pushcfunction(L, l_window_create_custom);
     lua_setfield(L, -2, "create_custom");
 
+    lua_pushcfunction(L, l_window_invalidate);
+    lua_setfield(L, -2, "invalidate");
+
     /* Advanced layout */
     lua_pushcfunction(L, l_window_equalize);
     lua_setfield(L, -2, "equalize");
@@ -2185,27 +3208,92 @@ int lua_bridge_init(Editor *ed) {
     register_editor_api(L);
     register_syntax_api(L);
     register_process_api(L);
+    register_git_api(L);
     register_terminal_api(L);
     register_window_api(L);
     register_theme_api(L);
+    register_profile_api(L);
+    register_task_api(L);
+    register_search_api(L);
+    register_finder_api(L);
+    register_canvas_api(L);
+
+    syntax_set_loader(lua_syntax_loader, ed);
 
     ed->lua_state = L;
     return 0;
 }
 
 void lua_bridge_cleanup(Editor *ed) {
+    buffer_set_change_listener(NULL, NULL);
+    syntax_set_loader(NULL, NULL);
     if (ed && ed->lua_state) {
+        lua_task_shutdown();
+        lua_finder_shutdown();
+        lua_profile_cleanup((lua_State *)ed->lua_state);
         lua_close((lua_State *)ed->lua_state);
         ed->lua_state = NULL;
     }
 }
 
+/* Nesting of lua_bridge_load_plugin calls (init.lua loads the plugins) */
+static int plugin_load_depth = 0;
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* Append {path, ms, cached, ok, depth} to _PLUGIN_LOAD_TIMES */
+static void record_plugin_load(lua_State *L, const char *filename, double ms, bool cached, bool ok) {
+    lua_getglobal(L, "_PLUGIN_LOAD_TIMES");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setglobal(L, "_PLUGIN_LOAD_TIMES");
+    }
+
+    lua_createtable(L, 0, 5);
+    lua_pushstring(L, filename);
+    lua_setfield(L, -2, "path");
+    lua_pushnumber(L, ms);
+    lua_setfield(L, -2, "ms");
+    lua_pushboolean(L, cached);
+    lua_setfield(L, -2, "cached");
+    lua_pushboolean(L, ok);
+    lua_setfield(L, -2, "ok");
+    lua_pushinteger(L, plugin_load_depth);
+    lua_setfield(L, -2, "depth");
+    lua_rawseti(L, -2, (lua_Integer)lua_rawlen(L, -2) + 1);
+
+    lua_pop(L, 1);
+}
+
 int lua_bridge_load_plugin(Editor *ed, const char *filename) {
     if (!ed || !ed->lua_state) return -1;
 
     lua_State *L = (lua_State *)ed->lua_state;
 
-    if (luaL_dofile(L, filename) != LUA_OK) {
+    /* Compiled chunks are cached under config_dir/cache, keyed by path, mtime and size */
+    char cache_dir[512];
+    if (ed->config_dir) {
+        snprintf(cache_dir, sizeof(cache_dir), "%s/cache/bytecode", ed->config_dir);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    bool cached = false;
+    int status = lua_cache_load(L, filename, ed->config_dir ? cache_dir : NULL, &cached);
+    if (status == LUA_OK) {
+        plugin_load_depth++;
+        status = lua_profile_pcall(L, 0, 0, LUA_PROFILE_LOAD);
+        plugin_load_depth--;
+    }
+
+    if (status != LUA_OK) {
         /* Error occurred - store error message in global _PLUGIN_LOAD_ERROR */
         const char *err = lua_tostring(L, -1);
         if (err) {
@@ -2213,18 +3301,65 @@ int lua_bridge_load_plugin(Editor *ed, const char *filename) {
             lua_setglobal(L, "_PLUGIN_LOAD_ERROR");
         }
         lua_pop(L, 1);
+
+        /* A missing file is a normal miss on the search path, not a load */
+        if (access(filename, F_OK) == 0) {
+            record_plugin_load(L, filename, elapsed_ms(&start), cached, false);
+        }
         return -1;
     }
 
+    record_plugin_load(L, filename, elapsed_ms(&start), cached, true);
     return 0;
 }
 
+void lua_bridge_report_load_times(Editor *ed) {
+    if (!ed || !ed->lua_state) return;
+
+    lua_State *L = (lua_State *)ed->lua_state;
+    lua_getglobal(L, "_PLUGIN_LOAD_TIMES");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        return;
+    }
+
+    /* Top-level loads include the plugins they load, so only they add up */
+    int files = 0, cached = 0;
+    double total_ms = 0;
+    int len = lua_rawlen(L, -1);
+    for (int i = 1; i <= len; i++) {
+        lua_rawgeti(L, -1, i);
+        lua_getfield(L, -1, "ok");
+        lua_getfield(L, -2, "cached");
+        lua_getfield(L, -3, "depth");
+        lua_getfield(L, -4, "ms");
+        if (lua_toboolean(L, -4)) files++;
+        if (lua_toboolean(L, -3)) cached++;
+        if (lua_tointeger(L, -2) == 0) total_ms += lua_tonumber(L, -1);
+        lua_pop(L, 5);
+    }
+    lua_pop(L, 1);
+
+    if (files == 0) return;
+
+    char msg[256];
+    if (ed->status_len > 0) {
+        snprintf(msg, sizeof(msg), "%.*s (%d Lua files in %.1f ms, %d cached)",
+                 (int)ed->status_len, ed->status_msg, files, total_ms, cached);
+    } else {
+        snprintf(msg, sizeof(msg), "Loaded %d Lua files in %.1f ms (%d from bytecode cache)",
+                 files, total_ms, cached);
+    }
+    editor_set_status(ed, msg);
+}
+
 int lua_bridge_exec(Editor *ed, const char *code) {
     if (!ed || !ed->lua_state) return -1;
 
     lua_State *L = (lua_State *)ed->lua_state;
 
-    if (luaL_dostring(L, code) != LUA_OK) {
+    if (luaL_loadstring(L, code) != LUA_OK ||
+        lua_profile_pcall(L, 0, 0, LUA_PROFILE_KEYMAP) != LUA_OK) {
         const char *err = lua_tostring(L, -1);
         (void)err; /* TODO: Display error */
         lua_pop(L, 1);
@@ -2234,6 +3369,28 @@ int lua_bridge_exec(Editor *ed, const char *code) {
     return 0;
 }
 
+int lua_bridge_call_binding(Editor *ed, const char *func_name) {
+    if (!ed || !ed->lua_state) return -1;
+
+    /* Call the handler itself, so its time is charged to (and budgeted
+     * against) the plugin that defined it */
+    lua_State *L = (lua_State *)ed->lua_state;
+    int top = lua_gettop(L);
+    char code[512];
+    snprintf(code, sizeof(code), "return %s", func_name);
+    if (luaL_loadstring(L, code) != LUA_OK || lua_pcall(L, 0, 1, 0) != LUA_OK ||
+        !lua_isfunction(L, -1)) {
+        /* Not a plain function reference (e.g. obj:method) - append () */
+        lua_settop(L, top);
+        snprintf(code, sizeof(code), "%s()", func_name);
+        return lua_bridge_exec(ed, code);
+    }
+
+    int status = lua_profile_pcall(L, 0, 0, LUA_PROFILE_KEYMAP);
+    lua_settop(L, top);
+    return status == LUA_OK ? 0 : -1;
+}
+
 int lua_bridge_call(Editor *ed, const char *func_name) {
     if (!ed || !ed->lua_state) return -1;
 
@@ -2245,7 +3402,7 @@ int lua_bridge_call(Editor *ed, const char *func_name) {
         return -1;
     }
 
-    if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+    if (lua_profile_pcall(L, 0, 0, LUA_PROFILE_HOOK) != LUA_OK) {
         const char *err = lua_tostring(L, -1);
         (void)err; /* TODO: Display error */
         lua_pop(L, 1);
@@ -2269,7 +3426,7 @@ char *lua_bridge_call_gutter_renderer(Editor *ed, int line_num) {
 
     /* Call _gutter_renderer(line_num) */
     lua_pushinteger(L, line_num);
-    if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
+    if (lua_profile_pcall(L, 1, 1, LUA_PROFILE_GUTTER) != LUA_OK) {
         const char *err = lua_tostring(L, -1);
         (void)err; /* TODO: Display error */
         lua_pop(L, 1);
@@ -2287,6 +3444,30 @@ char *lua_bridge_call_gutter_renderer(Editor *ed, int line_num) {
     return gutter;
 }
 
+/* Changes whenever a buffer is opened, closed, edited, saved or renamed, or
+ * the active window switches to another buffer */
+static unsigned long buffers_state(Editor *ed) {
+    unsigned long state = ed->buffer_count;
+    for (size_t i = 0; i < ed->buffer_count; i++) {
+        Buffer *buf = ed->buffers[i];
+        state = state * 31 + (uintptr_t)buf;
+        state = state * 31 + (uintptr_t)buf->filename;
+        state = state * 31 + buf->version * 2 + buf->modified;
+    }
+    Window *active = ed->active_window;
+    if (active && active->content_type == CONTENT_BUFFER) {
+        state = state * 31 + (uintptr_t)active->content.buffer;
+    }
+    return state;
+}
+
+/* depends.interval elapsed: redraw on the frame the timer wakes the loop for */
+static void window_render_tick(void *data) {
+    Window *win = data;
+    win->render_timer = 0;
+    window_invalidate(win);
+}
+
 void lua_bridge_call_window_renderer(Editor *ed, Window *win) {
     if (!ed || !ed->lua_state || !win || !win->renderer_name) return;
 
@@ -2305,6 +3486,31 @@ void lua_bridge_call_window_renderer(Editor *ed, Window *win) {
         return;
     }
 
+    /* Optional dependencies: depends = {buffers = true, interval = ms} */
+    bool watch_buffers = false;
+    lua_Integer interval = 0;
+    lua_getfield(L, -1, "depends");
+    if (lua_istable(L, -1)) {
+        lua_getfield(L, -1, "buffers");
+        watch_buffers = lua_toboolean(L, -1);
+        lua_getfield(L, -2, "interval");
+        interval = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0;
+        lua_pop(L, 2);
+    }
+    lua_pop(L, 1);
+    unsigned long buffers = watch_buffers ? buffers_state(ed) : 0;
+
+    /* A renderer that draws on its canvas is only called again once the cells
+     * are stale; otherwise the flush repaints them as they are. Renderers that
+     * draw on the terminal directly have nothing to reuse and run every frame. */
+    Canvas *canvas = win->canvas;
+    if (canvas && win->render_valid &&
+        canvas->width == win->width && canvas->height == win->height &&
+        win->render_focused == win->focused && win->render_buffers == buffers) {
+        lua_pop(L, 2);
+        return;
+    }
+
     /* Get the render function from the renderer table */
     lua_getfield(L, -1, "render");
     if (!lua_isfunction(L, -1)) {
@@ -2312,6 +3518,10 @@ void lua_bridge_call_window_renderer(Editor *ed, Window *win) {
         return;
     }
 
+    /* Canvas handle, kept below the call to release it afterwards */
+    lua_canvas_push(L, win);
+    lua_insert(L, -2);
+
     /* Push window data (stored as a Lua registry reference) */
     if (win->content.custom_data) {
         /* Retrieve the data from the registry */
@@ -2327,14 +3537,37 @@ void lua_bridge_call_window_renderer(Editor *ed, Window *win) {
     lua_pushinteger(L, win->width);
     lua_pushinteger(L, win->height);
 
-    /* Call render(data, x, y, width, height) */
-    if (lua_pcall(L, 5, 0, 0) != LUA_OK) {
+    lua_pushvalue(L, -7);
+
+    /* Call render(data, x, y, width, height, canvas) */
+    if (lua_profile_pcall(L, 6, 0, LUA_PROFILE_WINDOW_RENDER) != LUA_OK) {
         const char *err = lua_tostring(L, -1);
         (void)err; /* TODO: Display error */
         lua_pop(L, 1);
+    } else {
+        /* Cells are current until invalidated; a failed render retries */
+        win->render_valid = true;
+        win->render_focused = win->focused;
+        win->render_buffers = buffers;
     }
 
-    lua_pop(L, 2);  /* Pop renderer table and _window_renderers */
+    if (interval > 0 && win->render_timer == 0) {
+        int timer = event_loop_add_timer(interval > INT_MAX ? INT_MAX : (int)interval,
+                                         window_render_tick, win);
+        win->render_timer = timer > 0 ? timer : 0;
+    }
+
+    lua_canvas_release(L, -1);
+    lua_pop(L, 3);  /* Pop canvas, renderer table and _window_renderers */
+}
+
+/* The window with this id in any tab, or NULL once it is gone */
+static Window *find_window_any_tab(Editor *ed, int id) {
+    Window *win = window_find_by_id(ed->root_window, id);
+    for (TabGroup *tab = ed->tab_groups; tab && !win; tab = tab->next) {
+        win = window_find_by_id(tab->root_window, id);
+    }
+    return win;
 }
 
 bool lua_bridge_call_window_key_handler(Editor *ed, Window *win, int key) {
@@ -2373,10 +3606,14 @@ bool lua_bridge_call_window_key_handler(Editor *ed, Window *win, int key) {
     /* Push key */
     lua_pushinteger(L, key);
 
-    /* Call on_key(data, key) -> handled */
+    /* Call on_key(data, key) -> handled; a handled key redraws the window,
+     * unless the handler closed it */
+    int win_id = win->id;
     bool handled = false;
-    if (lua_pcall(L, 2, 1, 0) == LUA_OK) {
+    if (lua_profile_pcall(L, 2, 1, LUA_PROFILE_WINDOW_KEY) == LUA_OK) {
         handled = lua_toboolean(L, -1);
+        win = find_window_any_tab(ed, win_id);
+        if (handled && win) window_invalidate(win);
         lua_pop(L, 1);
     } else {
         const char *err = lua_tostring(L, -1);
@@ -2414,11 +3651,13 @@ void lua_bridge_trigger_window_event(Editor *ed, const char *event_name, int win
             /* Push arguments based on event type */
             lua_pushinteger(L, win_id);
 
+            int nargs = 1;
             if (strcmp(event_name, "focus") == 0) {
                 lua_pushinteger(L, prev_win_id);
-                lua_pcall(L, 2, 0, 0);
-            } else {
-                lua_pcall(L, 1, 0, 0);
+                nargs = 2;
+            }
+            if (lua_profile_pcall(L, nargs, 0, LUA_PROFILE_WINDOW_EVENT) != LUA_OK) {
+                lua_pop(L, 1);  /* Drop the error message */
             }
         } else {
             lua_pop(L, 1);
@@ -2427,3 +3666,38 @@ void lua_bridge_trigger_window_event(Editor *ed, const char *event_name, int win
 
     lua_pop(L, 2);  /* Pop hooks table and _window_hooks */
 }
+
+void lua_bridge_trigger_save_event(Editor *ed, const char *filename, bool ok) {
+    if (!ed || !ed->lua_state || !filename) return;
+
+    lua_State *L = (lua_State *)ed->lua_state;
+
+    /* Get event hooks: _editor_hooks.save */
+    lua_getglobal(L, "_editor_hooks");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        return;
+    }
+
+    lua_getfield(L, -1, "save");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 2);
+        return;
+    }
+
+    int len = lua_rawlen(L, -1);
+    for (int i = 1; i <= len; i++) {
+        lua_rawgeti(L, -1, i);
+        if (lua_isfunction(L, -1)) {
+            lua_pushstring(L, filename);
+            lua_pushboolean(L, ok);
+            if (lua_profile_pcall(L, 2, 0, LUA_PROFILE_HOOK) != LUA_OK) {
+                lua_pop(L, 1);  /* Drop the error message */
+            }
+        } else {
+            lua_pop(L, 1);
+        }
+    }
+
+    lua_pop(L, 2);  /* Pop hooks table and _editor_hooks */
+}
@@ -0,0 +1,179 @@
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
+#include "lua_cache.h"
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LUA_CACHE_MAGIC "OCCELC1"
+
+/* Cache file: header, then the source path, then the bytecode */
+typedef struct {
+    char magic[8];
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t source_size;
+    uint64_t code_size;
+    uint32_t path_len;
+    uint32_t reserved;
+} LuaCacheHeader;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+} DumpBuffer;
+
+/* Create dir and any missing parents */
+static int make_dirs(const char *dir) {
+    if (mkdir(dir, 0755) == 0 || errno == EEXIST) return 0;
+    if (errno != ENOENT) return -1;
+
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%s", dir);
+    char *slash = strrchr(parent, '/');
+    if (!slash || slash == parent) return -1;
+    *slash = '\0';
+
+    if (make_dirs(parent) != 0) return -1;
+    return mkdir(dir, 0755) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+/* Cache file for a source: FNV-1a of its absolute path */
+static void cache_file_path(const char *cache_dir, const char *abs_path, char *out, size_t size) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const char *p = abs_path; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 1099511628211ULL;
+    }
+    snprintf(out, size, "%s/%016llx.luac", cache_dir, (unsigned long long)h);
+}
+
+/* Load from the cache if it is still current; returns false on any mismatch */
+static bool load_cached(lua_State *L, const char *cache_file, const char *abs_path,
+                        const char *chunkname, const struct stat *src) {
+    int fd = open(cache_file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(LuaCacheHeader)) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    const LuaCacheHeader *hdr = map;
+    size_t path_len = strlen(abs_path);
+    bool ok = memcmp(hdr->magic, LUA_CACHE_MAGIC, sizeof(hdr->magic)) == 0 &&
+              hdr->mtime_sec == (int64_t)src->st_mtim.tv_sec &&
+              hdr->mtime_nsec == (int64_t)src->st_mtim.tv_nsec &&
+              hdr->source_size == (int64_t)src->st_size &&
+              hdr->path_len == path_len &&
+              sizeof(LuaCacheHeader) + path_len + hdr->code_size == size &&
+              memcmp((const char *)map + sizeof(LuaCacheHeader), abs_path, path_len) == 0;
+
+    if (ok) {
+        /* Lua copies what it needs, so the mapping can go right after */
+        const char *code = (const char *)map + sizeof(LuaCacheHeader) + path_len;
+        if (luaL_loadbufferx(L, code, hdr->code_size, chunkname, "b") != LUA_OK) {
+            lua_pop(L, 1);  /* e.g. written by another Lua version */
+            ok = false;
+        }
+    }
+
+    munmap(map, size);
+    return ok;
+}
+
+static int dump_writer(lua_State *L, const void *p, size_t sz, void *ud) {
+    (void)L;
+    DumpBuffer *buf = ud;
+
+    if (buf->len + sz > buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity : 4096;
+        while (capacity < buf->len + sz) capacity *= 2;
+        char *data = realloc(buf->data, capacity);
+        if (!data) return 1;
+        buf->data = data;
+        buf->capacity = capacity;
+    }
+
+    memcpy(buf->data + buf->len, p, sz);
+    buf->len += sz;
+    return 0;
+}
+
+/* Dump the function on top of the stack to the cache (best effort) */
+static void store_cached(lua_State *L, const char *cache_file, const char *abs_path,
+                         const struct stat *src) {
+    DumpBuffer code = {0};
+    if (lua_dump(L, dump_writer, &code, 0) != 0 || code.len == 0) {
+        free(code.data);
+        return;
+    }
+
+    LuaCacheHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, LUA_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.mtime_sec = src->st_mtim.tv_sec;
+    hdr.mtime_nsec = src->st_mtim.tv_nsec;
+    hdr.source_size = src->st_size;
+    hdr.code_size = code.len;
+    hdr.path_len = strlen(abs_path);
+
+    /* Readers only ever see a complete file: write aside, then rename */
+    char tmp_path[PATH_MAX + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", cache_file, (long)getpid());
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (f) {
+        bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+                  fwrite(abs_path, 1, hdr.path_len, f) == hdr.path_len &&
+                  fwrite(code.data, 1, code.len, f) == code.len;
+        if (fclose(f) != 0) ok = false;
+        if (!ok || rename(tmp_path, cache_file) != 0) unlink(tmp_path);
+    }
+
+    free(code.data);
+}
+
+int lua_cache_load(lua_State *L, const char *path, const char *cache_dir, bool *from_cache) {
+    *from_cache = false;
+
+    struct stat src;
+    char abs_path[PATH_MAX];
+    if (!cache_dir || stat(path, &src) == -1 || !S_ISREG(src.st_mode) ||
+        !realpath(path, abs_path)) {
+        return luaL_loadfile(L, path);
+    }
+
+    char chunkname[PATH_MAX + 1];
+    snprintf(chunkname, sizeof(chunkname), "@%s", path);
+
+    char cache_file[PATH_MAX];
+    cache_file_path(cache_dir, abs_path, cache_file, sizeof(cache_file));
+
+    if (load_cached(L, cache_file, abs_path, chunkname, &src)) {
+        *from_cache = true;
+        return LUA_OK;
+    }
+
+    int status = luaL_loadfile(L, path);
+    if (status == LUA_OK && make_dirs(cache_dir) == 0) {
+        store_cached(L, cache_file, abs_path, &src);
+    }
+    return status;
+}
@@ -0,0 +1,272 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lua_bridge.h"
+#include "window.h"
+#include "canvas.h"
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* Canvas handles: passed to a custom window's render function and only
+ * valid during that call. The cells belong to the window and persist, so a
+ * renderer may redraw only what changed. */
+#define CANVAS_HANDLE "occe.canvas"
+
+typedef struct {
+    Window *win;
+} CanvasHandle;
+
+void lua_canvas_push(lua_State *L, Window *win) {
+    /* Cells follow the window's size; a resize blanks them */
+    if (win->canvas) canvas_resize(win->canvas, win->width, win->height);
+
+    CanvasHandle *handle = lua_newuserdatauv(L, sizeof(CanvasHandle), 0);
+    handle->win = win;
+    luaL_setmetatable(L, CANVAS_HANDLE);
+}
+
+void lua_canvas_release(lua_State *L, int idx) {
+    CanvasHandle *handle = luaL_testudata(L, idx, CANVAS_HANDLE);
+    if (handle) handle->win = NULL;
+}
+
+/* Canvas behind the handle at idx, created on first use */
+static Canvas *check_canvas(lua_State *L, int idx) {
+    CanvasHandle *handle = luaL_checkudata(L, idx, CANVAS_HANDLE);
+    Window *win = handle->win;
+    if (!win) {
+        luaL_error(L, "canvas used outside its window's render call");
+        return NULL;
+    }
+
+    if (!win->canvas) {
+        win->canvas = canvas_create(win->width, win->height);
+        if (!win->canvas) luaL_error(L, "out of memory");
+    }
+    return win->canvas;
+}
+
+static uint8_t opt_style(lua_State *L, int idx) {
+    lua_Integer style = luaL_optinteger(L, idx, 0);
+    luaL_argcheck(L, style >= 0 && style < CANVAS_MAX_STYLES, idx, "invalid style id");
+    return (uint8_t)style;
+}
+
+/* Lua API: canvas:size() -> width, height */
+static int l_canvas_size(lua_State *L) {
+    Canvas *canvas = check_canvas(L, 1);
+    lua_pushinteger(L, canvas->width);
+    lua_pushinteger(L, canvas->height);
+    return 2;
+}
+
+/* Lua API: canvas:put(x, y, text[, style]) -> columns written
+ * (0-based, relative to the window) */
+static int l_canvas_put(lua_State *L) {
+    Canvas *canvas = check_canvas(L, 1);
+    int x = (int)luaL_checkinteger(L, 2);
+    int y = (int)luaL_checkinteger(L, 3);
+    size_t len;
+    const char *text = luaL_checklstring(L, 4, &len);
+    uint8_t style = opt_style(L, 5);
+
+    lua_pushinteger(L, canvas_put(canvas, x, y, text, len, style));
+    return 1;
+}
+
+/* Rectangle field: rect.name, else rect[index] */
+static int rect_field(lua_State *L, int idx, const char *name, int index, int def) {
+    lua_getfield(L, idx, name);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_rawgeti(L, idx, index);
+    }
+    int value = lua_isnil(L, -1) ? def : (int)luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+    return value;
+}
+
+/* Lua API: canvas:fill([rect[, style[, char]]]) - rect is {x, y, w, h}
+ * (or named fields); the whole canvas when nil */
+static int l_canvas_fill(lua_State *L) {
+    Canvas *canvas = check_canvas(L, 1);
+    int x = 0, y = 0, w = canvas->width, h = canvas->height;
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        x = rect_field(L, 2, "x", 1, 0);
+        y = rect_field(L, 2, "y", 2, 0);
+        w = rect_field(L, 2, "w", 3, canvas->width - x);
+        h = rect_field(L, 2, "h", 4, canvas->height - y);
+    }
+    uint8_t style = opt_style(L, 3);
+    size_t ch_len = 0;
+    const char *ch = luaL_optlstring(L, 4, " ", &ch_len);
+
+    canvas_fill(canvas, x, y, w, h, ch, ch_len, style);
+    return 0;
+}
+
+/* Lua API: canvas:clear([style]) */
+static int l_canvas_clear(lua_State *L) {
+    Canvas *canvas = check_canvas(L, 1);
+    canvas_fill(canvas, 0, 0, canvas->width, canvas->height, " ", 1, opt_style(L, 2));
+    return 0;
+}
+
+/* Lua API: canvas:blit_lines(lines[, y[, style]])
+ * Replaces whole rows from y on. Each line is a string drawn in style, or a
+ * list of spans {text, style}; the rest of each row is blanked in style. */
+static int l_canvas_blit_lines(lua_State *L) {
+    Canvas *canvas = check_canvas(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int y = (int)luaL_optinteger(L, 3, 0);
+    uint8_t style = opt_style(L, 4);
+
+    lua_Integer count = (lua_Integer)lua_rawlen(L, 2);
+    for (lua_Integer i = 1; i <= count; i++) {
+        int row = y + (int)(i - 1);
+        if (row >= canvas->height) break;
+
+        lua_rawgeti(L, 2, i);
+        if (row < 0) {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        canvas_fill(canvas, 0, row, canvas->width, 1, " ", 1, style);
+        size_t len;
+        if (lua_type(L, -1) == LUA_TSTRING) {
+            const char *text = lua_tolstring(L, -1, &len);
+            canvas_put(canvas, 0, row, text, len, style);
+        } else if (lua_istable(L, -1)) {
+            int line = lua_gettop(L);
+            int x = 0;
+            lua_Integer spans = (lua_Integer)lua_rawlen(L, line);
+            for (lua_Integer s = 1; s <= spans && x < canvas->width; s++) {
+                lua_rawgeti(L, line, s);
+                uint8_t span_style = style;
+                const char *text;
+                if (lua_istable(L, line + 1)) {
+                    lua_rawgeti(L, line + 1, 1);
+                    lua_rawgeti(L, line + 1, 2);
+                    text = lua_tolstring(L, line + 2, &len);
+                    if (!lua_isnil(L, line + 3)) span_style = opt_style(L, line + 3);
+                } else {
+                    text = lua_tolstring(L, line + 1, &len);
+                }
+                if (!text) return luaL_error(L, "line %d: span %d has no text", (int)i, (int)s);
+
+                x += canvas_put(canvas, x, row, text, len, span_style);
+                lua_settop(L, line);
+            }
+        } else {
+            return luaL_error(L, "line %d must be a string or a list of spans", (int)i);
+        }
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+/* Append one color to an SGR parameter list: 0-255 palette index,
+ * "#rrggbb" or {r, g, b} */
+static void append_color(lua_State *L, int idx, const char *field, int base,
+                         char *buf, size_t size, size_t *pos) {
+    lua_getfield(L, idx, field);
+    int color = lua_gettop(L);
+    if (lua_isinteger(L, color)) {
+        lua_Integer n = lua_tointeger(L, color);
+        if (n < 0 || n > 255) luaL_error(L, "%s: palette index out of range", field);
+        *pos += snprintf(buf + *pos, size - *pos, ";%d;5;%d", base, (int)n);
+    } else if (lua_type(L, color) == LUA_TSTRING) {
+        unsigned int r, g, b;
+        if (sscanf(lua_tostring(L, color), "#%2x%2x%2x", &r, &g, &b) != 3) {
+            luaL_error(L, "%s: expected \"#rrggbb\"", field);
+        }
+        *pos += snprintf(buf + *pos, size - *pos, ";%d;2;%u;%u;%u", base, r, g, b);
+    } else if (lua_istable(L, color)) {
+        int rgb[3];
+        for (int i = 0; i < 3; i++) {
+            lua_rawgeti(L, color, i + 1);
+            rgb[i] = (int)luaL_checkinteger(L, -1) & 0xff;
+            lua_pop(L, 1);
+        }
+        *pos += snprintf(buf + *pos, size - *pos, ";%d;2;%d;%d;%d", base, rgb[0], rgb[1], rgb[2]);
+    } else if (!lua_isnil(L, color)) {
+        luaL_error(L, "%s: expected a palette index, \"#rrggbb\" or {r, g, b}", field);
+    }
+    lua_pop(L, 1);
+    if (*pos >= size) *pos = size - 1;
+}
+
+/* Lua API: canvas.style(spec) -> style id
+ * spec: a syntax.HL_* type (follows the active theme), an SGR escape string,
+ * or {fg, bg, bold, dim, italic, underline, reverse} */
+static int l_canvas_style(lua_State *L) {
+    int id;
+    if (lua_isinteger(L, 1)) {
+        lua_Integer type = lua_tointeger(L, 1);
+        luaL_argcheck(L, type >= 0 && type < HL_MAX, 1, "unknown highlight type");
+        id = canvas_style_highlight((HighlightType)type);
+    } else if (lua_type(L, 1) == LUA_TSTRING) {
+        id = canvas_style_sgr(lua_tostring(L, 1));
+    } else {
+        luaL_checktype(L, 1, LUA_TTABLE);
+
+        static const struct { const char *name; int code; } attrs[] = {
+            {"bold", 1}, {"dim", 2}, {"italic", 3}, {"underline", 4}, {"reverse", 7},
+        };
+        char params[128] = "0";
+        size_t pos = 1;
+        for (size_t i = 0; i < sizeof(attrs) / sizeof(attrs[0]); i++) {
+            lua_getfield(L, 1, attrs[i].name);
+            if (lua_toboolean(L, -1)) {
+                pos += snprintf(params + pos, sizeof(params) - pos, ";%d", attrs[i].code);
+            }
+            lua_pop(L, 1);
+        }
+        append_color(L, 1, "fg", 38, params, sizeof(params), &pos);
+        append_color(L, 1, "bg", 48, params, sizeof(params), &pos);
+
+        char sgr[160];
+        snprintf(sgr, sizeof(sgr), "\x1b[%sm", params);
+        id = canvas_style_sgr(sgr);
+    }
+
+    if (id < 0) return luaL_error(L, "too many canvas styles (max %d)", CANVAS_MAX_STYLES);
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+/* Register canvas API */
+void register_canvas_api(lua_State *L) {
+    lua_newtable(L);
+
+    lua_pushcfunction(L, l_canvas_style);
+    lua_setfield(L, -2, "style");
+
+    lua_setglobal(L, "canvas");
+
+    /* Methods of canvas handles */
+    luaL_newmetatable(L, CANVAS_HANDLE);
+    lua_newtable(L);
+
+    lua_pushcfunction(L, l_canvas_size);
+    lua_setfield(L, -2, "size");
+
+    lua_pushcfunction(L, l_canvas_put);
+    lua_setfield(L, -2, "put");
+
+    lua_pushcfunction(L, l_canvas_fill);
+    lua_setfield(L, -2, "fill");
+
+    lua_pushcfunction(L, l_canvas_clear);
+    lua_setfield(L, -2, "clear");
+
+    lua_pushcfunction(L, l_canvas_blit_lines);
+    lua_setfield(L, -2, "blit_lines");
+
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1);
+}
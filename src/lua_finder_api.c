@@ -0,0 +1,218 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE  /* realpath */
+#include "lua_bridge.h"
+#include "lua_profile.h"
+#include "file_index.h"
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+
+/* The finder keeps one file index open, for the directory last opened */
+static FileIndex *finder_index = NULL;
+static char *finder_root = NULL;
+static lua_State *finder_L = NULL;
+static int finder_on_update = LUA_NOREF;
+static bool finder_notifying = false;   /* In on_update, which cannot close the index */
+
+static Editor *finder_editor(lua_State *L) {
+    lua_getglobal(L, "_EDITOR_PTR");
+    Editor *ed = (Editor *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return ed;
+}
+
+static void finder_changed(FileIndex *fi, void *data) {
+    (void)fi;
+    (void)data;
+    lua_State *L = finder_L;
+    if (!L || finder_on_update == LUA_NOREF) return;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, finder_on_update);
+    finder_notifying = true;
+    int status = lua_profile_pcall(L, 0, 0, LUA_PROFILE_HOOK);
+    finder_notifying = false;
+    if (status != LUA_OK) {
+        const char *err = lua_tostring(L, -1);
+        char msg[256];
+        snprintf(msg, sizeof(msg), "finder: %s", err ? err : "callback error");
+        lua_pop(L, 1);
+
+        Editor *ed = finder_editor(L);
+        if (ed) editor_set_status(ed, msg);
+    }
+}
+
+static void finder_close(void) {
+    file_index_close(finder_index);
+    finder_index = NULL;
+    free(finder_root);
+    finder_root = NULL;
+    if (finder_L) luaL_unref(finder_L, LUA_REGISTRYINDEX, finder_on_update);
+    finder_on_update = LUA_NOREF;
+}
+
+/* Open the index of root, unless it is the one already open. Returns false
+ * with an error message pushed if root cannot be indexed. */
+static bool finder_open(lua_State *L, const char *root) {
+    char abs_root[PATH_MAX];
+    if (!realpath(root, abs_root)) {
+        lua_pushfstring(L, "%s: cannot open directory", root);
+        return false;
+    }
+    if (finder_index && strcmp(finder_root, abs_root) == 0) return true;
+
+    finder_close();
+    Editor *ed = finder_editor(L);
+    char cache_dir[512];
+    if (ed && ed->config_dir) {
+        snprintf(cache_dir, sizeof(cache_dir), "%s/cache/files", ed->config_dir);
+    }
+
+    finder_index = file_index_open(abs_root, ed && ed->config_dir ? cache_dir : NULL,
+                                   finder_changed, NULL);
+    finder_root = finder_index ? strdup(abs_root) : NULL;
+    if (!finder_root) {
+        finder_close();
+        lua_pushfstring(L, "%s: cannot index directory", root);
+        return false;
+    }
+    return true;
+}
+
+/* Lua API: finder.open([root], [opts]) -> true or nil, error
+ * Indexes the files below root (default ".") in the background, from the
+ * cache of the last session first. opts.on_update() is called whenever the
+ * files changed. Replaces the index of another root. */
+static int l_finder_open(lua_State *L) {
+    const char *root = luaL_optstring(L, 1, ".");
+    if (!lua_isnoneornil(L, 2)) luaL_checktype(L, 2, LUA_TTABLE);
+    if (finder_notifying) return luaL_error(L, "finder.open: not from on_update");
+
+    if (!finder_open(L, root)) {
+        lua_pushnil(L);
+        lua_insert(L, -2);
+        return 2;
+    }
+
+    luaL_unref(L, LUA_REGISTRYINDEX, finder_on_update);
+    finder_on_update = LUA_NOREF;
+    if (!lua_isnoneornil(L, 2)) {
+        lua_getfield(L, 2, "on_update");
+        if (lua_isfunction(L, -1)) {
+            finder_on_update = luaL_ref(L, LUA_REGISTRYINDEX);
+        } else {
+            lua_pop(L, 1);
+        }
+    }
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/* Lua API: finder.query(text, [limit]) -> array of {path, score, positions}
+ * The best limit (default 20) paths text fuzzily matches, best first; spaces
+ * in text are ignored. positions holds the 0-based byte offset in path of
+ * each character of text matched. Opens "." if nothing is open. */
+static int l_finder_query(lua_State *L) {
+    size_t len;
+    const char *text = luaL_checklstring(L, 1, &len);
+    lua_Integer limit = luaL_optinteger(L, 2, 20);
+    if (limit < 1) limit = 1;
+    if (limit > 1000) limit = 1000;
+
+    if (!finder_index && !finder_open(L, ".")) return lua_error(L);
+
+    FileMatch *matches = malloc((size_t)limit * sizeof(FileMatch));
+    if (!matches) return luaL_error(L, "Out of memory");
+    size_t count = file_index_query(finder_index, text, len, matches, (size_t)limit);
+
+    /* The characters the positions are for */
+    size_t matched = 0;
+    for (size_t i = 0; i < len && matched < FILE_QUERY_MAX; i++) {
+        if (text[i] != ' ') matched++;
+    }
+
+    lua_createtable(L, (int)count, 0);
+    for (size_t i = 0; i < count; i++) {
+        lua_createtable(L, 0, 3);
+        lua_pushlstring(L, matches[i].path, matches[i].len);
+        lua_setfield(L, -2, "path");
+        lua_pushinteger(L, matches[i].score);
+        lua_setfield(L, -2, "score");
+        lua_createtable(L, (int)matched, 0);
+        for (size_t j = 0; j < matched; j++) {
+            lua_pushinteger(L, matches[i].positions[j]);
+            lua_rawseti(L, -2, (lua_Integer)j + 1);
+        }
+        lua_setfield(L, -2, "positions");
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+    free(matches);
+    return 1;
+}
+
+/* Lua API: finder.status() -> {root, files, scanning, watching} or nil */
+static int l_finder_status(lua_State *L) {
+    if (!finder_index) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    FileIndexStatus status;
+    file_index_status(finder_index, &status);
+    lua_createtable(L, 0, 4);
+    lua_pushstring(L, finder_root);
+    lua_setfield(L, -2, "root");
+    lua_pushinteger(L, (lua_Integer)status.files);
+    lua_setfield(L, -2, "files");
+    lua_pushboolean(L, status.scanning);
+    lua_setfield(L, -2, "scanning");
+    lua_pushboolean(L, status.watching);
+    lua_setfield(L, -2, "watching");
+    return 1;
+}
+
+/* Lua API: finder.rescan() - Scan the open directory again */
+static int l_finder_rescan(lua_State *L) {
+    (void)L;
+    file_index_rescan(finder_index);
+    return 0;
+}
+
+/* Lua API: finder.close() - Close the index, saving it for the next session */
+static int l_finder_close(lua_State *L) {
+    if (finder_notifying) return luaL_error(L, "finder.close: not from on_update");
+    finder_close();
+    return 0;
+}
+
+void lua_finder_shutdown(void) {
+    finder_close();
+    finder_L = NULL;
+}
+
+void register_finder_api(lua_State *L) {
+    finder_L = L;
+
+    lua_newtable(L);
+
+    lua_pushcfunction(L, l_finder_open);
+    lua_setfield(L, -2, "open");
+
+    lua_pushcfunction(L, l_finder_query);
+    lua_setfield(L, -2, "query");
+
+    lua_pushcfunction(L, l_finder_status);
+    lua_setfield(L, -2, "status");
+
+    lua_pushcfunction(L, l_finder_rescan);
+    lua_setfield(L, -2, "rescan");
+
+    lua_pushcfunction(L, l_finder_close);
+    lua_setfield(L, -2, "close");
+
+    lua_setglobal(L, "finder");
+}
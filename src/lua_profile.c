@@ -0,0 +1,560 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lua_profile.h"
+#include "occe.h"
+#include "terminal.h"
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+bool lua_profile_enabled = false;
+
+/* Costs of one plugin at one kind of call site */
+typedef struct ProfileEntry {
+    char *plugin;
+    LuaProfileSite site;
+    uint64_t calls;
+    double total_ms;
+    double max_ms;
+    uint64_t alloc_bytes;
+    struct ProfileEntry *next;
+} ProfileEntry;
+
+/* Wraps the state's own allocator while profiling, counting bytes handed out */
+typedef struct {
+    lua_Alloc alloc;
+    void *ud;
+    uint64_t allocated;
+} ProfileAllocator;
+
+static const char *const site_names[LUA_PROFILE_SITE_COUNT] = {
+    "keymap", "gutter", "window_render", "window_key", "window_event", "hook", "load",
+    "task"
+};
+
+static ProfileEntry *profile_entries = NULL;
+static size_t profile_entry_count = 0;
+static ProfileAllocator profile_allocator;
+
+/* Budget settings, and the deadline of the outermost running call (0: none) */
+static int budget_call_ms = LUA_BUDGET_CALL_MS;
+static int budget_load_ms = LUA_BUDGET_LOAD_MS;
+static bool budget_disable = false;
+static double budget_deadline = 0;
+static int budget_limit_ms = 0;
+static bool budget_expired = false;
+
+/* Plugins switched off for running over budget */
+static char **disabled_plugins = NULL;
+static size_t disabled_count = 0;
+
+static void *profile_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+    ProfileAllocator *pa = ud;
+    void *block = pa->alloc(pa->ud, ptr, osize, nsize);
+
+    /* Without a block, osize only tells what kind of object is coming */
+    size_t old = ptr ? osize : 0;
+    if (block && nsize > old) pa->allocated += nsize - old;
+    return block;
+}
+
+void lua_profile_enable(lua_State *L, bool enable) {
+    if (enable == lua_profile_enabled) return;
+
+    if (enable) {
+        profile_allocator.alloc = lua_getallocf(L, &profile_allocator.ud);
+        lua_setallocf(L, profile_alloc, &profile_allocator);
+    } else {
+        /* Blocks from the wrapper came from this allocator all along */
+        lua_setallocf(L, profile_allocator.alloc, profile_allocator.ud);
+    }
+    lua_profile_enabled = enable;
+}
+
+void lua_profile_reset(void) {
+    ProfileEntry *entry = profile_entries;
+    while (entry) {
+        ProfileEntry *next = entry->next;
+        free(entry->plugin);
+        free(entry);
+        entry = next;
+    }
+    profile_entries = NULL;
+    profile_entry_count = 0;
+}
+
+void lua_profile_function_plugin(lua_State *L, int idx, char *out, size_t size) {
+    lua_Debug ar;
+    lua_pushvalue(L, idx);
+    if (!lua_getinfo(L, ">S", &ar)) {
+        snprintf(out, size, "?");
+        return;
+    }
+
+    if (ar.source[0] != '@') {
+        snprintf(out, size, "%s", ar.what[0] == 'C' ? "(builtin)" : ar.short_src);
+        return;
+    }
+
+    const char *path = ar.source + 1;
+    const char *p = path;
+    const char *found;
+    while ((found = strstr(p, "plugins/")) != NULL) {
+        p = found + strlen("plugins/");
+    }
+    snprintf(out, size, "%s", p != path ? p : path);
+}
+
+static ProfileEntry *profile_entry(const char *plugin, LuaProfileSite site) {
+    ProfileEntry **link = &profile_entries;
+    for (ProfileEntry *entry = profile_entries; entry; link = &entry->next, entry = entry->next) {
+        if (entry->site == site && strcmp(entry->plugin, plugin) == 0) {
+            /* Keep the hot entries at the front */
+            *link = entry->next;
+            entry->next = profile_entries;
+            profile_entries = entry;
+            return entry;
+        }
+    }
+
+    ProfileEntry *entry = calloc(1, sizeof(ProfileEntry));
+    if (!entry) return NULL;
+    entry->plugin = strdup(plugin);
+    if (!entry->plugin) {
+        free(entry);
+        return NULL;
+    }
+    entry->site = site;
+    entry->next = profile_entries;
+    profile_entries = entry;
+    profile_entry_count++;
+    return entry;
+}
+
+static double now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+static bool plugin_disabled(const char *plugin) {
+    for (size_t i = 0; i < disabled_count; i++) {
+        if (strcmp(disabled_plugins[i], plugin) == 0) return true;
+    }
+    return false;
+}
+
+static void disable_plugin(const char *plugin) {
+    if (plugin_disabled(plugin)) return;
+
+    char **list = realloc(disabled_plugins, (disabled_count + 1) * sizeof(char *));
+    if (!list) return;
+    disabled_plugins = list;
+
+    char *copy = strdup(plugin);
+    if (!copy) return;
+    disabled_plugins[disabled_count++] = copy;
+}
+
+static bool enable_plugin(const char *plugin) {
+    for (size_t i = 0; i < disabled_count; i++) {
+        if (strcmp(disabled_plugins[i], plugin) == 0) {
+            free(disabled_plugins[i]);
+            disabled_plugins[i] = disabled_plugins[--disabled_count];
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Count hook while a budget is armed */
+static void budget_hook(lua_State *L, lua_Debug *ar) {
+    (void)ar;
+
+    if (budget_deadline == 0) {
+        /* Left behind in a coroutine after its call ended */
+        lua_sethook(L, NULL, 0, 0);
+        return;
+    }
+
+    if (now_ms() < budget_deadline) {
+        if (lua_gethookcount(L) != LUA_BUDGET_HOOK_COUNT) {
+            lua_sethook(L, budget_hook, LUA_MASKCOUNT, LUA_BUDGET_HOOK_COUNT);
+        }
+        return;
+    }
+
+    /* Fail at every instruction from now on, so a plugin that catches the
+     * error with pcall cannot keep running */
+    budget_expired = true;
+    lua_sethook(L, budget_hook, LUA_MASKCOUNT, 1);
+    luaL_error(L, "exceeded its time budget of %d ms", budget_limit_ms);
+}
+
+static void report_overrun(lua_State *L, const char *plugin, LuaProfileSite site, int limit) {
+    if (budget_disable) disable_plugin(plugin);
+
+    lua_getglobal(L, "_EDITOR_PTR");
+    Editor *ed = (Editor *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (!ed) return;
+
+    char msg[384];
+    snprintf(msg, sizeof(msg), "%s: %s call stopped after %d ms%s", plugin,
+             site_names[site], limit,
+             budget_disable ? " - plugin disabled (editor.enable_plugin to undo)" : "");
+    editor_set_status(ed, msg);
+}
+
+/* State saved around one guarded call or coroutine step */
+typedef struct {
+    int limit;
+    double saved_deadline;
+    int saved_limit;
+    lua_Hook hook;
+    int mask;
+    int count;
+    bool armed;
+    uint64_t allocated;
+    double start;
+} BudgetGuard;
+
+/* Arm the budget on the thread about to run. A nested call stays within its
+ * caller's deadline; a plugin load starts its own, since init.lua loading
+ * every plugin is not one slow call. */
+static void guard_begin(lua_State *L, BudgetGuard *g, int limit, LuaProfileSite site) {
+    g->limit = limit;
+    g->saved_deadline = budget_deadline;
+    g->saved_limit = budget_limit_ms;
+    g->armed = false;
+    if (limit > 0) {
+        g->hook = lua_gethook(L);
+        g->mask = lua_gethookmask(L);
+        g->count = lua_gethookcount(L);
+
+        double deadline = now_ms() + limit;
+        if (g->saved_deadline == 0 || site == LUA_PROFILE_LOAD || deadline < g->saved_deadline) {
+            budget_deadline = deadline;
+            budget_limit_ms = limit;
+            g->armed = true;
+        }
+        lua_sethook(L, budget_hook, LUA_MASKCOUNT, LUA_BUDGET_HOOK_COUNT);
+    }
+
+    g->allocated = profile_allocator.allocated;
+    g->start = now_ms();
+}
+
+/* Disarm, blame an overrun and account the call; report is where the status
+ * line message comes from */
+static void guard_end(lua_State *L, lua_State *report, BudgetGuard *g, bool failed,
+                      const char *plugin, LuaProfileSite site) {
+    double ms = now_ms() - g->start;
+
+    if (g->limit > 0) {
+        /* Time spent loading a plugin is not charged to the caller */
+        budget_deadline = g->saved_deadline;
+        if (g->saved_deadline != 0 && site == LUA_PROFILE_LOAD) budget_deadline += ms;
+        budget_limit_ms = g->saved_limit;
+        lua_sethook(L, g->hook, g->mask, g->count);
+    }
+
+    /* The call that set the deadline is the one to blame */
+    if (g->armed && budget_expired) {
+        budget_expired = false;
+        if (failed) report_overrun(report, plugin, site, g->limit);
+    }
+
+    /* The call may have switched profiling off - then it is not counted */
+    if (lua_profile_enabled) {
+        ProfileEntry *entry = profile_entry(plugin, site);
+        if (entry) {
+            entry->calls++;
+            entry->total_ms += ms;
+            if (ms > entry->max_ms) entry->max_ms = ms;
+            entry->alloc_bytes += profile_allocator.allocated - g->allocated;
+        }
+    }
+}
+
+int lua_profile_pcall(lua_State *L, int nargs, int nresults, LuaProfileSite site) {
+    int limit = site == LUA_PROFILE_LOAD ? budget_load_ms : budget_call_ms;
+    if (!lua_profile_enabled && limit == 0 && disabled_count == 0) {
+        return lua_pcall(L, nargs, nresults, 0);
+    }
+
+    char plugin[256];
+    lua_profile_function_plugin(L, -(nargs + 1), plugin, sizeof(plugin));
+
+    if (disabled_count > 0 && plugin_disabled(plugin)) {
+        lua_pop(L, nargs + 1);
+        lua_pushfstring(L, "%s is disabled", plugin);
+        return LUA_ERRRUN;
+    }
+
+    BudgetGuard guard;
+    guard_begin(L, &guard, limit, site);
+    int status = lua_pcall(L, nargs, nresults, 0);
+    guard_end(L, L, &guard, status != LUA_OK, plugin, site);
+    return status;
+}
+
+int lua_profile_resume(lua_State *co, lua_State *from, int nargs, int *nresults,
+                       const char *plugin) {
+    if (!lua_profile_enabled && budget_call_ms == 0 && disabled_count == 0) {
+        return lua_resume(co, from, nargs, nresults);
+    }
+
+    if (disabled_count > 0 && plugin_disabled(plugin)) {
+        lua_pop(co, nargs);
+        lua_pushfstring(co, "%s is disabled", plugin);
+        *nresults = 0;
+        return LUA_ERRRUN;
+    }
+
+    /* Each step between yields is one call's worth of budget */
+    BudgetGuard guard;
+    guard_begin(co, &guard, budget_call_ms, LUA_PROFILE_TASK);
+    int status = lua_resume(co, from, nargs, nresults);
+    guard_end(co, from, &guard, status != LUA_OK && status != LUA_YIELD, plugin,
+              LUA_PROFILE_TASK);
+    return status;
+}
+
+void lua_profile_cleanup(lua_State *L) {
+    if (L) lua_profile_enable(L, false);
+    lua_profile_reset();
+
+    for (size_t i = 0; i < disabled_count; i++) free(disabled_plugins[i]);
+    free(disabled_plugins);
+    disabled_plugins = NULL;
+    disabled_count = 0;
+    budget_deadline = 0;
+    budget_expired = false;
+}
+
+static int compare_total(const void *a, const void *b) {
+    const ProfileEntry *ea = *(const ProfileEntry *const *)a;
+    const ProfileEntry *eb = *(const ProfileEntry *const *)b;
+    if (ea->total_ms != eb->total_ms) return ea->total_ms < eb->total_ms ? 1 : -1;
+    return strcmp(ea->plugin, eb->plugin);
+}
+
+/* Entries sorted by total time, most expensive first. Caller frees. */
+static ProfileEntry **sorted_entries(void) {
+    ProfileEntry **sorted = malloc((profile_entry_count + 1) * sizeof(ProfileEntry *));
+    if (!sorted) return NULL;
+
+    size_t n = 0;
+    for (ProfileEntry *entry = profile_entries; entry; entry = entry->next) {
+        sorted[n++] = entry;
+    }
+    qsort(sorted, n, sizeof(ProfileEntry *), compare_total);
+    sorted[n] = NULL;
+    return sorted;
+}
+
+/* Lua API: editor.profile([enable]) -> enabled */
+static int l_editor_profile(lua_State *L) {
+    if (!lua_isnoneornil(L, 1)) {
+        lua_profile_enable(L, lua_toboolean(L, 1));
+    }
+    lua_pushboolean(L, lua_profile_enabled);
+    return 1;
+}
+
+/* Lua API: editor.profile_report() -> {{plugin, site, calls, total_ms,
+ * max_ms, avg_ms, alloc_bytes}, ...} sorted by total_ms */
+static int l_editor_profile_report(lua_State *L) {
+    ProfileEntry **sorted = sorted_entries();
+    if (!sorted) return luaL_error(L, "out of memory");
+
+    lua_createtable(L, (int)profile_entry_count, 0);
+    for (size_t i = 0; sorted[i]; i++) {
+        const ProfileEntry *entry = sorted[i];
+        lua_createtable(L, 0, 7);
+        lua_pushstring(L, entry->plugin);
+        lua_setfield(L, -2, "plugin");
+        lua_pushstring(L, site_names[entry->site]);
+        lua_setfield(L, -2, "site");
+        lua_pushinteger(L, (lua_Integer)entry->calls);
+        lua_setfield(L, -2, "calls");
+        lua_pushnumber(L, entry->total_ms);
+        lua_setfield(L, -2, "total_ms");
+        lua_pushnumber(L, entry->max_ms);
+        lua_setfield(L, -2, "max_ms");
+        lua_pushnumber(L, entry->calls ? entry->total_ms / entry->calls : 0);
+        lua_setfield(L, -2, "avg_ms");
+        lua_pushinteger(L, (lua_Integer)entry->alloc_bytes);
+        lua_setfield(L, -2, "alloc_bytes");
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+
+    free(sorted);
+    return 1;
+}
+
+/* Lua API: editor.lua_budget([{call_ms, load_ms, disable}]) ->
+ * {call_ms, load_ms, disable, disabled = {plugin, ...}} */
+static int l_editor_lua_budget(lua_State *L) {
+    if (lua_istable(L, 1)) {
+        lua_getfield(L, 1, "call_ms");
+        if (!lua_isnil(L, -1)) budget_call_ms = (int)luaL_checkinteger(L, -1);
+        lua_getfield(L, 1, "load_ms");
+        if (!lua_isnil(L, -1)) budget_load_ms = (int)luaL_checkinteger(L, -1);
+        lua_getfield(L, 1, "disable");
+        if (!lua_isnil(L, -1)) budget_disable = lua_toboolean(L, -1);
+        lua_pop(L, 3);
+
+        if (budget_call_ms < 0) budget_call_ms = 0;
+        if (budget_load_ms < 0) budget_load_ms = 0;
+    }
+
+    lua_createtable(L, 0, 4);
+    lua_pushinteger(L, budget_call_ms);
+    lua_setfield(L, -2, "call_ms");
+    lua_pushinteger(L, budget_load_ms);
+    lua_setfield(L, -2, "load_ms");
+    lua_pushboolean(L, budget_disable);
+    lua_setfield(L, -2, "disable");
+    lua_createtable(L, (int)disabled_count, 0);
+    for (size_t i = 0; i < disabled_count; i++) {
+        lua_pushstring(L, disabled_plugins[i]);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+    lua_setfield(L, -2, "disabled");
+    return 1;
+}
+
+/* Lua API: editor.enable_plugin(plugin) -> true if it had been disabled */
+static int l_editor_enable_plugin(lua_State *L) {
+    const char *plugin = luaL_checkstring(L, 1);
+    lua_pushboolean(L, enable_plugin(plugin));
+    return 1;
+}
+
+/* Lua API: editor.profile_reset() */
+static int l_editor_profile_reset(lua_State *L) {
+    (void)L;
+    lua_profile_reset();
+    return 0;
+}
+
+static Editor *profile_editor(lua_State *L) {
+    lua_getglobal(L, "_EDITOR_PTR");
+    Editor *ed = (Editor *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return ed;
+}
+
+/* Write one window row: text cut to width, rest of the line cleared */
+static void profile_row(Terminal *term, int x, int y, int width, const char *text) {
+    terminal_move_cursor(term, y, x);
+    size_t len = strlen(text);
+    if (width >= 0 && len > (size_t)width) len = width;
+    terminal_write(term, text, len);
+    terminal_write_str(term, "\x1b[K");
+}
+
+/* Built-in "profiler" window: render(data, x, y, width, height) */
+static int l_profile_render(lua_State *L) {
+    Editor *ed = profile_editor(L);
+    int x = luaL_checkinteger(L, 2);
+    int y = luaL_checkinteger(L, 3);
+    int width = luaL_checkinteger(L, 4);
+    int height = luaL_checkinteger(L, 5);
+    if (!ed || !ed->term || height <= 0) return 0;
+
+    Terminal *term = ed->term;
+    char line[512];
+
+    snprintf(line, sizeof(line), "=== Plugin profile (%s) === p: start/stop  r: reset",
+             lua_profile_enabled ? "recording" : "stopped");
+    terminal_write_str(term, "\x1b[1;36m");
+    profile_row(term, x, y, width, line);
+    terminal_write_str(term, "\x1b[0m");
+
+    int row = 1;
+    if (row < height) {
+        snprintf(line, sizeof(line), "%-32s %-13s %8s %10s %9s %9s %10s",
+                 "plugin", "site", "calls", "total ms", "avg ms", "max ms", "alloc KB");
+        terminal_write_str(term, "\x1b[90m");
+        profile_row(term, x, y + row++, width, line);
+        terminal_write_str(term, "\x1b[0m");
+    }
+
+    ProfileEntry **sorted = sorted_entries();
+    for (size_t i = 0; sorted && sorted[i] && row < height; i++) {
+        const ProfileEntry *entry = sorted[i];
+        snprintf(line, sizeof(line), "%-32.32s %-13s %8llu %10.2f %9.3f %9.3f %10.1f",
+                 entry->plugin, site_names[entry->site], (unsigned long long)entry->calls,
+                 entry->total_ms, entry->calls ? entry->total_ms / entry->calls : 0,
+                 entry->max_ms, entry->alloc_bytes / 1024.0);
+        profile_row(term, x, y + row++, width, line);
+    }
+    free(sorted);
+
+    while (row < height) {
+        profile_row(term, x, y + row++, width, "");
+    }
+    return 0;
+}
+
+/* Built-in "profiler" window: on_key(data, key) -> handled */
+static int l_profile_on_key(lua_State *L) {
+    int key = luaL_checkinteger(L, 2);
+
+    if (key == 'p') {
+        lua_profile_enable(L, !lua_profile_enabled);
+    } else if (key == 'r') {
+        lua_profile_reset();
+    } else {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+void register_profile_api(lua_State *L) {
+    lua_getglobal(L, "editor");
+    if (lua_istable(L, -1)) {
+        lua_pushcfunction(L, l_editor_profile);
+        lua_setfield(L, -2, "profile");
+
+        lua_pushcfunction(L, l_editor_profile_report);
+        lua_setfield(L, -2, "profile_report");
+
+        lua_pushcfunction(L, l_editor_profile_reset);
+        lua_setfield(L, -2, "profile_reset");
+
+        lua_pushcfunction(L, l_editor_lua_budget);
+        lua_setfield(L, -2, "lua_budget");
+
+        lua_pushcfunction(L, l_editor_enable_plugin);
+        lua_setfield(L, -2, "enable_plugin");
+    }
+    lua_pop(L, 1);
+
+    /* _window_renderers.profiler, opened with window.create_custom("profiler") */
+    lua_getglobal(L, "_window_renderers");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setglobal(L, "_window_renderers");
+    }
+
+    lua_createtable(L, 0, 2);
+    lua_pushcfunction(L, l_profile_render);
+    lua_setfield(L, -2, "render");
+    lua_pushcfunction(L, l_profile_on_key);
+    lua_setfield(L, -2, "on_key");
+    lua_setfield(L, -2, "profiler");
+
+    lua_pop(L, 1);
+}
@@ -0,0 +1,171 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lua_bridge.h"
+#include "lua_profile.h"
+#include "project_search.h"
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Callbacks a plugin passed to search.project, held in the registry until
+ * done. They run on the editor's main state: the caller may have been a
+ * task's coroutine, suspended or collected by the time results arrive. */
+typedef struct {
+    Editor *ed;
+    int on_results;
+    int on_done;
+} LuaProjectSearch;
+
+/* Call a callback with its argument already pushed above it */
+static void lua_search_call(LuaProjectSearch *ls) {
+    lua_State *L = (lua_State *)ls->ed->lua_state;
+    if (lua_profile_pcall(L, 1, 0, LUA_PROFILE_HOOK) != LUA_OK) {
+        const char *err = lua_tostring(L, -1);
+        char msg[256];
+        snprintf(msg, sizeof(msg), "search: %s", err ? err : "callback error");
+        editor_set_status(ls->ed, msg);
+        lua_pop(L, 1);
+    }
+}
+
+static void lua_search_matches(const ProjectMatch *matches, size_t count, void *data) {
+    LuaProjectSearch *ls = data;
+    lua_State *L = (lua_State *)ls->ed->lua_state;
+    if (!L || ls->on_results == LUA_NOREF) return;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ls->on_results);
+    lua_createtable(L, (int)count, 0);
+    for (size_t i = 0; i < count; i++) {
+        const ProjectMatch *m = &matches[i];
+        lua_createtable(L, 0, 5);
+        lua_pushstring(L, m->path);
+        lua_setfield(L, -2, "path");
+        lua_pushinteger(L, (lua_Integer)m->line);
+        lua_setfield(L, -2, "line");
+        lua_pushinteger(L, (lua_Integer)m->col);
+        lua_setfield(L, -2, "col");
+        lua_pushinteger(L, (lua_Integer)m->len);
+        lua_setfield(L, -2, "len");
+        lua_pushlstring(L, m->text, m->text_len);
+        lua_setfield(L, -2, "text");
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+    lua_search_call(ls);
+}
+
+static void lua_search_done(const ProjectSearchStats *stats, void *data) {
+    LuaProjectSearch *ls = data;
+    lua_State *L = (lua_State *)ls->ed->lua_state;
+    if (!L) {
+        free(ls);
+        return;
+    }
+
+    /* A cancelled search only releases its callbacks */
+    if (!stats->cancelled && ls->on_done != LUA_NOREF) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ls->on_done);
+        lua_createtable(L, 0, 4);
+        lua_pushinteger(L, (lua_Integer)stats->files);
+        lua_setfield(L, -2, "files");
+        lua_pushinteger(L, (lua_Integer)stats->binary);
+        lua_setfield(L, -2, "binary");
+        lua_pushinteger(L, (lua_Integer)stats->matches);
+        lua_setfield(L, -2, "matches");
+        lua_pushboolean(L, stats->truncated);
+        lua_setfield(L, -2, "truncated");
+        lua_search_call(ls);
+    }
+    luaL_unref(L, LUA_REGISTRYINDEX, ls->on_results);
+    luaL_unref(L, LUA_REGISTRYINDEX, ls->on_done);
+    free(ls);
+}
+
+/* Registry ref for opts[name] if it is a function */
+static int search_opt_ref(lua_State *L, int opts, const char *name) {
+    if (opts == 0) return LUA_NOREF;
+    lua_getfield(L, opts, name);
+    if (lua_isfunction(L, -1)) return luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_pop(L, 1);
+    return LUA_NOREF;
+}
+
+/* Lua API: search.project(query, [root], [opts]) -> id or nil, error
+ * Searches the files below root (default ".") in the background, skipping
+ * binary and .gitignore'd files. opts: regex, ignore_case, whole_word,
+ * max_results (default 10000, 0 for no limit), on_results(results) with
+ * results an array of {path, line, col, len, text} (line and col 0-based),
+ * and on_done({files, binary, matches, truncated}). */
+static int l_search_project(lua_State *L) {
+    lua_getglobal(L, "_EDITOR_PTR");
+    Editor *ed = (Editor *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (!ed || !ed->lua_state) return luaL_error(L, "No editor");
+
+    size_t query_len;
+    const char *query = luaL_checklstring(L, 1, &query_len);
+    const char *root = luaL_optstring(L, 2, ".");
+    int opts = 0;
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        opts = 3;
+    }
+
+    ProjectSearchOptions o = {.max_results = 10000};
+    if (opts) {
+        lua_getfield(L, opts, "ignore_case");
+        if (lua_toboolean(L, -1)) o.flags |= SEARCH_IGNORE_CASE;
+        lua_getfield(L, opts, "whole_word");
+        if (lua_toboolean(L, -1)) o.flags |= SEARCH_WHOLE_WORD;
+        lua_getfield(L, opts, "regex");
+        o.regex = lua_toboolean(L, -1);
+        lua_getfield(L, opts, "max_results");
+        if (!lua_isnil(L, -1)) {
+            lua_Integer max = luaL_checkinteger(L, -1);
+            o.max_results = max > 0 ? (size_t)max : 0;
+        }
+        lua_pop(L, 4);
+    }
+
+    LuaProjectSearch *ls = malloc(sizeof(LuaProjectSearch));
+    if (!ls) return luaL_error(L, "Out of memory");
+    ls->ed = ed;
+    ls->on_results = search_opt_ref(L, opts, "on_results");
+    ls->on_done = search_opt_ref(L, opts, "on_done");
+
+    ProjectSearchCallbacks callbacks = {
+        .on_matches = lua_search_matches,
+        .on_done = lua_search_done,
+        .data = ls,
+    };
+    char err[256];
+    int id = project_search_start(root, query, query_len, &o, &callbacks, err, sizeof(err));
+    if (id == -1) {
+        luaL_unref(L, LUA_REGISTRYINDEX, ls->on_results);
+        luaL_unref(L, LUA_REGISTRYINDEX, ls->on_done);
+        free(ls);
+        lua_pushnil(L);
+        lua_pushstring(L, err[0] ? err : "out of memory");
+        return 2;
+    }
+
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+/* Lua API: search.cancel(id) - Stop a search; its on_done is not called */
+static int l_search_cancel(lua_State *L) {
+    project_search_cancel((int)luaL_checkinteger(L, 1));
+    return 0;
+}
+
+void register_search_api(lua_State *L) {
+    lua_newtable(L);
+
+    lua_pushcfunction(L, l_search_project);
+    lua_setfield(L, -2, "project");
+
+    lua_pushcfunction(L, l_search_cancel);
+    lua_setfield(L, -2, "cancel");
+
+    lua_setglobal(L, "search");
+}
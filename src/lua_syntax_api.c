@@ -0,0 +1,151 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lua_bridge.h"
+#include "syntax.h"
+#include "colors.h"
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+/* Lua API: syntax.register(name) -> syntax object */
+static int l_syntax_register(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+    Syntax *syn = syntax_register(name);
+
+    if (syn) {
+        lua_pushlightuserdata(L, syn);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Lua API: syntax.declare(name, {ext, ...}, plugin) -> syntax object
+ * The plugin (a path under plugins/) is only loaded when a file with one of
+ * the extensions is first opened; it then calls syntax.register(name). */
+static int l_syntax_declare(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    const char *source = luaL_checkstring(L, 3);
+
+    Syntax *syn = syntax_declare(name, source);
+    if (!syn) return 0;
+
+    int len = lua_rawlen(L, 2);
+    for (int i = 1; i <= len; i++) {
+        lua_rawgeti(L, 2, i);
+        if (lua_isstring(L, -1)) {
+            syntax_add_extension(syn, lua_tostring(L, -1));
+        }
+        lua_pop(L, 1);
+    }
+
+    lua_pushlightuserdata(L, syn);
+    return 1;
+}
+
+/* Lua API: syntax.add_extension(syn, ext) */
+static int l_syntax_add_extension(lua_State *L) {
+    Syntax *syn = (Syntax *)lua_touserdata(L, 1);
+    const char *ext = luaL_checkstring(L, 2);
+
+    if (syn && ext) {
+        syntax_add_extension(syn, ext);
+    }
+
+    return 0;
+}
+
+/* Lua API: syntax.add_keyword(syn, keyword, hl_type) */
+static int l_syntax_add_keyword(lua_State *L) {
+    Syntax *syn = (Syntax *)lua_touserdata(L, 1);
+    const char *keyword = luaL_checkstring(L, 2);
+    int hl_type = luaL_checkinteger(L, 3);
+
+    if (syn && keyword) {
+        syntax_add_keyword(syn, keyword, (HighlightType)hl_type);
+    }
+
+    return 0;
+}
+
+/* Lua API: syntax.add_pattern(syn, regex, hl_type) -> true, or nil and an error
+ * Highlights whatever the regular expression matches; see regexp.h for the syntax */
+static int l_syntax_add_pattern(lua_State *L) {
+    Syntax *syn = (Syntax *)lua_touserdata(L, 1);
+    const char *pattern = luaL_checkstring(L, 2);
+    int hl_type = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, hl_type >= 0 && hl_type < HL_MAX, 3, "unknown highlight type");
+
+    char err[256];
+    if (!syn || syntax_add_pattern(syn, pattern, (HighlightType)hl_type, err, sizeof(err)) != 0) {
+        lua_pushnil(L);
+        lua_pushstring(L, syn ? err : "invalid syntax object");
+        return 2;
+    }
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/* Lua API: syntax.set_comments(syn, single, multi_start, multi_end) */
+static int l_syntax_set_comments(lua_State *L) {
+    Syntax *syn = (Syntax *)lua_touserdata(L, 1);
+    const char *single = lua_isnil(L, 2) ? NULL : lua_tostring(L, 2);
+    const char *multi_start = lua_isnil(L, 3) ? NULL : lua_tostring(L, 3);
+    const char *multi_end = lua_isnil(L, 4) ? NULL : lua_tostring(L, 4);
+
+    if (syn) {
+        syntax_set_comments(syn, single, multi_start, multi_end);
+    }
+
+    return 0;
+}
+
+/* Register syntax API functions */
+void register_syntax_api(lua_State *L) {
+    lua_newtable(L);
+
+    lua_pushcfunction(L, l_syntax_register);
+    lua_setfield(L, -2, "register");
+
+    lua_pushcfunction(L, l_syntax_declare);
+    lua_setfield(L, -2, "declare");
+
+    lua_pushcfunction(L, l_syntax_add_extension);
+    lua_setfield(L, -2, "add_extension");
+
+    lua_pushcfunction(L, l_syntax_add_keyword);
+    lua_setfield(L, -2, "add_keyword");
+
+    lua_pushcfunction(L, l_syntax_add_pattern);
+    lua_setfield(L, -2, "add_pattern");
+
+    lua_pushcfunction(L, l_syntax_set_comments);
+    lua_setfield(L, -2, "set_comments");
+
+    /* Highlight type constants */
+    lua_pushinteger(L, HL_NORMAL);
+    lua_setfield(L, -2, "HL_NORMAL");
+    lua_pushinteger(L, HL_KEYWORD);
+    lua_setfield(L, -2, "HL_KEYWORD");
+    lua_pushinteger(L, HL_TYPE);
+    lua_setfield(L, -2, "HL_TYPE");
+    lua_pushinteger(L, HL_STRING);
+    lua_setfield(L, -2, "HL_STRING");
+    lua_pushinteger(L, HL_NUMBER);
+    lua_setfield(L, -2, "HL_NUMBER");
+    lua_pushinteger(L, HL_COMMENT);
+    lua_setfield(L, -2, "HL_COMMENT");
+    lua_pushinteger(L, HL_OPERATOR);
+    lua_setfield(L, -2, "HL_OPERATOR");
+    lua_pushinteger(L, HL_FUNCTION);
+    lua_setfield(L, -2, "HL_FUNCTION");
+    lua_pushinteger(L, HL_VARIABLE);
+    lua_setfield(L, -2, "HL_VARIABLE");
+    lua_pushinteger(L, HL_CONSTANT);
+    lua_setfield(L, -2, "HL_CONSTANT");
+    lua_pushinteger(L, HL_PREPROCESSOR);
+    lua_setfield(L, -2, "HL_PREPROCESSOR");
+
+    lua_setglobal(L, "syntax");
+}
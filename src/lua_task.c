@@ -0,0 +1,588 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lua_bridge.h"
+#include "lua_profile.h"
+#include "event_loop.h"
+#include "process.h"
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* Tasks: plugin functions run as Lua coroutines. An awaiting call
+ * (task.sleep, task.run, task.read_file, ...) starts its work and yields;
+ * the result comes back through the event loop, which resumes the task with
+ * it. Plugins get sequential code, and the main thread never waits on them. */
+
+typedef struct LuaTask {
+    lua_State *co;
+    int ref;            /* Registry ref keeping the coroutine alive */
+    unsigned id;
+    bool waiting;       /* Yielded, and a wakeup is on its way */
+    bool running;
+    bool cancelled;     /* Cancelled while running - finish once it stops */
+    int timer;          /* Pending task.sleep, 0 if none */
+    unsigned await_seq; /* Which task.await a resume function belongs to */
+    int await_ref;      /* Values handed to that resume function */
+    char plugin[256];
+    struct LuaTask *next;
+} LuaTask;
+
+static LuaTask *tasks = NULL;
+static unsigned next_task_id = 1;
+static lua_State *task_L = NULL;
+
+static LuaTask *find_task(unsigned id) {
+    for (LuaTask *t = tasks; t; t = t->next) {
+        if (t->id == id) return t;
+    }
+    return NULL;
+}
+
+static void *task_key(const LuaTask *t) {
+    return (void *)(uintptr_t)t->id;
+}
+
+static LuaTask *task_from_key(void *data) {
+    return find_task((unsigned)(uintptr_t)data);
+}
+
+static void task_finish(LuaTask *t) {
+    for (LuaTask **link = &tasks; *link; link = &(*link)->next) {
+        if (*link == t) {
+            *link = t->next;
+            break;
+        }
+    }
+
+    if (t->timer) event_loop_cancel_timer(t->timer);
+    luaL_unref(task_L, LUA_REGISTRYINDEX, t->await_ref);
+    luaL_unref(task_L, LUA_REGISTRYINDEX, t->ref);
+    free(t);
+}
+
+static void task_report(const char *msg) {
+    lua_getglobal(task_L, "_EDITOR_PTR");
+    Editor *ed = (Editor *)lua_touserdata(task_L, -1);
+    lua_pop(task_L, 1);
+    if (ed) editor_set_status(ed, msg);
+}
+
+static void task_step_later(void *data);
+
+/* Resume t with nargs values already pushed on its thread */
+static void task_resume(LuaTask *t, int nargs) {
+    t->waiting = false;
+    t->running = true;
+    int nresults = 0;
+    int status = lua_profile_resume(t->co, task_L, nargs, &nresults, t->plugin);
+    t->running = false;
+
+    if (status == LUA_YIELD && !t->cancelled) {
+        lua_pop(t->co, nresults);
+        /* A bare coroutine.yield() is a task.yield() */
+        if (!t->waiting) {
+            t->waiting = true;
+            if (event_loop_post(task_step_later, task_key(t)) != 0) {
+                task_report("task: out of memory");
+                task_finish(t);
+            }
+        }
+        return;
+    }
+
+    if (status != LUA_OK && status != LUA_YIELD) {
+        const char *err = lua_tostring(t->co, -1);
+        char msg[384];
+        snprintf(msg, sizeof(msg), "task: %s", err ? err : "error");
+        task_report(msg);
+    }
+    task_finish(t);
+}
+
+/* Posted wakeup with no result: task start, task.yield() */
+static void task_step_later(void *data) {
+    LuaTask *t = task_from_key(data);
+    if (!t) return;
+    /* A task that has not started still has its function's arguments on its
+     * stack; a yielded one has nothing */
+    int nargs = lua_status(t->co) == LUA_OK ? lua_gettop(t->co) - 1 : 0;
+    task_resume(t, nargs);
+}
+
+/* The task running on L, about to await; errors outside a task */
+static LuaTask *awaiting_task(lua_State *L, const char *what) {
+    for (LuaTask *t = tasks; t; t = t->next) {
+        if (t->co == L && t->running) {
+            if (!lua_isyieldable(L)) {
+                luaL_error(L, "%s: cannot wait here (inside a C call)", what);
+            }
+            return t;
+        }
+    }
+    luaL_error(L, "%s must be called from a task (task.spawn)", what);
+    return NULL;
+}
+
+/* Lua API: task.spawn(fn, ...) -> id
+ * Runs fn(...) as a task, starting on the next loop iteration */
+static int l_task_spawn(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    int nargs = lua_gettop(L);
+
+    LuaTask *t = calloc(1, sizeof(LuaTask));
+    if (!t) return luaL_error(L, "out of memory");
+    t->await_ref = LUA_NOREF;
+    lua_profile_function_plugin(L, 1, t->plugin, sizeof(t->plugin));
+
+    t->co = lua_newthread(L);
+    t->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    if (!lua_checkstack(t->co, nargs)) {
+        luaL_unref(L, LUA_REGISTRYINDEX, t->ref);
+        free(t);
+        return luaL_error(L, "too many arguments");
+    }
+    for (int i = 1; i <= nargs; i++) lua_pushvalue(L, i);
+    lua_xmove(L, t->co, nargs);
+
+    t->id = next_task_id++;
+    if (next_task_id == 0) next_task_id = 1;
+    t->waiting = true;
+    t->next = tasks;
+    tasks = t;
+
+    if (event_loop_post(task_step_later, task_key(t)) != 0) {
+        task_finish(t);
+        return luaL_error(L, "out of memory");
+    }
+
+    lua_pushinteger(L, t->id);
+    return 1;
+}
+
+/* Lua API: task.cancel(id) -> true if the task was still alive
+ * Whatever it was waiting for still completes, but is dropped */
+static int l_task_cancel(lua_State *L) {
+    LuaTask *t = find_task((unsigned)luaL_checkinteger(L, 1));
+    if (!t) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    if (t->running) {
+        t->cancelled = true;
+        /* Cancelling itself: stop here if possible, else at its next wait */
+        if (t->co == L && lua_isyieldable(L)) return lua_yield(L, 0);
+    } else {
+        task_finish(t);
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/* Lua API: task.current() -> id of the running task, or nil */
+static int l_task_current(lua_State *L) {
+    for (LuaTask *t = tasks; t; t = t->next) {
+        if (t->co == L && t->running) {
+            lua_pushinteger(L, t->id);
+            return 1;
+        }
+    }
+    lua_pushnil(L);
+    return 1;
+}
+
+/* Lua API: task.yield() - let the editor run, continue next loop iteration */
+static int l_task_yield(lua_State *L) {
+    LuaTask *t = awaiting_task(L, "task.yield");
+    if (event_loop_post(task_step_later, task_key(t)) != 0) {
+        return luaL_error(L, "out of memory");
+    }
+    t->waiting = true;
+    return lua_yield(L, 0);
+}
+
+static void task_sleep_done(void *data) {
+    LuaTask *t = task_from_key(data);
+    if (!t) return;
+    t->timer = 0;
+    task_resume(t, 0);
+}
+
+/* Lua API: task.sleep(ms) */
+static int l_task_sleep(lua_State *L) {
+    LuaTask *t = awaiting_task(L, "task.sleep");
+    lua_Integer ms = luaL_checkinteger(L, 1);
+    if (ms < 0) ms = 0;
+    if (ms > INT32_MAX) ms = INT32_MAX;
+
+    t->timer = event_loop_add_timer((int)ms, task_sleep_done, task_key(t));
+    if (t->timer == -1) {
+        t->timer = 0;
+        return luaL_error(L, "out of memory");
+    }
+    t->waiting = true;
+    return lua_yield(L, 0);
+}
+
+/* Output of a task.run child, collected until it exits */
+typedef struct {
+    unsigned task_id;
+    char *out[2];
+    size_t len[2];
+    size_t capacity[2];
+    bool overflow;
+} TaskProcess;
+
+static void task_process_append(TaskProcess *tp, int stream, const char *chunk, size_t len) {
+    if (tp->overflow) return;
+    if (tp->len[stream] + len > tp->capacity[stream]) {
+        size_t capacity = tp->capacity[stream] ? tp->capacity[stream] : 4096;
+        while (capacity < tp->len[stream] + len) capacity *= 2;
+        char *out = realloc(tp->out[stream], capacity);
+        if (!out) {
+            tp->overflow = true;
+            return;
+        }
+        tp->out[stream] = out;
+        tp->capacity[stream] = capacity;
+    }
+    memcpy(tp->out[stream] + tp->len[stream], chunk, len);
+    tp->len[stream] += len;
+}
+
+static void task_process_stdout(pid_t pid, const char *chunk, size_t len, void *data) {
+    (void)pid;
+    task_process_append(data, 0, chunk, len);
+}
+
+static void task_process_stderr(pid_t pid, const char *chunk, size_t len, void *data) {
+    (void)pid;
+    task_process_append(data, 1, chunk, len);
+}
+
+static void task_process_exit(pid_t pid, int code, void *data) {
+    (void)pid;
+    TaskProcess *tp = data;
+
+    /* code -1: the editor is shutting down and the task goes with it */
+    LuaTask *t = code >= 0 ? find_task(tp->task_id) : NULL;
+    if (t) {
+        if (tp->overflow) {
+            lua_pushnil(t->co);
+            lua_pushstring(t->co, "out of memory");
+            task_resume(t, 2);
+        } else {
+            lua_pushlstring(t->co, tp->out[0] ? tp->out[0] : "", tp->len[0]);
+            lua_pushlstring(t->co, tp->out[1] ? tp->out[1] : "", tp->len[1]);
+            lua_pushinteger(t->co, code);
+            task_resume(t, 3);
+        }
+    }
+
+    free(tp->out[0]);
+    free(tp->out[1]);
+    free(tp);
+}
+
+/* Lua API: task.run(argv, {stdin}) -> stdout, stderr, code  or  nil, error
+ * Starts argv[1] (searched in PATH) and waits for it to exit */
+static int l_task_run(lua_State *L) {
+    LuaTask *t = awaiting_task(L, "task.run");
+    luaL_checktype(L, 1, LUA_TTABLE);
+    int opts = 0;
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        opts = 2;
+    }
+
+    int argc = (int)lua_rawlen(L, 1);
+    if (argc == 0) return luaL_argerror(L, 1, "empty argv");
+    luaL_checkstack(L, argc + 8, "too many arguments");
+
+    /* Strings stay alive on the stack until posix_spawn has copied them */
+    char **argv = malloc((argc + 1) * sizeof(char *));
+    if (!argv) return luaL_error(L, "out of memory");
+    for (int i = 0; i < argc; i++) {
+        lua_rawgeti(L, 1, i + 1);
+        argv[i] = (char *)lua_tostring(L, -1);
+        if (!argv[i]) {
+            free(argv);
+            return luaL_argerror(L, 1, "argv entries must be strings");
+        }
+    }
+    argv[argc] = NULL;
+
+    const char *input = NULL;
+    size_t input_len = 0;
+    if (opts) {
+        lua_getfield(L, opts, "stdin");
+        if (lua_isstring(L, -1)) input = lua_tolstring(L, -1, &input_len);
+    }
+
+    TaskProcess *tp = calloc(1, sizeof(TaskProcess));
+    if (!tp) {
+        free(argv);
+        return luaL_error(L, "out of memory");
+    }
+    tp->task_id = t->id;
+
+    ProcessCallbacks callbacks = {
+        .on_stdout = task_process_stdout,
+        .on_stderr = task_process_stderr,
+        .on_exit = task_process_exit,
+        .data = tp,
+    };
+    pid_t pid = process_spawn(argv, input, input_len, &callbacks);
+    int err = errno;
+    free(argv);
+
+    if (pid == -1) {
+        free(tp);
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(err));
+        return 2;
+    }
+
+    t->waiting = true;
+    return lua_yield(L, 0);
+}
+
+/* A task.read_file in flight; the worker thread owns it until it posts */
+typedef struct {
+    unsigned task_id;
+    char *path;
+    char *data;
+    size_t len;
+    int err;
+} TaskRead;
+
+static void task_read_done(void *data) {
+    TaskRead *tr = data;
+    LuaTask *t = find_task(tr->task_id);
+    if (t) {
+        if (tr->err) {
+            lua_pushnil(t->co);
+            lua_pushstring(t->co, strerror(tr->err));
+        } else {
+            lua_pushlstring(t->co, tr->data ? tr->data : "", tr->len);
+            lua_pushnil(t->co);
+        }
+        task_resume(t, 2);
+    }
+
+    free(tr->path);
+    free(tr->data);
+    free(tr);
+}
+
+static void *task_read_thread(void *arg) {
+    TaskRead *tr = arg;
+
+    int fd = open(tr->path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        tr->err = errno;
+    } else if (S_ISDIR(st.st_mode)) {
+        tr->err = EISDIR;
+    } else {
+        /* st_size is only a hint - pipes and /proc files report 0 */
+        size_t capacity = st.st_size > 0 ? (size_t)st.st_size + 1 : 4096;
+        tr->data = malloc(capacity);
+        if (!tr->data) tr->err = ENOMEM;
+        while (!tr->err) {
+            if (tr->len == capacity) {
+                char *data = realloc(tr->data, capacity * 2);
+                if (!data) {
+                    tr->err = ENOMEM;
+                    break;
+                }
+                tr->data = data;
+                capacity *= 2;
+            }
+            ssize_t n = read(fd, tr->data + tr->len, capacity - tr->len);
+            if (n > 0) {
+                tr->len += n;
+            } else if (n == 0) {
+                break;
+            } else if (errno != EINTR) {
+                tr->err = errno;
+            }
+        }
+    }
+    if (fd != -1) close(fd);
+
+    if (event_loop_post(task_read_done, tr) != 0) {
+        /* Nobody will hear back - the task stays asleep until cancelled */
+        free(tr->path);
+        free(tr->data);
+        free(tr);
+    }
+    return NULL;
+}
+
+/* Lua API: task.read_file(path) -> contents or nil, error
+ * The file is read on a worker thread */
+static int l_task_read_file(lua_State *L) {
+    LuaTask *t = awaiting_task(L, "task.read_file");
+    const char *path = luaL_checkstring(L, 1);
+
+    TaskRead *tr = calloc(1, sizeof(TaskRead));
+    if (!tr) return luaL_error(L, "out of memory");
+    tr->task_id = t->id;
+    tr->path = strdup(path);
+    if (!tr->path) {
+        free(tr);
+        return luaL_error(L, "out of memory");
+    }
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&thread, &attr, task_read_thread, tr);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        free(tr->path);
+        free(tr);
+        lua_pushnil(L);
+        lua_pushstring(L, strerror(err));
+        return 2;
+    }
+
+    t->waiting = true;
+    return lua_yield(L, 0);
+}
+
+static void task_await_done(void *data) {
+    LuaTask *t = task_from_key(data);
+    if (!t || t->await_ref == LUA_NOREF) return;
+
+    /* Unpack the saved values onto the task's thread */
+    lua_rawgeti(task_L, LUA_REGISTRYINDEX, t->await_ref);
+    luaL_unref(task_L, LUA_REGISTRYINDEX, t->await_ref);
+    t->await_ref = LUA_NOREF;
+
+    lua_getfield(task_L, -1, "n");
+    int n = (int)lua_tointeger(task_L, -1);
+    lua_pop(task_L, 1);
+    if (n < 0 || !lua_checkstack(t->co, n)) n = 0;
+    for (int i = 1; i <= n; i++) lua_rawgeti(task_L, -1 - (i - 1), i);
+    lua_xmove(task_L, t->co, n);
+    lua_pop(task_L, 1);
+
+    task_resume(t, n);
+}
+
+/* The resume function task.await hands out: resume(...) -> true the first time */
+static int l_task_await_resume(lua_State *L) {
+    unsigned id = (unsigned)lua_tointeger(L, lua_upvalueindex(1));
+    unsigned seq = (unsigned)lua_tointeger(L, lua_upvalueindex(2));
+
+    LuaTask *t = find_task(id);
+    if (!t || !t->waiting || t->await_seq != seq) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    /* Always resume from the loop: resume() may be called before the task
+     * has even yielded, or from inside another task */
+    int n = lua_gettop(L);
+    lua_createtable(L, n, 1);
+    lua_insert(L, 1);
+    for (int i = n; i >= 1; i--) lua_rawseti(L, 1, i);
+    lua_pushinteger(L, n);
+    lua_setfield(L, 1, "n");
+
+    if (event_loop_post(task_await_done, task_key(t)) != 0) {
+        return luaL_error(L, "out of memory");
+    }
+    t->await_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    t->await_seq++;
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/* Lua API: task.await(fn) -> the values passed to resume
+ * Calls fn(resume) and waits until resume(...) is called, so any callback
+ * style API can be awaited. fn itself must not wait. */
+static int l_task_await(lua_State *L) {
+    LuaTask *t = awaiting_task(L, "task.await");
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+
+    t->await_seq++;
+    t->waiting = true;
+
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, t->id);
+    lua_pushinteger(L, t->await_seq);
+    lua_pushcclosure(L, l_task_await_resume, 2);
+    lua_call(L, 1, 0);
+
+    return lua_yield(L, 0);
+}
+
+/* Lua API: task.list() -> {{id, plugin, waiting}, ...} */
+static int l_task_list(lua_State *L) {
+    lua_newtable(L);
+    int index = 1;
+    for (LuaTask *t = tasks; t; t = t->next) {
+        lua_createtable(L, 0, 3);
+        lua_pushinteger(L, t->id);
+        lua_setfield(L, -2, "id");
+        lua_pushstring(L, t->plugin);
+        lua_setfield(L, -2, "plugin");
+        lua_pushboolean(L, t->waiting);
+        lua_setfield(L, -2, "waiting");
+        lua_rawseti(L, -2, index++);
+    }
+    return 1;
+}
+
+void lua_task_shutdown(void) {
+    while (tasks) task_finish(tasks);
+    task_L = NULL;
+}
+
+/* Register task API */
+void register_task_api(lua_State *L) {
+    task_L = L;
+
+    lua_newtable(L);
+
+    lua_pushcfunction(L, l_task_spawn);
+    lua_setfield(L, -2, "spawn");
+
+    lua_pushcfunction(L, l_task_cancel);
+    lua_setfield(L, -2, "cancel");
+
+    lua_pushcfunction(L, l_task_current);
+    lua_setfield(L, -2, "current");
+
+    lua_pushcfunction(L, l_task_list);
+    lua_setfield(L, -2, "list");
+
+    lua_pushcfunction(L, l_task_yield);
+    lua_setfield(L, -2, "yield");
+
+    lua_pushcfunction(L, l_task_sleep);
+    lua_setfield(L, -2, "sleep");
+
+    lua_pushcfunction(L, l_task_run);
+    lua_setfield(L, -2, "run");
+
+    lua_pushcfunction(L, l_task_read_file);
+    lua_setfield(L, -2, "read_file");
+
+    lua_pushcfunction(L, l_task_await);
+    lua_setfield(L, -2, "await");
+
+    lua_setglobal(L, "task");
+}
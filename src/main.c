@@ -24,6 +24,9 @@ int main(int argc, char *argv[]) {
                 buffer_append_row(buf, "", 0);
             }
 
+            /* Offer to replay edits from a crashed session */
+            editor_offer_recovery(ed, buf);
+
             /* Add buffer to editor */
             ed->buffers = malloc(sizeof(Buffer *));
             ed->buffers[0] = buf;
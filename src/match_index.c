@@ -0,0 +1,300 @@
+#define _POSIX_C_SOURCE 200809L
+#include "match_index.h"
+#include "event_loop.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* One index of the buffer, as matches sorted by position. Immutable once
+ * published; only the main thread frees it, after a newer one replaced it
+ * (or the job of an index destroyed under it).
+ * It keeps the snapshot it was built from, to find what the next one must
+ * search again. */
+typedef struct {
+    BufferSnapshot *snapshot;
+    size_t count;
+    size_t capacity;
+    IndexedMatch matches[];
+} MatchList;
+
+/* Rows searched between checks for an abandoned job */
+#define MATCH_INDEX_CANCEL_ROWS 1024
+
+enum {
+    JOB_RUNNING,
+    JOB_DONE,                   /* Waiting to be reaped on the main thread */
+    JOB_ABANDONED,              /* Index destroyed: the job stops and frees it */
+};
+
+/* Background re-index of the rows changed since the previous list */
+typedef struct {
+    pthread_t thread;
+    MatchIndex *mi;
+    BufferSnapshot *snapshot;
+    const MatchList *prev;      /* List to patch, or NULL for a full scan */
+    MatchList *retired;         /* The list this one replaced */
+    atomic_int state;
+    bool failed;
+} MatchIndexJob;
+
+struct MatchIndex {
+    SearchPattern *pat;         /* Only the running job uses these */
+    Regexp *re;
+
+    _Atomic(MatchList *) list;  /* Latest result, read by the renderer */
+    MatchIndexJob *job;         /* Index in progress, or NULL */
+    unsigned long version;      /* Buffer version the last job started from */
+    bool submitted;
+};
+
+/* ===== Indexing ===== */
+
+static bool list_add(MatchList **lp, size_t row, size_t col, size_t len) {
+    MatchList *l = *lp;
+    if (l->count == l->capacity) {
+        size_t capacity = l->capacity ? l->capacity * 2 : 64;
+        MatchList *grown = realloc(l, sizeof(MatchList) + capacity * sizeof(IndexedMatch));
+        if (!grown) return false;
+        *lp = l = grown;
+        l->capacity = capacity;
+    }
+    l->matches[l->count++] = (IndexedMatch){row, (uint32_t)col, (uint32_t)len};
+    return true;
+}
+
+/* Bytes in the UTF-8 character at s, so the scan never stops inside one */
+static size_t char_len(const char *s, size_t avail) {
+    size_t n = 1;
+    while (n < avail && ((unsigned char)s[n] & 0xC0) == 0x80) n++;
+    return n;
+}
+
+/* Append the matches in one row */
+static bool index_row(const MatchIndex *mi, MatchList **lp, size_t y, const BufferRow *row) {
+    size_t pos = 0;
+    while (pos <= row->size) {
+        size_t start, end;
+        if (mi->pat) {
+            ptrdiff_t p = search_find(mi->pat, row->data, row->size, pos);
+            if (p < 0) break;
+            start = (size_t)p;
+            end = start + search_pattern_length(mi->pat);
+        } else {
+            RegexpMatch m;
+            if (!regexp_search(mi->re, row->data, row->size, pos, &m)) break;
+            start = (size_t)m.start[0];
+            end = (size_t)m.end[0];
+        }
+
+        /* Empty matches show nothing: step over a character and go on */
+        if (end == start) {
+            if (start >= row->size) break;
+            pos = start + char_len(row->data + start, row->size - start);
+            continue;
+        }
+        if (!list_add(lp, y, start, end - start)) return false;
+        pos = end;
+    }
+    return true;
+}
+
+/* First match in l on row y or below */
+static size_t list_lower_bound(const MatchList *l, size_t y) {
+    size_t lo = 0, hi = l->count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (l->matches[mid].row < y) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Build the new list. Matches in rows untouched since prev are carried over,
+ * shifted by the rows inserted or removed; the rows between are searched. */
+static MatchList *match_index_compute(const MatchIndexJob *job) {
+    const MatchList *prev = job->prev;
+    size_t n = buffer_snapshot_num_rows(job->snapshot);
+
+    size_t capacity = prev ? prev->count + 16 : 64;
+    MatchList *l = malloc(sizeof(MatchList) + capacity * sizeof(IndexedMatch));
+    if (!l) return NULL;
+    l->snapshot = NULL;
+    l->count = 0;
+    l->capacity = capacity;
+
+    /* Rows [top, n - bottom) are new; prev rows [old_n - bottom, old_n) moved */
+    size_t top = 0, bottom = 0, old_n = 0;
+    if (prev) {
+        old_n = buffer_snapshot_num_rows(prev->snapshot);
+        buffer_snapshot_compare(prev->snapshot, job->snapshot, &top, &bottom);
+        if (top > n) top = n;
+        if (top > old_n) top = old_n;
+        if (bottom > n - top) bottom = n - top;
+        if (bottom > old_n - top) bottom = old_n - top;
+
+        size_t keep = list_lower_bound(prev, top);
+        memcpy(l->matches, prev->matches, keep * sizeof(IndexedMatch));
+        l->count = keep;
+    }
+
+    BufferSnapshotIter it;
+    buffer_snapshot_iter_init(&it, job->snapshot, top);
+    for (size_t y = top; y < n - bottom; y++) {
+        if ((y - top) % MATCH_INDEX_CANCEL_ROWS == 0 &&
+            atomic_load(&((MatchIndexJob *)job)->state) == JOB_ABANDONED) {
+            free(l);
+            return NULL;
+        }
+
+        const BufferRow *row = buffer_snapshot_iter_next(&it);
+        if (!row || !index_row(job->mi, &l, y, row)) {
+            free(l);
+            return NULL;
+        }
+    }
+
+    if (prev) {
+        for (size_t i = list_lower_bound(prev, old_n - bottom); i < prev->count; i++) {
+            IndexedMatch moved = prev->matches[i];
+            moved.row = moved.row - (old_n - bottom) + (n - bottom);
+            if (!list_add(&l, moved.row, moved.col, moved.len)) {
+                free(l);
+                return NULL;
+            }
+        }
+    }
+
+    l->snapshot = buffer_snapshot_retain(job->snapshot);
+    return l;
+}
+
+static void match_list_free(MatchList *l) {
+    if (!l) return;
+    buffer_snapshot_release(l->snapshot);
+    free(l);
+}
+
+/* Wakes the main loop; the redraw that follows reaps the job */
+static void match_index_ready(void *data) {
+    (void)data;
+}
+
+static void match_index_free(MatchIndex *mi) {
+    match_list_free(atomic_load(&mi->list));
+    search_pattern_destroy(mi->pat);
+    regexp_free(mi->re);
+    free(mi);
+}
+
+static void *match_index_main(void *arg) {
+    MatchIndexJob *job = arg;
+    MatchIndex *mi = job->mi;
+
+    MatchList *l = match_index_compute(job);
+    if (l) {
+        job->retired = atomic_exchange(&mi->list, l);
+    } else {
+        job->failed = true;
+    }
+    buffer_snapshot_release(job->snapshot);
+    job->snapshot = NULL;
+
+    if (atomic_exchange(&job->state, JOB_DONE) == JOB_ABANDONED) {
+        /* The index was destroyed while this ran; nobody is left to reap it */
+        match_list_free(job->retired);
+        free(job);
+        match_index_free(mi);
+        return NULL;
+    }
+    event_loop_post(match_index_ready, NULL);
+    return NULL;
+}
+
+/* Collect a job; with wait, block until it finishes first */
+static bool match_index_reap(MatchIndex *mi, bool wait) {
+    MatchIndexJob *job = mi->job;
+    if (!job) return true;
+    if (!wait && atomic_load(&job->state) != JOB_DONE) return false;
+
+    pthread_join(job->thread, NULL);
+    if (job->failed) mi->submitted = false;  /* Try again at the next update */
+    match_list_free(job->retired);
+    free(job);
+    mi->job = NULL;
+    return true;
+}
+
+/* ===== Index ===== */
+
+MatchIndex *match_index_create(SearchPattern *pat, Regexp *re) {
+    if (!pat == !re) return NULL;
+
+    MatchIndex *mi = calloc(1, sizeof(MatchIndex));
+    if (!mi) return NULL;
+    mi->pat = pat;
+    mi->re = re;
+    atomic_init(&mi->list, NULL);
+    return mi;
+}
+
+void match_index_destroy(MatchIndex *mi) {
+    if (!mi) return;
+
+    /* A full scan of a large buffer takes a while: rather than wait for it,
+     * tell it to stop and leave the index for its thread to free */
+    MatchIndexJob *job = mi->job;
+    if (job) {
+        pthread_t thread = job->thread;
+        if (atomic_exchange(&job->state, JOB_ABANDONED) != JOB_DONE) {
+            pthread_detach(thread);
+            return;
+        }
+        match_index_reap(mi, true);
+    }
+    match_index_free(mi);
+}
+
+void match_index_update(MatchIndex *mi, Buffer *buf) {
+    if (!mi || !buf) return;
+
+    /* One job at a time; the next one patches its result */
+    if (!match_index_reap(mi, false)) return;
+    if (mi->submitted && mi->version == buf->version) return;
+
+    MatchIndexJob *job = calloc(1, sizeof(MatchIndexJob));
+    if (!job) return;
+    job->snapshot = buffer_snapshot_acquire(buf);
+    if (!job->snapshot) {
+        free(job);
+        return;
+    }
+    job->mi = mi;
+    job->prev = atomic_load(&mi->list);
+    atomic_init(&job->state, JOB_RUNNING);
+
+    mi->version = buf->version;
+    if (pthread_create(&job->thread, NULL, match_index_main, job) != 0) {
+        buffer_snapshot_release(job->snapshot);
+        free(job);
+        mi->submitted = false;
+        return;
+    }
+    mi->job = job;
+    mi->submitted = true;
+}
+
+const IndexedMatch *match_index_view(const MatchIndex *mi, size_t *count) {
+    const MatchList *l = mi ? atomic_load(&((MatchIndex *)mi)->list) : NULL;
+    *count = l ? l->count : 0;
+    return l ? l->matches : NULL;
+}
+
+size_t match_index_find(const IndexedMatch *matches, size_t count, size_t row, size_t col) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const IndexedMatch *m = &matches[mid];
+        if (m->row < row || (m->row == row && m->col < col)) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
@@ -0,0 +1,388 @@
+#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
+#include "process.h"
+#include "event_loop.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+typedef struct Process {
+    pid_t pid;
+    int stdin_fd;
+    int stdout_fd;
+    int stderr_fd;
+
+    /* Pending stdin, written as the pipe drains */
+    char *input;
+    size_t input_len;
+    size_t input_written;
+
+    bool exited;
+    int code;
+
+    ProcessCallbacks callbacks;
+    struct Process *next;
+} Process;
+
+static Process *processes = NULL;
+
+/* SIGCHLD handler writes a byte here; the main loop then reaps our children */
+static int sigchld_pipe[2] = {-1, -1};
+static struct sigaction old_sigchld;
+static struct sigaction old_sigpipe;
+
+static int set_nonblock_cloexec(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) return -1;
+    return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+static void close_pipe(int p[2]) {
+    if (p[0] != -1) close(p[0]);
+    if (p[1] != -1) close(p[1]);
+    p[0] = p[1] = -1;
+}
+
+static void sigchld_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    char byte = 1;
+    ssize_t n = write(sigchld_pipe[1], &byte, 1);
+    (void)n;
+    errno = saved_errno;
+}
+
+static void process_unlink(Process *p) {
+    for (Process **pp = &processes; *pp; pp = &(*pp)->next) {
+        if (*pp == p) {
+            *pp = p->next;
+            return;
+        }
+    }
+}
+
+static void process_close_fd(int *fd) {
+    if (*fd == -1) return;
+    event_loop_unwatch_fd(*fd);
+    close(*fd);
+    *fd = -1;
+}
+
+static void process_free(Process *p) {
+    process_close_fd(&p->stdin_fd);
+    process_close_fd(&p->stdout_fd);
+    process_close_fd(&p->stderr_fd);
+    free(p->input);
+    free(p);
+}
+
+/* Report the exit only once the child is reaped and all its output was delivered */
+static void process_maybe_finish(Process *p) {
+    if (!p->exited || p->stdout_fd != -1 || p->stderr_fd != -1) return;
+
+    process_unlink(p);
+    if (p->callbacks.on_exit) {
+        p->callbacks.on_exit(p->pid, p->code, p->callbacks.data);
+    }
+    process_free(p);
+}
+
+static void process_read_pipe(int fd, short revents, void *data) {
+    (void)revents;
+    Process *p = data;
+    static char chunk[PROCESS_READ_CHUNK];
+
+    /* Drain what is available so fast writers arrive in few, large chunks */
+    size_t len = 0;
+    bool eof = false;
+    while (len < sizeof(chunk)) {
+        ssize_t n = read(fd, chunk + len, sizeof(chunk) - len);
+        if (n > 0) {
+            len += n;
+        } else if (n == 0) {
+            eof = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) eof = true;
+            break;
+        }
+    }
+
+    bool is_stdout = fd == p->stdout_fd;
+    if (eof) process_close_fd(is_stdout ? &p->stdout_fd : &p->stderr_fd);
+
+    if (len > 0) {
+        void (*cb)(pid_t, const char *, size_t, void *) =
+            is_stdout ? p->callbacks.on_stdout : p->callbacks.on_stderr;
+        if (cb) cb(p->pid, chunk, len, p->callbacks.data);
+    }
+
+    process_maybe_finish(p);
+}
+
+static void process_write_stdin(int fd, short revents, void *data) {
+    (void)revents;
+    Process *p = data;
+
+    while (p->input_written < p->input_len) {
+        ssize_t n = write(fd, p->input + p->input_written, p->input_len - p->input_written);
+        if (n > 0) {
+            p->input_written += n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;  /* Wait for the child to read some */
+        } else {
+            break;  /* EPIPE: the child stopped reading */
+        }
+    }
+
+    /* Closing stdin tells the child there is no more input */
+    process_close_fd(&p->stdin_fd);
+    free(p->input);
+    p->input = NULL;
+}
+
+static void process_reap(int fd, short revents, void *data) {
+    (void)revents;
+    (void)data;
+
+    char drain[64];
+    while (read(fd, drain, sizeof(drain)) > 0) {
+    }
+
+    /* Only wait on our own pids so popen/pclose elsewhere keep working */
+    Process *p = processes;
+    while (p) {
+        Process *next = p->next;
+        int status;
+        if (!p->exited && waitpid(p->pid, &status, WNOHANG) == p->pid) {
+            p->exited = true;
+            p->code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+            process_maybe_finish(p);
+        }
+        p = next;
+    }
+}
+
+int process_init(void) {
+    if (sigchld_pipe[0] != -1) return 0;
+
+    if (pipe(sigchld_pipe) == -1) return -1;
+    if (set_nonblock_cloexec(sigchld_pipe[0]) == -1 ||
+        set_nonblock_cloexec(sigchld_pipe[1]) == -1 ||
+        event_loop_watch_fd(sigchld_pipe[0], POLLIN, process_reap, NULL) == -1) {
+        close_pipe(sigchld_pipe);
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, &old_sigchld);
+
+    /* A child closing its stdin early must not kill the editor */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, &old_sigpipe);
+
+    return 0;
+}
+
+void process_shutdown(void) {
+    if (sigchld_pipe[0] == -1) return;
+
+    while (processes) {
+        Process *p = processes;
+        processes = p->next;
+        if (!p->exited) kill(p->pid, SIGTERM);
+        /* Let the owner release what it attached to the callbacks */
+        if (p->callbacks.on_exit) p->callbacks.on_exit(p->pid, -1, p->callbacks.data);
+        process_free(p);
+    }
+
+    sigaction(SIGCHLD, &old_sigchld, NULL);
+    sigaction(SIGPIPE, &old_sigpipe, NULL);
+    event_loop_unwatch_fd(sigchld_pipe[0]);
+    close_pipe(sigchld_pipe);
+}
+
+/* Run argv with the given fds as its stdin/stdout/stderr (-1: /dev/null).
+ * Returns 0 or an errno value. */
+static int spawn_child(char *const argv[], int in_fd, int out_fd, int err_fd, pid_t *pid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int err;
+    if ((err = posix_spawn_file_actions_init(&actions)) != 0) return err;
+    if ((err = posix_spawnattr_init(&attr)) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return err;
+    }
+
+    int fds[3] = {in_fd, out_fd, err_fd};
+    for (int target = 0; target < 3; target++) {
+        if (fds[target] != -1) {
+            posix_spawn_file_actions_adddup2(&actions, fds[target], target);
+        } else {
+            posix_spawn_file_actions_addopen(&actions, target, "/dev/null",
+                                             target == STDIN_FILENO ? O_RDONLY : O_WRONLY, 0);
+        }
+    }
+
+    /* Undo our SIGPIPE/SIGCHLD handling in the child */
+    sigset_t defaults, mask;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    sigaddset(&defaults, SIGCHLD);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+    err = posix_spawnp(pid, argv[0], &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return err;
+}
+
+pid_t process_spawn(char *const argv[], const char *input, size_t input_len,
+                    const ProcessCallbacks *callbacks) {
+    if (!argv || !argv[0]) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (process_init() == -1) return -1;
+
+    Process *p = calloc(1, sizeof(Process));
+    if (!p) return -1;
+    p->stdin_fd = p->stdout_fd = p->stderr_fd = -1;
+    if (callbacks) p->callbacks = *callbacks;
+
+    if (input) {
+        p->input = malloc(input_len ? input_len : 1);
+        if (!p->input) {
+            free(p);
+            return -1;
+        }
+        memcpy(p->input, input, input_len);
+        p->input_len = input_len;
+    }
+
+    int in_pipe[2] = {-1, -1};
+    int out_pipe[2] = {-1, -1};
+    int err_pipe[2] = {-1, -1};
+    int err = 0;
+
+    /* Every end is close-on-exec; the child only keeps what dup2 gives it */
+    if ((input && pipe(in_pipe) == -1) || pipe(out_pipe) == -1 || pipe(err_pipe) == -1) {
+        err = errno;
+        goto fail;
+    }
+    int *ends[] = {&in_pipe[0], &in_pipe[1], &out_pipe[0], &out_pipe[1], &err_pipe[0], &err_pipe[1]};
+    for (size_t i = 0; i < sizeof(ends) / sizeof(ends[0]); i++) {
+        if (*ends[i] != -1 && fcntl(*ends[i], F_SETFD, FD_CLOEXEC) == -1) {
+            err = errno;
+            goto fail;
+        }
+    }
+
+    err = spawn_child(argv, in_pipe[0], out_pipe[1], err_pipe[1], &p->pid);
+    if (err != 0) goto fail;
+
+    /* Keep only the parent's ends */
+    if (in_pipe[0] != -1) close(in_pipe[0]);
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    p->stdin_fd = in_pipe[1];
+    p->stdout_fd = out_pipe[0];
+    p->stderr_fd = err_pipe[0];
+
+    /* The child is running now, so from here on failures just lose a stream */
+    if (p->stdin_fd != -1 &&
+        (set_nonblock_cloexec(p->stdin_fd) == -1 ||
+         event_loop_watch_fd(p->stdin_fd, POLLOUT, process_write_stdin, p) == -1)) {
+        process_close_fd(&p->stdin_fd);
+    }
+    if (set_nonblock_cloexec(p->stdout_fd) == -1 ||
+        event_loop_watch_fd(p->stdout_fd, POLLIN, process_read_pipe, p) == -1) {
+        process_close_fd(&p->stdout_fd);
+    }
+    if (set_nonblock_cloexec(p->stderr_fd) == -1 ||
+        event_loop_watch_fd(p->stderr_fd, POLLIN, process_read_pipe, p) == -1) {
+        process_close_fd(&p->stderr_fd);
+    }
+
+    p->next = processes;
+    processes = p;
+    return p->pid;
+
+fail:
+    close_pipe(in_pipe);
+    close_pipe(out_pipe);
+    close_pipe(err_pipe);
+    free(p->input);
+    free(p);
+    errno = err;
+    return -1;
+}
+
+int process_kill(pid_t pid, int sig) {
+    for (Process *p = processes; p; p = p->next) {
+        if (p->pid == pid) {
+            if (p->exited) return 0;  /* Already gone, just not reported yet */
+            return kill(pid, sig);
+        }
+    }
+    errno = ESRCH;
+    return -1;
+}
+
+pid_t process_spawn_pipe(char *const argv[], int *stdin_fd, int *stdout_fd) {
+    if (!argv || !argv[0] || !stdin_fd || !stdout_fd) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int in_pipe[2] = {-1, -1};
+    int out_pipe[2] = {-1, -1};
+    pid_t pid = -1;
+    int err = 0;
+
+    if (pipe(in_pipe) == -1 || pipe(out_pipe) == -1) {
+        err = errno;
+    } else if (fcntl(in_pipe[0], F_SETFD, FD_CLOEXEC) == -1 ||
+               fcntl(in_pipe[1], F_SETFD, FD_CLOEXEC) == -1 ||
+               fcntl(out_pipe[0], F_SETFD, FD_CLOEXEC) == -1 ||
+               fcntl(out_pipe[1], F_SETFD, FD_CLOEXEC) == -1) {
+        err = errno;
+    } else {
+        err = spawn_child(argv, in_pipe[0], out_pipe[1], -1, &pid);
+    }
+
+    if (err != 0) {
+        close_pipe(in_pipe);
+        close_pipe(out_pipe);
+        errno = err;
+        return -1;
+    }
+
+    close(in_pipe[0]);
+    close(out_pipe[1]);
+    *stdin_fd = in_pipe[1];
+    *stdout_fd = out_pipe[0];
+    return pid;
+}
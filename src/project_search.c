@@ -0,0 +1,706 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE  /* madvise(), _SC_NPROCESSORS_ONLN */
+#include "project_search.h"
+#include "gitignore.h"
+#include "regexp.h"
+#include "event_loop.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Files up to this size are read into a buffer; mapping costs more than
+ * copying them. Larger ones are mapped. */
+#define READ_MAX_LEN (256 * 1024)
+
+/* Bytes checked for a NUL to tell binary files, as git and grep do */
+#define BINARY_CHECK_LEN 8192
+
+#define MAX_THREADS 16
+
+/* Hand a worker's matches over once it has this many, even mid-file */
+#define BATCH_MATCHES 256
+
+/* ===== Work queues ===== */
+
+typedef struct {
+    char *path;                 /* Relative to the root; "" for the root itself */
+    const IgnoreList *ignore;   /* Rules for a directory's entries */
+    bool is_dir;
+} WorkItem;
+
+/* A worker's own queue: it pushes and pops at the tail, thieves take from
+ * the head - the oldest items, nearest the root, which tend to be largest */
+typedef struct {
+    pthread_mutex_t lock;
+    WorkItem *items;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} WorkQueue;
+
+/* A worker's matches not yet handed over. Strings are kept as offsets, since
+ * the string space may move while the batch grows. */
+typedef struct {
+    size_t path;
+    size_t text;
+    size_t text_len;
+    size_t line;
+    size_t col;
+    size_t len;
+} BatchMatch;
+
+typedef struct ResultBatch {
+    BatchMatch *matches;
+    size_t count;
+    size_t capacity;
+    char *strings;
+    size_t strings_len;
+    size_t strings_cap;
+    struct ResultBatch *next;
+} ResultBatch;
+
+typedef struct ProjectSearch ProjectSearch;
+
+typedef struct {
+    pthread_t thread;
+    ProjectSearch *ps;
+    WorkQueue queue;
+    Regexp *re;                 /* Own copy: a Regexp is not shared between threads */
+    ResultBatch *batch;
+    char *read_buf;             /* Small files are read here */
+    unsigned steal_seed;
+} Worker;
+
+struct ProjectSearch {
+    int id;
+    int root_fd;
+    SearchPattern *pat;         /* Literal search, shared (read-only); NULL for a regex */
+    size_t max_results;
+    ProjectSearchCallbacks callbacks;
+
+    Worker *workers;
+    int num_workers;
+    atomic_int running;         /* Workers still running */
+    atomic_size_t pending;      /* Items queued or being worked on */
+    atomic_bool stop;           /* Cancelled, or max_results reached */
+    bool cancelled;             /* Main thread only */
+
+    /* Idle workers sleep here until work is pushed or the search ends */
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    atomic_int sleepers;
+    unsigned long work_seq;
+
+    /* Batches waiting for the main thread */
+    pthread_mutex_t results_lock;
+    ResultBatch *results;
+    ResultBatch **results_tail;
+    bool results_posted;
+
+    pthread_mutex_t ignore_lock;
+    IgnoreList *ignores;        /* Every list loaded, freed with the search */
+
+    atomic_size_t files;
+    atomic_size_t binary;
+    atomic_size_t matches;
+    atomic_bool truncated;
+
+    ProjectSearch *next;
+};
+
+static ProjectSearch *searches = NULL;  /* Main thread only */
+static int next_search_id = 1;
+
+static void search_wake_all(ProjectSearch *ps) {
+    pthread_mutex_lock(&ps->idle_lock);
+    ps->work_seq++;
+    pthread_cond_broadcast(&ps->idle_cond);
+    pthread_mutex_unlock(&ps->idle_lock);
+}
+
+static void queue_push(Worker *w, char *path, const IgnoreList *ignore, bool is_dir) {
+    ProjectSearch *ps = w->ps;
+    WorkQueue *q = &w->queue;
+
+    atomic_fetch_add(&ps->pending, 1);
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->capacity) {
+        if (q->head > 0) {
+            memmove(q->items, q->items + q->head, (q->tail - q->head) * sizeof(WorkItem));
+            q->tail -= q->head;
+            q->head = 0;
+        } else {
+            size_t capacity = q->capacity ? q->capacity * 2 : 64;
+            WorkItem *items = realloc(q->items, capacity * sizeof(WorkItem));
+            if (!items) {
+                pthread_mutex_unlock(&q->lock);
+                free(path);
+                atomic_fetch_sub(&ps->pending, 1);
+                return;
+            }
+            q->items = items;
+            q->capacity = capacity;
+        }
+    }
+    q->items[q->tail++] = (WorkItem){path, ignore, is_dir};
+    pthread_mutex_unlock(&q->lock);
+
+    if (atomic_load(&ps->sleepers) > 0) search_wake_all(ps);
+}
+
+static bool queue_take(WorkQueue *q, WorkItem *out, bool steal) {
+    pthread_mutex_lock(&q->lock);
+    bool found = q->head < q->tail;
+    if (found) {
+        *out = steal ? q->items[q->head++] : q->items[--q->tail];
+        if (q->head == q->tail) q->head = q->tail = 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+/* Next item: the worker's own newest, else the oldest of another's */
+static bool worker_next(Worker *w, WorkItem *out) {
+    if (queue_take(&w->queue, out, false)) return true;
+
+    ProjectSearch *ps = w->ps;
+    int n = ps->num_workers;
+    int start = (int)(rand_r(&w->steal_seed) % (unsigned)n);
+    for (int i = 0; i < n; i++) {
+        Worker *victim = &ps->workers[(start + i) % n];
+        if (victim != w && queue_take(&victim->queue, out, true)) return true;
+    }
+    return false;
+}
+
+static bool any_queued(ProjectSearch *ps) {
+    for (int i = 0; i < ps->num_workers; i++) {
+        WorkQueue *q = &ps->workers[i].queue;
+        pthread_mutex_lock(&q->lock);
+        bool queued = q->head < q->tail;
+        pthread_mutex_unlock(&q->lock);
+        if (queued) return true;
+    }
+    return false;
+}
+
+/* ===== Results ===== */
+
+static void batch_free(ResultBatch *batch) {
+    if (!batch) return;
+    free(batch->matches);
+    free(batch->strings);
+    free(batch);
+}
+
+/* Copy s into the batch's string space; offset, or SIZE_MAX on failure */
+static size_t batch_string(ResultBatch *batch, const char *s, size_t len) {
+    if (batch->strings_len + len + 1 > batch->strings_cap) {
+        size_t capacity = batch->strings_cap ? batch->strings_cap : 4096;
+        while (capacity < batch->strings_len + len + 1) capacity *= 2;
+        char *strings = realloc(batch->strings, capacity);
+        if (!strings) return SIZE_MAX;
+        batch->strings = strings;
+        batch->strings_cap = capacity;
+    }
+    size_t offset = batch->strings_len;
+    memcpy(batch->strings + offset, s, len);
+    batch->strings[offset + len] = '\0';
+    batch->strings_len += len + 1;
+    return offset;
+}
+
+static void search_deliver(void *data);
+
+/* Hand the worker's batch to the main thread */
+static void worker_flush(Worker *w) {
+    ResultBatch *batch = w->batch;
+    if (!batch || batch->count == 0) return;
+    w->batch = NULL;
+
+    ProjectSearch *ps = w->ps;
+    pthread_mutex_lock(&ps->results_lock);
+    *ps->results_tail = batch;
+    ps->results_tail = &batch->next;
+    bool post = !ps->results_posted;
+    ps->results_posted = true;
+    pthread_mutex_unlock(&ps->results_lock);
+
+    if (post) event_loop_post(search_deliver, (void *)(intptr_t)ps->id);
+}
+
+/* Record a match; false once the search should stop */
+static bool worker_add(Worker *w, const char *path, size_t *path_offset,
+                       size_t line, size_t col, size_t len, const char *text, size_t text_len) {
+    ProjectSearch *ps = w->ps;
+    size_t total = atomic_fetch_add(&ps->matches, 1) + 1;
+    if (ps->max_results && total > ps->max_results) {
+        atomic_fetch_sub(&ps->matches, 1);
+        atomic_store(&ps->truncated, true);
+        atomic_store(&ps->stop, true);
+        search_wake_all(ps);
+        return false;
+    }
+
+    ResultBatch *batch = w->batch;
+    if (!batch) {
+        batch = w->batch = calloc(1, sizeof(ResultBatch));
+        if (!batch) return false;
+        *path_offset = SIZE_MAX;
+    }
+    if (batch->count == batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity * 2 : 32;
+        BatchMatch *matches = realloc(batch->matches, capacity * sizeof(BatchMatch));
+        if (!matches) return false;
+        batch->matches = matches;
+        batch->capacity = capacity;
+    }
+
+    /* The path is stored once per file and batch */
+    if (*path_offset == SIZE_MAX) {
+        *path_offset = batch_string(batch, path, strlen(path));
+        if (*path_offset == SIZE_MAX) return false;
+    }
+    size_t text_offset = batch_string(batch, text, text_len);
+    if (text_offset == SIZE_MAX) return false;
+
+    batch->matches[batch->count++] = (BatchMatch){*path_offset, text_offset, text_len, line, col, len};
+    if (batch->count >= BATCH_MATCHES) {
+        worker_flush(w);
+        *path_offset = SIZE_MAX;
+    }
+    return true;
+}
+
+static ProjectSearch *find_search(int id) {
+    for (ProjectSearch *ps = searches; ps; ps = ps->next) {
+        if (ps->id == id) return ps;
+    }
+    return NULL;
+}
+
+/* Main thread: every batch queued so far, in one callback */
+static void search_drain(ProjectSearch *ps) {
+    pthread_mutex_lock(&ps->results_lock);
+    ResultBatch *batches = ps->results;
+    ps->results = NULL;
+    ps->results_tail = &ps->results;
+    ps->results_posted = false;
+    pthread_mutex_unlock(&ps->results_lock);
+
+    size_t count = 0;
+    for (ResultBatch *b = batches; b; b = b->next) count += b->count;
+
+    ProjectMatch *matches = NULL;
+    if (count > 0 && !ps->cancelled && ps->callbacks.on_matches) {
+        matches = malloc(count * sizeof(ProjectMatch));
+    }
+    if (matches) {
+        size_t n = 0;
+        for (ResultBatch *b = batches; b; b = b->next) {
+            for (size_t i = 0; i < b->count; i++) {
+                const BatchMatch *m = &b->matches[i];
+                matches[n++] = (ProjectMatch){
+                    .path = b->strings + m->path,
+                    .line = m->line,
+                    .col = m->col,
+                    .len = m->len,
+                    .text = b->strings + m->text,
+                    .text_len = m->text_len,
+                };
+            }
+        }
+        ps->callbacks.on_matches(matches, n, ps->callbacks.data);
+        free(matches);
+    }
+
+    while (batches) {
+        ResultBatch *next = batches->next;
+        batch_free(batches);
+        batches = next;
+    }
+}
+
+static void search_deliver(void *data) {
+    ProjectSearch *ps = find_search((int)(intptr_t)data);
+    if (ps) search_drain(ps);
+}
+
+/* ===== Searching ===== */
+
+/* Queue a directory's entries, under its .gitignore if it has one */
+static void search_dir(Worker *w, const WorkItem *item) {
+    ProjectSearch *ps = w->ps;
+    GitignoreDir gd;
+    if (!gitignore_dir_open(&gd, ps->root_fd, item->path, item->ignore)) return;
+    if (gd.own) {
+        pthread_mutex_lock(&ps->ignore_lock);
+        gitignore_keep(&ps->ignores, gd.own);
+        pthread_mutex_unlock(&ps->ignore_lock);
+    }
+
+    char *path;
+    bool is_dir;
+    while (!atomic_load(&ps->stop) && (path = gitignore_dir_next(&gd, &is_dir))) {
+        queue_push(w, path, gd.ignore, is_dir);
+    }
+    gitignore_dir_close(&gd);
+}
+
+/* Newlines in [from, to), moving *line_start past the last one */
+static size_t count_lines(const char *data, size_t from, size_t to, size_t *line_start) {
+    size_t lines = 0;
+    const char *p = data + from, *end = data + to;
+    while ((p = memchr(p, '\n', (size_t)(end - p)))) {
+        lines++;
+        p++;
+        *line_start = (size_t)(p - data);
+    }
+    return lines;
+}
+
+static void search_literal(Worker *w, const char *path, const char *data, size_t size) {
+    ProjectSearch *ps = w->ps;
+    size_t match_len = search_pattern_length(ps->pat);
+    size_t path_offset = SIZE_MAX;
+    size_t line = 0, line_start = 0, counted = 0, pos = 0;
+    ptrdiff_t at;
+
+    /* The whole file at once: no per-line work where nothing matches */
+    while (pos < size && (at = search_find(ps->pat, data, size, pos)) >= 0) {
+        line += count_lines(data, counted, (size_t)at, &line_start);
+        counted = (size_t)at;
+
+        const char *nl = memchr(data + at, '\n', size - (size_t)at);
+        size_t line_end = nl ? (size_t)(nl - data) : size;
+        if (!worker_add(w, path, &path_offset, line, (size_t)at - line_start, match_len,
+                        data + line_start, line_end - line_start)) {
+            return;
+        }
+        pos = (size_t)at + match_len;
+    }
+}
+
+static void search_regexp(Worker *w, const char *path, const char *data, size_t size) {
+    size_t path_offset = SIZE_MAX;
+    size_t line = 0, start = 0;
+    RegexpMatch m;
+
+    /* ^ and $ are line boundaries, so the expression runs a line at a time */
+    while (start < size) {
+        const char *nl = memchr(data + start, '\n', size - start);
+        size_t len = nl ? (size_t)(nl - data) - start : size - start;
+        const char *text = data + start;
+
+        size_t pos = 0;
+        while (pos <= len && regexp_search(w->re, text, len, pos, &m)) {
+            size_t match_start = (size_t)m.start[0], match_end = (size_t)m.end[0];
+            if (match_end > match_start &&
+                !worker_add(w, path, &path_offset, line, match_start, match_end - match_start,
+                            text, len)) {
+                return;
+            }
+            /* Empty matches show nothing: step past them */
+            pos = match_end > match_start ? match_end : match_start + 1;
+        }
+
+        line++;
+        start += len + 1;
+        if (atomic_load(&w->ps->stop)) return;
+    }
+}
+
+/* Read a small file whole into the worker's buffer */
+static char *read_small(Worker *w, int fd, size_t size) {
+    if (!w->read_buf && !(w->read_buf = malloc(READ_MAX_LEN))) return NULL;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, w->read_buf + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    return done == size ? w->read_buf : NULL;
+}
+
+static void search_file(Worker *w, const WorkItem *item) {
+    ProjectSearch *ps = w->ps;
+    int fd = openat(ps->root_fd, item->path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    size_t size = (size_t)st.st_size;
+    bool mapped = size > READ_MAX_LEN;
+    char *data;
+    if (mapped) {
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) data = NULL;
+        else madvise(data, size, MADV_SEQUENTIAL);
+    } else {
+        data = read_small(w, fd, size);
+    }
+    close(fd);
+    if (!data) return;
+
+    if (memchr(data, '\0', size < BINARY_CHECK_LEN ? size : BINARY_CHECK_LEN)) {
+        atomic_fetch_add(&ps->binary, 1);
+    } else {
+        atomic_fetch_add(&ps->files, 1);
+        if (ps->pat) {
+            search_literal(w, item->path, data, size);
+        } else {
+            search_regexp(w, item->path, data, size);
+        }
+    }
+    if (mapped) munmap(data, size);
+}
+
+static void search_done(void *data);
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    ProjectSearch *ps = w->ps;
+
+    for (;;) {
+        WorkItem item;
+        if (worker_next(w, &item)) {
+            if (!atomic_load(&ps->stop)) {
+                if (item.is_dir) search_dir(w, &item);
+                else search_file(w, &item);
+            }
+            free(item.path);
+            worker_flush(w);
+            if (atomic_fetch_sub(&ps->pending, 1) == 1) search_wake_all(ps);
+            continue;
+        }
+
+        /* Nothing to take: sleep until more is pushed or the search ends */
+        pthread_mutex_lock(&ps->idle_lock);
+        atomic_fetch_add(&ps->sleepers, 1);
+        unsigned long seq = ps->work_seq;
+        while (seq == ps->work_seq && atomic_load(&ps->pending) > 0 &&
+               !atomic_load(&ps->stop) && !any_queued(ps)) {
+            pthread_cond_wait(&ps->idle_cond, &ps->idle_lock);
+        }
+        atomic_fetch_sub(&ps->sleepers, 1);
+        pthread_mutex_unlock(&ps->idle_lock);
+
+        if (atomic_load(&ps->pending) == 0 || atomic_load(&ps->stop)) break;
+    }
+
+    /* A stopped search leaves items behind; drop them */
+    WorkItem item;
+    while (queue_take(&w->queue, &item, false)) free(item.path);
+    worker_flush(w);
+
+    if (atomic_fetch_sub(&ps->running, 1) == 1) {
+        event_loop_post(search_done, (void *)(intptr_t)ps->id);
+    }
+    return NULL;
+}
+
+/* ===== Searches ===== */
+
+static void search_free(ProjectSearch *ps) {
+    for (int i = 0; i < ps->num_workers; i++) {
+        Worker *w = &ps->workers[i];
+        WorkItem item;
+        while (queue_take(&w->queue, &item, false)) free(item.path);
+        free(w->queue.items);
+        pthread_mutex_destroy(&w->queue.lock);
+        regexp_free(w->re);
+        batch_free(w->batch);
+        free(w->read_buf);
+    }
+    free(ps->workers);
+
+    while (ps->results) {
+        ResultBatch *next = ps->results->next;
+        batch_free(ps->results);
+        ps->results = next;
+    }
+    gitignore_free_all(ps->ignores);
+
+    pthread_mutex_destroy(&ps->idle_lock);
+    pthread_cond_destroy(&ps->idle_cond);
+    pthread_mutex_destroy(&ps->results_lock);
+    pthread_mutex_destroy(&ps->ignore_lock);
+    search_pattern_destroy(ps->pat);
+    if (ps->root_fd != -1) close(ps->root_fd);
+    free(ps);
+}
+
+/* Collect a search whose workers have all stopped: deliver what is left,
+ * report it done, and free it */
+static void search_finish(ProjectSearch *ps) {
+    for (ProjectSearch **link = &searches; *link; link = &(*link)->next) {
+        if (*link == ps) {
+            *link = ps->next;
+            break;
+        }
+    }
+
+    for (int i = 0; i < ps->num_workers; i++) pthread_join(ps->workers[i].thread, NULL);
+    search_drain(ps);
+
+    ProjectSearchStats stats = {
+        .files = atomic_load(&ps->files),
+        .binary = atomic_load(&ps->binary),
+        .matches = atomic_load(&ps->matches),
+        .truncated = atomic_load(&ps->truncated),
+        .cancelled = ps->cancelled,
+    };
+    if (ps->callbacks.on_done) ps->callbacks.on_done(&stats, ps->callbacks.data);
+    search_free(ps);
+}
+
+static void search_done(void *data) {
+    ProjectSearch *ps = find_search((int)(intptr_t)data);
+    if (ps) search_finish(ps);
+}
+
+static char *regex_source(const char *query, size_t len, int flags) {
+    /* Whole words: the expression between two word boundaries */
+    bool words = flags & SEARCH_WHOLE_WORD;
+    char *source = malloc(len + (words ? 10 : 1));
+    if (!source) return NULL;
+    size_t n = 0;
+    if (words) {
+        memcpy(source, "\\b(?:", 5);
+        n = 5;
+    }
+    memcpy(source + n, query, len);
+    n += len;
+    if (words) {
+        memcpy(source + n, ")\\b", 3);
+        n += 3;
+    }
+    source[n] = '\0';
+    return source;
+}
+
+int project_search_start(const char *root, const char *query, size_t len,
+                         const ProjectSearchOptions *opts,
+                         const ProjectSearchCallbacks *callbacks,
+                         char *err, size_t err_size) {
+    if (err && err_size) err[0] = '\0';
+    if (!root || !query || len == 0) {
+        if (err) snprintf(err, err_size, "empty query");
+        return -1;
+    }
+
+    ProjectSearch *ps = calloc(1, sizeof(ProjectSearch));
+    if (!ps) return -1;
+    ps->root_fd = -1;
+    pthread_mutex_init(&ps->idle_lock, NULL);
+    pthread_cond_init(&ps->idle_cond, NULL);
+    pthread_mutex_init(&ps->results_lock, NULL);
+    pthread_mutex_init(&ps->ignore_lock, NULL);
+    ps->results_tail = &ps->results;
+    if (callbacks) ps->callbacks = *callbacks;
+    ps->max_results = opts ? opts->max_results : 0;
+    int flags = opts ? opts->flags : 0;
+
+    int threads = opts && opts->threads > 0 ? opts->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    ps->workers = calloc((size_t)threads, sizeof(Worker));
+    if (!ps->workers) {
+        search_free(ps);
+        return -1;
+    }
+    for (int i = 0; i < threads; i++) {
+        Worker *w = &ps->workers[i];
+        w->ps = ps;
+        w->steal_seed = (unsigned)i * 2654435761u + 1;
+        pthread_mutex_init(&w->queue.lock, NULL);
+    }
+    ps->num_workers = threads;
+
+    /* Compile up front, so a bad query is reported here */
+    if (opts && opts->regex) {
+        char *source = regex_source(query, len, flags);
+        if (!source) {
+            search_free(ps);
+            return -1;
+        }
+        int re_flags = (flags & SEARCH_IGNORE_CASE) ? REGEXP_IGNORE_CASE : 0;
+        for (int i = 0; i < threads; i++) {
+            ps->workers[i].re = regexp_compile(source, re_flags, err, err_size);
+            if (!ps->workers[i].re) {
+                free(source);
+                search_free(ps);
+                return -1;
+            }
+        }
+        free(source);
+    } else {
+        ps->pat = search_pattern_create(query, len, flags);
+        if (!ps->pat) {
+            search_free(ps);
+            return -1;
+        }
+    }
+
+    ps->root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (ps->root_fd == -1) {
+        if (err) snprintf(err, err_size, "%s: %s", root, strerror(errno));
+        search_free(ps);
+        return -1;
+    }
+
+    char *start = strdup("");
+    if (!start) {
+        search_free(ps);
+        return -1;
+    }
+    queue_push(&ps->workers[0], start, NULL, true);
+
+    /* The id is only published once every worker runs: a failed start
+     * leaves nothing for their posted events to find */
+    int id = next_search_id++;
+    ps->id = id;
+    atomic_store(&ps->running, threads);
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&ps->workers[i].thread, NULL, worker_main, &ps->workers[i]) != 0) {
+            atomic_store(&ps->stop, true);
+            search_wake_all(ps);
+            for (int j = 0; j < i; j++) pthread_join(ps->workers[j].thread, NULL);
+            search_free(ps);
+            if (err) snprintf(err, err_size, "cannot start search threads");
+            return -1;
+        }
+    }
+
+    ps->next = searches;
+    searches = ps;
+    return id;
+}
+
+void project_search_cancel(int id) {
+    ProjectSearch *ps = find_search(id);
+    if (!ps || ps->cancelled) return;
+    ps->cancelled = true;
+    atomic_store(&ps->stop, true);
+    search_wake_all(ps);
+}
+
+void project_search_shutdown(void) {
+    while (searches) {
+        ProjectSearch *ps = searches;
+        project_search_cancel(ps->id);
+        search_finish(ps);
+    }
+}
@@ -0,0 +1,1301 @@
+#define _POSIX_C_SOURCE 200809L
+#include "regexp.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Limits on what a pattern may expand to */
+#define REGEXP_MAX_INSTS 20000      /* Compiled program size */
+#define REGEXP_MAX_REPEAT 1000      /* Largest {n,m} count */
+#define REGEXP_MAX_DEPTH 200        /* Group and quantifier nesting */
+
+/* The DFA cache is flushed when it grows past this, and a search gives up on
+ * it (and runs the NFA alone) after flushing this often */
+#define DFA_MAX_BYTES (1 << 20)
+#define DFA_MAX_FLUSHES 8
+
+#define DFA_END 256                 /* Symbol for the end of the text */
+#define DFA_SYMBOLS 257
+
+/* ---- Program ---- */
+
+typedef enum {
+    OP_BYTE,        /* Consume a byte in sets[x] */
+    OP_SPLIT,       /* Continue at x, then (lower priority) at y */
+    OP_JMP,         /* Continue at x */
+    OP_SAVE,        /* Record the position in capture slot arg */
+    OP_ASSERT,      /* Continue only if assertion arg holds here */
+    OP_MATCH
+} OpCode;
+
+typedef enum {
+    ASSERT_BOL,
+    ASSERT_EOL,
+    ASSERT_WORD,    /* \b */
+    ASSERT_NOT_WORD /* \B */
+} AssertKind;
+
+typedef struct {
+    uint8_t op;
+    uint8_t arg;
+    int x;
+    int y;
+} Inst;
+
+typedef struct {
+    uint64_t bits[4];
+} ByteSet;
+
+static inline bool set_has(const ByteSet *set, int c) {
+    return (set->bits[c >> 6] >> (c & 63)) & 1;
+}
+
+static inline void set_add(ByteSet *set, int c) {
+    set->bits[c >> 6] |= (uint64_t)1 << (c & 63);
+}
+
+static void set_add_range(ByteSet *set, int lo, int hi) {
+    for (int c = lo; c <= hi; c++) set_add(set, c);
+}
+
+static inline bool is_word_byte(int c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           c == '_' || c >= 0x80;
+}
+
+/* ---- Matching scratch ---- */
+
+/* Sparse set of program counters: insert and lookup in O(1), cleared in O(1) */
+typedef struct {
+    int *sparse;
+    int *dense;
+    int count;
+} PcSet;
+
+static inline bool pcset_has(const PcSet *s, int pc) {
+    int i = s->sparse[pc];
+    return i < s->count && s->dense[i] == pc;
+}
+
+static inline int pcset_add(PcSet *s, int pc) {
+    s->sparse[pc] = s->count;
+    s->dense[s->count] = pc;
+    return s->count++;
+}
+
+/* NFA threads at one position, in priority order, with their captures */
+typedef struct {
+    PcSet pcs;
+    ptrdiff_t *caps;        /* ncap slots per entry of pcs.dense */
+} ThreadList;
+
+/* Closure work: follow pc, or restore caps[slot] to old once done */
+typedef struct {
+    int pc;
+    int slot;
+    ptrdiff_t old;
+} Frame;
+
+/* ---- DFA ---- */
+
+#define DFA_FLAG_START 0x1  /* At the start of the text */
+#define DFA_FLAG_WORD 0x2   /* The previous byte is a word character */
+
+/* A DFA state is the set of NFA threads waiting to look at the next byte,
+ * plus what ^ and \b need to know about the byte before it */
+typedef struct {
+    uint32_t hash;
+    uint8_t flags;
+    bool idle;                  /* Only the thread starting here: no match in progress */
+    int count;
+    uint32_t next[DFA_SYMBOLS]; /* 0: not computed; else (index + 1) << 1 | matched */
+    int pcs[];                  /* Sorted */
+} DfaState;
+
+typedef struct {
+    bool anchored;
+    DfaState **states;
+    size_t num_states;
+    size_t states_capacity;
+    uint32_t *table;            /* Open addressing: state index + 1, 0 empty */
+    size_t table_size;
+    size_t bytes;
+    uint32_t start[4];          /* By flags: state index + 1, 0 not built */
+    int flushes;                /* During the current scan */
+} Dfa;
+
+struct Regexp {
+    Inst *prog;
+    int num_insts;
+    ByteSet *sets;
+    int num_sets;
+    int groups;
+    int ncap;                   /* 2 * (groups + 1) */
+    bool has_bol;
+    bool has_word;              /* Uses \b or \B */
+
+    /* Scratch, sized for the program */
+    ThreadList lists[2];
+    Frame *stack;
+    PcSet closure;
+    PcSet kernel;
+    int *kernel_pcs;
+
+    Dfa forward;                /* Unanchored: is there a match at all */
+    Dfa anchored;               /* Is there a match starting here */
+};
+
+/* ---- Parser ---- */
+
+typedef enum {
+    NODE_EMPTY,
+    NODE_SET,       /* One byte in sets[index] */
+    NODE_CAT,       /* a then b */
+    NODE_ALT,       /* a, else b */
+    NODE_REPEAT,    /* a, min to max times (-1: unbounded) */
+    NODE_GROUP,     /* a, captured as group index (0: not captured) */
+    NODE_ASSERT     /* Assertion index */
+} NodeType;
+
+typedef struct Node {
+    NodeType type;
+    struct Node *a;
+    struct Node *b;
+    int min;
+    int max;
+    bool greedy;
+    int index;
+    struct Node *allocated;     /* Every node, for freeing */
+} Node;
+
+typedef struct {
+    const char *p;
+    int flags;
+    Node *nodes;
+    ByteSet *sets;
+    int num_sets;
+    int sets_capacity;
+    int groups;
+    int depth;
+    bool has_bol;
+    bool has_word;
+    const char *error;
+} Parser;
+
+static Node *new_node(Parser *ps, NodeType type, Node *a, Node *b) {
+    if (ps->error) return NULL;
+
+    Node *node = calloc(1, sizeof(Node));
+    if (!node) {
+        ps->error = "out of memory";
+        return NULL;
+    }
+    node->type = type;
+    node->a = a;
+    node->b = b;
+    node->allocated = ps->nodes;
+    ps->nodes = node;
+    return node;
+}
+
+/* A new, empty byte set; returns its index or -1 */
+static int new_set(Parser *ps) {
+    if (ps->error) return -1;
+
+    if (ps->num_sets >= ps->sets_capacity) {
+        int capacity = ps->sets_capacity ? ps->sets_capacity * 2 : 16;
+        ByteSet *sets = realloc(ps->sets, sizeof(ByteSet) * capacity);
+        if (!sets) {
+            ps->error = "out of memory";
+            return -1;
+        }
+        ps->sets = sets;
+        ps->sets_capacity = capacity;
+    }
+    memset(&ps->sets[ps->num_sets], 0, sizeof(ByteSet));
+    return ps->num_sets++;
+}
+
+static Node *set_node(Parser *ps, int lo, int hi) {
+    int set = new_set(ps);
+    if (set < 0) return NULL;
+    set_add_range(&ps->sets[set], lo, hi);
+
+    Node *node = new_node(ps, NODE_SET, NULL, NULL);
+    if (node) node->index = set;
+    return node;
+}
+
+static Node *cat(Parser *ps, Node *a, Node *b) {
+    if (!a) return b;
+    if (!b) return a;
+    return new_node(ps, NODE_CAT, a, b);
+}
+
+static Node *alt(Parser *ps, Node *a, Node *b) {
+    if (!a) return b;
+    if (!b) return a;
+    return new_node(ps, NODE_ALT, a, b);
+}
+
+/* Any character of two or more bytes, or a byte that cannot start one (so
+ * malformed text is still matched a byte at a time) */
+static Node *multibyte_node(Parser *ps) {
+    Node *two = cat(ps, set_node(ps, 0xC0, 0xDF), set_node(ps, 0x80, 0xBF));
+    Node *three = cat(ps, set_node(ps, 0xE0, 0xEF),
+                      cat(ps, set_node(ps, 0x80, 0xBF), set_node(ps, 0x80, 0xBF)));
+    Node *four = cat(ps, set_node(ps, 0xF0, 0xF7),
+                     cat(ps, set_node(ps, 0x80, 0xBF),
+                         cat(ps, set_node(ps, 0x80, 0xBF), set_node(ps, 0x80, 0xBF))));
+
+    Node *stray = set_node(ps, 0x80, 0xBF);
+    if (stray) set_add_range(&ps->sets[stray->index], 0xF8, 0xFF);
+
+    return alt(ps, two, alt(ps, three, alt(ps, four, stray)));
+}
+
+/* Length of the UTF-8 sequence starting with c, 1 for anything invalid */
+static int utf8_len(unsigned char c) {
+    return c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : c < 0xF8 ? 4 : 1;
+}
+
+/* Take one (possibly multibyte) character; returns its byte count */
+static int take_char(Parser *ps, const char **start) {
+    *start = ps->p;
+    int n = utf8_len((unsigned char)*ps->p);
+    for (int i = 1; i < n; i++) {
+        if (((unsigned char)ps->p[i] & 0xC0) != 0x80) {
+            n = 1;
+            break;
+        }
+    }
+    ps->p += n;
+    return n;
+}
+
+static Node *literal_node(Parser *ps, const char *s, int n) {
+    Node *node = NULL;
+    for (int i = 0; i < n; i++) {
+        int c = (unsigned char)s[i];
+        Node *byte = set_node(ps, c, c);
+        if (byte && n == 1 && (ps->flags & REGEXP_IGNORE_CASE)) {
+            if (c >= 'a' && c <= 'z') set_add(&ps->sets[byte->index], c - 'a' + 'A');
+            if (c >= 'A' && c <= 'Z') set_add(&ps->sets[byte->index], c - 'A' + 'a');
+        }
+        node = cat(ps, node, byte);
+    }
+    return node;
+}
+
+/* A character class being parsed: ASCII members as bits, non-ASCII ones as
+ * any_multibyte (\W, \D, \S and negation) or a list of characters */
+typedef struct {
+    ByteSet ascii;
+    bool any_multibyte;
+    Node *chars;
+} ClassSpec;
+
+/* \d \w \s and their negations; false if c is none of them */
+static bool class_escape(ClassSpec *spec, char c) {
+    ByteSet set = {{0}};
+    bool word_like = false;
+    switch (c) {
+    case 'd': case 'D':
+        set_add_range(&set, '0', '9');
+        break;
+    case 'w': case 'W':
+        set_add_range(&set, '0', '9');
+        set_add_range(&set, 'a', 'z');
+        set_add_range(&set, 'A', 'Z');
+        set_add(&set, '_');
+        word_like = true;
+        break;
+    case 's': case 'S':
+        set_add(&set, ' ');
+        set_add_range(&set, '\t', '\r');
+        break;
+    default:
+        return false;
+    }
+
+    bool negated = c >= 'A' && c <= 'Z';
+    for (int b = 0; b < 128; b++) {
+        if (set_has(&set, b) != negated) set_add(&spec->ascii, b);
+    }
+    /* Non-ASCII characters are word characters, and neither digits nor spaces */
+    if (word_like != negated) spec->any_multibyte = true;
+    return true;
+}
+
+/* Byte value of an escape standing for one character, or -1 */
+static int char_escape(Parser *ps) {
+    char c = *ps->p;
+    switch (c) {
+    case 'n': ps->p++; return '\n';
+    case 't': ps->p++; return '\t';
+    case 'r': ps->p++; return '\r';
+    case 'f': ps->p++; return '\f';
+    case 'v': ps->p++; return '\v';
+    case 'x': {
+        int value = 0;
+        for (int i = 1; i <= 2; i++) {
+            char h = ps->p[i];
+            int digit = (h >= '0' && h <= '9') ? h - '0' :
+                        (h >= 'a' && h <= 'f') ? h - 'a' + 10 :
+                        (h >= 'A' && h <= 'F') ? h - 'A' + 10 : -1;
+            if (digit < 0) {
+                ps->error = "\\x needs two hex digits";
+                return -1;
+            }
+            value = value * 16 + digit;
+        }
+        ps->p += 3;
+        if (value >= 0x80) {
+            ps->error = "\\x escapes above \\x7f are not supported";
+            return -1;
+        }
+        return value;
+    }
+    default:
+        if (c >= '1' && c <= '9') {
+            ps->error = "backreferences are not supported";
+            return -1;
+        }
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+            ps->error = "unknown escape";
+            return -1;
+        }
+        if (c == '\0') {
+            ps->error = "trailing backslash";
+            return -1;
+        }
+        ps->p++;
+        return (unsigned char)c;
+    }
+}
+
+static Node *parse_class(Parser *ps) {
+    ClassSpec spec = {{{0}}, false, NULL};
+    bool negated = false;
+    if (*ps->p == '^') {
+        negated = true;
+        ps->p++;
+    }
+
+    bool first = true;
+    while (*ps->p && (*ps->p != ']' || first)) {
+        first = false;
+
+        int lo;
+        if (*ps->p == '\\') {
+            ps->p++;
+            if (class_escape(&spec, *ps->p)) {
+                ps->p++;
+                continue;
+            }
+            lo = char_escape(ps);
+            if (lo < 0) return NULL;
+        } else if ((unsigned char)*ps->p >= 0x80) {
+            const char *s;
+            int n = take_char(ps, &s);
+            if (*ps->p == '-' && ps->p[1] != ']' && ps->p[1]) {
+                ps->error = "ranges of non-ASCII characters are not supported";
+                return NULL;
+            }
+            spec.chars = alt(ps, spec.chars, literal_node(ps, s, n));
+            continue;
+        } else {
+            lo = (unsigned char)*ps->p++;
+        }
+
+        int hi = lo;
+        if (*ps->p == '-' && ps->p[1] != ']' && ps->p[1]) {
+            ps->p++;
+            if (*ps->p == '\\') {
+                ps->p++;
+                hi = char_escape(ps);
+                if (hi < 0) return NULL;
+            } else if ((unsigned char)*ps->p >= 0x80) {
+                ps->error = "ranges of non-ASCII characters are not supported";
+                return NULL;
+            } else {
+                hi = (unsigned char)*ps->p++;
+            }
+            if (hi < lo) {
+                ps->error = "invalid range in class";
+                return NULL;
+            }
+        }
+        set_add_range(&spec.ascii, lo, hi);
+    }
+
+    if (*ps->p != ']') {
+        ps->error = "missing ]";
+        return NULL;
+    }
+    ps->p++;
+
+    if (ps->flags & REGEXP_IGNORE_CASE) {
+        for (int c = 'a'; c <= 'z'; c++) {
+            if (set_has(&spec.ascii, c) || set_has(&spec.ascii, c - 'a' + 'A')) {
+                set_add(&spec.ascii, c);
+                set_add(&spec.ascii, c - 'a' + 'A');
+            }
+        }
+    }
+
+    if (negated) {
+        if (spec.chars) {
+            ps->error = "negated classes of non-ASCII characters are not supported";
+            return NULL;
+        }
+        for (int i = 0; i < 2; i++) spec.ascii.bits[i] = ~spec.ascii.bits[i];
+        spec.any_multibyte = !spec.any_multibyte;
+    }
+
+    int set = new_set(ps);
+    if (set < 0) return NULL;
+    ps->sets[set] = spec.ascii;
+    Node *node = new_node(ps, NODE_SET, NULL, NULL);
+    if (node) node->index = set;
+
+    if (spec.any_multibyte) return alt(ps, node, multibyte_node(ps));
+    return alt(ps, node, spec.chars);
+}
+
+static Node *parse_alt(Parser *ps);
+
+static Node *assert_node(Parser *ps, AssertKind kind) {
+    Node *node = new_node(ps, NODE_ASSERT, NULL, NULL);
+    if (node) node->index = kind;
+    return node;
+}
+
+static Node *parse_atom(Parser *ps) {
+    char c = *ps->p;
+    switch (c) {
+    case '(': {
+        ps->p++;
+        int index = 0;
+        if (ps->p[0] == '?' && ps->p[1] == ':') {
+            ps->p += 2;
+        } else if (ps->p[0] == '?') {
+            ps->error = "unsupported group syntax";
+            return NULL;
+        } else {
+            if (ps->groups >= REGEXP_MAX_GROUPS) {
+                ps->error = "too many capture groups";
+                return NULL;
+            }
+            index = ++ps->groups;
+        }
+
+        if (++ps->depth > REGEXP_MAX_DEPTH) {
+            ps->error = "pattern nested too deeply";
+            return NULL;
+        }
+        Node *inner = parse_alt(ps);
+        ps->depth--;
+        if (ps->error) return NULL;
+        if (*ps->p != ')') {
+            ps->error = "missing )";
+            return NULL;
+        }
+        ps->p++;
+
+        Node *node = new_node(ps, NODE_GROUP, inner, NULL);
+        if (node) node->index = index;
+        return node;
+    }
+    case '[':
+        ps->p++;
+        return parse_class(ps);
+    case '.': {
+        ps->p++;
+        return alt(ps, set_node(ps, 0x00, 0x7F), multibyte_node(ps));
+    }
+    case '^':
+        ps->p++;
+        ps->has_bol = true;
+        return assert_node(ps, ASSERT_BOL);
+    case '$':
+        ps->p++;
+        return assert_node(ps, ASSERT_EOL);
+    case '\\': {
+        ps->p++;
+        char e = *ps->p;
+        if (e == 'b' || e == 'B') {
+            ps->p++;
+            ps->has_word = true;
+            return assert_node(ps, e == 'b' ? ASSERT_WORD : ASSERT_NOT_WORD);
+        }
+
+        ClassSpec spec = {{{0}}, false, NULL};
+        if (class_escape(&spec, e)) {
+            ps->p++;
+            int set = new_set(ps);
+            if (set < 0) return NULL;
+            ps->sets[set] = spec.ascii;
+            Node *node = new_node(ps, NODE_SET, NULL, NULL);
+            if (node) node->index = set;
+            return spec.any_multibyte ? alt(ps, node, multibyte_node(ps)) : node;
+        }
+
+        int value = char_escape(ps);
+        if (value < 0) return NULL;
+        char ch = (char)value;
+        return literal_node(ps, &ch, 1);
+    }
+    case '*': case '+': case '?':
+        ps->error = "nothing to repeat";
+        return NULL;
+    default: {
+        const char *s;
+        int n = take_char(ps, &s);
+        return literal_node(ps, s, n);
+    }
+    }
+}
+
+/* Parse a count for {n,m}; -1 if there is none */
+static int parse_count(const char **p) {
+    if (**p < '0' || **p > '9') return -1;
+    long value = 0;
+    while (**p >= '0' && **p <= '9') {
+        if (value <= REGEXP_MAX_REPEAT) value = value * 10 + (**p - '0');
+        (*p)++;
+    }
+    return value > REGEXP_MAX_REPEAT ? REGEXP_MAX_REPEAT + 1 : (int)value;
+}
+
+/* {n}, {n,} or {n,m} at ps->p; false (and nothing consumed) if it is not one */
+static bool parse_braces(Parser *ps, int *min, int *max) {
+    const char *p = ps->p + 1;
+    *min = parse_count(&p);
+    if (*min < 0) return false;
+
+    *max = *min;
+    if (*p == ',') {
+        p++;
+        if (*p == '}') {
+            *max = -1;
+        } else if ((*max = parse_count(&p)) < 0) {
+            return false;
+        }
+    }
+    if (*p != '}') return false;
+
+    if (*min > REGEXP_MAX_REPEAT || *max > REGEXP_MAX_REPEAT) {
+        ps->error = "repeat count too large";
+    } else if (*max >= 0 && *max < *min) {
+        ps->error = "invalid repeat range";
+    }
+    ps->p = p + 1;
+    return true;
+}
+
+static Node *parse_repeat(Parser *ps) {
+    Node *atom = parse_atom(ps);
+    if (ps->error) return NULL;
+
+    for (;;) {
+        int min, max;
+        char c = *ps->p;
+        if (c == '*') {
+            min = 0, max = -1;
+            ps->p++;
+        } else if (c == '+') {
+            min = 1, max = -1;
+            ps->p++;
+        } else if (c == '?') {
+            min = 0, max = 1;
+            ps->p++;
+        } else if (c == '{' && parse_braces(ps, &min, &max)) {
+            if (ps->error) return NULL;
+        } else {
+            return atom;
+        }
+
+        bool greedy = true;
+        if (*ps->p == '?') {
+            greedy = false;
+            ps->p++;
+        }
+
+        if (atom && atom->type == NODE_ASSERT) {
+            ps->error = "nothing to repeat";
+            return NULL;
+        }
+        Node *node = new_node(ps, NODE_REPEAT, atom, NULL);
+        if (!node) return NULL;
+        node->min = min;
+        node->max = max;
+        node->greedy = greedy;
+        atom = node;
+    }
+}
+
+static Node *parse_cat(Parser *ps) {
+    Node *node = NULL;
+    while (*ps->p && *ps->p != '|' && *ps->p != ')') {
+        Node *next = parse_repeat(ps);
+        if (ps->error) return NULL;
+        node = cat(ps, node, next);
+    }
+    return node ? node : new_node(ps, NODE_EMPTY, NULL, NULL);
+}
+
+static Node *parse_alt(Parser *ps) {
+    Node *node = parse_cat(ps);
+    while (!ps->error && *ps->p == '|') {
+        ps->p++;
+        Node *next = parse_cat(ps);
+        node = new_node(ps, NODE_ALT, node, next);
+    }
+    return node;
+}
+
+/* ---- Compiler ---- */
+
+typedef struct {
+    Inst *prog;
+    int count;
+    int capacity;
+    const char *error;
+} Compiler;
+
+static int emit(Compiler *cc, OpCode op, int arg, int x, int y) {
+    if (cc->error) return -1;
+    if (cc->count >= REGEXP_MAX_INSTS) {
+        cc->error = "pattern too large";
+        return -1;
+    }
+    if (cc->count >= cc->capacity) {
+        int capacity = cc->capacity ? cc->capacity * 2 : 64;
+        Inst *prog = realloc(cc->prog, sizeof(Inst) * capacity);
+        if (!prog) {
+            cc->error = "out of memory";
+            return -1;
+        }
+        cc->prog = prog;
+        cc->capacity = capacity;
+    }
+
+    Inst *in = &cc->prog[cc->count];
+    in->op = op;
+    in->arg = arg;
+    in->x = x;
+    in->y = y;
+    return cc->count++;
+}
+
+/* Whether node can match without consuming a byte */
+static bool nullable(const Node *node) {
+    if (!node) return true;
+
+    switch (node->type) {
+    case NODE_SET:
+        return false;
+    case NODE_CAT:
+        return nullable(node->a) && nullable(node->b);
+    case NODE_ALT:
+        return nullable(node->a) || nullable(node->b);
+    case NODE_REPEAT:
+        return node->min == 0 || nullable(node->a);
+    case NODE_GROUP:
+        return nullable(node->a);
+    default:
+        return true;
+    }
+}
+
+static void compile_node(Compiler *cc, const Node *node) {
+    if (!node || cc->error) return;
+
+    switch (node->type) {
+    case NODE_EMPTY:
+        break;
+    case NODE_SET:
+        emit(cc, OP_BYTE, 0, node->index, 0);
+        break;
+    case NODE_CAT:
+        compile_node(cc, node->a);
+        compile_node(cc, node->b);
+        break;
+    case NODE_ALT: {
+        int split = emit(cc, OP_SPLIT, 0, 0, 0);
+        if (split < 0) return;
+        cc->prog[split].x = cc->count;
+        compile_node(cc, node->a);
+        int jmp = emit(cc, OP_JMP, 0, 0, 0);
+        if (jmp < 0) return;
+        cc->prog[split].y = cc->count;
+        compile_node(cc, node->b);
+        cc->prog[jmp].x = cc->count;
+        break;
+    }
+    case NODE_GROUP:
+        if (node->index > 0) emit(cc, OP_SAVE, node->index * 2, 0, 0);
+        compile_node(cc, node->a);
+        if (node->index > 0) emit(cc, OP_SAVE, node->index * 2 + 1, 0, 0);
+        break;
+    case NODE_ASSERT:
+        emit(cc, OP_ASSERT, node->index, 0, 0);
+        break;
+    case NODE_REPEAT: {
+        if (node->max < 0 && (node->min > 0 || nullable(node->a))) {
+            /* As in RE2, x{n,} is x{n-1}x+, and x* whose body can match
+             * empty is (x+)?: an empty pass through the body then reaches
+             * the loop's split again and dies, instead of outranking the
+             * exit. [skip: split body, out;] body: x; split body, out */
+            for (int i = 0; i < node->min - 1; i++) compile_node(cc, node->a);
+            int skip = node->min == 0 ? emit(cc, OP_SPLIT, 0, 0, 0) : -1;
+            int body = cc->count;
+            compile_node(cc, node->a);
+            int split = emit(cc, OP_SPLIT, 0, 0, 0);
+            if (cc->error) return;
+            int out = cc->count;
+            cc->prog[split].x = node->greedy ? body : out;
+            cc->prog[split].y = node->greedy ? out : body;
+            if (skip >= 0) cc->prog[skip] = cc->prog[split];
+            break;
+        }
+
+        for (int i = 0; i < node->min; i++) compile_node(cc, node->a);
+
+        if (node->max < 0) {
+            /* loop: split body, out; body; jmp loop */
+            int split = emit(cc, OP_SPLIT, 0, 0, 0);
+            if (split < 0) return;
+            compile_node(cc, node->a);
+            emit(cc, OP_JMP, 0, split, 0);
+            if (cc->error) return;
+            int body = split + 1, out = cc->count;
+            cc->prog[split].x = node->greedy ? body : out;
+            cc->prog[split].y = node->greedy ? out : body;
+            break;
+        }
+
+        /* Optional copies, each able to skip straight to the end */
+        int optional = node->max - node->min;
+        if (optional == 0) break;
+        int *splits = malloc(sizeof(int) * optional);
+        if (!splits) {
+            cc->error = "out of memory";
+            return;
+        }
+        for (int i = 0; i < optional && !cc->error; i++) {
+            splits[i] = emit(cc, OP_SPLIT, 0, 0, 0);
+            compile_node(cc, node->a);
+        }
+        if (!cc->error) {
+            int out = cc->count;
+            for (int i = 0; i < optional; i++) {
+                Inst *in = &cc->prog[splits[i]];
+                in->x = node->greedy ? splits[i] + 1 : out;
+                in->y = node->greedy ? out : splits[i] + 1;
+            }
+        }
+        free(splits);
+        break;
+    }
+    }
+}
+
+/* ---- Construction ---- */
+
+static void free_nodes(Node *node) {
+    while (node) {
+        Node *next = node->allocated;
+        free(node);
+        node = next;
+    }
+}
+
+static void set_error(char *err, size_t err_size, const char *msg, const char *pattern, const char *at) {
+    if (err && err_size > 0) {
+        snprintf(err, err_size, "%s at offset %d", msg, (int)(at - pattern));
+    }
+}
+
+static int alloc_scratch(Regexp *re) {
+    int n = re->num_insts;
+    re->lists[0].pcs.sparse = calloc(n, sizeof(int));
+    re->lists[0].pcs.dense = calloc(n, sizeof(int));
+    re->lists[0].caps = malloc(sizeof(ptrdiff_t) * n * re->ncap);
+    re->lists[1].pcs.sparse = calloc(n, sizeof(int));
+    re->lists[1].pcs.dense = calloc(n, sizeof(int));
+    re->lists[1].caps = malloc(sizeof(ptrdiff_t) * n * re->ncap);
+    re->stack = malloc(sizeof(Frame) * (2 * n + 1));
+    re->closure.sparse = calloc(n, sizeof(int));
+    re->closure.dense = calloc(n, sizeof(int));
+    re->kernel.sparse = calloc(n, sizeof(int));
+    re->kernel.dense = calloc(n, sizeof(int));
+    re->kernel_pcs = malloc(sizeof(int) * n);
+
+    if (!re->lists[0].pcs.sparse || !re->lists[0].pcs.dense || !re->lists[0].caps ||
+        !re->lists[1].pcs.sparse || !re->lists[1].pcs.dense || !re->lists[1].caps ||
+        !re->stack || !re->closure.sparse || !re->closure.dense ||
+        !re->kernel.sparse || !re->kernel.dense || !re->kernel_pcs) {
+        return -1;
+    }
+    return 0;
+}
+
+Regexp *regexp_compile(const char *pattern, int flags, char *err, size_t err_size) {
+    if (err && err_size > 0) err[0] = '\0';
+    if (!pattern) return NULL;
+
+    Parser ps = {0};
+    ps.p = pattern;
+    ps.flags = flags;
+
+    Node *root = parse_alt(&ps);
+    if (!ps.error && *ps.p == ')') ps.error = "unmatched )";
+    if (ps.error) {
+        set_error(err, err_size, ps.error, pattern, ps.p);
+        free_nodes(ps.nodes);
+        free(ps.sets);
+        return NULL;
+    }
+
+    /* save 0; pattern; save 1; match */
+    Compiler cc = {0};
+    emit(&cc, OP_SAVE, 0, 0, 0);
+    compile_node(&cc, root);
+    emit(&cc, OP_SAVE, 1, 0, 0);
+    emit(&cc, OP_MATCH, 0, 0, 0);
+    free_nodes(ps.nodes);
+
+    Regexp *re = cc.error ? NULL : calloc(1, sizeof(Regexp));
+    if (!re) {
+        set_error(err, err_size, cc.error ? cc.error : "out of memory", pattern, ps.p);
+        free(cc.prog);
+        free(ps.sets);
+        return NULL;
+    }
+
+    re->prog = cc.prog;
+    re->num_insts = cc.count;
+    re->sets = ps.sets;
+    re->num_sets = ps.num_sets;
+    re->groups = ps.groups;
+    re->ncap = 2 * (ps.groups + 1);
+    re->has_bol = ps.has_bol;
+    re->has_word = ps.has_word;
+    re->forward.anchored = false;
+    re->anchored.anchored = true;
+
+    if (alloc_scratch(re) != 0) {
+        set_error(err, err_size, "out of memory", pattern, ps.p);
+        regexp_free(re);
+        return NULL;
+    }
+    return re;
+}
+
+static void dfa_clear(Dfa *dfa) {
+    for (size_t i = 0; i < dfa->num_states; i++) free(dfa->states[i]);
+    dfa->num_states = 0;
+    if (dfa->table) memset(dfa->table, 0, sizeof(uint32_t) * dfa->table_size);
+    dfa->bytes = sizeof(uint32_t) * dfa->table_size;
+    memset(dfa->start, 0, sizeof(dfa->start));
+}
+
+static void dfa_free(Dfa *dfa) {
+    dfa_clear(dfa);
+    free(dfa->states);
+    free(dfa->table);
+}
+
+void regexp_free(Regexp *re) {
+    if (!re) return;
+
+    dfa_free(&re->forward);
+    dfa_free(&re->anchored);
+    for (int i = 0; i < 2; i++) {
+        free(re->lists[i].pcs.sparse);
+        free(re->lists[i].pcs.dense);
+        free(re->lists[i].caps);
+    }
+    free(re->stack);
+    free(re->closure.sparse);
+    free(re->closure.dense);
+    free(re->kernel.sparse);
+    free(re->kernel.dense);
+    free(re->kernel_pcs);
+    free(re->prog);
+    free(re->sets);
+    free(re);
+}
+
+int regexp_groups(const Regexp *re) {
+    return re ? re->groups : 0;
+}
+
+/* ---- Assertions ---- */
+
+/* What assertions can see at a position: the bytes on either side */
+typedef struct {
+    bool at_start;
+    bool prev_word;
+    int next;           /* Byte, or DFA_END */
+} Context;
+
+static bool assert_holds(int kind, const Context *ctx) {
+    bool next_word = ctx->next != DFA_END && is_word_byte(ctx->next);
+    switch (kind) {
+    case ASSERT_BOL: return ctx->at_start;
+    case ASSERT_EOL: return ctx->next == DFA_END;
+    case ASSERT_WORD: return ctx->prev_word != next_word;
+    case ASSERT_NOT_WORD: return ctx->prev_word == next_word;
+    }
+    return false;
+}
+
+static Context context_at(const unsigned char *t, size_t len, size_t pos) {
+    Context ctx;
+    ctx.at_start = pos == 0;
+    ctx.prev_word = pos > 0 && is_word_byte(t[pos - 1]);
+    ctx.next = pos < len ? t[pos] : DFA_END;
+    return ctx;
+}
+
+/* ---- NFA (Pike VM) ---- */
+
+/* Add pc and everything reachable from it without consuming a byte, in
+ * priority order. caps holds the thread's captures; it is restored before
+ * returning. */
+static void add_thread(Regexp *re, ThreadList *list, int pc, ptrdiff_t *caps,
+                       const Context *ctx, ptrdiff_t pos) {
+    Frame *stack = re->stack;
+    int top = 0;
+    stack[top++] = (Frame){pc, -1, 0};
+
+    while (top > 0) {
+        Frame f = stack[--top];
+        if (f.slot >= 0) {
+            caps[f.slot] = f.old;
+            continue;
+        }
+
+        pc = f.pc;
+        while (!pcset_has(&list->pcs, pc)) {
+            int entry = pcset_add(&list->pcs, pc);
+            const Inst *in = &re->prog[pc];
+            if (in->op == OP_JMP) {
+                pc = in->x;
+            } else if (in->op == OP_SPLIT) {
+                stack[top++] = (Frame){in->y, -1, 0};
+                pc = in->x;
+            } else if (in->op == OP_SAVE) {
+                stack[top++] = (Frame){0, in->arg, caps[in->arg]};
+                caps[in->arg] = pos;
+                pc++;
+            } else if (in->op == OP_ASSERT) {
+                if (!assert_holds(in->arg, ctx)) break;
+                pc++;
+            } else {
+                /* OP_BYTE or OP_MATCH: a thread waiting on the next byte */
+                memcpy(&list->caps[(size_t)entry * re->ncap], caps, sizeof(ptrdiff_t) * re->ncap);
+                break;
+            }
+        }
+    }
+}
+
+static bool pike_run(Regexp *re, const unsigned char *t, size_t len, size_t from,
+                     bool anchored, RegexpMatch *m) {
+    int ncap = re->ncap;
+    ThreadList *clist = &re->lists[0], *nlist = &re->lists[1];
+    ptrdiff_t start_caps[2 * (REGEXP_MAX_GROUPS + 1)];
+    ptrdiff_t found[2 * (REGEXP_MAX_GROUPS + 1)];
+    bool matched = false;
+
+    clist->pcs.count = 0;
+    for (size_t pos = from; ; pos++) {
+        Context ctx = context_at(t, len, pos);
+        if (!matched && (!anchored || pos == from)) {
+            for (int i = 0; i < ncap; i++) start_caps[i] = -1;
+            add_thread(re, clist, 0, start_caps, &ctx, (ptrdiff_t)pos);
+        }
+        if (clist->pcs.count == 0) break;
+
+        Context next_ctx = pos < len ? context_at(t, len, pos + 1) : ctx;
+        nlist->pcs.count = 0;
+        for (int i = 0; i < clist->pcs.count; i++) {
+            const Inst *in = &re->prog[clist->pcs.dense[i]];
+            ptrdiff_t *caps = &clist->caps[(size_t)i * ncap];
+            if (in->op == OP_MATCH) {
+                /* Threads after this one have lower priority: drop them */
+                memcpy(found, caps, sizeof(ptrdiff_t) * ncap);
+                matched = true;
+                break;
+            }
+            if (in->op == OP_BYTE && pos < len && set_has(&re->sets[in->x], t[pos])) {
+                add_thread(re, nlist, clist->pcs.dense[i] + 1, caps, &next_ctx, (ptrdiff_t)pos + 1);
+            }
+        }
+
+        ThreadList *swap = clist;
+        clist = nlist;
+        nlist = swap;
+        if (pos >= len) break;
+    }
+
+    if (matched && m) {
+        for (int g = 0; g <= REGEXP_MAX_GROUPS; g++) {
+            bool set = g <= re->groups && found[2 * g] >= 0 && found[2 * g + 1] >= 0;
+            m->start[g] = set ? found[2 * g] : -1;
+            m->end[g] = set ? found[2 * g + 1] : -1;
+        }
+    }
+    return matched;
+}
+
+/* ---- Lazy DFA ---- */
+
+static uint32_t state_hash(uint8_t flags, const int *pcs, int count) {
+    uint32_t h = 2166136261u ^ flags;
+    for (int i = 0; i < count; i++) {
+        h ^= (uint32_t)pcs[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Index + 1 of the state for (flags, pcs); 0 when the cache is out of room */
+static uint32_t dfa_intern(Dfa *dfa, uint8_t flags, const int *pcs, int count) {
+    uint32_t hash = state_hash(flags, pcs, count);
+
+    if (dfa->table_size > 0) {
+        size_t mask = dfa->table_size - 1;
+        for (size_t i = hash & mask; dfa->table[i]; i = (i + 1) & mask) {
+            DfaState *s = dfa->states[dfa->table[i] - 1];
+            if (s->hash == hash && s->flags == flags && s->count == count &&
+                memcmp(s->pcs, pcs, sizeof(int) * count) == 0) {
+                return dfa->table[i];
+            }
+        }
+    }
+
+    size_t size = sizeof(DfaState) + sizeof(int) * count;
+    if (dfa->bytes + size > DFA_MAX_BYTES) return 0;
+
+    /* Keep the table at most half full */
+    if ((dfa->num_states + 1) * 2 > dfa->table_size) {
+        size_t table_size = dfa->table_size ? dfa->table_size * 2 : 64;
+        uint32_t *table = calloc(table_size, sizeof(uint32_t));
+        if (!table) return 0;
+        for (size_t i = 0; i < dfa->num_states; i++) {
+            size_t j = dfa->states[i]->hash & (table_size - 1);
+            while (table[j]) j = (j + 1) & (table_size - 1);
+            table[j] = (uint32_t)i + 1;
+        }
+        dfa->bytes += sizeof(uint32_t) * (table_size - dfa->table_size);
+        free(dfa->table);
+        dfa->table = table;
+        dfa->table_size = table_size;
+    }
+    if (dfa->num_states >= dfa->states_capacity) {
+        size_t capacity = dfa->states_capacity ? dfa->states_capacity * 2 : 16;
+        DfaState **states = realloc(dfa->states, sizeof(DfaState *) * capacity);
+        if (!states) return 0;
+        dfa->states = states;
+        dfa->states_capacity = capacity;
+    }
+
+    DfaState *s = calloc(1, size);
+    if (!s) return 0;
+    s->hash = hash;
+    s->flags = flags;
+    s->count = count;
+    s->idle = count == 1 && pcs[0] == 0;  /* pc 0 is only ever a fresh start */
+    memcpy(s->pcs, pcs, sizeof(int) * count);
+
+    dfa->states[dfa->num_states] = s;
+    size_t mask = dfa->table_size - 1;
+    size_t i = hash & mask;
+    while (dfa->table[i]) i = (i + 1) & mask;
+    dfa->table[i] = (uint32_t)++dfa->num_states;
+    dfa->bytes += size;
+    return dfa->table[i];
+}
+
+/* Intern, flushing the cache once if it is full. Returns 0 when the scan
+ * should give up on the DFA. */
+static uint32_t dfa_add_state(Dfa *dfa, uint8_t flags, const int *pcs, int count) {
+    uint32_t id = dfa_intern(dfa, flags, pcs, count);
+    if (id) return id;
+
+    if (++dfa->flushes > DFA_MAX_FLUSHES) return 0;
+    dfa_clear(dfa);
+    return dfa_intern(dfa, flags, pcs, count);
+}
+
+static uint8_t dfa_flags(const Regexp *re, bool at_start, bool prev_word) {
+    return (re->has_bol && at_start ? DFA_FLAG_START : 0) |
+           (re->has_word && prev_word ? DFA_FLAG_WORD : 0);
+}
+
+/* Follow state *sp on symbol c. Returns the encoded transition, or 0 to give
+ * up; *sp is NULL afterwards if the cache was flushed. */
+static uint32_t dfa_step(Regexp *re, Dfa *dfa, DfaState **sp, int c) {
+    DfaState *s = *sp;
+    Context ctx = {s->flags & DFA_FLAG_START, s->flags & DFA_FLAG_WORD, c};
+
+    /* Closure of the state's threads, seeing c ahead */
+    re->closure.count = 0;
+    re->kernel.count = 0;
+    bool matched = false;
+    int *stack = (int *)re->stack;
+    int top = 0;
+    for (int i = s->count - 1; i >= 0; i--) stack[top++] = s->pcs[i];
+
+    while (top > 0) {
+        int pc = stack[--top];
+        while (!pcset_has(&re->closure, pc)) {
+            pcset_add(&re->closure, pc);
+            const Inst *in = &re->prog[pc];
+            if (in->op == OP_JMP) {
+                pc = in->x;
+            } else if (in->op == OP_SPLIT) {
+                stack[top++] = in->y;
+                pc = in->x;
+            } else if (in->op == OP_SAVE) {
+                pc++;
+            } else if (in->op == OP_ASSERT) {
+                if (!assert_holds(in->arg, &ctx)) break;
+                pc++;
+            } else {
+                if (in->op == OP_MATCH) {
+                    matched = true;
+                } else if (c != DFA_END && set_has(&re->sets[in->x], c) &&
+                           !pcset_has(&re->kernel, pc + 1)) {
+                    pcset_add(&re->kernel, pc + 1);
+                }
+                break;
+            }
+        }
+    }
+
+    /* Unanchored: a new match attempt starts at every position */
+    if (!dfa->anchored && c != DFA_END && !pcset_has(&re->kernel, 0)) pcset_add(&re->kernel, 0);
+
+    int count = re->kernel.count;
+    memcpy(re->kernel_pcs, re->kernel.dense, sizeof(int) * count);
+    qsort(re->kernel_pcs, count, sizeof(int), compare_ints);
+
+    bool word = c != DFA_END && is_word_byte(c);
+    int flushes = dfa->flushes;
+    uint32_t id = dfa_add_state(dfa, dfa_flags(re, false, word), re->kernel_pcs, count);
+    if (!id) return 0;
+
+    uint32_t next = id << 1 | (matched ? 1 : 0);
+    if (dfa->flushes != flushes) {
+        *sp = NULL;  /* Flushed: s is gone */
+    } else {
+        s->next[c] = next;
+    }
+    return next;
+}
+
+/* 1 if a match exists (starting at from, if anchored), 0 if not, -1 if the
+ * DFA gave up and the NFA must decide. On 1, *start is where the leftmost
+ * match can start at the earliest: the last point no match was in progress. */
+static int dfa_scan(Regexp *re, Dfa *dfa, const unsigned char *t, size_t len, size_t from,
+                    size_t *start) {
+    dfa->flushes = 0;
+    *start = from;
+
+    uint8_t flags = dfa_flags(re, from == 0, from > 0 && is_word_byte(t[from - 1]));
+    if (!dfa->start[flags]) {
+        int start = 0;
+        dfa->start[flags] = dfa_add_state(dfa, flags, &start, 1);
+        if (!dfa->start[flags]) return -1;
+    }
+    DfaState *s = dfa->states[dfa->start[flags] - 1];
+
+    for (size_t i = from; ; i++) {
+        if (s->idle) *start = i;
+        int c = i < len ? t[i] : DFA_END;
+        uint32_t next = s->next[c];
+        if (!next) {
+            next = dfa_step(re, dfa, &s, c);
+            if (!next) return -1;
+        }
+        if (next & 1) return 1;
+        if (c == DFA_END) return 0;
+
+        s = dfa->states[(next >> 1) - 1];
+        if (s->count == 0) return 0;  /* Dead: no thread left */
+    }
+}
+
+/* ---- Public matching ---- */
+
+bool regexp_search(Regexp *re, const char *text, size_t len, size_t from, RegexpMatch *m) {
+    if (!re || !text || from > len) return false;
+
+    const unsigned char *t = (const unsigned char *)text;
+    size_t start;
+    int found = dfa_scan(re, &re->forward, t, len, from, &start);
+    if (found == 0) return false;
+    if (found == 1 && !m) return true;
+    return pike_run(re, t, len, found == 1 ? start : from, false, m);
+}
+
+bool regexp_match_at(Regexp *re, const char *text, size_t len, size_t pos, RegexpMatch *m) {
+    if (!re || !text || pos > len) return false;
+
+    const unsigned char *t = (const unsigned char *)text;
+    size_t start;
+    int found = dfa_scan(re, &re->anchored, t, len, pos, &start);
+    if (found == 0) return false;
+    if (found == 1 && !m) return true;
+    return pike_run(re, t, len, pos, true, m);
+}
+
+char *regexp_expand(const char *tmpl, const char *text, const RegexpMatch *m, size_t *out_len) {
+    /* Two passes: measure, then copy */
+    char *out = NULL;
+    size_t len = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        len = 0;
+        for (const char *p = tmpl; *p; p++) {
+            if (*p != '\\' || !p[1]) {
+                if (out) out[len] = *p;
+                len++;
+                continue;
+            }
+
+            p++;
+            if (*p >= '0' && *p <= '9') {
+                int g = *p - '0';
+                if (m->start[g] >= 0) {
+                    size_t n = (size_t)(m->end[g] - m->start[g]);
+                    if (out) memcpy(out + len, text + m->start[g], n);
+                    len += n;
+                }
+            } else {
+                if (out) out[len] = *p == 'n' ? '\n' : *p == 't' ? '\t' : *p;
+                len++;
+            }
+        }
+
+        if (!out) {
+            out = malloc(len + 1);
+            if (!out) return NULL;
+        }
+    }
+
+    out[len] = '\0';
+    if (out_len) *out_len = len;
+    return out;
+}
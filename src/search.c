@@ -1,119 +1,519 @@
 #define _POSIX_C_SOURCE 200809L
 #include "search.h"
+#include "undo.h"
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-SearchResult *buffer_search(Buffer *buf, const char *query, int start_row, int start_col, bool forward) {
-    if (!buf || !query || !query[0]) return NULL;
+/* Needles at least this long are searched with Horspool skips alone: the
+ * skips are long enough to step over whole cache lines, so less memory is
+ * read. Shorter ones go through the SIMD filter, which keeps up with memory
+ * bandwidth but reads every byte. */
+#define SEARCH_SKIP_MIN_LEN 512
+
+struct SearchPattern {
+    unsigned char *needle;  /* Lowercased with SEARCH_IGNORE_CASE */
+    size_t len;
+    int flags;
+    size_t skip[256];       /* Forward shift, keyed by the window's last byte */
+    size_t rskip[256];      /* Backward shift, keyed by the window's first byte */
+};
+
+static inline unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+/* The other case of an ASCII letter, else c itself */
+static inline unsigned char other_case(unsigned char c) {
+    if (c >= 'a' && c <= 'z') return (unsigned char)(c - ('a' - 'A'));
+    if (c >= 'A' && c <= 'Z') return (unsigned char)(c + ('a' - 'A'));
+    return c;
+}
+
+static inline bool is_word_byte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           c == '_' || c >= 0x80;
+}
 
-    size_t query_len = strlen(query);
-    int row = start_row;
-    int col = start_col;
+SearchPattern *search_pattern_create(const char *needle, size_t len, int flags) {
+    if (!needle || len == 0) return NULL;
+
+    SearchPattern *pat = malloc(sizeof(SearchPattern));
+    if (!pat) return NULL;
+    pat->needle = malloc(len);
+    if (!pat->needle) {
+        free(pat);
+        return NULL;
+    }
+
+    pat->len = len;
+    pat->flags = flags;
+    bool ignore_case = flags & SEARCH_IGNORE_CASE;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)needle[i];
+        pat->needle[i] = ignore_case ? fold(c) : c;
+    }
+
+    /* Horspool tables; with ignore_case both cases of a letter shift alike */
+    for (int c = 0; c < 256; c++) {
+        pat->skip[c] = len;
+        pat->rskip[c] = len;
+    }
+    for (size_t i = 0; i + 1 < len; i++) {
+        unsigned char c = pat->needle[i];
+        pat->skip[c] = len - 1 - i;
+        if (ignore_case) pat->skip[other_case(c)] = len - 1 - i;
+    }
+    for (size_t i = len - 1; i > 0; i--) {
+        unsigned char c = pat->needle[i];
+        pat->rskip[c] = i;
+        if (ignore_case) pat->rskip[other_case(c)] = i;
+    }
+    return pat;
+}
+
+void search_pattern_destroy(SearchPattern *pat) {
+    if (!pat) return;
+    free(pat->needle);
+    free(pat);
+}
+
+size_t search_pattern_length(const SearchPattern *pat) {
+    return pat ? pat->len : 0;
+}
+
+static inline bool matches_at(const SearchPattern *pat, const unsigned char *t) {
+    if (!(pat->flags & SEARCH_IGNORE_CASE)) return memcmp(t, pat->needle, pat->len) == 0;
+
+    for (size_t i = 0; i < pat->len; i++) {
+        if (fold(t[i]) != pat->needle[i]) return false;
+    }
+    return true;
+}
+
+/* Horspool: first match starting in [from, len - m] */
+static ptrdiff_t skip_find(const SearchPattern *pat, const unsigned char *t, size_t len, size_t from) {
+    size_t m = pat->len;
+    if (len < m) return -1;
+
+    bool ignore_case = pat->flags & SEARCH_IGNORE_CASE;
+    unsigned char last = pat->needle[m - 1];
+    for (size_t p = from; p <= len - m; ) {
+        unsigned char c = t[p + m - 1];
+        if ((ignore_case ? fold(c) : c) == last && matches_at(pat, t + p)) return (ptrdiff_t)p;
+        p += pat->skip[c];
+    }
+    return -1;
+}
+
+/* Horspool run backwards: last match starting in [0, hi) */
+static ptrdiff_t skip_rfind(const SearchPattern *pat, const unsigned char *t, size_t len, size_t hi) {
+    size_t m = pat->len;
+    if (len < m) return -1;
+    if (hi > len - m + 1) hi = len - m + 1;
+    if (hi == 0) return -1;
+
+    bool ignore_case = pat->flags & SEARCH_IGNORE_CASE;
+    unsigned char first = pat->needle[0];
+    for (size_t p = hi - 1; ; ) {
+        unsigned char c = t[p];
+        if ((ignore_case ? fold(c) : c) == first && matches_at(pat, t + p)) return (ptrdiff_t)p;
+        size_t shift = pat->rskip[c];
+        if (p < shift) break;
+        p -= shift;
+    }
+    return -1;
+}
+
+#if defined(__SSE2__)
+/* 16 positions at a time: a position is only verified when both its first
+ * and its last byte match the needle's */
+typedef struct {
+    __m128i first, first_alt;
+    __m128i last, last_alt;
+} ByteFilter;
+
+static ByteFilter filter_create(const SearchPattern *pat) {
+    unsigned char first = pat->needle[0], last = pat->needle[pat->len - 1];
+    bool ignore_case = pat->flags & SEARCH_IGNORE_CASE;
+    ByteFilter f;
+    f.first = _mm_set1_epi8((char)first);
+    f.first_alt = _mm_set1_epi8((char)(ignore_case ? other_case(first) : first));
+    f.last = _mm_set1_epi8((char)last);
+    f.last_alt = _mm_set1_epi8((char)(ignore_case ? other_case(last) : last));
+    return f;
+}
+
+/* Bit i set: position p + i passes the filter. Reads t[p, p + m + 15). */
+static inline unsigned int filter_block(const ByteFilter *f, const unsigned char *t, size_t p, size_t m) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(t + p));
+    __m128i b = _mm_loadu_si128((const __m128i *)(t + p + m - 1));
+    __m128i first = _mm_or_si128(_mm_cmpeq_epi8(a, f->first), _mm_cmpeq_epi8(a, f->first_alt));
+    __m128i last = _mm_or_si128(_mm_cmpeq_epi8(b, f->last), _mm_cmpeq_epi8(b, f->last_alt));
+    return (unsigned int)_mm_movemask_epi8(_mm_and_si128(first, last));
+}
+
+static ptrdiff_t filter_find(const SearchPattern *pat, const unsigned char *t, size_t len, size_t from) {
+    size_t m = pat->len;
+    ByteFilter f = filter_create(pat);
+
+    size_t p = from;
+    for (; p + m + 15 <= len; p += 16) {
+        unsigned int mask = filter_block(&f, t, p, m);
+        while (mask) {
+            size_t i = (size_t)__builtin_ctz(mask);
+            if (matches_at(pat, t + p + i)) return (ptrdiff_t)(p + i);
+            mask &= mask - 1;
+        }
+    }
+    return skip_find(pat, t, len, p);
+}
+
+static ptrdiff_t filter_rfind(const SearchPattern *pat, const unsigned char *t, size_t len, size_t hi) {
+    size_t m = pat->len;
+    if (len < m) return -1;
+    if (hi > len - m + 1) hi = len - m + 1;
+    ByteFilter f = filter_create(pat);
+
+    for (; hi >= 16; hi -= 16) {
+        size_t p = hi - 16;
+        unsigned int mask = filter_block(&f, t, p, m);
+        while (mask) {
+            size_t i = 31 - (size_t)__builtin_clz(mask);
+            if (matches_at(pat, t + p + i)) return (ptrdiff_t)(p + i);
+            mask &= ~(1u << i);
+        }
+    }
+    return skip_rfind(pat, t, len, hi);
+}
+#endif
+
+/* Leftmost candidate ignoring word boundaries */
+static ptrdiff_t find_any(const SearchPattern *pat, const unsigned char *t, size_t len, size_t from) {
+    if (from > len || len - from < pat->len) return -1;
+
+    if (pat->len == 1 && !(pat->flags & SEARCH_IGNORE_CASE)) {
+        const unsigned char *hit = memchr(t + from, pat->needle[0], len - from);
+        return hit ? hit - t : -1;
+    }
+#if defined(__SSE2__)
+    if (pat->len < SEARCH_SKIP_MIN_LEN) return filter_find(pat, t, len, from);
+#endif
+    return skip_find(pat, t, len, from);
+}
+
+static ptrdiff_t rfind_any(const SearchPattern *pat, const unsigned char *t, size_t len, size_t before) {
+#if defined(__SSE2__)
+    if (pat->len < SEARCH_SKIP_MIN_LEN) return filter_rfind(pat, t, len, before);
+#endif
+    return skip_rfind(pat, t, len, before);
+}
+
+static bool is_whole_word(const SearchPattern *pat, const unsigned char *t, size_t len, size_t p) {
+    if (p > 0 && is_word_byte(t[p - 1])) return false;
+    if (p + pat->len < len && is_word_byte(t[p + pat->len])) return false;
+    return true;
+}
+
+ptrdiff_t search_find(const SearchPattern *pat, const char *text, size_t len, size_t from) {
+    if (!pat || !text) return -1;
+
+    const unsigned char *t = (const unsigned char *)text;
+    for (;;) {
+        ptrdiff_t p = find_any(pat, t, len, from);
+        if (p < 0 || !(pat->flags & SEARCH_WHOLE_WORD) || is_whole_word(pat, t, len, (size_t)p)) {
+            return p;
+        }
+        from = (size_t)p + 1;
+    }
+}
+
+ptrdiff_t search_rfind(const SearchPattern *pat, const char *text, size_t len, size_t before) {
+    if (!pat || !text) return -1;
+
+    const unsigned char *t = (const unsigned char *)text;
+    for (;;) {
+        ptrdiff_t p = rfind_any(pat, t, len, before);
+        if (p < 0 || !(pat->flags & SEARCH_WHOLE_WORD) || is_whole_word(pat, t, len, (size_t)p)) {
+            return p;
+        }
+        before = (size_t)p;
+    }
+}
+
+static SearchResult *search_result(int row, ptrdiff_t col, size_t len) {
+    SearchResult *result = malloc(sizeof(SearchResult));
+    if (!result) return NULL;
+
+    result->row = row;
+    result->col = (int)col;
+    result->match_len = len;
+    return result;
+}
+
+SearchResult *buffer_search_pattern(Buffer *buf, const SearchPattern *pat,
+                                    int start_row, int start_col, bool forward) {
+    if (!buf || !pat || start_row < 0 || start_row >= (int)buf->num_rows) return NULL;
+    if (start_col < 0) start_col = 0;
 
     if (forward) {
-        /* Search forward - skip current position to find next match */
-        /* Start searching from col+1 on first row to be consistent with backward search */
-        int search_start = (row == start_row && col < (int)buf->rows[row].size) ? col + 1 : col;
+        /* Skip the current position to find the next match */
+        BufferRow *first = buffer_row(buf, start_row);
+        size_t from = (size_t)start_col < first->size ? (size_t)start_col + 1 : first->size;
+
+        for (int row = start_row; row < (int)buf->num_rows; row++) {
+            BufferRow *r = buffer_row(buf, row);
+            ptrdiff_t col = search_find(pat, r->data, r->size, from);
+            if (col >= 0) return search_result(row, col, pat->len);
+
+            from = 0; /* Start from beginning of next lines */
+        }
+    } else {
+        /* Matches on the first row must start left of the cursor */
+        size_t before = (size_t)start_col;
+
+        for (int row = start_row; row >= 0; row--) {
+            BufferRow *r = buffer_row(buf, row);
+            ptrdiff_t col = search_rfind(pat, r->data, r->size, row == start_row ? before : r->size);
+            if (col >= 0) return search_result(row, col, pat->len);
+        }
+    }
+
+    return NULL; /* Not found */
+}
 
-        for (; row < (int)buf->num_rows; row++) {
-            if (row >= (int)buf->num_rows) break;
+SearchResult *buffer_search(Buffer *buf, const char *query, int start_row, int start_col, bool forward) {
+    if (!buf || !query || !query[0]) return NULL;
+
+    SearchPattern *pat = search_pattern_create(query, strlen(query), 0);
+    if (!pat) return NULL;
+
+    SearchResult *result = buffer_search_pattern(buf, pat, start_row, start_col, forward);
+    search_pattern_destroy(pat);
+    return result;
+}
 
-            BufferRow *r = &buf->rows[row];
-            const char *found = strstr(r->data + search_start, query);
+SearchResult *buffer_search_regexp(Buffer *buf, Regexp *re, int start_row, int start_col, bool forward) {
+    if (!buf || !re || start_row < 0 || start_row >= (int)buf->num_rows) return NULL;
+    if (start_col < 0) start_col = 0;
 
-            if (found) {
-                SearchResult *result = malloc(sizeof(SearchResult));
-                if (!result) return NULL;
+    RegexpMatch m;
+    if (forward) {
+        /* Skip the current position to find the next match */
+        BufferRow *first = buffer_row(buf, start_row);
+        size_t from = (size_t)start_col < first->size ? (size_t)start_col + 1 : first->size;
 
-                result->row = row;
-                result->col = found - r->data;
-                result->match_len = query_len;
-                return result;
+        for (int row = start_row; row < (int)buf->num_rows; row++) {
+            BufferRow *r = buffer_row(buf, row);
+            if (regexp_search(re, r->data, r->size, from, &m)) {
+                return search_result(row, m.start[0], (size_t)(m.end[0] - m.start[0]));
             }
 
-            search_start = 0; /* Start from beginning of next lines */
+            from = 0; /* Start from beginning of next lines */
         }
     } else {
-        /* Search backward */
-        for (; row >= 0; row--) {
-            if (row < 0 || row >= (int)buf->num_rows) break;
-
-            BufferRow *r = &buf->rows[row];
-
-            /* Search backwards in the current line */
-            int search_col = (row == start_row) ? col : (int)r->size;
-
-            for (int c = search_col - 1; c >= 0; c--) {
-                if (c + query_len <= r->size) {
-                    if (strncmp(r->data + c, query, query_len) == 0) {
-                        SearchResult *result = malloc(sizeof(SearchResult));
-                        if (!result) return NULL;
-
-                        result->row = row;
-                        result->col = c;
-                        result->match_len = query_len;
-                        return result;
-                    }
-                }
+        /* Step through the row's matches to the last one left of the cursor */
+        for (int row = start_row; row >= 0; row--) {
+            BufferRow *r = buffer_row(buf, row);
+            size_t limit = row == start_row ? (size_t)start_col : r->size + 1;
+            ptrdiff_t col = -1;
+            size_t match_len = 0;
+
+            size_t pos = 0;
+            while (pos <= r->size && regexp_search(re, r->data, r->size, pos, &m) &&
+                   (size_t)m.start[0] < limit) {
+                col = m.start[0];
+                match_len = (size_t)(m.end[0] - m.start[0]);
+                pos = (size_t)m.start[0] + 1;
             }
+            if (col >= 0) return search_result(row, col, match_len);
         }
     }
 
     return NULL; /* Not found */
 }
 
-int buffer_replace(Buffer *buf, const char *search, const char *replace, bool all) {
-    if (!buf || !search || !replace) return 0;
+/* Bytes in the UTF-8 character at s, so an empty match never splits one */
+static size_t char_len(const char *s, size_t avail) {
+    size_t n = 1;
+    while (n < avail && ((unsigned char)s[n] & 0xC0) == 0x80) n++;
+    return n;
+}
 
-    int count = 0;
-    int row = 0;
-    int col = 0;
+/* Growable text the replaced rows are written into */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+} ReplaceOut;
 
-    size_t search_len = strlen(search);
-    size_t replace_len = strlen(replace);
+static bool out_append(ReplaceOut *out, const char *s, size_t n) {
+    if (n == 0) return true;
+    if (out->len + n > out->capacity) {
+        size_t capacity = out->capacity ? out->capacity : 256;
+        while (capacity < out->len + n) capacity *= 2;
+        char *data = realloc(out->data, capacity);
+        if (!data) return false;
+        out->data = data;
+        out->capacity = capacity;
+    }
+    memcpy(out->data + out->len, s, n);
+    out->len += n;
+    return true;
+}
 
-    do {
-        SearchResult *result = buffer_search(buf, search, row, col, true);
-        if (!result) break;
+/* Write a row with its matches replaced to out. Returns the number replaced
+ * (out is left alone if none), or -1 on allocation failure. */
+typedef int (*RowReplacer)(void *ctx, const char *data, size_t size, bool all, ReplaceOut *out);
 
-        /* Found a match at result->row, result->col */
-        BufferRow *r = &buf->rows[result->row];
+typedef struct {
+    const SearchPattern *pat;
+    const char *text;
+    size_t len;
+} LiteralReplace;
 
-        /* Calculate new size */
-        size_t new_size = r->size - search_len + replace_len;
+static int replace_row_literal(void *ctx, const char *data, size_t size, bool all,
+                               ReplaceOut *out) {
+    const LiteralReplace *lr = ctx;
+    size_t match_len = search_pattern_length(lr->pat);
+    size_t copied = 0;
+    int count = 0;
+    ptrdiff_t at;
 
-        /* Ensure capacity */
-        while (new_size >= r->capacity) {
-            r->capacity *= 2;
-            char *new_data = realloc(r->data, r->capacity);
-            if (!new_data) {
-                free(result);
-                return count;
-            }
-            r->data = new_data;
+    while ((at = search_find(lr->pat, data, size, copied)) >= 0) {
+        if (!out_append(out, data + copied, (size_t)at - copied) ||
+            !out_append(out, lr->text, lr->len)) {
+            return -1;
         }
+        copied = (size_t)at + match_len;
+        count++;
+        if (!all) break;
+    }
+    if (count > 0 && !out_append(out, data + copied, size - copied)) return -1;
+    return count;
+}
+
+typedef struct {
+    Regexp *re;
+    const char *tmpl;
+} RegexpReplace;
 
-        /* Make room for replacement */
-        memmove(r->data + result->col + replace_len,
-                r->data + result->col + search_len,
-                r->size - result->col - search_len);
+static int replace_row_regexp(void *ctx, const char *data, size_t size, bool all,
+                              ReplaceOut *out) {
+    const RegexpReplace *rr = ctx;
+    size_t copied = 0, pos = 0;
+    int count = 0;
+    RegexpMatch m;
 
-        /* Insert replacement */
-        memcpy(r->data + result->col, replace, replace_len);
-        r->size = new_size;
-        r->data[r->size] = '\0';
+    while (pos <= size && regexp_search(rr->re, data, size, pos, &m)) {
+        size_t expanded_len;
+        char *expanded = regexp_expand(rr->tmpl, data, &m, &expanded_len);
+        if (!expanded) return -1;
 
+        /* Text up to the match, then the replacement */
+        size_t start = (size_t)m.start[0], end = (size_t)m.end[0];
+        bool ok = out_append(out, data + copied, start - copied) &&
+                  out_append(out, expanded, expanded_len);
+        free(expanded);
+        if (!ok) return -1;
+        copied = end;
         count++;
-        row = result->row;
-        col = result->col + replace_len;
+        if (!all) break;
+
+        /* After an empty match, step over a character before trying again */
+        pos = end;
+        if (start == end) {
+            if (end >= size) break;
+            pos += char_len(data + end, size - end);
+        }
+    }
+    if (count > 0 && !out_append(out, data + copied, size - copied)) return -1;
+    return count;
+}
+
+/* Replace matches in a single pass over the rows. Everything from the first
+ * changed row to the last is rebuilt into one text and set as one edit, so
+ * highlighting is invalidated once and one undo step takes it all back. */
+static int replace_rows(Buffer *buf, RowReplacer replace_row, void *ctx, bool all) {
+    ReplaceOut old_text = {0}, new_text = {0}, row_text = {0};
+    size_t first = 0, last = 0;
+    int count = 0;
 
-        free(result);
-    } while (all);
+    for (size_t y = 0; y < buf->num_rows; y++) {
+        const BufferRow *row = buffer_row(buf, y);
+        row_text.len = 0;
+        int replaced = replace_row(ctx, row->data, row->size, all, &row_text);
+        if (replaced < 0) goto fail;
+        if (replaced == 0) continue;
+
+        if (count == 0) {
+            first = y;
+        } else {
+            /* Rows between two changes are part of the edit, unchanged */
+            for (size_t gap = last + 1; gap < y; gap++) {
+                const BufferRow *g = buffer_row(buf, gap);
+                if (!out_append(&old_text, "\n", 1) || !out_append(&old_text, g->data, g->size) ||
+                    !out_append(&new_text, "\n", 1) || !out_append(&new_text, g->data, g->size)) {
+                    goto fail;
+                }
+            }
+            if (!out_append(&old_text, "\n", 1) || !out_append(&new_text, "\n", 1)) goto fail;
+        }
+        if (!out_append(&old_text, row->data, row->size) ||
+            !out_append(&new_text, row_text.data, row_text.len)) {
+            goto fail;
+        }
+        last = y;
+        count += replaced;
+        if (!all) break;
+    }
 
     if (count > 0) {
-        buf->modified = true;
+        if (buffer_set_text(buf, first, last + 1, new_text.data, new_text.len) != 0) goto fail;
+        if (buf->undo_stack) {
+            undo_push_replace_lines(buf->undo_stack, (int)first, old_text.data, old_text.len,
+                                    new_text.data, new_text.len);
+        }
     }
 
+    free(old_text.data);
+    free(new_text.data);
+    free(row_text.data);
+    return count;
+
+fail:
+    free(old_text.data);
+    free(new_text.data);
+    free(row_text.data);
+    return 0;
+}
+
+int buffer_replace_pattern(Buffer *buf, const SearchPattern *pat,
+                           const char *replace, size_t len, bool all) {
+    if (!buf || !pat || !replace) return 0;
+
+    LiteralReplace lr = {pat, replace, len};
+    return replace_rows(buf, replace_row_literal, &lr, all);
+}
+
+int buffer_replace(Buffer *buf, const char *search, const char *replace, bool all) {
+    if (!buf || !search || !search[0] || !replace) return 0;
+
+    SearchPattern *pat = search_pattern_create(search, strlen(search), 0);
+    if (!pat) return 0;
+
+    int count = buffer_replace_pattern(buf, pat, replace, strlen(replace), all);
+    search_pattern_destroy(pat);
     return count;
 }
+
+int buffer_replace_regexp(Buffer *buf, Regexp *re, const char *tmpl, bool all) {
+    if (!buf || !re || !tmpl) return 0;
+
+    RegexpReplace rr = {re, tmpl};
+    return replace_rows(buf, replace_row_regexp, &rr, all);
+}
@@ -1,8 +1,11 @@
 #define _POSIX_C_SOURCE 200809L
 #include "syntax.h"
+#include "syntax_bundle.h"
+#include "regexp.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdio.h>
 
 Syntax *syntax_list = NULL;
 
@@ -10,8 +13,25 @@ void syntax_init(void) {
     /* Initialize built-in syntaxes */
 }
 
+static SyntaxLoader syntax_loader = NULL;
+static void *syntax_loader_data = NULL;
+
+static Syntax *syntax_find_by_name(const char *name) {
+    for (Syntax *syn = syntax_list; syn; syn = syn->next) {
+        if (strcmp(syn->name, name) == 0) return syn;
+    }
+    return NULL;
+}
+
 Syntax *syntax_register(const char *name) {
-    Syntax *syn = malloc(sizeof(Syntax));
+    Syntax *syn = syntax_find_by_name(name);
+    if (syn) {
+        /* The declared syntax's plugin is running (or it was loaded eagerly) */
+        syn->loaded = true;
+        return syn;
+    }
+
+    syn = malloc(sizeof(Syntax));
     if (!syn) return NULL;
 
     syn->name = strdup(name);
@@ -20,18 +40,44 @@ Syntax *syntax_register(const char *name) {
     syn->rules = NULL;
     syn->num_rules = 0;
     syn->rules_capacity = 0;
+    syn->num_patterns = 0;
     syn->singleline_comment = NULL;
     syn->multiline_start = NULL;
     syn->multiline_end = NULL;
+    syn->source = NULL;
+    syn->loaded = true;
+    syn->bundle = NULL;
     syn->next = syntax_list;
     syntax_list = syn;
 
     return syn;
 }
 
+Syntax *syntax_declare(const char *name, const char *source) {
+    Syntax *syn = syntax_find_by_name(name);
+    if (syn) return syn;  /* Already registered - nothing left to load */
+
+    syn = syntax_register(name);
+    if (!syn) return NULL;
+
+    syn->source = strdup(source);
+    syn->loaded = syn->source == NULL;
+    return syn;
+}
+
+void syntax_set_loader(SyntaxLoader loader, void *data) {
+    syntax_loader = loader;
+    syntax_loader_data = data;
+}
+
 void syntax_add_extension(Syntax *syn, const char *ext) {
     if (!syn) return;
 
+    /* A declared syntax's plugin repeats the extensions from the manifest */
+    for (size_t i = 0; i < syn->num_extensions; i++) {
+        if (strcmp(syn->extensions[i], ext) == 0) return;
+    }
+
     char **new_extensions = realloc(syn->extensions, sizeof(char *) * (syn->num_extensions + 1));
     if (!new_extensions) return;  /* Allocation failed, keep old data */
 
@@ -40,35 +86,69 @@ void syntax_add_extension(Syntax *syn, const char *ext) {
     syn->num_extensions++;
 }
 
-void syntax_add_rule(Syntax *syn, PatternType type, const char *pattern, HighlightType hl_type) {
-    if (!syn) return;
-
+static SyntaxRule *append_rule(Syntax *syn, PatternType type, const char *pattern, HighlightType hl_type) {
     if (syn->num_rules >= syn->rules_capacity) {
         size_t new_capacity = syn->rules_capacity == 0 ? 32 : syn->rules_capacity * 2;
         SyntaxRule *new_rules = realloc(syn->rules, sizeof(SyntaxRule) * new_capacity);
-        if (!new_rules) return;  /* Allocation failed, keep old data */
+        if (!new_rules) return NULL;  /* Allocation failed, keep old data */
         syn->rules = new_rules;
         syn->rules_capacity = new_capacity;
     }
 
+    char *copy = strdup(pattern);
+    if (!copy) return NULL;
+
     SyntaxRule *rule = &syn->rules[syn->num_rules];
     rule->type = type;
-    rule->pattern = strdup(pattern);
+    rule->pattern = copy;
     rule->hl_type = hl_type;
     rule->priority = 0;
+    rule->regex = NULL;
     syn->num_rules++;
+    return rule;
+}
+
+void syntax_add_rule(Syntax *syn, PatternType type, const char *pattern, HighlightType hl_type) {
+    if (!syn || !pattern) return;
+
+    if (type == PATTERN_MATCH) {
+        syntax_add_pattern(syn, pattern, hl_type, NULL, 0);
+    } else {
+        append_rule(syn, type, pattern, hl_type);
+    }
 }
 
 void syntax_add_keyword(Syntax *syn, const char *keyword, HighlightType hl_type) {
     syntax_add_rule(syn, PATTERN_KEYWORD, keyword, hl_type);
 }
 
+int syntax_add_pattern(Syntax *syn, const char *pattern, HighlightType hl_type,
+                       char *err, size_t err_size) {
+    if (!syn || !pattern) return -1;
+
+    Regexp *re = regexp_compile(pattern, 0, err, err_size);
+    if (!re) return -1;
+
+    SyntaxRule *rule = append_rule(syn, PATTERN_MATCH, pattern, hl_type);
+    if (!rule) {
+        regexp_free(re);
+        if (err && err_size > 0) snprintf(err, err_size, "out of memory");
+        return -1;
+    }
+    rule->regex = re;
+    syn->num_patterns++;
+    return 0;
+}
+
 void syntax_set_comments(Syntax *syn, const char *single, const char *multi_start, const char *multi_end) {
     if (!syn) return;
 
-    if (single) syn->singleline_comment = strdup(single);
-    if (multi_start) syn->multiline_start = strdup(multi_start);
-    if (multi_end) syn->multiline_end = strdup(multi_end);
+    /* Empty markers mean "none" - an empty one would match everywhere */
+    if (single && *single) syn->singleline_comment = strdup(single);
+    if (multi_start && *multi_start && multi_end && *multi_end) {
+        syn->multiline_start = strdup(multi_start);
+        syn->multiline_end = strdup(multi_end);
+    }
 }
 
 Syntax *syntax_find_by_filename(const char *filename) {
@@ -82,6 +162,11 @@ Syntax *syntax_find_by_filename(const char *filename) {
     for (Syntax *syn = syntax_list; syn; syn = syn->next) {
         for (size_t i = 0; i < syn->num_extensions; i++) {
             if (strcmp(dot, syn->extensions[i]) == 0) {
+                if (!syn->loaded) {
+                    /* First file of this language: load its rules now, once */
+                    syn->loaded = true;
+                    if (syntax_loader) syntax_loader(syn, syntax_loader_data);
+                }
                 return syn;
             }
         }
@@ -169,6 +254,26 @@ HighlightedLine *syntax_highlight_line(Syntax *syn, const char *line, bool prev_
             }
         }
 
+        /* Regular expression rules, in the order they were added */
+        if (syn->num_patterns > 0) {
+            int end = -1;
+            HighlightType type = HL_NORMAL;
+            RegexpMatch m;
+            for (size_t r = 0; r < syn->num_rules && end < 0; r++) {
+                const SyntaxRule *rule = &syn->rules[r];
+                if (rule->type != PATTERN_MATCH || !rule->regex) continue;
+                if (regexp_match_at(rule->regex, line, len, i, &m) && m.end[0] > i) {
+                    end = (int)m.end[0];
+                    type = rule->hl_type;
+                }
+            }
+            if (end >= 0) {
+                add_segment(hl, i, end, type);
+                i = end;
+                continue;
+            }
+        }
+
         /* Check for string literals */
         if (line[i] == '"' || line[i] == '\'') {
             char quote = line[i];
@@ -206,6 +311,16 @@ HighlightedLine *syntax_highlight_line(Syntax *syn, const char *line, bool prev_
 
             /* Extract word */
             int word_len = i - start;
+
+            /* Precompiled keywords: one hash probe, no copy */
+            if (syn->bundle) {
+                int hl_type = syntax_bundle_lookup(syn, &line[start], word_len);
+                if (hl_type >= 0) {
+                    add_segment(hl, start, i, (HighlightType)hl_type);
+                    continue;
+                }
+            }
+
             char word[256];
             if (word_len < 255) {  /* Leave room for null terminator */
                 strncpy(word, &line[start], word_len);
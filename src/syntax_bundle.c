@@ -0,0 +1,347 @@
+#define _POSIX_C_SOURCE 200809L
+#include "syntax_bundle.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* The mapped bundle - kept for the life of the process */
+static const char *bundle_map = NULL;
+static size_t bundle_size = 0;
+
+static uint32_t keyword_hash(const char *word, size_t len) {
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)word[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Smallest power of two at least twice count, so probes stay short */
+static uint32_t keyword_slots(size_t count) {
+    uint32_t slots = 1;
+    while (slots < count * 2) slots <<= 1;
+    return slots;
+}
+
+static size_t keyword_count(const Syntax *syn) {
+    size_t count = 0;
+    for (size_t r = 0; r < syn->num_rules; r++) {
+        if (syn->rules[r].type == PATTERN_KEYWORD) count++;
+    }
+    return count;
+}
+
+/* Copy a string into the pool; returns its offset, 0 for NULL */
+static uint32_t put_string(char *data, size_t *pool, const char *str) {
+    if (!str) return 0;
+    size_t len = strlen(str) + 1;
+    uint32_t offset = *pool;
+    memcpy(data + offset, str, len);
+    *pool += len;
+    return offset;
+}
+
+static size_t string_size(const char *str) {
+    return str ? strlen(str) + 1 : 0;
+}
+
+int syntax_bundle_write(const char *path) {
+    /* Pass 1: size the fixed tables and the string pool */
+    size_t num_langs = 0;
+    size_t tables = 0;
+    size_t strings = 0;
+    for (Syntax *syn = syntax_list; syn; syn = syn->next) {
+        if (!syn->loaded) continue;  /* Declared only - nothing to compile */
+        num_langs++;
+        tables += syn->num_extensions * sizeof(uint32_t);
+        size_t count = keyword_count(syn);
+        if (count > 0) tables += keyword_slots(count) * sizeof(SyntaxBundleKeyword);
+        tables += syn->num_patterns * sizeof(SyntaxBundlePattern);
+
+        strings += string_size(syn->name) + string_size(syn->singleline_comment) +
+                   string_size(syn->multiline_start) + string_size(syn->multiline_end);
+        for (size_t i = 0; i < syn->num_extensions; i++) {
+            strings += string_size(syn->extensions[i]);
+        }
+        for (size_t r = 0; r < syn->num_rules; r++) {
+            if (syn->rules[r].type == PATTERN_KEYWORD || syn->rules[r].type == PATTERN_MATCH) {
+                strings += string_size(syn->rules[r].pattern);
+            }
+        }
+    }
+
+    size_t langs_offset = sizeof(SyntaxBundleHeader);
+    size_t tables_offset = langs_offset + num_langs * sizeof(SyntaxBundleLang);
+    size_t pool_offset = tables_offset + tables;
+    size_t size = pool_offset + strings;
+    if (size > UINT32_MAX) return -1;
+
+    char *data = calloc(1, size);
+    if (!data) return -1;
+
+    SyntaxBundleHeader *hdr = (SyntaxBundleHeader *)data;
+    memcpy(hdr->magic, SYNTAX_BUNDLE_MAGIC, sizeof(hdr->magic));
+    hdr->byte_order = SYNTAX_BUNDLE_BYTE_ORDER;
+    hdr->size = size;
+    hdr->num_langs = num_langs;
+    hdr->langs = langs_offset;
+
+    /* Pass 2: fill everything in */
+    SyntaxBundleLang *lang = (SyntaxBundleLang *)(data + langs_offset);
+    size_t table = tables_offset;
+    size_t pool = pool_offset;
+    for (Syntax *syn = syntax_list; syn; syn = syn->next) {
+        if (!syn->loaded) continue;
+
+        lang->name = put_string(data, &pool, syn->name);
+        lang->singleline_comment = put_string(data, &pool, syn->singleline_comment);
+        lang->multiline_start = put_string(data, &pool, syn->multiline_start);
+        lang->multiline_end = put_string(data, &pool, syn->multiline_end);
+
+        lang->extensions = syn->num_extensions > 0 ? table : 0;
+        lang->num_extensions = syn->num_extensions;
+        uint32_t *extensions = (uint32_t *)(data + table);
+        for (size_t i = 0; i < syn->num_extensions; i++) {
+            extensions[i] = put_string(data, &pool, syn->extensions[i]);
+        }
+        table += syn->num_extensions * sizeof(uint32_t);
+
+        size_t count = keyword_count(syn);
+        if (count > 0) {
+            uint32_t slots = keyword_slots(count);
+            SyntaxBundleKeyword *kw = (SyntaxBundleKeyword *)(data + table);
+            lang->keywords = table;
+            lang->keyword_mask = slots - 1;
+
+            for (size_t r = 0; r < syn->num_rules; r++) {
+                const SyntaxRule *rule = &syn->rules[r];
+                if (rule->type != PATTERN_KEYWORD) continue;
+
+                size_t len = strlen(rule->pattern);
+                uint32_t hash = keyword_hash(rule->pattern, len);
+                uint32_t i = hash & lang->keyword_mask;
+                bool duplicate = false;
+                while (kw[i].word) {
+                    /* First definition wins, as with the rule list */
+                    if (kw[i].hash == hash && kw[i].len == len &&
+                        memcmp(data + kw[i].word, rule->pattern, len) == 0) {
+                        duplicate = true;
+                        break;
+                    }
+                    i = (i + 1) & lang->keyword_mask;
+                }
+                if (duplicate) continue;
+
+                kw[i].hash = hash;
+                kw[i].word = put_string(data, &pool, rule->pattern);
+                kw[i].len = len;
+                kw[i].hl_type = rule->hl_type;
+            }
+            table += slots * sizeof(SyntaxBundleKeyword);
+        }
+
+        if (syn->num_patterns > 0) {
+            SyntaxBundlePattern *pattern = (SyntaxBundlePattern *)(data + table);
+            lang->patterns = table;
+            for (size_t r = 0; r < syn->num_rules; r++) {
+                const SyntaxRule *rule = &syn->rules[r];
+                if (rule->type != PATTERN_MATCH) continue;
+
+                pattern[lang->num_patterns].pattern = put_string(data, &pool, rule->pattern);
+                pattern[lang->num_patterns].hl_type = rule->hl_type;
+                lang->num_patterns++;
+            }
+            table += syn->num_patterns * sizeof(SyntaxBundlePattern);
+        }
+
+        lang++;
+    }
+
+    /* Duplicate keywords leave unused pool bytes at the end - trim them */
+    hdr->size = pool;
+
+    char tmp_path[PATH_MAX + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        free(data);
+        return -1;
+    }
+
+    bool ok = fwrite(data, 1, pool, f) == pool;
+    if (fclose(f) != 0) ok = false;
+    free(data);
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/* A string offset must land inside the file; the file ends in NUL */
+static bool valid_string(uint32_t offset) {
+    return offset == 0 || offset < bundle_size;
+}
+
+static bool valid_table(uint32_t offset, size_t count, size_t elem) {
+    return offset % sizeof(uint32_t) == 0 && offset <= bundle_size &&
+           count <= (bundle_size - offset) / elem;
+}
+
+static bool valid_lang(const SyntaxBundleLang *lang) {
+    if (lang->name == 0 || !valid_string(lang->name) ||
+        !valid_string(lang->singleline_comment) ||
+        !valid_string(lang->multiline_start) || !valid_string(lang->multiline_end) ||
+        !valid_table(lang->extensions, lang->num_extensions, sizeof(uint32_t))) {
+        return false;
+    }
+
+    const uint32_t *extensions = (const uint32_t *)(bundle_map + lang->extensions);
+    for (uint32_t i = 0; i < lang->num_extensions; i++) {
+        if (extensions[i] == 0 || !valid_string(extensions[i])) return false;
+    }
+
+    if (!valid_table(lang->patterns, lang->num_patterns, sizeof(SyntaxBundlePattern))) {
+        return false;
+    }
+    const SyntaxBundlePattern *patterns = (const SyntaxBundlePattern *)(bundle_map + lang->patterns);
+    for (uint32_t i = 0; i < lang->num_patterns; i++) {
+        if (patterns[i].pattern == 0 || !valid_string(patterns[i].pattern) ||
+            patterns[i].hl_type >= HL_MAX) {
+            return false;
+        }
+    }
+
+    if (lang->keywords == 0) return true;
+
+    size_t slots = (size_t)lang->keyword_mask + 1;
+    if ((slots & lang->keyword_mask) != 0 ||
+        !valid_table(lang->keywords, slots, sizeof(SyntaxBundleKeyword))) {
+        return false;
+    }
+
+    const SyntaxBundleKeyword *kw = (const SyntaxBundleKeyword *)(bundle_map + lang->keywords);
+    bool has_empty = false;
+    for (size_t i = 0; i < slots; i++) {
+        if (kw[i].word == 0) {
+            has_empty = true;
+        } else if (kw[i].word >= bundle_size || kw[i].len >= bundle_size - kw[i].word ||
+                   kw[i].hl_type >= HL_MAX) {
+            return false;
+        }
+    }
+    return has_empty;  /* Otherwise a miss would probe forever */
+}
+
+/* Whether name's plugin in plugin_dirs is newer than a bundle of mtime */
+static bool plugin_newer(const char *name, const char *const *plugin_dirs, size_t num_dirs,
+                         const struct timespec *mtime) {
+    for (size_t i = 0; i < num_dirs; i++) {
+        char plugin_path[PATH_MAX];
+        snprintf(plugin_path, sizeof(plugin_path), "%s/syntax/%s.lua", plugin_dirs[i], name);
+
+        struct stat st;
+        if (stat(plugin_path, &st) == -1) continue;
+        return st.st_mtim.tv_sec > mtime->tv_sec ||
+               (st.st_mtim.tv_sec == mtime->tv_sec && st.st_mtim.tv_nsec > mtime->tv_nsec);
+    }
+    return false;
+}
+
+int syntax_bundle_load(const char *path, const char *const *plugin_dirs, size_t num_dirs) {
+    if (bundle_map) return -1;  /* One bundle per process */
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(SyntaxBundleHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    bundle_map = map;
+    bundle_size = size;
+
+    const SyntaxBundleHeader *hdr = map;
+    bool ok = memcmp(hdr->magic, SYNTAX_BUNDLE_MAGIC, sizeof(hdr->magic)) == 0 &&
+              hdr->byte_order == SYNTAX_BUNDLE_BYTE_ORDER &&
+              hdr->size == size && bundle_map[size - 1] == '\0' &&
+              valid_table(hdr->langs, hdr->num_langs, sizeof(SyntaxBundleLang));
+
+    const SyntaxBundleLang *langs = (const SyntaxBundleLang *)(bundle_map + hdr->langs);
+    for (uint32_t i = 0; ok && i < hdr->num_langs; i++) {
+        ok = valid_lang(&langs[i]);
+    }
+
+    if (!ok) {
+        munmap(map, size);
+        bundle_map = NULL;
+        bundle_size = 0;
+        return -1;
+    }
+
+    int registered = 0;
+    for (uint32_t i = 0; i < hdr->num_langs; i++) {
+        const SyntaxBundleLang *lang = &langs[i];
+        if (plugin_newer(bundle_map + lang->name, plugin_dirs, num_dirs, &st.st_mtim)) continue;
+
+        Syntax *syn = syntax_register(bundle_map + lang->name);
+        if (!syn) continue;
+
+        syn->bundle = lang;
+        const uint32_t *extensions = (const uint32_t *)(bundle_map + lang->extensions);
+        for (uint32_t e = 0; e < lang->num_extensions; e++) {
+            syntax_add_extension(syn, bundle_map + extensions[e]);
+        }
+
+        /* Comment markers point into the mapping; set_comments replaces them */
+        if (lang->singleline_comment && !syn->singleline_comment) {
+            syn->singleline_comment = (char *)(bundle_map + lang->singleline_comment);
+        }
+        if (lang->multiline_start && !syn->multiline_start) {
+            syn->multiline_start = (char *)(bundle_map + lang->multiline_start);
+        }
+        if (lang->multiline_end && !syn->multiline_end) {
+            syn->multiline_end = (char *)(bundle_map + lang->multiline_end);
+        }
+
+        /* Regular expressions can't be mapped: compile them now */
+        const SyntaxBundlePattern *patterns = (const SyntaxBundlePattern *)(bundle_map + lang->patterns);
+        for (uint32_t p = 0; p < lang->num_patterns; p++) {
+            syntax_add_pattern(syn, bundle_map + patterns[p].pattern,
+                               (HighlightType)patterns[p].hl_type, NULL, 0);
+        }
+        registered++;
+    }
+
+    return registered;
+}
+
+int syntax_bundle_lookup(const Syntax *syn, const char *word, size_t len) {
+    const SyntaxBundleLang *lang = syn->bundle;
+    if (!lang || lang->keywords == 0) return -1;
+
+    const SyntaxBundleKeyword *kw = (const SyntaxBundleKeyword *)(bundle_map + lang->keywords);
+    uint32_t hash = keyword_hash(word, len);
+    for (uint32_t i = hash & lang->keyword_mask; kw[i].word; i = (i + 1) & lang->keyword_mask) {
+        if (kw[i].hash == hash && kw[i].len == len &&
+            memcmp(bundle_map + kw[i].word, word, len) == 0) {
+            return kw[i].hl_type;
+        }
+    }
+    return -1;
+}
@@ -16,6 +16,7 @@ Terminal *terminal_create(void) {
     term->cols = 80;
     term->buffer_size = INITIAL_BUFFER_SIZE;
     term->buffer_used = 0;
+    term->clears = 0;
     term->screen_buffer = malloc(term->buffer_size);
 
     if (!term->screen_buffer) {
@@ -248,6 +249,18 @@ void terminal_clear(Terminal *term) {
     term->buffer_used = 0;
 }
 
+void terminal_clear_screen(Terminal *term) {
+    terminal_write_str(term, "\x1b[2J");
+    term->clears++;  /* Anything drawn before is gone */
+}
+
+void terminal_erase_chars(Terminal *term, int count) {
+    if (count <= 0) return;
+    char buf[32];
+    snprintf(buf, sizeof(buf), "\x1b[%dX", count);
+    terminal_write_str(term, buf);
+}
+
 void terminal_write(Terminal *term, const char *data, size_t len) {
     while (term->buffer_used + len > term->buffer_size) {
         size_t new_size = term->buffer_size * 2;
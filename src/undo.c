@@ -1,5 +1,6 @@
 #include "undo.h"
 #include "buffer.h"
+#include "journal.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -23,6 +24,11 @@ static void undo_action_destroy(UndoAction *action) {
         free(action->data.insert_line.line_data);
     } else if (action->type == UNDO_DELETE_LINE && action->data.delete_line.line_data) {
         free(action->data.delete_line.line_data);
+    } else if (action->type == UNDO_INSERT_TEXT || action->type == UNDO_DELETE_TEXT) {
+        free(action->data.text.text);
+    } else if (action->type == UNDO_REPLACE_LINES) {
+        free(action->data.lines.old_text);
+        free(action->data.lines.new_text);
     }
 
     free(action);
@@ -42,10 +48,11 @@ void undo_stack_destroy(UndoStack *stack) {
 }
 
 static void undo_clear_redo(UndoStack *stack) {
-    if (!stack || !stack->current) return;
+    if (!stack) return;
 
-    /* Clear all actions after current */
-    UndoAction *action = stack->current->next;
+    /* Clear all actions after current - all of them if everything was undone */
+    UndoAction *action = stack->current ? stack->current->next : stack->head;
+    if (!stack->current) stack->head = NULL;
     while (action) {
         UndoAction *next = action->next;
         undo_action_destroy(action);
@@ -155,6 +162,115 @@ void undo_push_delete_line(UndoStack *stack, int x, int y, const char *line, siz
     undo_push_action(stack, action);
 }
 
+static void undo_push_text(UndoStack *stack, UndoActionType type, int x, int y,
+                           const char *text, size_t len) {
+    UndoAction *action = malloc(sizeof(UndoAction));
+    if (!action) return;
+
+    action->type = type;
+    action->cursor_x = x;
+    action->cursor_y = y;
+
+    action->data.text.text = malloc(len + 1);
+    if (!action->data.text.text) {
+        free(action);
+        return;
+    }
+    memcpy(action->data.text.text, text, len);
+    action->data.text.text[len] = '\0';
+    action->data.text.len = len;
+
+    undo_push_action(stack, action);
+}
+
+void undo_push_insert_text(UndoStack *stack, int x, int y, const char *text, size_t len) {
+    undo_push_text(stack, UNDO_INSERT_TEXT, x, y, text, len);
+}
+
+void undo_push_delete_text(UndoStack *stack, int x, int y, const char *text, size_t len) {
+    undo_push_text(stack, UNDO_DELETE_TEXT, x, y, text, len);
+}
+
+void undo_push_replace_lines(UndoStack *stack, int y, const char *old_text, size_t old_len,
+                             const char *new_text, size_t new_len) {
+    UndoAction *action = malloc(sizeof(UndoAction));
+    if (!action) return;
+
+    action->type = UNDO_REPLACE_LINES;
+    action->cursor_x = 0;
+    action->cursor_y = y;
+
+    action->data.lines.old_text = malloc(old_len + 1);
+    action->data.lines.new_text = malloc(new_len + 1);
+    if (!action->data.lines.old_text || !action->data.lines.new_text) {
+        free(action->data.lines.old_text);
+        free(action->data.lines.new_text);
+        free(action);
+        return;
+    }
+    memcpy(action->data.lines.old_text, old_text, old_len);
+    action->data.lines.old_text[old_len] = '\0';
+    action->data.lines.old_len = old_len;
+    memcpy(action->data.lines.new_text, new_text, new_len);
+    action->data.lines.new_text[new_len] = '\0';
+    action->data.lines.new_len = new_len;
+
+    undo_push_action(stack, action);
+}
+
+/* Position just past text inserted at (x, y) */
+static void undo_text_end(const UndoAction *action, int *end_x, int *end_y) {
+    const char *text = action->data.text.text;
+    size_t len = action->data.text.len;
+    int x = action->cursor_x;
+    int y = action->cursor_y;
+
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] == '\n') {
+            y++;
+            x = 0;
+        } else {
+            x++;
+        }
+    }
+    *end_x = x;
+    *end_y = y;
+}
+
+/* Replay a span edit without recording it again */
+static void undo_apply_text(Buffer *buf, const UndoAction *action, bool insert) {
+    UndoStack *stack = buf->undo_stack;
+    buf->undo_stack = NULL;
+
+    if (insert) {
+        buffer_insert_text(buf, action->cursor_x, action->cursor_y,
+                           action->data.text.text, action->data.text.len);
+    } else {
+        int end_x, end_y;
+        undo_text_end(action, &end_x, &end_y);
+        buffer_delete_text(buf, action->cursor_x, action->cursor_y, end_x, end_y);
+    }
+
+    buf->undo_stack = stack;
+}
+
+/* Apply a row replacement backwards (undo: new rows back to old) or forwards */
+static void undo_apply_lines(Buffer *buf, const UndoAction *action, bool undo) {
+    const char *from = undo ? action->data.lines.new_text : action->data.lines.old_text;
+    size_t from_len = undo ? action->data.lines.new_len : action->data.lines.old_len;
+    const char *to = undo ? action->data.lines.old_text : action->data.lines.new_text;
+    size_t to_len = undo ? action->data.lines.old_len : action->data.lines.new_len;
+
+    size_t rows = 1;
+    for (size_t i = 0; i < from_len; i++) {
+        if (from[i] == '\n') rows++;
+    }
+    size_t start = (size_t)action->cursor_y;
+    buffer_set_text(buf, start, start + rows, to, to_len);
+    buf->cursor_x = 0;
+    buf->cursor_y = action->cursor_y;
+}
+
 /* Forward declarations for buffer operations without undo recording */
 static void buffer_insert_char_raw(Buffer *buf, int c);
 static void buffer_delete_char_raw(Buffer *buf, int at_x, int at_y);
@@ -193,6 +309,20 @@ int undo_apply(Buffer *buf, UndoStack *stack) {
             /* TODO: Implement */
             break;
 
+        case UNDO_INSERT_TEXT:
+            undo_apply_text(buf, action, false);
+            break;
+
+        case UNDO_DELETE_TEXT:
+            undo_apply_text(buf, action, true);
+            buf->cursor_x = action->cursor_x;
+            buf->cursor_y = action->cursor_y;
+            break;
+
+        case UNDO_REPLACE_LINES:
+            undo_apply_lines(buf, action, true);
+            break;
+
         default:
             break;
     }
@@ -240,6 +370,18 @@ int redo_apply(Buffer *buf, UndoStack *stack) {
             /* TODO: Implement */
             break;
 
+        case UNDO_INSERT_TEXT:
+            undo_apply_text(buf, action, true);
+            break;
+
+        case UNDO_DELETE_TEXT:
+            undo_apply_text(buf, action, false);
+            break;
+
+        case UNDO_REPLACE_LINES:
+            undo_apply_lines(buf, action, false);
+            break;
+
         default:
             break;
     }
@@ -274,7 +416,8 @@ static void buffer_insert_char_raw(Buffer *buf, int c) {
         buffer_append_row(buf, "", 0);
     }
 
-    BufferRow *row = &buf->rows[buf->cursor_y];
+    BufferRow *row = buffer_row_mut(buf, buf->cursor_y);
+    if (!row) return;
 
     /* Ensure capacity */
     if (row->size + 1 >= row->capacity) {
@@ -291,6 +434,10 @@ static void buffer_insert_char_raw(Buffer *buf, int c) {
     row->size++;
     row->data[row->size] = '\0';
 
+    if (buf->journal) {
+        journal_record_insert(buf->journal, buf->cursor_x, buf->cursor_y, &row->data[buf->cursor_x], 1);
+    }
+
     buf->cursor_x++;
     buf->modified = true;
 }
@@ -298,8 +445,12 @@ static void buffer_insert_char_raw(Buffer *buf, int c) {
 static void buffer_delete_char_raw(Buffer *buf, int at_x, int at_y) {
     if (!buf || at_y >= (int)buf->num_rows) return;
 
-    BufferRow *row = &buf->rows[at_y];
-    if (at_x >= (int)row->size) return;
+    BufferRow *row = buffer_row_mut(buf, at_y);
+    if (!row || at_x >= (int)row->size) return;
+
+    if (buf->journal) {
+        journal_record_delete(buf->journal, at_x, at_y, at_x + 1, at_y);
+    }
 
     /* Delete character */
     memmove(&row->data[at_x], &row->data[at_x + 1], row->size - at_x);
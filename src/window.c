@@ -4,6 +4,10 @@
 #include "syntax.h"
 #include "colors.h"
 #include "lua_bridge.h"
+#include "git.h"
+#include "canvas.h"
+#include "event_loop.h"
+#include "match_index.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -22,7 +26,13 @@ Window *window_create_leaf(Buffer *buf, int x, int y, int w, int h) {
     /* Content */
     win->content_type = CONTENT_BUFFER;
     win->content.buffer = buf;
+    win->content.custom_data = NULL;
     win->renderer_name = NULL;
+    win->canvas = NULL;
+    win->render_valid = false;
+    win->render_focused = false;
+    win->render_buffers = 0;
+    win->render_timer = 0;
     win->row_offset = 0;
     win->col_offset = 0;
 
@@ -55,8 +65,14 @@ Window *window_create_leaf_custom(const char *renderer, int x, int y, int w, int
 
     /* Content */
     win->content_type = CONTENT_CUSTOM;
+    win->content.buffer = NULL;
     win->content.custom_data = NULL;  /* Will be set from Lua */
     win->renderer_name = renderer ? strdup(renderer) : NULL;
+    win->canvas = NULL;
+    win->render_valid = false;
+    win->render_focused = false;
+    win->render_buffers = 0;
+    win->render_timer = 0;
     win->row_offset = 0;
     win->col_offset = 0;
 
@@ -86,7 +102,13 @@ Window *window_create_split(WindowType type, Window *left, Window *right, float
     /* Content - splits don't have content */
     win->content_type = CONTENT_BUFFER;
     win->content.buffer = NULL;
+    win->content.custom_data = NULL;
     win->renderer_name = NULL;
+    win->canvas = NULL;
+    win->render_valid = false;
+    win->render_focused = false;
+    win->render_buffers = 0;
+    win->render_timer = 0;
     win->row_offset = 0;
     win->col_offset = 0;
 
@@ -118,6 +140,8 @@ void window_destroy(Window *win) {
     if (win->renderer_name) {
         free(win->renderer_name);
     }
+    canvas_destroy(win->canvas);
+    if (win->render_timer > 0) event_loop_cancel_timer(win->render_timer);
 
     free(win);
 }
@@ -144,8 +168,9 @@ void window_resize(Window *win, int x, int y, int w, int h) {
 static void window_render_leaf(Window *win, Terminal *term, Editor *ed, bool show_line_numbers) {
     /* Handle custom renderers */
     if (win->content_type == CONTENT_CUSTOM && win->renderer_name) {
-        /* Call Lua renderer */
+        /* Call Lua renderer, then write out whatever it drew on its canvas */
         lua_bridge_call_window_renderer(ed, win);
+        if (win->canvas) canvas_flush(win->canvas, term, win->x, win->y);
         return;
     }
 
@@ -160,8 +185,18 @@ static void window_render_leaf(Window *win, Terminal *term, Editor *ed, bool sho
         gutter_width = snprintf(NULL, 0, "%d", max_line) + 1; /* +1 for space */
         /* Add 2 more for git symbol + space */
         gutter_width += 2;
+
+        /* Native git markers: look up the repository once, re-diff after edits */
+        if (ed->git_gutter && !buf->git_checked && buf->filename) {
+            buf->git_checked = true;
+            buf->git = git_file_open(buf->filename);
+        }
+        if (ed->git_gutter && buf->git) git_file_update(buf->git, buf);
     }
 
+    /* Search matches: index off the main thread, then read the sorted result */
+    match_index_update(buf->search_index, buf);
+
     /* Adjust scroll offset to keep cursor in view */
     if (buf->cursor_y < win->row_offset) {
         win->row_offset = buf->cursor_y;
@@ -173,11 +208,19 @@ static void window_render_leaf(Window *win, Terminal *term, Editor *ed, bool sho
     /* Find matching bracket for highlighting */
     BracketMatch bracket_match = buffer_find_matching_bracket(buf);
 
+    /* First search match on screen; later rows walk forward from it */
+    size_t num_matches;
+    const IndexedMatch *matches = match_index_view(buf->search_index, &num_matches);
+    size_t next_match = match_index_find(matches, num_matches, win->row_offset, 0);
+
     /* Render visible rows */
     for (int y = 0; y < win->height - 1; y++) {
         int file_row = y + win->row_offset;
 
+        /* Blank the row within this window only; \x1b[K would run on into
+         * the window beside it */
         terminal_move_cursor(term, win->y + y, win->x);
+        terminal_erase_chars(term, win->width);
 
         /* Render line number gutter */
         if (show_line_numbers) {
@@ -207,13 +250,31 @@ static void window_render_leaf(Window *win, Terminal *term, Editor *ed, bool sho
                 /* Reset color */
                 terminal_write_str(term, "\x1b[0m");
 
-                /* Render gutter via Lua plugin (e.g., git status) */
-                char *gutter = lua_bridge_call_gutter_renderer(ed, file_row);
-                if (gutter) {
-                    terminal_write_str(term, gutter);
-                    free(gutter);
+                if (ed->git_gutter && buf->git) {
+                    /* Git status straight from the diff - no call into Lua per line */
+                    switch (git_file_line_status(buf->git, file_row)) {
+                        case GIT_LINE_ADDED:
+                            terminal_write_str(term, "\x1b[32m+\x1b[0m ");  /* Green + */
+                            break;
+                        case GIT_LINE_MODIFIED:
+                            terminal_write_str(term, "\x1b[33m~\x1b[0m ");  /* Yellow ~ */
+                            break;
+                        case GIT_LINE_DELETED:
+                            terminal_write_str(term, "\x1b[31m-\x1b[0m ");  /* Red - */
+                            break;
+                        default:
+                            terminal_write_str(term, "  ");
+                            break;
+                    }
                 } else {
-                    terminal_write_str(term, "  ");  /* No gutter renderer */
+                    /* Render gutter via Lua plugin */
+                    char *gutter = lua_bridge_call_gutter_renderer(ed, file_row);
+                    if (gutter) {
+                        terminal_write_str(term, gutter);
+                        free(gutter);
+                    } else {
+                        terminal_write_str(term, "  ");  /* No gutter renderer */
+                    }
                 }
             }
         }
@@ -221,16 +282,16 @@ static void window_render_leaf(Window *win, Terminal *term, Editor *ed, bool sho
         if (file_row >= (int)buf->num_rows) {
             /* Empty row */
             terminal_write_str(term, "~");
-            /* Clear rest of line */
-            terminal_write_str(term, "\x1b[K");
         } else {
             /* Render text row with syntax highlighting */
-            BufferRow *row = &buf->rows[file_row];
+            BufferRow *row = buffer_row(buf, file_row);
 
             /* Set current line background */
             bool is_cursor_line = (file_row == buf->cursor_y);
             if (is_cursor_line) {
                 terminal_write_str(term, "\x1b[100m"); /* Bright black (gray) background */
+                terminal_move_cursor(term, win->y + y, win->x + gutter_width);
+                terminal_erase_chars(term, win->width - gutter_width);  /* To the window's edge */
             }
 
             /* Get or compute highlighting for this line */
@@ -320,6 +381,29 @@ static void window_render_leaf(Window *win, Terminal *term, Editor *ed, bool sho
                 }
             }
 
+            /* Highlight search matches */
+            for (; next_match < num_matches; next_match++) {
+                const IndexedMatch *m = &matches[next_match];
+                if (m->row > (size_t)file_row) break;
+                if (m->row < (size_t)file_row) continue;
+
+                /* The index may trail an edit by a frame - stay inside the row */
+                int start = (int)m->col;
+                int end = start + (int)m->len;
+                if (end > (int)row->size) end = row->size;
+                if (start < win->col_offset) start = win->col_offset;
+                if (end > win->col_offset + win->width - gutter_width) {
+                    end = win->col_offset + win->width - gutter_width;
+                }
+                if (start >= end) continue;
+
+                int screen_col = win->x + gutter_width + (start - win->col_offset);
+                terminal_move_cursor(term, win->y + y, screen_col);
+                terminal_write_str(term, "\x1b[30;43m");  /* Black on yellow */
+                terminal_write(term, &row->data[start], end - start);
+                terminal_write_str(term, is_cursor_line ? "\x1b[0;100m" : "\x1b[0m");
+            }
+
             /* Highlight visual selection */
             if (buf->has_selection) {
                 int start_y = buf->select_start_y;
@@ -382,18 +466,12 @@ static void window_render_leaf(Window *win, Terminal *term, Editor *ed, bool sho
                     int screen_col = win->x + gutter_width + (bracket_match.col - win->col_offset);
                     terminal_move_cursor(term, win->y + y, screen_col);
                     terminal_write_str(term, "\x1b[7m");  /* Reverse video */
-                    BufferRow *match_row = &buf->rows[bracket_match.row];
+                    BufferRow *match_row = buffer_row(buf, bracket_match.row);
                     terminal_write(term, &match_row->data[bracket_match.col], 1);
                     terminal_write_str(term, "\x1b[27m"); /* Reset reverse */
                 }
             }
 
-            /* Move to end of line for clearing */
-            terminal_move_cursor(term, win->y + y, win->x + win->width - 1);
-
-            /* Clear rest of line */
-            terminal_write_str(term, "\x1b[K");
-
             /* Reset background if this was the cursor line */
             if (is_cursor_line) {
                 terminal_write_str(term, "\x1b[0m");
@@ -411,6 +489,22 @@ static void window_render_leaf(Window *win, Terminal *term, Editor *ed, bool sho
                    buf->modified ? "[+] " : "",
                    buf->cursor_y + 1, buf->cursor_x + 1);
 
+    /* Match count straight from the index - no rescan */
+    if (num_matches > 0 && len < (int)sizeof(status)) {
+        /* Last match starting at or before the cursor, if the cursor is in it */
+        size_t k = match_index_find(matches, num_matches, buf->cursor_y, buf->cursor_x + 1);
+        const IndexedMatch *m = k > 0 ? &matches[--k] : NULL;
+        if (m && m->row == (size_t)buf->cursor_y &&
+            (size_t)buf->cursor_x < (size_t)m->col + m->len) {
+            len += snprintf(status + len, sizeof(status) - len, "| match %zu of %zu ",
+                            k + 1, num_matches);
+        } else {
+            len += snprintf(status + len, sizeof(status) - len, "| %zu match%s ",
+                            num_matches, num_matches == 1 ? "" : "es");
+        }
+        if (len >= (int)sizeof(status)) len = sizeof(status) - 1;
+    }
+
     if (len > win->width) len = win->width;
     terminal_write(term, status, len);
 
@@ -540,6 +634,8 @@ Window *window_only(Window *root, Window *to_keep) {
     } else {
         new_win = window_create_leaf_custom(to_keep->renderer_name, x, y, w, h);
         new_win->content.custom_data = to_keep->content.custom_data;
+        new_win->canvas = to_keep->canvas;
+        to_keep->canvas = NULL;
     }
     new_win->id = id;
 
@@ -569,6 +665,10 @@ void window_set_focused(Window *win, bool focused) {
     win->focused = focused;
 }
 
+void window_invalidate(Window *win) {
+    if (win) win->render_valid = false;
+}
+
 /* Get window in a direction (left/right/up/down) */
 Window *window_get_direction(Window *root, Window *current, const char *direction) {
     /* Simplified implementation - just cycle for now */
@@ -593,12 +693,12 @@ void window_swap(Window *a, Window *b) {
     a->content_type = b->content_type;
     b->content_type = temp_type;
 
-    /* Swap content union */
-    if (a->content_type == CONTENT_BUFFER && b->content_type == CONTENT_BUFFER) {
-        Buffer *temp = a->content.buffer;
-        a->content.buffer = b->content.buffer;
-        b->content.buffer = temp;
-    } else {
+    /* Swap content */
+    Buffer *temp = a->content.buffer;
+    a->content.buffer = b->content.buffer;
+    b->content.buffer = temp;
+
+    if (a->content_type != CONTENT_BUFFER || b->content_type != CONTENT_BUFFER) {
         void *temp_data = a->content.custom_data;
         a->content.custom_data = b->content.custom_data;
         b->content.custom_data = temp_data;
@@ -606,6 +706,13 @@ void window_swap(Window *a, Window *b) {
         char *temp_name = a->renderer_name;
         a->renderer_name = b->renderer_name;
         b->renderer_name = temp_name;
+
+        Canvas *temp_canvas = a->canvas;
+        a->canvas = b->canvas;
+        b->canvas = temp_canvas;
+
+        window_invalidate(a);
+        window_invalidate(b);
     }
 }
 
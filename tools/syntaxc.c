@@ -0,0 +1,54 @@
+#define _POSIX_C_SOURCE 200809L
+#include "syntax.h"
+#include "syntax_bundle.h"
+#include "lua_bridge.h"
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+#include <stdio.h>
+
+/* occe-syntaxc: compile syntax definitions into a bundle for the editor.
+ * The Lua files stay the source; this runs them against the same syntax API
+ * the editor offers and writes the result with syntax_bundle_write(). */
+
+/* The definitions announce themselves with print() - keep the build quiet */
+static int quiet_print(lua_State *L) {
+    (void)L;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s OUTPUT SYNTAX.lua...\n", argv[0]);
+        return 2;
+    }
+
+    lua_State *L = luaL_newstate();
+    if (!L) {
+        fprintf(stderr, "%s: cannot create Lua state\n", argv[0]);
+        return 1;
+    }
+
+    luaL_openlibs(L);
+    lua_pushcfunction(L, quiet_print);
+    lua_setglobal(L, "print");
+    syntax_init();
+    register_syntax_api(L);
+
+    for (int i = 2; i < argc; i++) {
+        if (luaL_dofile(L, argv[i]) != LUA_OK) {
+            fprintf(stderr, "%s: %s\n", argv[0], lua_tostring(L, -1));
+            lua_close(L);
+            return 1;
+        }
+    }
+
+    int status = 0;
+    if (syntax_bundle_write(argv[1]) != 0) {
+        fprintf(stderr, "%s: cannot write %s\n", argv[0], argv[1]);
+        status = 1;
+    }
+
+    lua_close(L);
+    return status;
+}